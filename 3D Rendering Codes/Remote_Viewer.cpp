@@ -0,0 +1,654 @@
+#include <GL/glew.h>                    // GLEW helps load OpenGL extensions, must be included before GLFW
+#include <GLFW/glfw3.h>                 // GLFW handles window creation and input
+#include <glm/glm.hpp>                  // GLM for math
+#include <glm/gtc/matrix_transform.hpp> // GLM matrix transforms
+#include <glm/gtc/type_ptr.hpp>         // Convert GLM types to raw pointers
+
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <string>
+
+#include "Starfield.h"   // Static VBO background stars
+#include "Trail_Pool.h"  // Pooled ring-buffer orbit trails
+#include "Remote_View.h" // Frames from a simulation running in another process
+
+// Thin viewer for a headless simulation (Engine Codes/Sim_Server.cpp). It attaches to the
+// stream named on the command line, shows the bodies interpolated between the frames it
+// receives and never touches the simulation: any number of viewers can watch one run.
+//
+//      ./Sim_Server --name belt --asteroids 20000 &
+//      ./Remote_Viewer belt
+
+// Window dimensions
+int screenWidth = 1024;
+int screenHeight = 768;
+
+// Background stars (generated once, drawn with a single call per frame)
+const int STAR_COUNT = 200000;
+
+// Camera variables
+glm::vec3 cameraPos = glm::vec3(10.0f, 5.0f, 10.0f);
+glm::vec3 cameraFront = glm::vec3(-0.7f, -0.3f, -0.7f);
+glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+
+// Mouse control variables
+float lastX = screenWidth / 2.0f;
+float lastY = screenHeight / 2.0f;
+float yaw = -135.0f;
+float pitch = -20.0f;
+bool firstMouse = true;
+bool mousePressed = false;
+
+// Timing
+float deltaTime = 0.0f;
+float lastFrame = 0.0f;
+
+// Stream
+const double RECONNECT_SECONDS = 2.0; // No new frame for this long: look for a restarted server
+FrameBroadcast channel;
+ViewTimeline timeline;
+ViewState bodies;
+uint64_t newestFrame = 0;
+uint64_t framesReceived = 0;
+
+// Trails come with the frames, one pooled trail per body ID that has points
+const int MAX_TRAIL_LENGTH = 1000;                   // Points per trail
+const size_t TRAIL_MEMORY_BUDGET = 16 * 1024 * 1024; // Upper bound for all trail points
+const long long TRAIL_IDLE_FRAMES = 600;             // Trails without new points are dropped after ~10 s
+TrailPool trailPool(MAX_TRAIL_LENGTH, TRAIL_MEMORY_BUDGET);
+const float TRAIL_PIXEL_ERROR = 1.0f; // Trails drop samples within this many pixels of the drawn line
+TrailTolerance trailTolerance;        // That bound for this frame's camera
+std::vector<TrailHandle> trailOfId;
+long long frameCount = 0;
+
+// Shader source code //
+
+// Vertex shader source code
+const char *vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
+)";
+
+// Fragment shader source code
+const char *fragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 objectColor;
+uniform vec3 viewPos;
+
+void main()
+{
+    // Ambient lighting
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * lightColor;
+
+    // Diffuse lighting
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+
+    // Specular lighting
+    float specularStrength = 0.8;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 64);
+    vec3 specular = specularStrength * spec * lightColor;
+
+    vec3 result = (ambient + diffuse + specular) * objectColor;
+    FragColor = vec4(result, 1.0);
+}
+)";
+
+// Trail shader for orbit visualisation //
+
+// Trail vertex shader
+const char *trailVertexShader = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aStamp; // Sample number of the point
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float currentTime; // Stamp of the trail's newest point
+uniform float fadeLength;  // Points older than this many samples are gone
+
+out float fade;
+
+void main()
+{
+    fade = 1.0 - (currentTime - aStamp) / fadeLength;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
+)";
+
+// Trail fragment shader
+const char *trailFragmentShader = R"(
+#version 330 core
+out vec4 FragColor;
+
+uniform vec3 color;
+uniform float alpha;
+
+in float fade;
+
+void main()
+{
+    if (fade <= 0.0)
+        discard;
+    FragColor = vec4(color, alpha * fade);
+}
+)";
+
+// Forward declarations
+GLFWwindow *StartGLFW(const std::string &streamName);
+unsigned int CreateShaderProgram(const char *vertexSource, const char *fragmentSource);
+void GenerateSphere(std::vector<float> &vertices, std::vector<unsigned int> &indices, float radius, int sectors, int stacks);
+void ProcessInput(GLFWwindow *window);
+void MouseCallback(GLFWwindow *window, double xpos, double ypos);
+void MouseButtonCallback(GLFWwindow *window, int button, int action, int mods);
+void ScrollCallback(GLFWwindow *window, double xoffset, double yoffset);
+void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
+
+// Takes every frame published since the last call. After a quiet spell the server may
+// have restarted under the same name, then the stream is opened again.
+void ReceiveFrames(const std::string &segment)
+{
+    static std::vector<unsigned char> bytes;
+    static ViewFrame frame;
+    static double lastNews = -RECONNECT_SECONDS;
+
+    double now = ViewClock();
+    if (!channel.valid() || now - lastNews > RECONNECT_SECONDS)
+    {
+        lastNews = now;
+        FrameBroadcast fresh;
+        if (fresh.open(segment) && fresh.createdAt() != channel.createdAt())
+        {
+            channel.close();
+            if (channel.open(segment))
+            {
+                std::cout << "Attached to stream " << segment << std::endl;
+                newestFrame = 0;
+                timeline.clear();
+                trailPool.releaseAll();
+            }
+        }
+    }
+    if (!channel.valid())
+        return;
+
+    while (channel.readNext(newestFrame, bytes, newestFrame))
+    {
+        if (!DecodeFrame(bytes, frame))
+            continue;
+        timeline.add(frame);
+        framesReceived++;
+        lastNews = now;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string streamName = argc > 1 ? argv[1] : "default";
+    const std::string segment = "/spaceengine-view-" + streamName;
+
+    GLFWwindow *window = StartGLFW(streamName);
+    if (!window)
+        return -1;
+
+    glfwSetCursorPosCallback(window, MouseCallback);
+    glfwSetMouseButtonCallback(window, MouseButtonCallback);
+    glfwSetScrollCallback(window, ScrollCallback);
+    glfwSetKeyCallback(window, KeyCallback);
+
+    // Create shaders
+    unsigned int shaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+    unsigned int trailShader = CreateShaderProgram(trailVertexShader, trailFragmentShader);
+    int trailViewLoc = glGetUniformLocation(trailShader, "view");
+    int trailProjectionLoc = glGetUniformLocation(trailShader, "projection");
+    int trailColorLoc = glGetUniformLocation(trailShader, "color");
+    int trailAlphaLoc = glGetUniformLocation(trailShader, "alpha");
+    int trailCurrentTimeLoc = glGetUniformLocation(trailShader, "currentTime");
+    int trailFadeLengthLoc = glGetUniformLocation(trailShader, "fadeLength");
+
+    // Generate sphere mesh
+    std::vector<float> sphereVertices;
+    std::vector<unsigned int> sphereIndices;
+    GenerateSphere(sphereVertices, sphereIndices, 1.0f, 36, 18);
+
+    unsigned int sphereVAO, sphereVBO, sphereEBO;
+    glGenVertexArrays(1, &sphereVAO);
+    glGenBuffers(1, &sphereVBO);
+    glGenBuffers(1, &sphereEBO);
+
+    glBindVertexArray(sphereVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+    glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned int), sphereIndices.data(), GL_STATIC_DRAW);
+
+    // Position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    // Normal attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+
+    // Trail buffers mirror the trail pool, filled as points are added
+    TrailGpu trailGpu;
+
+    // Enable OpenGL features
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_LINE_SMOOTH);
+    glLineWidth(2.0f);
+
+    // Background starfield
+    Starfield starfield = CreateStarfield3D(STAR_COUNT, 1977);
+
+    float lightAngle = 0.0f;
+    std::cout << "Waiting for stream '" << streamName << "' (start ./Sim_Server --name " << streamName << ")" << std::endl;
+
+    while (!glfwWindowShouldClose(window))
+    {
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        ProcessInput(window);
+        trailTolerance = TrailToleranceFor(cameraPos, glm::radians(45.0f), screenHeight, TRAIL_PIXEL_ERROR);
+
+        // New frames in, bodies interpolated to the playback time
+        ReceiveFrames(segment);
+        double now = ViewClock();
+        timeline.sample(now, bodies);
+
+        // Trail points of the frames playback went past
+        frameCount++;
+        timeline.takeTrailPoints(now, [&](uint32_t id, float x, float y, float z)
+                                 {
+            if (id >= trailOfId.size())
+                trailOfId.resize(id + 1);
+            if (!trailPool.valid(trailOfId[id]))
+                trailOfId[id] = trailPool.acquire(frameCount);
+            trailPool.touch(trailOfId[id], frameCount);
+            trailPool.push(trailOfId[id], glm::vec3(x, y, z), trailTolerance); });
+        trailPool.ageOut(frameCount, TRAIL_IDLE_FRAMES);
+
+        lightAngle += deltaTime * 0.5f;
+        glm::vec3 lightPos(15.0f * cos(lightAngle), 8.0f, 15.0f * sin(lightAngle));
+
+        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / screenHeight, 0.1f, 200.0f);
+
+        glClearColor(0.02f, 0.02f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // Render background stars first, they never write depth
+        DrawStarfield3D(starfield, view, projection);
+
+        // Render trails
+        glDepthMask(GL_FALSE);
+        glUseProgram(trailShader);
+        glUniformMatrix4fv(trailViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(trailProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform1f(trailAlphaLoc, 0.4f);
+        glUniform1f(trailFadeLengthLoc, float(trailPool.trailLength()));
+        SyncTrailGpu(trailGpu, trailPool); // Only the points added since the last frame
+
+        for (size_t i = 0; i < bodies.size(); ++i)
+        {
+            uint32_t id = bodies.id[i];
+            if (id >= trailOfId.size() || !trailPool.valid(trailOfId[id]))
+                continue;
+
+            glUniform3f(trailColorLoc, bodies.cr[i], bodies.cg[i], bodies.cb[i]);
+            glUniform1f(trailCurrentTimeLoc, trailPool.newestStamp(trailOfId[id]));
+            DrawTrail(trailGpu, trailPool, trailOfId[id]);
+        }
+        glDepthMask(GL_TRUE);
+
+        // Render spheres
+        glUseProgram(shaderProgram);
+
+        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+        glUniform3fv(glGetUniformLocation(shaderProgram, "lightPos"), 1, glm::value_ptr(lightPos));
+        glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), 1.0f, 1.0f, 1.0f);
+        glUniform3fv(glGetUniformLocation(shaderProgram, "viewPos"), 1, glm::value_ptr(cameraPos));
+
+        for (size_t i = 0; i < bodies.size(); ++i)
+        {
+            if (bodies.outside[i])
+                continue; // Escaped, its position is only clamped to the edge of the grid
+
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, glm::vec3(bodies.x[i], bodies.y[i], bodies.z[i]));
+            model = glm::scale(model, glm::vec3(bodies.radius[i]));
+
+            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+            glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), bodies.cr[i], bodies.cg[i], bodies.cb[i]);
+
+            glBindVertexArray(sphereVAO);
+            glDrawElements(GL_TRIANGLES, (GLsizei)sphereIndices.size(), GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+        }
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    // Cleanup
+    channel.close();
+    glDeleteVertexArrays(1, &sphereVAO);
+    glDeleteBuffers(1, &sphereVBO);
+    glDeleteBuffers(1, &sphereEBO);
+    DestroyTrailGpu(trailGpu);
+    glDeleteProgram(shaderProgram);
+    glDeleteProgram(trailShader);
+    DestroyStarfield(starfield);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
+
+// Function to initialize GLFW, create window, and set up OpenGL context
+GLFWwindow *StartGLFW(const std::string &streamName)
+{
+    if (!glfwInit())
+    {
+        std::cerr << "Failed to initialise GLFW" << std::endl;
+        return nullptr;
+    }
+
+    // Set OpenGL version to 3.3 Core
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    std::string title = "3D Space Engine - Remote Viewer (" + streamName + ")";
+    GLFWwindow *window = glfwCreateWindow(screenWidth, screenHeight, title.c_str(), NULL, NULL);
+    if (!window)
+    {
+        std::cerr << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return nullptr;
+    }
+
+    glfwMakeContextCurrent(window);
+
+    if (glewInit() != GLEW_OK)
+    {
+        std::cerr << "Failed to initialize GLEW" << std::endl;
+        return nullptr;
+    }
+
+    glViewport(0, 0, screenWidth, screenHeight);
+
+    std::cout << "=== Remote Viewer Controls ===" << std::endl;
+    std::cout << "WASD: Move camera" << std::endl;
+    std::cout << "Q/E: Move up/down" << std::endl;
+    std::cout << "Mouse (hold left): Look around" << std::endl;
+    std::cout << "Scroll: Zoom" << std::endl;
+    std::cout << "C: Print stream stats" << std::endl;
+    std::cout << "ESC: Exit (the simulation keeps running)" << std::endl;
+    std::cout << "==============================" << std::endl;
+
+    return window;
+}
+
+// Function to create and compile shader program
+unsigned int CreateShaderProgram(const char *vertexSource, const char *fragmentSource)
+{
+    // Compile vertex shader
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(vertexShader);
+
+    // Check vertex shader compilation
+    int success;
+    char infoLog[512];
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+        std::cerr << "Vertex shader compilation failed:\n"
+                  << infoLog << std::endl;
+    }
+
+    // Compile fragment shader
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(fragmentShader);
+
+    // Check fragment shader compilation
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+        std::cerr << "Fragment shader compilation failed:\n"
+                  << infoLog << std::endl;
+    }
+
+    // Link shaders to program
+    unsigned int shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    glLinkProgram(shaderProgram);
+
+    // Check linking
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+        std::cerr << "Shader program linking failed:\n"
+                  << infoLog << std::endl;
+    }
+
+    // Delete shaders as they're now linked
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    return shaderProgram;
+}
+
+// Function to generate a sphere mesh for rendering
+void GenerateSphere(std::vector<float> &vertices, std::vector<unsigned int> &indices, float radius, int sectors, int stacks)
+{
+    float x, y, z, xy;
+    float nx, ny, nz, lengthInv = 1.0f / radius;
+
+    float sectorStep = 2 * M_PI / sectors;
+    float stackStep = M_PI / stacks;
+    float sectorAngle, stackAngle;
+
+    // Generate vertices
+    for (int i = 0; i <= stacks; ++i)
+    {
+        stackAngle = M_PI / 2 - i * stackStep;
+        xy = radius * cosf(stackAngle);
+        z = radius * sinf(stackAngle);
+
+        for (int j = 0; j <= sectors; ++j)
+        {
+            sectorAngle = j * sectorStep;
+
+            x = xy * cosf(sectorAngle);
+            y = xy * sinf(sectorAngle);
+            vertices.push_back(x);
+            vertices.push_back(y);
+            vertices.push_back(z);
+
+            nx = x * lengthInv;
+            ny = y * lengthInv;
+            nz = z * lengthInv;
+            vertices.push_back(nx);
+            vertices.push_back(ny);
+            vertices.push_back(nz);
+        }
+    }
+
+    // Generate indices
+    int k1, k2;
+    for (int i = 0; i < stacks; ++i)
+    {
+        k1 = i * (sectors + 1);
+        k2 = k1 + sectors + 1;
+
+        for (int j = 0; j < sectors; ++j, ++k1, ++k2)
+        {
+            if (i != 0)
+            {
+                indices.push_back(k1);
+                indices.push_back(k2);
+                indices.push_back(k1 + 1);
+            }
+
+            if (i != (stacks - 1))
+            {
+                indices.push_back(k1 + 1);
+                indices.push_back(k2);
+                indices.push_back(k2 + 1);
+            }
+        }
+    }
+}
+
+// Process input for camera movement
+void ProcessInput(GLFWwindow *window)
+{
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    float cameraSpeed = 5.0f * deltaTime;
+
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        cameraPos += cameraSpeed * cameraFront;
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        cameraPos -= cameraSpeed * cameraFront;
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+        cameraPos -= cameraUp * cameraSpeed;
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        cameraPos += cameraUp * cameraSpeed;
+}
+
+// Mouse callback to handle camera rotation
+void MouseCallback(GLFWwindow *window, double xpos, double ypos)
+{
+    if (!mousePressed)
+        return;
+
+    if (firstMouse)
+    {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    float xoffset = xpos - lastX;
+    float yoffset = lastY - ypos;
+    lastX = xpos;
+    lastY = ypos;
+
+    float sensitivity = 0.1f;
+    xoffset *= sensitivity;
+    yoffset *= sensitivity;
+
+    yaw += xoffset;
+    pitch += yoffset;
+
+    if (pitch > 89.0f)
+        pitch = 89.0f;
+    if (pitch < -89.0f)
+        pitch = -89.0f;
+
+    glm::vec3 direction;
+    direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+    direction.y = sin(glm::radians(pitch));
+    direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+    cameraFront = glm::normalize(direction);
+}
+
+// Mouse button callback to handle mouse press/release
+void MouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT)
+    {
+        if (action == GLFW_PRESS)
+        {
+            mousePressed = true;
+            firstMouse = true;
+        }
+        else if (action == GLFW_RELEASE)
+        {
+            mousePressed = false;
+        }
+    }
+}
+
+// Scroll callback to handle zooming
+void ScrollCallback(GLFWwindow *window, double xoffset, double yoffset)
+{
+    float zoomSpeed = 1.0f;
+    cameraPos += cameraFront * (float)yoffset * zoomSpeed;
+}
+
+// Key callback to print the stream stats
+void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    if (action == GLFW_PRESS && key == GLFW_KEY_C)
+    {
+        std::cout << "=== Stream Stats ===" << std::endl;
+        if (timeline.empty())
+        {
+            std::cout << "No frames yet" << std::endl;
+            return;
+        }
+        const ViewFrame &newest = timeline.newest();
+        std::cout << "Bodies: " << newest.size() << ", simulation time: " << bodies.simTime << std::endl;
+        std::cout << "Frames received: " << framesReceived << ", missed: " << timeline.skippedFrames()
+                  << ", interval: " << timeline.frameInterval() * 1000.0 << " ms" << std::endl;
+        std::cout << "Latency (newest frame): " << (ViewClock() - newest.wallTime) * 1000.0 << " ms, viewers attached: "
+                  << (channel.valid() ? channel.viewers() : 0) << std::endl;
+        trailPool.printReport(std::cout);
+    }
+}
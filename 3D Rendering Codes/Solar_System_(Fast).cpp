@@ -12,10 +12,18 @@
 #include <string>
 #include <random>
 
+#include "Starfield.h"  // Static VBO background stars
+#include "Trail_Pool.h" // Pooled ring-buffer orbit trails
+#include "Job_System.h" // Work-stealing jobs and the frame's task graph
+#include "Profiler.h"   // Per-stage frame timings
+
 // Window dimensions
 int screenWidth = 1024;
 int screenHeight = 768;
 
+// Background stars (generated once, drawn with a single call per frame)
+const int STAR_COUNT = 200000;
+
 // Camera variables
 glm::vec3 cameraPos = glm::vec3(10.0f, 5.0f, 10.0f);
 glm::vec3 cameraFront = glm::vec3(-0.7f, -0.3f, -0.7f);
@@ -39,6 +47,20 @@ float simulationSpeed = 1.0f;
 float G = 6.674f;                  // Gravitational constant (increased for better simulation)
 const float MAX_TIMESTEP = 0.001f; // Maximum timestep for stability
 
+// Trails: only bodies on screen (or the selected one) get a trail from the pool
+const int MAX_TRAIL_LENGTH = 1000;                      // Points per trail
+const size_t TRAIL_MEMORY_BUDGET = 16 * 1024 * 1024; // Upper bound for all trail points
+const long long TRAIL_IDLE_FRAMES = 600;             // Off-screen trails are dropped after ~10 s
+TrailPool trailPool(MAX_TRAIL_LENGTH, TRAIL_MEMORY_BUDGET);
+const float TRAIL_PIXEL_ERROR = 1.5f; // Trails drop samples within this many pixels of the drawn line (see Trail_Simplify_Check.cpp)
+TrailTolerance trailTolerance;        // That bound for this frame's camera
+long long frameCount = 0;
+int selectedObject = -1; // Tab cycles through bodies, the selected one keeps its trail off screen
+
+// Frame stages run as a task graph on the job system, P prints their timings
+JobSystem jobs;
+Profiler frameProfiler;
+
 // Shader source code //
 
 // Vertex shader source code
@@ -105,12 +127,18 @@ void main()
 const char *trailVertexShader = R"(
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aStamp; // Sample number of the point
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform float currentTime; // Stamp of the trail's newest point
+uniform float fadeLength;  // Points older than this many samples are gone
+
+out float fade;
 
 void main()
 {
+    fade = 1.0 - (currentTime - aStamp) / fadeLength;
     gl_Position = projection * view * vec4(aPos, 1.0);
 }
 )";
@@ -123,9 +151,13 @@ out vec4 FragColor;
 uniform vec3 color;
 uniform float alpha;
 
+in float fade;
+
 void main()
 {
-    FragColor = vec4(color, alpha);
+    if (fade <= 0.0)
+        discard;
+    FragColor = vec4(color, alpha * fade);
 }
 )";
 
@@ -152,8 +184,7 @@ public:
     float mass;
     bool fixed; // Whether this object is immovable (e.g., the sun)
 
-    std::vector<glm::vec3> trail;
-    const int maxTrailLength = 1000; // Increased for better trail visualization
+    TrailHandle trail; // Points live in the trail pool, invalid while the body has no trail
 
     Object3D(glm::vec3 pos, glm::vec3 vel, float m, glm::vec3 col, float r = 0.5f, bool isFixed = false)
         : position(pos), velocity(vel), mass(m), color(col), radius(r), fixed(isFixed)
@@ -184,9 +215,7 @@ public:
         trailCounter++;
         if (trailCounter % 3 == 0) // Add to trail every 3rd frame
         {
-            trail.push_back(position);
-            if (trail.size() > maxTrailLength)
-                trail.erase(trail.begin());
+            trailPool.push(trail, position, trailTolerance);
         }
 
         acceleration = glm::vec3(0.0f);
@@ -387,6 +416,12 @@ int main()
     // Create shaders
     unsigned int shaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
     unsigned int trailShader = CreateShaderProgram(trailVertexShader, trailFragmentShader);
+    int trailViewLoc = glGetUniformLocation(trailShader, "view");
+    int trailProjectionLoc = glGetUniformLocation(trailShader, "projection");
+    int trailColorLoc = glGetUniformLocation(trailShader, "color");
+    int trailAlphaLoc = glGetUniformLocation(trailShader, "alpha");
+    int trailCurrentTimeLoc = glGetUniformLocation(trailShader, "currentTime");
+    int trailFadeLengthLoc = glGetUniformLocation(trailShader, "fadeLength");
 
     // Generate sphere mesh
     std::vector<float> sphereVertices;
@@ -416,16 +451,8 @@ int main()
 
     glBindVertexArray(0);
 
-    // Trails VAO and VBO
-    unsigned int trailVAO, trailVBO;
-    glGenVertexArrays(1, &trailVAO);
-    glGenBuffers(1, &trailVBO);
-
-    glBindVertexArray(trailVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
+    // Trail buffers mirror the trail pool, filled as points are added
+    TrailGpu trailGpu;
 
     // Enable OpenGL features
     glEnable(GL_DEPTH_TEST);
@@ -434,6 +461,9 @@ int main()
     glEnable(GL_LINE_SMOOTH);
     glLineWidth(2.0f);
 
+    // Background starfield
+    Starfield starfield = CreateStarfield3D(STAR_COUNT, 1977);
+
     std::vector<Object3D> objects = CreateObjects();
 
     // Store pointer to objects in GLFW window for reset
@@ -444,84 +474,130 @@ int main()
     std::cout << "=== Collision Detection Status: ENABLED ===" << std::endl;
     std::cout << "Objects in simulation: " << objects.size() << std::endl;
 
-    while (!glfwWindowShouldClose(window))
+    // Stages of a frame. Physics, light and camera don't depend on each other; the trails
+    // need the new positions and the new camera. Drawing stays on this thread (GL context).
+    glm::mat4 view, projection, viewProjection;
+
+    auto physicsStage = [&]()
     {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        if (isPaused)
+            return;
 
-        ProcessInput(window);
+        // Use smaller timestep for better stability
+        float physicsTimeStep = std::min(deltaTime * simulationSpeed, MAX_TIMESTEP);
 
-        if (!isPaused)
-        {
-            // Use smaller timestep for better stability
-            float physicsTimeStep = std::min(deltaTime * simulationSpeed, MAX_TIMESTEP);
+        // Multiple physics steps per frame if needed
+        int physicsSteps = std::max(1, (int)(deltaTime * simulationSpeed / MAX_TIMESTEP));
+        physicsTimeStep = deltaTime * simulationSpeed / physicsSteps;
 
-            // Multiple physics steps per frame if needed
-            int physicsSteps = std::max(1, (int)(deltaTime * simulationSpeed / MAX_TIMESTEP));
-            physicsTimeStep = deltaTime * simulationSpeed / physicsSteps;
+        for (int step = 0; step < physicsSteps; step++)
+        {
+            // Reset acceleration
+            for (auto &obj : objects)
+                obj.acceleration = glm::vec3(0.0f);
 
-            for (int step = 0; step < physicsSteps; step++)
+            // Calculate gravitational forces, every body only writes its own acceleration
+            auto gravityOn = [&](size_t i)
             {
-                // Reset acceleration
-                for (auto &obj : objects)
-                    obj.acceleration = glm::vec3(0.0f);
+                for (size_t j = 0; j < objects.size(); ++j)
+                    objects[i].calculateGravitationalForce(objects[j]);
+            };
+            jobs.parallelFor(objects.size(), gravityOn, 16);
 
-                // Calculate gravitational forces
-                for (size_t i = 0; i < objects.size(); ++i)
-                    for (size_t j = 0; j < objects.size(); ++j)
-                        objects[i].calculateGravitationalForce(objects[j]);
+            // Update positions
+            for (auto &obj : objects)
+                obj.updatePosition(physicsTimeStep);
 
-                // Update positions
-                for (auto &obj : objects)
-                    obj.updatePosition(physicsTimeStep);
-
-                // Collision detection and resolution
-                for (size_t i = 0; i < objects.size(); ++i)
+            // Collision detection and resolution
+            for (size_t i = 0; i < objects.size(); ++i)
+            {
+                for (size_t j = i + 1; j < objects.size(); ++j)
                 {
-                    for (size_t j = i + 1; j < objects.size(); ++j)
+                    if (CheckCollision(objects[i], objects[j]))
                     {
-                        if (CheckCollision(objects[i], objects[j]))
-                        {
-                            ResolveCollision(objects[i], objects[j]);
-                            // Visual feedback for collision
-                            std::cout << "Collision detected between objects " << i << " and " << j << std::endl;
-                        }
+                        ResolveCollision(objects[i], objects[j]);
+                        // Visual feedback for collision
+                        std::cout << "Collision detected between objects " << i << " and " << j << std::endl;
                     }
                 }
             }
+        }
+    };
 
+    auto lightStage = [&]()
+    {
+        if (!isPaused)
             lightAngle += deltaTime * 0.5f;
+    };
+
+    auto cameraStage = [&]()
+    {
+        view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / screenHeight, 0.1f, 200.0f);
+        viewProjection = projection * view;
+    };
+
+    // Hand out trails to bodies on screen or selected, idle ones age out of the pool
+    auto trailStage = [&]()
+    {
+        frameCount++;
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            Object3D &obj = objects[i];
+            if (obj.fixed)
+                continue; // Never moves, nothing to trail
+            if ((int)i != selectedObject && !PointInView(viewProjection, obj.position))
+                continue;
+            if (trailPool.valid(obj.trail))
+                trailPool.touch(obj.trail, frameCount);
+            else
+                obj.trail = trailPool.acquire(frameCount);
         }
+        trailPool.ageOut(frameCount, TRAIL_IDLE_FRAMES);
+    };
+
+    TaskGraph frame;
+    int physics = frame.add("physics", physicsStage);
+    frame.add("light", lightStage);
+    int camera = frame.add("camera", cameraStage);
+    frame.add("trails", trailStage, {physics, camera});
+
+    while (!glfwWindowShouldClose(window))
+    {
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        ProcessInput(window);
+        trailTolerance = TrailToleranceFor(cameraPos, glm::radians(45.0f), screenHeight, TRAIL_PIXEL_ERROR);
+
+        frame.run(jobs, &frameProfiler);
 
         glm::vec3 lightPos(15.0f * cos(lightAngle), 8.0f, 15.0f * sin(lightAngle));
 
         glClearColor(0.02f, 0.02f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / screenHeight, 0.1f, 200.0f);
+        // Render background stars first, they never write depth
+        DrawStarfield3D(starfield, view, projection);
 
         // Render trails
         glDepthMask(GL_FALSE);
         glUseProgram(trailShader);
-        glUniformMatrix4fv(glGetUniformLocation(trailShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(trailShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(trailViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(trailProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform1f(trailAlphaLoc, 0.4f);
+        glUniform1f(trailFadeLengthLoc, float(trailPool.trailLength()));
+        SyncTrailGpu(trailGpu, trailPool); // Only the points added since the last frame
 
         for (const auto &obj : objects)
         {
-            if (obj.trail.size() > 1)
-            {
-                glBindVertexArray(trailVAO);
-                glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-                glBufferData(GL_ARRAY_BUFFER, obj.trail.size() * sizeof(glm::vec3), obj.trail.data(), GL_DYNAMIC_DRAW);
-
-                glUniform3fv(glGetUniformLocation(trailShader, "color"), 1, glm::value_ptr(obj.color));
-                glUniform1f(glGetUniformLocation(trailShader, "alpha"), 0.4f);
+            if (!trailPool.valid(obj.trail))
+                continue;
 
-                glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)obj.trail.size());
-                glBindVertexArray(0);
-            }
+            glUniform3fv(trailColorLoc, 1, glm::value_ptr(obj.color));
+            glUniform1f(trailCurrentTimeLoc, trailPool.newestStamp(obj.trail));
+            DrawTrail(trailGpu, trailPool, obj.trail);
         }
         glDepthMask(GL_TRUE);
 
@@ -557,10 +633,10 @@ int main()
     glDeleteVertexArrays(1, &sphereVAO);
     glDeleteBuffers(1, &sphereVBO);
     glDeleteBuffers(1, &sphereEBO);
-    glDeleteVertexArrays(1, &trailVAO);
-    glDeleteBuffers(1, &trailVBO);
+    DestroyTrailGpu(trailGpu);
     glDeleteProgram(shaderProgram);
     glDeleteProgram(trailShader);
+    DestroyStarfield(starfield);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -610,6 +686,7 @@ GLFWwindow *StartGLFW()
     std::cout << "Scroll: Zoom" << std::endl;
     std::cout << "Space: Pause/unpause" << std::endl;
     std::cout << "R: Reset simulation" << std::endl;
+    std::cout << "P: Print frame stage timings" << std::endl;
     std::cout << "ESC: Exit" << std::endl;
     std::cout << "================================" << std::endl;
 
@@ -834,6 +911,7 @@ void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
             if (objects)
             {
                 *objects = CreateObjects();
+                trailPool.releaseAll();
                 std::cout << "Simulation reset" << std::endl;
             }
         }
@@ -853,6 +931,25 @@ void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
                               << ", Distance from center=" << distFromCenter << std::endl;
                 }
             }
+            trailPool.printReport(std::cout);
+        }
+        else if (key == GLFW_KEY_P)
+        {
+            std::cout << "Job system: " << jobs.size() << " workers" << std::endl;
+            frameProfiler.printReport(std::cout);
+        }
+        else if (key == GLFW_KEY_TAB)
+        {
+            // Cycle the selected body, after the last one the selection is cleared
+            std::vector<Object3D> *objects = (std::vector<Object3D> *)glfwGetWindowUserPointer(window);
+            if (objects)
+            {
+                selectedObject = selectedObject + 1 < (int)objects->size() ? selectedObject + 1 : -1;
+                if (selectedObject >= 0)
+                    std::cout << "Selected object " << selectedObject << ", its trail is kept off screen" << std::endl;
+                else
+                    std::cout << "Selection cleared" << std::endl;
+            }
         }
     }
 }
\ No newline at end of file
@@ -12,10 +12,17 @@
 #include <string>
 #include <random>
 
+#include "Starfield.h"  // Static VBO background stars
+#include "Trail_Pool.h" // Pooled ring-buffer orbit trails
+#include "Time_Warp.h"  // Integrator and step size per frame, up to 1e8x
+
 // Window dimensions
 int screenWidth = 1024;
 int screenHeight = 768;
 
+// Background stars (generated once, drawn with a single call per frame)
+const int STAR_COUNT = 200000;
+
 // Camera variables
 glm::vec3 cameraPos = glm::vec3(10.0f, 5.0f, 10.0f);
 glm::vec3 cameraFront = glm::vec3(-0.7f, -0.3f, -0.7f);
@@ -35,7 +42,20 @@ float lastFrame = 0.0f;
 
 // Simulation control
 bool isPaused = false;
-float simulationSpeed = 1.0f;
+TimeWarpController timeWarp; // Simulated seconds per real second, +/- changes it 10x
+
+// Physics in double precision, the objects below only draw it
+Simulator physics(CreateScaledWorld());
+
+// Trails: only bodies on screen (or the selected one) get a trail from the pool
+const int MAX_TRAIL_LENGTH = 500;                      // Points per trail
+const size_t TRAIL_MEMORY_BUDGET = 16 * 1024 * 1024; // Upper bound for all trail points
+const long long TRAIL_IDLE_FRAMES = 600;             // Off-screen trails are dropped after ~10 s
+TrailPool trailPool(MAX_TRAIL_LENGTH, TRAIL_MEMORY_BUDGET);
+const float TRAIL_PIXEL_ERROR = 1.0f; // Trails drop samples within this many pixels of the drawn line
+TrailTolerance trailTolerance;        // That bound for this frame's camera
+long long frameCount = 0;
+int selectedObject = -1; // Tab cycles through bodies, the selected one keeps its trail off screen
 
 // ===== Constants =====
 const double AU_METERS = 149597870700.0; // meters in 1 AU
@@ -114,12 +134,18 @@ void main()
 const char *trailVertexShader = R"(
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aStamp; // Sample number of the point
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform float currentTime; // Stamp of the trail's newest point
+uniform float fadeLength;  // Points older than this many samples are gone
+
+out float fade;
 
 void main()
 {
+    fade = 1.0 - (currentTime - aStamp) / fadeLength;
     gl_Position = projection * view * vec4(aPos, 1.0);
 }
 )";
@@ -132,9 +158,13 @@ out vec4 FragColor;
 uniform vec3 color;
 uniform float alpha;
 
+in float fade;
+
 void main()
 {
-    FragColor = vec4(color, alpha);
+    if (fade <= 0.0)
+        discard;
+    FragColor = vec4(color, alpha * fade);
 }
 )";
 
@@ -154,68 +184,28 @@ class Object3D
 public:
     glm::vec3 position;
     glm::vec3 velocity;
-    glm::vec3 acceleration;
     glm::vec3 color;
 
     float radius;
     float mass;
 
-    std::vector<glm::vec3> trail;
-
-    const int maxTrailLength = 500;
+    TrailHandle trail; // Points live in the trail pool, invalid while the body has no trail
 
     Object3D(glm::vec3 pos, glm::vec3 vel, float m, glm::vec3 col, float r = 0.5f)
     {
         position = pos;
         velocity = vel;
-        acceleration = glm::vec3(0.0f);
         mass = m;
         color = col;
         radius = r;
     }
 
-    void applyForce(glm::vec3 force)
-    {
-        acceleration += force / mass;
-    }
-
-    void updatePosition(float dt)
-    {
-        if (isPaused)
-            return;
-
-        // Update velocity and position using Verlet integration for better stability
-        velocity += acceleration * dt;
-        position += velocity * dt;
-
-        // Add position to trail
-        trail.push_back(position);
-        if (trail.size() > maxTrailLength)
-        {
-            trail.erase(trail.begin());
-        }
-
-        // Reset acceleration for next frame
-        acceleration = glm::vec3(0.0f);
-    }
-
-    void calculateGravitationalForce(Object3D &other)
+    // Takes body i of the physics world and extends the trail
+    void followBody(const World &world, size_t i)
     {
-        if (&other == this)
-            return;
-
-        glm::vec3 direction = other.position - position;
-        float distance = glm::length(direction);
-
-        // Prevent division by zero and extreme forces at close distances
-        distance = std::max(distance, radius + other.radius);
-
-        // Newton's law of universal gravitation: F = G * m1 * m2 / r^2
-        float forceMagnitude = G * mass * other.mass / (distance * distance);
-
-        // Normalize direction and apply force
-        glm::vec3 force = glm::normalize(direction) * forceMagnitude;
-        applyForce(force);
+        position = glm::vec3(world.px[i], world.py[i], world.pz[i]);
+        velocity = glm::vec3(world.vx[i], world.vy[i], world.vz[i]);
+        trailPool.push(trail, position, trailTolerance);
     }
 };
 
@@ -324,6 +314,12 @@ int main()
     // Create shader programs
     unsigned int shaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
     unsigned int trailShader = CreateShaderProgram(trailVertexShader, trailFragmentShader);
+    int trailViewLoc = glGetUniformLocation(trailShader, "view");
+    int trailProjectionLoc = glGetUniformLocation(trailShader, "projection");
+    int trailColorLoc = glGetUniformLocation(trailShader, "color");
+    int trailAlphaLoc = glGetUniformLocation(trailShader, "alpha");
+    int trailCurrentTimeLoc = glGetUniformLocation(trailShader, "currentTime");
+    int trailFadeLengthLoc = glGetUniformLocation(trailShader, "fadeLength");
 
     // Generate sphere mesh
     std::vector<float> sphereVertices;
@@ -354,16 +350,8 @@ int main()
 
     glBindVertexArray(0);
 
-    // Create VAO and VBO for trails
-    unsigned int trailVAO, trailVBO;
-    glGenVertexArrays(1, &trailVAO);
-    glGenBuffers(1, &trailVBO);
-
-    glBindVertexArray(trailVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
+    // Trail buffers mirror the trail pool, filled as points are added
+    TrailGpu trailGpu;
 
     // Enable depth testing and blending for trails
     glEnable(GL_DEPTH_TEST);
@@ -372,8 +360,12 @@ int main()
     glEnable(GL_LINE_SMOOTH);
     glLineWidth(2.0f);
 
-    // Create objects
+    // Background starfield
+    Starfield starfield = CreateStarfield3D(STAR_COUNT, 1977);
+
+    // Create objects, the same bodies in the same order as the physics world
     std::vector<Object3D> objects = CreateObjects();
+    glfwSetWindowUserPointer(window, &objects);
 
     // Light position (moves around for dynamic lighting)
     float lightAngle = 0.0f;
@@ -388,24 +380,15 @@ int main()
 
         // Process input
         ProcessInput(window);
+        trailTolerance = TrailToleranceFor(cameraPos, glm::radians(45.0f), screenHeight, TRAIL_PIXEL_ERROR);
 
         // Update physics
         if (!isPaused)
         {
-            // Calculate gravitational forces between all objects
+            // The controller picks integrator and step count so the frame rate holds
+            timeWarp.advance(physics, deltaTime);
             for (size_t i = 0; i < objects.size(); ++i)
-            {
-                for (size_t j = 0; j < objects.size(); ++j)
-                {
-                    objects[i].calculateGravitationalForce(objects[j]);
-                }
-            }
-
-            // Update positions
-            for (auto &obj : objects)
-            {
-                obj.updatePosition(deltaTime * simulationSpeed);
-            }
+                objects[i].followBody(physics.world, i);
 
             // Animate light
             lightAngle += deltaTime * 0.5f;
@@ -422,28 +405,41 @@ int main()
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)screenWidth / (float)screenHeight, 0.1f, 100.0f);
 
+        // Render background stars first, they never write depth
+        DrawStarfield3D(starfield, view, projection);
+
+        // Hand out trails to bodies on screen or selected, idle ones age out of the pool
+        frameCount++;
+        glm::mat4 viewProjection = projection * view;
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            Object3D &obj = objects[i];
+            if ((int)i != selectedObject && !PointInView(viewProjection, obj.position))
+                continue;
+            if (trailPool.valid(obj.trail))
+                trailPool.touch(obj.trail, frameCount);
+            else
+                obj.trail = trailPool.acquire(frameCount);
+        }
+        trailPool.ageOut(frameCount, TRAIL_IDLE_FRAMES);
+
         // Render trails first (without depth writing)
         glDepthMask(GL_FALSE);
         glUseProgram(trailShader);
-        glUniformMatrix4fv(glGetUniformLocation(trailShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(trailShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(trailViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(trailProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform1f(trailAlphaLoc, 0.3f);
+        glUniform1f(trailFadeLengthLoc, float(trailPool.trailLength()));
+        SyncTrailGpu(trailGpu, trailPool); // Only the points added since the last frame
 
         for (const auto &obj : objects)
         {
-            if (obj.trail.size() > 1)
-            {
-                glBindVertexArray(trailVAO);
-                glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-                glBufferData(GL_ARRAY_BUFFER, obj.trail.size() * sizeof(glm::vec3),
-                             obj.trail.data(), GL_DYNAMIC_DRAW);
+            if (!trailPool.valid(obj.trail))
+                continue;
 
-                // Fade trail based on position in trail
-                glUniform3fv(glGetUniformLocation(trailShader, "color"), 1, glm::value_ptr(obj.color));
-                glUniform1f(glGetUniformLocation(trailShader, "alpha"), 0.3f);
-
-                glDrawArrays(GL_LINE_STRIP, 0, obj.trail.size());
-                glBindVertexArray(0);
-            }
+            glUniform3fv(trailColorLoc, 1, glm::value_ptr(obj.color));
+            glUniform1f(trailCurrentTimeLoc, trailPool.newestStamp(obj.trail));
+            DrawTrail(trailGpu, trailPool, obj.trail);
         }
         glDepthMask(GL_TRUE);
 
@@ -483,10 +479,10 @@ int main()
     glDeleteVertexArrays(1, &sphereVAO);
     glDeleteBuffers(1, &sphereVBO);
     glDeleteBuffers(1, &sphereEBO);
-    glDeleteVertexArrays(1, &trailVAO);
-    glDeleteBuffers(1, &trailVBO);
+    DestroyTrailGpu(trailGpu);
     glDeleteProgram(shaderProgram);
     glDeleteProgram(trailShader);
+    DestroyStarfield(starfield);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -536,6 +532,8 @@ GLFWwindow *StartGLFW()
     std::cout << "Scroll: Zoom" << std::endl;
     std::cout << "Space: Pause/unpause" << std::endl;
     std::cout << "R: Reset simulation" << std::endl;
+    std::cout << "+/-: Time warp up/down 10x (1x to 1e8x)" << std::endl;
+    std::cout << "T: Time warp report" << std::endl;
     std::cout << "ESC: Exit" << std::endl;
     std::cout << "================================" << std::endl;
 
@@ -760,8 +758,44 @@ void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
             if (objects)
             {
                 *objects = CreateObjects();
+                // A new simulator too: step-size history, tree and integrator state all belong
+                // to the old run, like the time warp's regime and measured step costs
+                physics = Simulator(CreateScaledWorld());
+                timeWarp = TimeWarpController();
+                trailPool.releaseAll();
                 std::cout << "Simulation reset" << std::endl;
             }
         }
+        else if (key == GLFW_KEY_TAB)
+        {
+            // Cycle the selected body, after the last one the selection is cleared
+            std::vector<Object3D> *objects = (std::vector<Object3D> *)glfwGetWindowUserPointer(window);
+            if (objects)
+            {
+                selectedObject = selectedObject + 1 < (int)objects->size() ? selectedObject + 1 : -1;
+                if (selectedObject >= 0)
+                    std::cout << "Selected object " << selectedObject << ", its trail is kept off screen" << std::endl;
+                else
+                    std::cout << "Selection cleared" << std::endl;
+            }
+        }
+        else if (key == GLFW_KEY_C)
+        {
+            trailPool.printReport(std::cout);
+        }
+        else if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) // + key
+        {
+            timeWarp.faster();
+            std::cout << "Time warp: " << timeWarp.warp() << "x" << std::endl;
+        }
+        else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT) // - key
+        {
+            timeWarp.slower();
+            std::cout << "Time warp: " << timeWarp.warp() << "x" << std::endl;
+        }
+        else if (key == GLFW_KEY_T)
+        {
+            timeWarp.printReport(std::cout);
+        }
     }
 }
\ No newline at end of file
@@ -12,10 +12,16 @@
 #include <string>
 #include <random>
 
+#include "Starfield.h"  // Static VBO background stars
+#include "Trail_Pool.h" // Pooled ring-buffer orbit trails
+
 // Window dimensions
 int screenWidth = 1024;
 int screenHeight = 768;
 
+// Background stars (generated once, drawn with a single call per frame)
+const int STAR_COUNT = 200000;
+
 // Camera variables
 glm::vec3 cameraPos = glm::vec3(10.0f, 5.0f, 10.0f);
 glm::vec3 cameraFront = glm::vec3(-0.7f, -0.3f, -0.7f);
@@ -39,6 +45,16 @@ float simulationSpeed = 0.1f;     // Reduced from 1.0f to slow down simulation
 float G = 1.0f;                   // Reduced gravitational constant for slower orbits
 const float MAX_TIMESTEP = 0.01f; // Increased timestep for smoother motion
 
+// Trails: only bodies on screen (or the selected one) get a trail from the pool
+const int MAX_TRAIL_LENGTH = 1000;                      // Points per trail
+const size_t TRAIL_MEMORY_BUDGET = 16 * 1024 * 1024; // Upper bound for all trail points
+const long long TRAIL_IDLE_FRAMES = 600;             // Off-screen trails are dropped after ~10 s
+TrailPool trailPool(MAX_TRAIL_LENGTH, TRAIL_MEMORY_BUDGET);
+const float TRAIL_PIXEL_ERROR = 1.0f; // Trails drop samples within this many pixels of the drawn line
+TrailTolerance trailTolerance;        // That bound for this frame's camera
+long long frameCount = 0;
+int selectedObject = -1; // Tab cycles through bodies, the selected one keeps its trail off screen
+
 // Shader source code //
 
 // Vertex shader source code
@@ -105,12 +121,18 @@ void main()
 const char *trailVertexShader = R"(
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aStamp; // Sample number of the point
 
 uniform mat4 view;
 uniform mat4 projection;
+uniform float currentTime; // Stamp of the trail's newest point
+uniform float fadeLength;  // Points older than this many samples are gone
+
+out float fade;
 
 void main()
 {
+    fade = 1.0 - (currentTime - aStamp) / fadeLength;
     gl_Position = projection * view * vec4(aPos, 1.0);
 }
 )";
@@ -123,9 +145,13 @@ out vec4 FragColor;
 uniform vec3 color;
 uniform float alpha;
 
+in float fade;
+
 void main()
 {
-    FragColor = vec4(color, alpha);
+    if (fade <= 0.0)
+        discard;
+    FragColor = vec4(color, alpha * fade);
 }
 )";
 
@@ -152,8 +178,7 @@ public:
     float mass;
     bool fixed; // Whether this object is immovable (e.g., the sun)
 
-    std::vector<glm::vec3> trail;
-    const int maxTrailLength = 1000; // Increased for better trail visualization
+    TrailHandle trail; // Points live in the trail pool, invalid while the body has no trail
 
     Object3D(glm::vec3 pos, glm::vec3 vel, float m, glm::vec3 col, float r = 0.5f, bool isFixed = false)
         : position(pos), velocity(vel), mass(m), color(col), radius(r), fixed(isFixed)
@@ -184,9 +209,7 @@ public:
         trailCounter++;
         if (trailCounter % 3 == 0) // Add to trail every 3rd frame
         {
-            trail.push_back(position);
-            if (trail.size() > maxTrailLength)
-                trail.erase(trail.begin());
+            trailPool.push(trail, position, trailTolerance);
         }
 
         acceleration = glm::vec3(0.0f);
@@ -387,6 +410,12 @@ int main()
     // Create shaders
     unsigned int shaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
     unsigned int trailShader = CreateShaderProgram(trailVertexShader, trailFragmentShader);
+    int trailViewLoc = glGetUniformLocation(trailShader, "view");
+    int trailProjectionLoc = glGetUniformLocation(trailShader, "projection");
+    int trailColorLoc = glGetUniformLocation(trailShader, "color");
+    int trailAlphaLoc = glGetUniformLocation(trailShader, "alpha");
+    int trailCurrentTimeLoc = glGetUniformLocation(trailShader, "currentTime");
+    int trailFadeLengthLoc = glGetUniformLocation(trailShader, "fadeLength");
 
     // Generate sphere mesh
     std::vector<float> sphereVertices;
@@ -416,16 +445,8 @@ int main()
 
     glBindVertexArray(0);
 
-    // Trails VAO and VBO
-    unsigned int trailVAO, trailVBO;
-    glGenVertexArrays(1, &trailVAO);
-    glGenBuffers(1, &trailVBO);
-
-    glBindVertexArray(trailVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
+    // Trail buffers mirror the trail pool, filled as points are added
+    TrailGpu trailGpu;
 
     // Enable OpenGL features
     glEnable(GL_DEPTH_TEST);
@@ -434,6 +455,9 @@ int main()
     glEnable(GL_LINE_SMOOTH);
     glLineWidth(2.0f);
 
+    // Background starfield
+    Starfield starfield = CreateStarfield3D(STAR_COUNT, 1977);
+
     std::vector<Object3D> objects = CreateObjects();
 
     // Store pointer to objects in GLFW window for reset
@@ -451,6 +475,7 @@ int main()
         lastFrame = currentFrame;
 
         ProcessInput(window);
+        trailTolerance = TrailToleranceFor(cameraPos, glm::radians(45.0f), screenHeight, TRAIL_PIXEL_ERROR);
 
         if (!isPaused)
         {
@@ -502,26 +527,43 @@ int main()
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), float(screenWidth) / screenHeight, 0.1f, 200.0f);
 
+        // Render background stars first, they never write depth
+        DrawStarfield3D(starfield, view, projection);
+
+        // Hand out trails to bodies on screen or selected, idle ones age out of the pool
+        frameCount++;
+        glm::mat4 viewProjection = projection * view;
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            Object3D &obj = objects[i];
+            if (obj.fixed)
+                continue; // Never moves, nothing to trail
+            if ((int)i != selectedObject && !PointInView(viewProjection, obj.position))
+                continue;
+            if (trailPool.valid(obj.trail))
+                trailPool.touch(obj.trail, frameCount);
+            else
+                obj.trail = trailPool.acquire(frameCount);
+        }
+        trailPool.ageOut(frameCount, TRAIL_IDLE_FRAMES);
+
         // Render trails
         glDepthMask(GL_FALSE);
         glUseProgram(trailShader);
-        glUniformMatrix4fv(glGetUniformLocation(trailShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(trailShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(trailViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(trailProjectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniform1f(trailAlphaLoc, 0.4f);
+        glUniform1f(trailFadeLengthLoc, float(trailPool.trailLength()));
+        SyncTrailGpu(trailGpu, trailPool); // Only the points added since the last frame
 
         for (const auto &obj : objects)
         {
-            if (obj.trail.size() > 1)
-            {
-                glBindVertexArray(trailVAO);
-                glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
-                glBufferData(GL_ARRAY_BUFFER, obj.trail.size() * sizeof(glm::vec3), obj.trail.data(), GL_DYNAMIC_DRAW);
+            if (!trailPool.valid(obj.trail))
+                continue;
 
-                glUniform3fv(glGetUniformLocation(trailShader, "color"), 1, glm::value_ptr(obj.color));
-                glUniform1f(glGetUniformLocation(trailShader, "alpha"), 0.4f);
-
-                glDrawArrays(GL_LINE_STRIP, 0, (GLsizei)obj.trail.size());
-                glBindVertexArray(0);
-            }
+            glUniform3fv(trailColorLoc, 1, glm::value_ptr(obj.color));
+            glUniform1f(trailCurrentTimeLoc, trailPool.newestStamp(obj.trail));
+            DrawTrail(trailGpu, trailPool, obj.trail);
         }
         glDepthMask(GL_TRUE);
 
@@ -557,10 +599,10 @@ int main()
     glDeleteVertexArrays(1, &sphereVAO);
     glDeleteBuffers(1, &sphereVBO);
     glDeleteBuffers(1, &sphereEBO);
-    glDeleteVertexArrays(1, &trailVAO);
-    glDeleteBuffers(1, &trailVBO);
+    DestroyTrailGpu(trailGpu);
     glDeleteProgram(shaderProgram);
     glDeleteProgram(trailShader);
+    DestroyStarfield(starfield);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -836,6 +878,7 @@ void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
             if (objects)
             {
                 *objects = CreateObjects();
+                trailPool.releaseAll();
                 std::cout << "Simulation reset" << std::endl;
             }
         }
@@ -855,6 +898,20 @@ void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
                               << ", Distance from center=" << distFromCenter << std::endl;
                 }
             }
+            trailPool.printReport(std::cout);
+        }
+        else if (key == GLFW_KEY_TAB)
+        {
+            // Cycle the selected body, after the last one the selection is cleared
+            std::vector<Object3D> *objects = (std::vector<Object3D> *)glfwGetWindowUserPointer(window);
+            if (objects)
+            {
+                selectedObject = selectedObject + 1 < (int)objects->size() ? selectedObject + 1 : -1;
+                if (selectedObject >= 0)
+                    std::cout << "Selected object " << selectedObject << ", its trail is kept off screen" << std::endl;
+                else
+                    std::cout << "Selection cleared" << std::endl;
+            }
         }
         else if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD) // + key
         {
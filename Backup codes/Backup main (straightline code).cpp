@@ -21,6 +21,8 @@
 #include <ctime>
 #include <cmath>
 
+#include "Starfield.h" // Static VBO background stars
+
 // Struct to define a celestial body (e.g., sun, planet)
 struct Body
 {
@@ -31,27 +33,6 @@ struct Body
     std::vector<glm::vec2> trail; // History of positions (for orbit trail)
 };
 
-// Struct to define a static star in the background
-struct Star
-{
-    float x, y;
-};
-
-std::vector<Star> stars;
-
-// Initializes star positions randomly across the screen (called once)
-void initStars(int count)
-{
-    stars.clear();
-    for (int i = 0; i < count; ++i)
-    {
-        stars.push_back({
-            static_cast<float>(rand() % 800 - 400), // x between -400 and +400
-            static_cast<float>(rand() % 600 - 300)  // y between -300 and +300
-        });
-    }
-}
-
 // Draws a filled circle at 'center' with given 'radius' and 'color'
 void drawCircle(glm::vec2 center, float radius, glm::vec3 color, int segments = 40)
 {
@@ -68,17 +49,6 @@ void drawCircle(glm::vec2 center, float radius, glm::vec3 color, int segments =
     glEnd();
 }
 
-// Renders all stars (white dots in the background)
-void renderStars()
-{
-    glPointSize(1.0f);
-    glBegin(GL_POINTS);
-    glColor3f(1.0f, 1.0f, 1.0f); // White color
-    for (const auto &star : stars)
-        glVertex2f(star.x, star.y);
-    glEnd();
-}
-
 // Applies gravity and updates velocity and position of all bodies
 void updatePhysics(std::vector<Body> &bodies, float dt)
 {
@@ -136,8 +106,6 @@ void renderBodies(const std::vector<Body> &bodies)
 
 int main()
 {
-    srand(static_cast<unsigned>(time(nullptr))); // Random seed for stars
-
     // Initialize GLFW
     if (!glfwInit())
         return -1;
@@ -163,7 +131,8 @@ int main()
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 
-    initStars(200); // Create 200 background stars
+    // Create the background stars once, they live in a static VBO from here on
+    Starfield starfield = CreateStarfield2D(2000, 1977, 400.0f, 300.0f);
 
     // Create a sun and one orbiting planet
     std::vector<Body> bodies = {
@@ -185,13 +154,14 @@ int main()
 
         updatePhysics(bodies, dt); // Simulate motion
 
-        renderStars();        // Draw stars first
-        renderBodies(bodies); // Then draw planets + trails
+        DrawStarfield2D(starfield); // Draw stars first (single draw call)
+        renderBodies(bodies);       // Then draw planets + trails
 
         glfwSwapBuffers(window); // Display the frame
         glfwPollEvents();        // Check for input/events
     }
 
+    DestroyStarfield(starfield);
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
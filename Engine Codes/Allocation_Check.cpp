@@ -0,0 +1,135 @@
+//
+//  Allocation_Check.cpp
+//  SpaceEngine
+//
+//  Counts heap allocations made by Simulator::step() in steady state. Global operator
+//  new/delete are replaced with counting versions; after a few warm-up steps (so the
+//  arenas and pool queues reach their working size) every further step must allocate
+//  nothing. Exits with status 1 otherwise, like Deterministic_Run.
+//
+//      ./Allocation_Check --asteroids 2000 --threads 4 --warmup 20 --steps 200
+//      ./Allocation_Check --serial        Check the plain serial collision loop instead
+//      ./Allocation_Check --kepler        Also use the Kepler / N-body hybrid
+//      ./Allocation_Check --tree          Also use Barnes-Hut gravity (refits must not allocate)
+//      ./Allocation_Check --morton        Also reorder the bodies along a Morton curve
+//      ./Allocation_Check --encounters    Also sub-cycle close pairs
+//      ./Allocation_Check --integrator rk4    Use another integrator than Euler (see Integrators.h)
+//
+//  Build: clang++ -std=c++17 -O3 -pthread -I"Engine Codes" "Engine Codes/Allocation_Check.cpp" -o allocation_check
+//
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Thread_Pool.h"
+#include "Cpu_Dispatch.h"
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// ===== Counting allocator =====
+
+std::atomic<long long> allocationCount{0};
+
+void *CountedAllocate(size_t bytes)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(bytes ? bytes : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t bytes) { return CountedAllocate(bytes); }
+void *operator new[](size_t bytes) { return CountedAllocate(bytes); }
+void *operator new(size_t bytes, const std::nothrow_t &) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(bytes ? bytes : 1);
+}
+void *operator new[](size_t bytes, const std::nothrow_t &tag) noexcept { return operator new(bytes, tag); }
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, size_t) noexcept { std::free(memory); }
+
+int main(int argc, char **argv)
+{
+    int asteroids = 2000;
+    unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+    long long warmup = 20;
+    long long steps = 200;
+    SimulationSettings settings;
+    settings.coloredCollisions = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--asteroids" && hasValue)
+            asteroids = std::atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue)
+            warmup = std::atoll(argv[++i]);
+        else if (arg == "--steps" && hasValue)
+            steps = std::atoll(argv[++i]);
+        else if (arg == "--serial")
+            settings.coloredCollisions = false;
+        else if (arg == "--kepler")
+            settings.keplerHybrid = true;
+        else if (arg == "--tree")
+            settings.treeGravity = true;
+        else if (arg == "--morton")
+            settings.mortonSort = true;
+        else if (arg == "--encounters")
+            settings.encounterSubcycling = true;
+        else if (arg == "--integrator" && hasValue)
+        {
+            if (!ParseIntegrator(argv[++i], settings.integrator))
+            {
+                std::cerr << "Unknown integrator '" << argv[i] << "' (use euler, leapfrog, yoshida, rk4, wh, kepler or ias15)" << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = asteroids;
+
+    ThreadPool pool(threads);
+    Simulator sim(CreateWorld(scenario, 42), settings, &pool);
+
+    std::cout << "=== Allocation check ===" << std::endl;
+    LogCpuDispatch(std::cout);
+    std::cout << "Bodies: " << sim.world.size() << ", threads: " << threads
+              << (settings.coloredCollisions ? ", coloured contact solver" : ", serial collisions") << std::endl;
+
+    // Warm up: arenas and pool queues grow to their working size here
+    long long before = allocationCount.load();
+    for (long long step = 0; step < warmup; ++step)
+        sim.step(scenario.maxTimestep);
+    long long warmupAllocations = allocationCount.load() - before;
+
+    before = allocationCount.load();
+    long long collisions = 0;
+    for (long long step = 0; step < steps; ++step)
+        collisions += sim.step(scenario.maxTimestep);
+    long long steadyAllocations = allocationCount.load() - before;
+
+    std::cout << "Warm-up: " << warmup << " steps, " << warmupAllocations << " allocations" << std::endl;
+    std::cout << "Steady state: " << steps << " steps, " << steadyAllocations << " allocations, "
+              << collisions << " collisions" << std::endl;
+    std::cout << "Arena high water: " << sim.stepArenas().highWaterBytes() / 1024 << " KB over "
+              << threads << " arenas, " << sim.stepArenas().heapAllocations() << " arena blocks allocated" << std::endl;
+
+    bool ok = steadyAllocations == 0;
+    std::cout << (ok ? "PASS: no heap allocations per step" : "FAIL: steps still allocate") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+//
+//  Arena.h
+//  SpaceEngine
+//
+//  Monotonic arena for data that only lives for one physics sub-step.
+//
+//  Pair lists, sort buffers and colour tables are rebuilt every sub-step. Allocating them
+//  from the heap each time means malloc traffic in the hot loop, so step-local containers
+//  draw from an Arena instead: allocation is a pointer bump, freeing is a no-op and
+//  reset() at the start of the next sub-step makes all of it reusable at once.
+//
+//  If a step needed more than one block, reset() folds them into a single block of the
+//  combined size, so after the first few steps the arena never touches the heap again.
+//  Arenas are not thread-safe; StepArenas keeps one per ThreadPool worker.
+//
+
+#pragma once
+
+#include "Thread_Pool.h"
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+class Arena
+{
+public:
+    explicit Arena(size_t initialBytes = 64 * 1024)
+    {
+        addBlock(initialBytes);
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        while (true)
+        {
+            Block &block = blocks[current];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+            uintptr_t aligned = (base + offset + alignment - 1) & ~uintptr_t(alignment - 1);
+            if (aligned + bytes <= base + block.size)
+            {
+                offset = aligned + bytes - base;
+                used += bytes;
+                highWater = std::max(highWater, used);
+                return reinterpret_cast<void *>(aligned);
+            }
+
+            // Doesn't fit: move on to the next block, or make one big enough
+            if (current + 1 == blocks.size())
+                addBlock(std::max(blocks.back().size * 2, bytes + alignment));
+            current++;
+            offset = 0;
+        }
+    }
+
+    // Makes all memory reusable. Several blocks are merged into one so the next step fits.
+    void reset()
+    {
+        if (blocks.size() > 1)
+        {
+            size_t total = 0;
+            for (const auto &block : blocks)
+                total += block.size;
+            blocks.clear();
+            addBlock(total);
+        }
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    size_t bytesUsed() const { return used; }          // Since the last reset
+    size_t highWaterBytes() const { return highWater; } // Most ever used between two resets
+    size_t heapAllocations() const { return blockAllocations; }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (const auto &block : blocks)
+            total += block.size;
+        return total;
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current = 0; // Block we are bumping in
+    size_t offset = 0;  // Bytes taken from the current block
+    size_t used = 0;
+    size_t highWater = 0;
+    size_t blockAllocations = 0;
+
+    void addBlock(size_t bytes)
+    {
+        blocks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[bytes]), bytes});
+        blockAllocations++;
+    }
+};
+
+// Standard allocator on top of an Arena so std::vector can live in it. deallocate() does
+// nothing: the memory comes back when the arena is reset.
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    Arena *arena;
+
+    explicit ArenaAllocator(Arena &a) : arena(&a) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// One arena per pool worker plus resetting them all at the start of a sub-step
+class StepArenas
+{
+public:
+    explicit StepArenas(unsigned workers = 1, size_t initialBytes = 64 * 1024) : initialBytes(initialBytes)
+    {
+        for (unsigned i = 0; i < std::max(1u, workers); ++i)
+            arenas.emplace_back(new Arena(initialBytes));
+    }
+
+    unsigned size() const { return (unsigned)arenas.size(); }
+
+    // Arena of the calling thread (worker 0 outside parallelFor)
+    Arena &local() { return *arenas[std::min(ThreadPool::currentWorker(), size() - 1)]; }
+    Arena &worker(unsigned index) { return *arenas[index]; }
+
+    // True if every worker of 'pool' has an arena of its own
+    bool covers(const ThreadPool *pool) const { return !pool || pool->size() <= size(); }
+
+    void resetAll()
+    {
+        for (auto &arena : arenas)
+            arena->reset();
+    }
+
+    // Replaces a worker's arena with a fresh one at least as big as the old one. Called
+    // from the worker itself, its blocks come from (and are first touched on) its node.
+    void renew(unsigned index)
+    {
+        size_t bytes = std::max(initialBytes, arenas[index]->capacity());
+        arenas[index].reset(new Arena(bytes));
+    }
+
+    size_t highWaterBytes() const
+    {
+        size_t total = 0;
+        for (const auto &arena : arenas)
+            total += arena->highWaterBytes();
+        return total;
+    }
+
+    size_t heapAllocations() const
+    {
+        size_t total = 0;
+        for (const auto &arena : arenas)
+            total += arena->heapAllocations();
+        return total;
+    }
+
+private:
+    std::vector<std::unique_ptr<Arena>> arenas;
+    size_t initialBytes;
+};
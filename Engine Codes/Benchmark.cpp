@@ -0,0 +1,1266 @@
+//
+//  Benchmark.cpp
+//  SpaceEngine
+//
+//  Headless benchmark suite for the simulation kernels.
+//
+//  Usage:
+//      ./Benchmark              Run every section
+//      ./Benchmark ensemble     Run only the named section(s)
+//
+//  Sections:
+//      ensemble   Ensemble-member steps per second: one system at a time vs. one member per SIMD lane
+//      collisions Dense asteroid belt: serial all-pairs contact loop vs. graph coloured parallel solver
+//      kepler     Wide belt: full N-body step vs. Kepler drift for bodies alone in their Hill sphere
+//      precision  Gravity in double vs. float pair terms with double or Kahan sums: time and error
+//      tiling     Direct gravity sum: naive per-body loop vs. lane kernel vs. cache-blocked tiles
+//      tree       Barnes-Hut: per-step build vs. refit time, rebuild every step vs. refit policy
+//      multipoles Barnes-Hut error / time over the opening angle, monopole vs. quadrupole nodes
+//      encounters Close flybys: deflection error over dt per softening kernel, with and without sub-cycling
+//      integrators SCALED Solar System over 10 years: energy error, force calls and time per integrator and dt
+//      orbits     Fast demo planets: force calls per orbit each integrator needs for the same accuracy
+//      timewarp   SCALED at 1x to 1e8x: integrator, steps and physics time per 60 fps frame, years per second
+//      jobs       Headless frame as a task graph on the job system vs. the same stages in sequence, stage profile
+//      numa       Wide belt: bodies placed by the creating thread vs. first touch by the (pinned) workers
+//      morton     Wide belt with tree gravity: creation order vs. adaptive Morton reordering
+//      viewers    Frame stream to remote viewers: publisher cost with 0 / 1 / 4 viewer processes, quantization error
+//      dispatch   Each dispatched kernel at every CPU level up to the detected one
+//
+//  Build: clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -pthread -I"Engine Codes" "Engine Codes/Benchmark.cpp" -o benchmark
+//
+
+#include "Headless_Simulation.h"
+#include "Ensemble.h"
+#include "Collision_Solver.h"
+#include "Simulator.h"
+#include "Thread_Pool.h"
+#include "Kepler.h"
+#include "Cpu_Dispatch.h"
+#include "Octree.h"
+#include "Morton_Order.h"
+#include "Integrators.h"
+#include "Time_Warp.h"
+#include "Job_System.h"
+#include "Numa.h"
+#include "Remote_View.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Seconds since 'start'
+double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ===== Ensemble =====
+
+// Integrates 'members' perturbed copies of the Fast scenario both ways and reports
+// ensemble-member steps per second
+void BenchmarkEnsemble()
+{
+    std::cout << "=== Ensemble integration (Fast scenario, 15 bodies) ===" << std::endl;
+    std::cout << " members     steps   one-by-one [member-steps/s]   lockstep SIMD [member-steps/s]   speedup" << std::endl;
+
+    Scenario scenario = FastScenario();
+    const int steps = 200;
+    const double dt = scenario.maxTimestep;
+
+    for (int members : {64, 1024, 4096})
+    {
+        // One system at a time with the regular World code
+        std::vector<World> worlds;
+        for (int m = 0; m < members; ++m)
+            worlds.push_back(CreateWorld(scenario, 1000 + m));
+
+        auto start = std::chrono::steady_clock::now();
+        for (auto &world : worlds)
+            for (int s = 0; s < steps; ++s)
+                StepWorld(world, dt);
+        double serialRate = double(members) * steps / SecondsSince(start);
+
+        // Every member in lockstep
+        Ensemble ensemble = CreateEnsemble(scenario, members, 0.0, 1000);
+        start = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s)
+            StepEnsemble(ensemble, (float)dt);
+        double ensembleRate = double(members) * steps / SecondsSince(start);
+
+        std::cout << std::setw(8) << members << std::setw(10) << steps
+                  << std::setw(30) << std::setprecision(4) << serialRate
+                  << std::setw(33) << std::setprecision(4) << ensembleRate
+                  << std::setw(10) << std::setprecision(3) << ensembleRate / serialRate << "x" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// ===== Collisions =====
+
+// Deepest remaining overlap as a fraction of the smaller radius, ignoring fixed-fixed pairs
+double WorstOverlap(const World &w)
+{
+    StepArenas arenas;
+    CollisionScratch scratch(arenas);
+    FindContactPairs(w, scratch);
+    double worst = 0.0;
+    for (const auto &pair : scratch.pairs)
+    {
+        if (w.fixed[pair.a] && w.fixed[pair.b])
+            continue;
+        double dx = w.px[pair.b] - w.px[pair.a];
+        double dy = w.py[pair.b] - w.py[pair.a];
+        double dz = w.pz[pair.b] - w.pz[pair.a];
+        double overlap = w.radius[pair.a] + w.radius[pair.b] - std::sqrt(dx * dx + dy * dy + dz * dz);
+        worst = std::max(worst, overlap / std::min(w.radius[pair.a], w.radius[pair.b]));
+    }
+    return worst;
+}
+
+// Largest position difference between two copies of the same world
+double MaxPositionDifference(const World &a, const World &b)
+{
+    double worst = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        double dx = a.px[i] - b.px[i], dy = a.py[i] - b.py[i], dz = a.pz[i] - b.pz[i];
+        worst = std::max(worst, std::sqrt(dx * dx + dy * dy + dz * dz));
+    }
+    return worst;
+}
+
+// Packs the asteroid belt until most asteroids touch a neighbour, then times one contact
+// resolution pass on the same state with both solvers
+void BenchmarkCollisions()
+{
+    std::cout << "=== Contact resolution (dense asteroid belt) ===" << std::endl;
+
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts;
+    for (unsigned t = 1; t < hardware; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(hardware);
+
+    for (int asteroids : {1000, 4000, 16000})
+    {
+        Scenario scenario = FastScenario();
+        scenario.asteroidCount = asteroids;
+        World start = CreateWorld(scenario, 7);
+
+        StepArenas arenas;
+        CollisionScratch scratch(arenas);
+        FindContactPairs(start, scratch);
+        std::cout << asteroids << " asteroids, " << scratch.pairs.size() << " contacts, ";
+        ColorContacts(start, scratch);
+        std::cout << scratch.batches.batchCount() << " colours, "
+                  << scratch.batches.pairs.size() - scratch.batches.overflowStart << " overflow pairs" << std::endl;
+
+        // Serial all-pairs reference
+        World serial = start;
+        auto clock = std::chrono::steady_clock::now();
+        ResolveWorldCollisions(serial);
+        double serialSeconds = SecondsSince(clock);
+
+        std::cout << "  solver                 threads   time [ms]   speedup   max |dx| vs serial   worst overlap" << std::endl;
+        std::cout << "  serial all-pairs" << std::setw(15) << 1
+                  << std::setw(12) << std::setprecision(4) << serialSeconds * 1000.0
+                  << std::setw(10) << "1.00x" << std::setw(21) << 0.0
+                  << std::setw(16) << std::setprecision(3) << WorstOverlap(serial) << std::endl;
+
+        for (int iterations : {1, 4})
+        {
+            for (unsigned threads : threadCounts)
+            {
+                ThreadPool pool(threads);
+                StepArenas poolArenas(threads);
+                CollisionScratch poolScratch(poolArenas);
+                World colored = start;
+                clock = std::chrono::steady_clock::now();
+                SolveCollisions(colored, poolScratch, iterations, &pool);
+                double seconds = SecondsSince(clock);
+
+                std::cout << "  coloured, " << iterations << " sweep" << (iterations > 1 ? "s" : " ")
+                          << std::setw(13) << threads
+                          << std::setw(12) << std::setprecision(4) << seconds * 1000.0
+                          << std::setw(9) << std::setprecision(3) << serialSeconds / seconds << "x"
+                          << std::setw(21) << std::setprecision(3) << MaxPositionDifference(serial, colored)
+                          << std::setw(16) << std::setprecision(3) << WorstOverlap(colored) << std::endl;
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+
+// ===== Kepler hybrid =====
+
+// Wide, thick belt of light asteroids where most bodies have their Hill sphere to themselves
+void BenchmarkKepler()
+{
+    std::cout << "=== Kepler hybrid (wide belt, Fast scenario) ===" << std::endl;
+    std::cout << "  bodies   steps   N-body [steps/s]   hybrid [steps/s]   speedup   on Kepler   max |dx| / r" << std::endl;
+
+    const int steps = 20;
+    for (int asteroids : {1000, 4000, 16000})
+    {
+        Scenario scenario = FastScenario();
+        scenario.asteroidCount = asteroids;
+        scenario.beltRadius = 22.0;
+        scenario.beltWidth = 20.0;
+        scenario.beltThickness = 4.0;
+        scenario.asteroidMassScale = 0.01;
+
+        // Both use the coloured contact solver so the comparison is about gravity only
+        SimulationSettings fullSettings;
+        fullSettings.coloredCollisions = true;
+        Simulator full(CreateWorld(scenario, 7), fullSettings);
+        auto clock = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s)
+            full.step(scenario.maxTimestep);
+        double fullRate = steps / SecondsSince(clock);
+
+        SimulationSettings settings = fullSettings;
+        settings.keplerHybrid = true;
+        Simulator hybrid(CreateWorld(scenario, 7), settings);
+        clock = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s)
+            hybrid.step(scenario.maxTimestep);
+        double hybridRate = steps / SecondsSince(clock);
+
+        // How far the two runs are apart. The Kepler drift is exact for an isolated body, so
+        // this is mostly the Euler error of the N-body run, not an error of the hybrid.
+        double worst = 0.0;
+        for (size_t i = 0; i < full.world.size(); ++i)
+        {
+            double dx = full.world.px[i] - hybrid.world.px[i];
+            double dy = full.world.py[i] - hybrid.world.py[i];
+            double dz = full.world.pz[i] - hybrid.world.pz[i];
+            double r = std::sqrt(full.world.px[i] * full.world.px[i] + full.world.pz[i] * full.world.pz[i]);
+            if (r > 0.0)
+                worst = std::max(worst, std::sqrt(dx * dx + dy * dy + dz * dz) / r);
+        }
+
+        std::cout << std::setw(8) << full.world.size() << std::setw(8) << steps
+                  << std::setw(19) << std::setprecision(4) << fullRate
+                  << std::setw(19) << std::setprecision(4) << hybridRate
+                  << std::setw(9) << std::setprecision(3) << hybridRate / fullRate << "x"
+                  << std::setw(11) << std::setprecision(3) << 100.0 * hybrid.keplerBodies() / full.world.size() << "%"
+                  << std::setw(15) << std::setprecision(3) << worst << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// ===== Force precision =====
+
+// One force evaluation per precision mode against a double Kahan reference. Error is
+// |a - a_ref| / |a_ref| per body, reported as the median and the worst body.
+void BenchmarkPrecision()
+{
+    std::cout << "=== Force precision (Fast scenario, single thread) ===" << std::endl;
+    std::cout << "  bodies   forces                          time [ms]   speedup   median rel. error   max rel. error" << std::endl;
+
+    struct Mode
+    {
+        ForcePrecision precision;
+        bool kahan;
+        const char *name;
+    };
+    const Mode modes[] = {
+        {ForcePrecision::Double, false, "double"},
+        {ForcePrecision::Double, true, "double, Kahan sums"},
+        {ForcePrecision::MixedDouble, false, "float terms, double sums"},
+        {ForcePrecision::MixedKahan, false, "float terms, Kahan float sums"},
+    };
+
+    for (int asteroids : {1000, 4000, 16000})
+    {
+        Scenario scenario = FastScenario();
+        scenario.asteroidCount = asteroids;
+        World reference = CreateWorld(scenario, 7);
+        reference.compensatedSummation = true;
+        ComputeAccelerations(reference);
+
+        const int evaluations = asteroids > 4000 ? 1 : 5;
+        double doubleSeconds = 0.0;
+        for (const Mode &mode : modes)
+        {
+            World world = CreateWorld(scenario, 7);
+            world.forcePrecision = mode.precision;
+            world.compensatedSummation = mode.kahan;
+            ComputeAccelerations(world); // Warm up
+            auto clock = std::chrono::steady_clock::now();
+            for (int e = 0; e < evaluations; ++e)
+                ComputeAccelerations(world);
+            double seconds = SecondsSince(clock) / evaluations;
+            if (mode.precision == ForcePrecision::Double && !mode.kahan)
+                doubleSeconds = seconds;
+
+            std::vector<double> errors;
+            for (size_t i = 0; i < world.size(); ++i)
+            {
+                if (world.fixed[i])
+                    continue;
+                double dx = world.ax[i] - reference.ax[i];
+                double dy = world.ay[i] - reference.ay[i];
+                double dz = world.az[i] - reference.az[i];
+                double norm = std::sqrt(reference.ax[i] * reference.ax[i] + reference.ay[i] * reference.ay[i] +
+                                        reference.az[i] * reference.az[i]);
+                errors.push_back(std::sqrt(dx * dx + dy * dy + dz * dz) / norm);
+            }
+            std::sort(errors.begin(), errors.end());
+
+            std::cout << std::setw(8) << reference.size() << "   " << std::left << std::setw(30) << mode.name << std::right
+                      << std::fixed << std::setw(11) << std::setprecision(2) << seconds * 1000.0
+                      << std::setw(9) << doubleSeconds / seconds << "x"
+                      << std::scientific << std::setprecision(1) << std::setw(20) << errors[errors.size() / 2]
+                      << std::setw(17) << errors.back() << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+        }
+        std::cout << std::endl;
+    }
+}
+
+// ===== Force tiling =====
+
+// Largest difference between two acceleration fields
+double MaxAccelerationDifference(const World &a, const World &b)
+{
+    double worst = 0.0;
+    for (size_t i = 0; i < a.size(); ++i)
+        worst = std::max({worst, std::fabs(a.ax[i] - b.ax[i]), std::fabs(a.ay[i] - b.ay[i]), std::fabs(a.az[i] - b.az[i])});
+    return worst;
+}
+
+// One double-precision force evaluation on a single thread: the naive for i / for j loop,
+// the lane kernel over all sources, and the lane kernel with tuned cache tiles
+void BenchmarkTiling()
+{
+    std::cout << "=== Direct N-body tiling (Fast scenario, double, single thread) ===" << std::endl;
+    auto clock = std::chrono::steady_clock::now();
+    ForceTiling tuned = SelectedForceTiling(FORCE_TILING_MIN_BODIES);
+    std::cout << "Tuned tiles: " << tuned.targetTile << " targets x " << tuned.sourceTile << " sources (0 = untiled), "
+              << std::setprecision(3) << SecondsSince(clock) * 1000.0 << " ms to tune" << std::endl;
+    std::cout << "  bodies   kernel                 time [ms]   speedup   Gpairs/s   max |da| vs naive" << std::endl;
+
+    for (int asteroids : {4000, 16000, 64000})
+    {
+        Scenario scenario = FastScenario();
+        scenario.asteroidCount = asteroids;
+        World naive = CreateWorld(scenario, 7);
+        const double pairs = double(naive.size()) * double(naive.size());
+
+        clock = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < naive.size(); ++i)
+            ComputeBodyAcceleration(naive, i);
+        double naiveSeconds = SecondsSince(clock);
+
+        auto report = [&](const char *name, double seconds, double difference)
+        {
+            std::cout << std::setw(8) << naive.size() << "   " << std::left << std::setw(20) << name << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(12) << seconds * 1000.0
+                      << std::setprecision(2) << std::setw(9) << naiveSeconds / seconds << "x"
+                      << std::setw(11) << pairs / seconds * 1e-9
+                      << std::scientific << std::setprecision(1) << std::setw(20) << difference << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+        };
+        report("naive loop", naiveSeconds, 0.0);
+
+        World lanes = naive;
+        clock = std::chrono::steady_clock::now();
+        ComputeAccelerationsTiled(lanes, ForceTiling());
+        report("lanes, untiled", SecondsSince(clock), MaxAccelerationDifference(naive, lanes));
+
+        World tiled = naive;
+        clock = std::chrono::steady_clock::now();
+        ComputeAccelerationsTiled(tiled, tuned);
+        report("lanes, tuned tiles", SecondsSince(clock), MaxAccelerationDifference(naive, tiled));
+        std::cout << std::endl;
+    }
+}
+
+// ===== Tree gravity =====
+
+// Median and worst |a - a_ref| / |a_ref| over the movable bodies
+void RelativeAccelerationError(const World &w, const World &reference, double &median, double &worst)
+{
+    std::vector<double> errors;
+    for (size_t i = 0; i < w.size(); ++i)
+    {
+        if (w.fixed[i])
+            continue;
+        double dx = w.ax[i] - reference.ax[i];
+        double dy = w.ay[i] - reference.ay[i];
+        double dz = w.az[i] - reference.az[i];
+        double norm = std::sqrt(reference.ax[i] * reference.ax[i] + reference.ay[i] * reference.ay[i] +
+                                reference.az[i] * reference.az[i]);
+        errors.push_back(std::sqrt(dx * dx + dy * dy + dz * dz) / norm);
+    }
+    std::sort(errors.begin(), errors.end());
+    median = errors.empty() ? 0.0 : errors[errors.size() / 2];
+    worst = errors.empty() ? 0.0 : errors.back();
+}
+
+// Runs the same steps twice, once rebuilding the tree every sub-step and once refitting
+// it until the quality metrics ask for a rebuild, and prints the per-step timings
+void BenchmarkTree()
+{
+    std::cout << "=== Tree gravity (wide belt, 16000 asteroids, theta 0.7, quadrupole) ===" << std::endl;
+    const int steps = 30;
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = 16000;
+    scenario.beltRadius = 22.0;
+    scenario.beltWidth = 20.0;
+    scenario.beltThickness = 4.0;
+    scenario.asteroidMassScale = 0.01;
+
+    SimulationSettings rebuildSettings;
+    rebuildSettings.coloredCollisions = true;
+    rebuildSettings.treeGravity = true;
+    rebuildSettings.treeMaxInflation = 0.0;
+    SimulationSettings refitSettings = rebuildSettings;
+    refitSettings.treeMaxInflation = 1.3;
+
+    Simulator rebuild(CreateWorld(scenario, 7), rebuildSettings);
+    Simulator refit(CreateWorld(scenario, 7), refitSettings);
+
+    std::cout << "  step   rebuild: build [ms]   walk [ms]   |   refit policy: action    build [ms]   refit [ms]   walk [ms]   inflation   terms / body" << std::endl;
+    double rebuildTree = 0.0, rebuildWalk = 0.0, refitTree = 0.0, refitWalk = 0.0;
+    for (int s = 0; s < steps; ++s)
+    {
+        rebuild.step(scenario.maxTimestep);
+        refit.step(scenario.maxTimestep);
+        const OctreeStats &a = rebuild.octree().stats();
+        const OctreeStats &b = refit.octree().stats();
+        rebuildTree += a.buildSeconds + a.refitSeconds;
+        rebuildWalk += a.walkSeconds;
+        refitTree += b.buildSeconds + b.refitSeconds;
+        refitWalk += b.walkSeconds;
+
+        std::cout << std::fixed << std::setprecision(2) << std::setw(6) << s
+                  << std::setw(22) << a.buildSeconds * 1000.0 << std::setw(12) << a.walkSeconds * 1000.0
+                  << "   |   " << std::setw(20) << (b.rebuilt ? (b.refitSeconds > 0.0 ? "refit + rebuild" : "build") : "refit")
+                  << std::setw(13) << b.buildSeconds * 1000.0 << std::setw(13) << b.refitSeconds * 1000.0
+                  << std::setw(12) << b.walkSeconds * 1000.0 << std::setw(12) << std::setprecision(3) << b.inflation
+                  << std::setw(15) << std::setprecision(1) << double(b.interactions) / refit.world.size() << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    // Forces of the refitted tree against the direct sum at the final positions
+    World direct = refit.world;
+    ComputeAccelerations(direct);
+    double median, worst;
+    RelativeAccelerationError(refit.world, direct, median, worst);
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Rebuild every step: tree " << rebuildTree * 1000.0 << " ms, walks " << rebuildWalk * 1000.0 << " ms" << std::endl
+              << "Refit policy:       tree " << refitTree * 1000.0 << " ms, walks " << refitWalk * 1000.0 << " ms, "
+              << refit.octree().stats().builds << " builds / " << refit.octree().stats().refits << " refits" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << "Refitted tree vs. direct sum: median rel. error " << std::setprecision(2) << median
+              << ", worst " << worst << std::endl
+              << std::endl;
+}
+
+// Error / time trade-off of the tree walk: for each opening angle, walk time and
+// relative error against the direct sum with point-mass nodes and with quadrupole nodes
+void BenchmarkMultipoles()
+{
+    std::cout << "=== Tree multipoles (walk time and error vs. direct sum over theta) ===" << std::endl;
+    struct Case
+    {
+        const char *name;
+        Scenario scenario;
+    };
+    std::vector<Case> cases = {{"fast", FastScenario()}, {"slow", SlowScenario()}, {"wide belt", FastScenario()}};
+    cases[0].scenario.asteroidCount = 16000;
+    cases[1].scenario.asteroidCount = 16000;
+    cases[2].scenario.asteroidCount = 16000;
+    cases[2].scenario.beltRadius = 22.0;
+    cases[2].scenario.beltWidth = 20.0;
+    cases[2].scenario.beltThickness = 4.0;
+    cases[2].scenario.asteroidMassScale = 0.01;
+    const double thetas[] = {0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0};
+    const int repeats = 3;
+
+    for (const Case &c : cases)
+    {
+        World world = CreateWorld(c.scenario, 7);
+        World direct = world;
+        ComputeAccelerations(direct);
+        Octree tree;
+        tree.update(world, 0.0);
+
+        std::cout << c.name << " (" << world.size() << " bodies)" << std::endl;
+        std::cout << "  theta   monopole: walk [ms]   terms / body   median err   worst err"
+                  << "   |   quadrupole: walk [ms]   terms / body   median err   worst err" << std::endl;
+        for (double theta : thetas)
+        {
+            std::cout << std::fixed << std::setprecision(1) << std::setw(7) << theta;
+            for (bool quadrupole : {false, true})
+            {
+                double best = 1e30;
+                for (int r = 0; r < repeats; ++r)
+                {
+                    tree.computeAccelerations(world, theta, quadrupole);
+                    best = std::min(best, tree.stats().walkSeconds);
+                }
+                double median, worst;
+                RelativeAccelerationError(world, direct, median, worst);
+                std::cout << std::fixed << std::setprecision(2) << (quadrupole ? "   |" : "") << std::setw(22) << best * 1000.0
+                          << std::setw(15) << std::setprecision(1) << double(tree.stats().interactions) / world.size();
+                std::cout.unsetf(std::ios::floatfield);
+                std::cout << std::setprecision(2) << std::setw(13) << median << std::setw(12) << worst;
+            }
+            std::cout << std::endl;
+        }
+    }
+    std::cout << std::endl;
+}
+
+// ===== Close encounters =====
+
+// 64 isolated two-body flybys, far enough apart not to feel each other, with impact
+// parameters from just outside contact to a few softening lengths
+World FlybyWorld(Softening softening)
+{
+    World world;
+    world.softening = softening;
+    const int pairs = 64;
+    for (int k = 0; k < pairs; ++k)
+    {
+        double impact = 0.35 + 0.5 * k / (pairs - 1);
+        double x = (k % 8) * 200.0, z = (k / 8) * 200.0;
+        world.addBody(x - 10.0, 0.0, z, 4.0, 0.0, 0.0, 1.0, 1.0f, 1.0f, 1.0f, 0.1);
+        world.addBody(x + 10.0, impact, z, -4.0, 0.0, 0.0, 1.0, 1.0f, 1.0f, 1.0f, 0.1);
+    }
+    return world;
+}
+
+// Runs the flybys to the end and returns the final world and sub-steps taken
+World RunFlybys(Softening softening, double dt, bool subcycle, long long &substeps)
+{
+    SimulationSettings settings;
+    settings.coloredCollisions = true;
+    settings.encounterSubcycling = subcycle;
+    Simulator sim(FlybyWorld(softening), settings);
+    const long long steps = (long long)(5.0 / dt + 0.5);
+    substeps = 0;
+    for (long long s = 0; s < steps; ++s)
+    {
+        sim.step(dt);
+        substeps += sim.encounters().substeps;
+    }
+    return sim.world;
+}
+
+// Worst error of the deflection angle of any flyby, against a reference run at dt = 2e-5
+// without sub-cycling
+void BenchmarkEncounters()
+{
+    std::cout << "=== Close encounters (64 flybys, deflection error vs. dt = 2e-5 reference) ===" << std::endl;
+    std::cout << "  softening        dt   global step: worst error   |   sub-cycled: worst error   sub-steps / step" << std::endl;
+    for (Softening softening : {Softening::Clamp, Softening::Plummer, Softening::Spline})
+    {
+        long long substeps;
+        World reference = RunFlybys(softening, 2e-5, false, substeps);
+        auto worstDeflectionError = [&](const World &w)
+        {
+            double worst = 0.0;
+            for (size_t i = 0; i < w.size(); i += 2)
+            {
+                double angle = std::atan2(w.vy[i + 1] - w.vy[i], w.vx[i + 1] - w.vx[i]);
+                double expected = std::atan2(reference.vy[i + 1] - reference.vy[i], reference.vx[i + 1] - reference.vx[i]);
+                worst = std::max(worst, std::fabs(angle - expected));
+            }
+            return worst;
+        };
+
+        for (double dt : {0.0005, 0.002, 0.008, 0.032})
+        {
+            World plain = RunFlybys(softening, dt, false, substeps);
+            World subcycled = RunFlybys(softening, dt, true, substeps);
+            std::cout << "  " << std::left << std::setw(10) << SofteningName(softening) << std::right
+                      << std::setw(10) << dt << std::setw(27) << std::setprecision(2) << worstDeflectionError(plain)
+                      << "   |" << std::setw(26) << worstDeflectionError(subcycled)
+                      << std::setw(19) << std::setprecision(3) << substeps * dt / 5.0 << std::endl;
+        }
+    }
+    std::cout << std::endl;
+}
+
+// ===== Integrators =====
+
+// The Sun and planets of the SCALED demo for ten years at a few fixed steps. The error is
+// the worst relative energy error seen at any step, sampled every step.
+void BenchmarkIntegrators()
+{
+    std::cout << "=== Integrators (SCALED Solar System, 10 years) ===" << std::endl;
+    std::cout << "  integrator   dt [days]   worst |dE / E|   force calls   time [ms]" << std::endl;
+    const double day = 86400.0, duration = 10.0 * 365.25 * day;
+    for (Integrator integrator : {Integrator::Euler, Integrator::Leapfrog, Integrator::Yoshida, Integrator::RK4,
+                                  Integrator::WisdomHolman, Integrator::IAS15})
+    {
+        for (double days : {0.25, 1.0, 4.0, 16.0})
+        {
+            SimulationSettings settings;
+            settings.integrator = integrator;
+            Simulator sim(CreateScaledWorld(), settings);
+            const double initialEnergy = TotalEnergy(sim.world);
+            const long long steps = (long long)(duration / (days * day));
+
+            double worst = 0.0, seconds = 0.0;
+            long long forceCalls = 0;
+            for (long long s = 0; s < steps; ++s)
+            {
+                auto clock = std::chrono::steady_clock::now();
+                sim.step(days * day);
+                seconds += SecondsSince(clock);
+                forceCalls += sim.forceCalls();
+                worst = std::max(worst, std::fabs(TotalEnergy(sim.world) - initialEnergy) / std::fabs(initialEnergy));
+            }
+
+            std::cout << "  " << std::left << std::setw(10) << IntegratorName(integrator) << std::right
+                      << std::setw(12) << days << std::setw(17) << std::setprecision(2) << worst
+                      << std::setw(14) << forceCalls << std::setw(12) << std::fixed << seconds * 1000.0 << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+        }
+    }
+    std::cout << std::endl;
+}
+
+// Planets and moon of CreateObjects() in the Fast demo (no asteroids, so no collisions)
+// over ten orbits of the inner planet. The Slow constants put the planets on crossing
+// orbits, which no integrator follows for long. Each integrator halves dt until its worst position error against an
+// IAS15 reference is below the tolerance, and reports what that cost per orbit.
+void BenchmarkOrbits()
+{
+    const double orbits = 10.0, tolerance = 1e-4;
+    std::cout << "=== Orbits (Fast planets, " << orbits << " inner orbits, position error < " << tolerance << ") ===" << std::endl;
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = 0;
+    const World initial = CreateWorld(scenario, 42);
+    const double period = 2.0 * M_PI * std::sqrt(std::pow(initial.px[1], 3) / (scenario.G * scenario.sunMass));
+    const double duration = orbits * period;
+
+    auto run = [&](Integrator integrator, long long steps, long long &forceCalls, double &energyError)
+    {
+        SimulationSettings settings;
+        settings.integrator = integrator;
+        Simulator sim(initial, settings);
+        const double initialEnergy = TotalEnergy(sim.world);
+        forceCalls = 0;
+        energyError = 0.0;
+        for (long long s = 0; s < steps; ++s)
+        {
+            sim.step(duration / steps);
+            forceCalls += sim.forceCalls();
+            energyError = std::max(energyError, std::fabs(TotalEnergy(sim.world) - initialEnergy) / std::fabs(initialEnergy));
+        }
+        return sim.world;
+    };
+
+    long long referenceCalls;
+    double referenceEnergy;
+    const World reference = run(Integrator::IAS15, (long long)(20.0 * orbits), referenceCalls, referenceEnergy);
+
+    std::cout << "  integrator   steps / orbit   force calls / orbit   position error   |dE / E|" << std::endl;
+    for (Integrator integrator : {Integrator::Euler, Integrator::Leapfrog, Integrator::Yoshida, Integrator::RK4})
+    {
+        long long steps = (long long)(20.0 * orbits), forceCalls = 0;
+        double error = 0.0, energyError = 0.0;
+        for (int attempt = 0; attempt < 14; ++attempt)
+        {
+            World w = run(integrator, steps, forceCalls, energyError);
+            error = 0.0;
+            for (size_t i = 0; i < w.size(); ++i)
+                error = std::max(error, std::sqrt((w.px[i] - reference.px[i]) * (w.px[i] - reference.px[i]) +
+                                                  (w.py[i] - reference.py[i]) * (w.py[i] - reference.py[i]) +
+                                                  (w.pz[i] - reference.pz[i]) * (w.pz[i] - reference.pz[i])));
+            if (error < tolerance)
+                break;
+            steps *= 2;
+        }
+
+        std::cout << "  " << std::left << std::setw(10) << IntegratorName(integrator) << std::right;
+        if (error < tolerance)
+            std::cout << std::setw(16) << (long long)(steps / orbits) << std::setw(22) << (long long)(forceCalls / orbits);
+        else
+            std::cout << std::setw(16) << "-" << std::setw(22) << "-";
+        std::cout << std::setw(17) << std::setprecision(2) << error << std::setw(11) << energyError << std::endl;
+    }
+    std::cout << "  " << std::left << std::setw(10) << "ias15" << std::right << std::setw(16) << 20
+              << std::setw(22) << (long long)(referenceCalls / orbits) << std::setw(17) << "reference"
+              << std::setw(11) << std::setprecision(2) << referenceEnergy << std::endl;
+    std::cout << std::endl;
+}
+
+// ===== Time warp =====
+
+// Adds light asteroids on circular orbits between 2.1 and 3.3 AU to a SCALED world
+void AddScaledAsteroids(World &w, int count, uint64_t seed)
+{
+    const double mu = w.G * w.mass[0];
+    for (int i = 0; i < count; ++i)
+    {
+        double r = 2.1 + 1.2 * CounterUniform(seed, i, 0);
+        double angle = 2.0 * M_PI * CounterUniform(seed, i, 1);
+        double speed = std::sqrt(mu / r);
+        w.addBody(r * std::cos(angle), r * std::sin(angle), 0.0, -speed * std::sin(angle), speed * std::cos(angle), 0.0,
+                  1e18, 0.6f, 0.5f, 0.4f, 0.02 * SCALED_RADIUS_SCALE);
+    }
+}
+
+// Drives the SCALED system through the time warp controller with frames of exactly 1/60 s
+// and reports what it picked at every warp. Wall time is the frame or the physics,
+// whichever took longer, as in the demo without its rendering.
+void BenchmarkTimeWarp()
+{
+    const int frames = 60;
+    for (int asteroids : {0, 1000, 4000})
+    {
+        std::cout << "=== Time warp (SCALED, " << asteroids << " asteroids" << (asteroids ? ", tree gravity" : "")
+                  << ", 60 fps, " << frames << " frames per warp) ===" << std::endl;
+        std::cout << "        warp   integrator   steps / frame   step [days]   physics [ms / frame]   years / s   |dE / E|" << std::endl;
+
+        SimulationSettings settings;
+        settings.coloredCollisions = true;
+        settings.treeGravity = asteroids > 0;
+        World initial = CreateScaledWorld();
+        AddScaledAsteroids(initial, asteroids, 11);
+        TimeWarpController controller;
+
+        for (double warp = TIME_WARP_MIN; warp <= TIME_WARP_MAX; warp *= 10.0)
+        {
+            Simulator sim(initial, settings);
+            const double initialEnergy = TotalEnergy(sim.world);
+            controller.setWarp(warp);
+            double physics = 0.0, simulated = 0.0, wall = 0.0;
+            for (int f = 0; f < frames; ++f)
+            {
+                simulated += controller.advance(sim, 1.0 / 60.0);
+                physics += controller.physicsSeconds();
+                wall += std::max(1.0 / 60.0, controller.physicsSeconds());
+            }
+            double energyError = std::fabs(TotalEnergy(sim.world) - initialEnergy) / std::fabs(initialEnergy);
+
+            std::cout << std::setw(12) << std::setprecision(0) << std::scientific << warp << std::defaultfloat << "   "
+                      << std::left << std::setw(10) << IntegratorName(controller.integrator()) << std::right
+                      << std::setw(16) << controller.steps() << std::setw(14) << std::setprecision(3) << controller.stepSize() / 86400.0
+                      << std::setw(23) << std::fixed << std::setprecision(2) << physics / frames * 1000.0 << std::defaultfloat
+                      << std::setw(12) << std::setprecision(3) << simulated / wall / SECONDS_PER_YEAR
+                      << std::setw(11) << std::setprecision(2) << energyError << std::endl;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// ===== Job system =====
+
+// The frame of a headless belt as a task graph: energy diagnostics only read positions and
+// velocities, so they run next to the force chunks; integration waits for both, collisions
+// for integration. The same stages run one after the other as reference, and both must
+// end in the same state.
+void BenchmarkJobs()
+{
+    const int steps = 20;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts = {1};
+    if (hardware > 1)
+        threadCounts.push_back(hardware);
+
+    for (int asteroids : {1000, 4000})
+    {
+        Scenario scenario = FastScenario();
+        scenario.asteroidCount = asteroids;
+        const World initial = CreateWorld(scenario, 3);
+        const double dt = scenario.maxTimestep;
+        const size_t block = 64;
+        std::cout << "=== Job system (Fast scenario, " << initial.size() << " bodies, " << steps << " steps) ===" << std::endl;
+
+        // Sequential reference
+        World serial = initial;
+        StepArenas serialArenas;
+        double energy = 0.0;
+        auto clock = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s)
+        {
+            energy = TotalEnergy(serial);
+            ComputeAccelerations(serial);
+            IntegrateWorld(serial, dt);
+            serial.time += dt;
+            serialArenas.resetAll();
+            CollisionScratch scratch(serialArenas);
+            SolveCollisions(serial, scratch, 1);
+        }
+        double serialSeconds = SecondsSince(clock);
+        std::cout << "  sequential stages: " << std::setprecision(4) << serialSeconds / steps * 1000.0 << " ms / step" << std::endl;
+
+        for (unsigned threads : threadCounts)
+        {
+            JobSystem jobs(threads);
+            Profiler profiler(1.0 / steps);
+            World w = initial;
+            StepArenas arenas;
+            double graphEnergy = 0.0;
+            const size_t n = w.size();
+            const size_t chunks = (n + block - 1) / block;
+            const ForceTiling tiling = SelectedForceTiling(n);
+
+            TaskGraph frame;
+            int diagnostics = frame.add("energy", [&]
+                                        { graphEnergy = TotalEnergy(w); });
+            int forces = frame.addParallel(
+                "forces", [&]
+                { return (n + tiling.targetTile - 1) / tiling.targetTile; },
+                [&](size_t b)
+                { ComputeAccelerationRange(w, b * tiling.targetTile, std::min(n, (b + 1) * tiling.targetTile), tiling.sourceTile); },
+                1);
+            int integrate = frame.addParallel(
+                "integrate", [&]
+                { return chunks; },
+                [&](size_t c)
+                {
+                    size_t begin = c * block;
+                    EulerKernel(std::min(n, begin + block) - begin, w.fixed.data() + begin, w.px.data() + begin, w.py.data() + begin,
+                                w.pz.data() + begin, w.vx.data() + begin, w.vy.data() + begin, w.vz.data() + begin,
+                                w.ax.data() + begin, w.ay.data() + begin, w.az.data() + begin, dt);
+                },
+                1, {diagnostics, forces});
+            frame.add(
+                "collisions", [&]
+                {
+                    w.time += dt;
+                    arenas.resetAll();
+                    CollisionScratch scratch(arenas);
+                    SolveCollisions(w, scratch, 1); },
+                {integrate});
+
+            clock = std::chrono::steady_clock::now();
+            for (int s = 0; s < steps; ++s)
+                frame.run(jobs, &profiler);
+            double seconds = SecondsSince(clock);
+
+            std::cout << "  task graph, " << threads << (threads == 1 ? " worker:  " : " workers: ") << std::setprecision(4)
+                      << seconds / steps * 1000.0 << " ms / step, " << std::setprecision(3) << serialSeconds / seconds << "x, "
+                      << (HashWorld(w) == HashWorld(serial) && graphEnergy == energy ? "same state" : "STATE DIFFERS") << std::endl;
+            profiler.printReport(std::cout);
+        }
+        std::cout << std::endl;
+    }
+}
+
+// ===== NUMA placement =====
+
+// Worker -> CPU (node) under every pinning policy
+void PrintWorkerCpus(const NumaTopology &topology, unsigned workers)
+{
+    for (PinPolicy policy : {PinPolicy::Compact, PinPolicy::Scatter})
+    {
+        std::vector<int> cpus = AssignWorkerCpus(topology, workers, policy);
+        std::cout << "    " << std::left << std::setw(9) << PinPolicyName(policy) << std::right;
+        for (unsigned w = 0; w < workers; ++w)
+            std::cout << " " << w << ":" << cpus[w] << "(" << NodeOfCpu(topology, cpus[w]) << ")";
+        std::cout << std::endl;
+    }
+}
+
+// Wide belt with tree gravity, stepped with the world as CreateWorld() left it, after first
+// touch by the workers, and after first touch with pinned workers. Local pages is the share
+// of each worker's bodies that live on its own node.
+void BenchmarkNuma()
+{
+    const NumaTopology topology = DetectNumaTopology();
+    const unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "=== NUMA placement (" << topology.nodes() << (topology.nodes() == 1 ? " node, " : " nodes, ")
+              << topology.cpus() << " CPUs, " << workers << " workers) ===" << std::endl;
+    std::cout << "  worker:cpu(node)" << std::endl;
+    PrintWorkerCpus(topology, workers);
+    if (topology.nodes() == 1 && topology.cpus() > 1)
+    {
+        std::cout << "  pretend 2-node split of the same CPUs" << std::endl;
+        PrintWorkerCpus(SplitTopology(topology, 2), workers);
+    }
+
+    const int steps = 5;
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = 64000;
+    scenario.beltWidth = 6.0;
+    scenario.beltThickness = 1.0;
+    scenario.asteroidMassScale = 0.01;
+    const World initial = CreateWorld(scenario, 5);
+
+    std::cout << "  " << initial.size() << " bodies, tree gravity, " << steps << " steps" << std::endl;
+    std::cout << "  placement                     step [ms]   local pages   hash" << std::endl;
+    for (int variant = 0; variant < 3; ++variant)
+    {
+        ThreadPool pool(workers);
+        std::vector<int> nodes(pool.size(), 0);
+        if (variant == 2)
+        {
+            PinWorkers(pool, topology, PinPolicy::Compact);
+            std::vector<int> cpus = AssignWorkerCpus(topology, pool.size(), PinPolicy::Compact);
+            for (unsigned w = 0; w < pool.size(); ++w)
+                nodes[w] = NodeOfCpu(topology, cpus[w]);
+        }
+        SimulationSettings settings;
+        settings.treeGravity = true;
+        settings.coloredCollisions = true;
+        settings.firstTouch = variant > 0;
+        Simulator sim(initial, settings, &pool);
+
+        auto clock = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s)
+            sim.step(scenario.maxTimestep);
+        double seconds = SecondsSince(clock);
+
+        const char *names[] = {"creating thread", "first touch", "first touch + compact"};
+        std::cout << "  " << std::left << std::setw(26) << names[variant] << std::right
+                  << std::setw(13) << std::setprecision(4) << seconds / steps * 1000.0
+                  << std::setw(13) << std::setprecision(3) << LocalPageShare(sim.world, pool, nodes)
+                  << "   " << std::hex << HashWorld(sim.world) << std::dec << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+// ===== Morton ordering =====
+
+// Runs the same belt with and without Morton reordering and compares step and tree walk
+// times. Bodies are matched by World::id, since their slots differ between the runs.
+void BenchmarkMorton()
+{
+    std::cout << "=== Morton ordering (wide belt, 50000 asteroids, tree gravity) ===" << std::endl;
+    const int steps = 10;
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = 50000;
+    scenario.beltRadius = 22.0;
+    scenario.beltWidth = 20.0;
+    scenario.beltThickness = 4.0;
+    scenario.asteroidMassScale = 0.01;
+
+    SimulationSettings settings;
+    settings.coloredCollisions = true;
+    settings.treeGravity = true;
+    SimulationSettings sortedSettings = settings;
+    sortedSettings.mortonSort = true;
+    sortedSettings.mortonWalkTimings = true;
+
+    Simulator plain(CreateWorld(scenario, 7), settings);
+    Simulator sorted(CreateWorld(scenario, 7), sortedSettings);
+
+    std::cout << "Creation order: " << std::setprecision(3) << MortonSpread(plain.world, MortonCubeAround(plain.world))
+              << " of memory neighbours more than a coarse cell apart" << std::endl;
+
+    auto run = [&](Simulator &sim, double &walkSeconds)
+    {
+        walkSeconds = 0.0;
+        auto clock = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; ++s)
+        {
+            sim.step(scenario.maxTimestep);
+            walkSeconds += sim.octree().stats().walkSeconds;
+        }
+        return SecondsSince(clock);
+    };
+    double plainWalk, sortedWalk;
+    double plainSeconds = run(plain, plainWalk);
+    double sortedSeconds = run(sorted, sortedWalk);
+
+    double worst = 0.0;
+    for (uint32_t id = 0; id < plain.world.size(); ++id)
+    {
+        size_t a = plain.world.slot[id], b = sorted.world.slot[id];
+        worst = std::max({worst, std::fabs(plain.world.px[a] - sorted.world.px[b]),
+                          std::fabs(plain.world.py[a] - sorted.world.py[b]), std::fabs(plain.world.pz[a] - sorted.world.pz[b])});
+    }
+
+    const MortonStats &stats = sorted.mortonSorter().stats();
+    std::cout << "  order            step [ms]   walk [ms]   speedup" << std::endl;
+    std::cout << std::fixed << std::setprecision(2)
+              << "  creation   " << std::setw(15) << plainSeconds / steps * 1000.0 << std::setw(12) << plainWalk / steps * 1000.0
+              << std::setw(9) << 1.0 << "x" << std::endl
+              << "  Morton     " << std::setw(15) << sortedSeconds / steps * 1000.0 << std::setw(12) << sortedWalk / steps * 1000.0
+              << std::setw(9) << plainSeconds / sortedSeconds << "x" << std::endl
+              << "Sorts: " << stats.sorts << " in " << steps << " steps (" << stats.checks << " checks, last sort "
+              << stats.sortSeconds * 1000.0 << " ms, check interval now " << stats.checkInterval << ")" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << "Scattered neighbours: " << std::setprecision(3) << stats.sortedSpread << " after the last sort, "
+              << stats.spread << " at the last check"
+              << "; max |dx| vs. unsorted run by ID: " << std::setprecision(2) << worst << std::endl
+              << std::endl;
+}
+
+// ===== Remote viewers =====
+
+// A viewer process: attaches to the stream, decodes and interpolates at 60 Hz until killed
+void RunBenchmarkViewer(const std::string &segment)
+{
+    FrameBroadcast channel;
+    if (!channel.open(segment))
+        _exit(1);
+    ViewTimeline timeline;
+    ViewFrame frame;
+    ViewState state;
+    std::vector<unsigned char> bytes;
+    uint64_t newest = 0;
+    for (;;)
+    {
+        while (channel.readNext(newest, bytes, newest))
+            if (DecodeFrame(bytes, frame))
+                timeline.add(frame);
+        timeline.sample(ViewClock(), state);
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+}
+
+// Steps a belt and publishes a frame after every step with 0, 1 and 4 viewer processes
+// attached: the publisher's cost must not depend on them. Then checks what a viewer gets
+// back: quantization error and interpolation between two frames.
+void BenchmarkViewers()
+{
+    std::cout << "=== Remote viewers (frame stream in shared memory) ===" << std::endl;
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = 20000;
+    const World initial = CreateWorld(scenario, 11);
+    const int steps = 40;
+    const std::string segment = "/spaceengine-view-benchmark-" + std::to_string(getpid());
+
+    ViewPublishSettings publish;
+    publish.frameRate = 0.0; // Every step
+    publish.trailInterval = 1;
+    World last;
+    std::cout << "  " << initial.size() << " bodies, tree gravity, a frame after each of " << steps << " steps" << std::endl;
+    std::cout << "  viewers   step [ms]   publish [ms/frame]   frame [KiB]   world [KiB]" << std::endl;
+    for (int viewers : {0, 1, 4})
+    {
+        FramePublisher publisher(publish);
+        UnlinkSharedSegment(segment);
+        if (!publisher.start(segment, initial.size()))
+        {
+            std::cout << "  shared memory not available here" << std::endl;
+            return;
+        }
+        std::vector<pid_t> children;
+        for (int v = 0; v < viewers; ++v)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+                RunBenchmarkViewer(segment);
+            children.push_back(pid);
+        }
+        while (publisher.channel().viewers() < (unsigned)viewers)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        SimulationSettings settings;
+        settings.treeGravity = true;
+        settings.coloredCollisions = true;
+        Simulator sim(initial, settings);
+        double stepSeconds = 0.0;
+        for (int s = 0; s < steps; ++s)
+        {
+            auto clock = std::chrono::steady_clock::now();
+            sim.step(scenario.maxTimestep);
+            stepSeconds += SecondsSince(clock);
+            publisher.afterStep(sim.world);
+        }
+
+        for (pid_t pid : children)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        size_t worldBytes = initial.size() * (11 * sizeof(double) + 3 * sizeof(float) + 1 + 2 * sizeof(uint32_t));
+        std::cout << std::setw(9) << viewers << std::setw(12) << std::setprecision(4) << stepSeconds / steps * 1000.0
+                  << std::setw(21) << publisher.publishSeconds() / publisher.frames() * 1000.0
+                  << std::setw(14) << publisher.lastFrameBytes() / 1024 << std::setw(14) << worldBytes / 1024 << std::endl;
+        publisher.stop();
+        last = sim.world;
+    }
+
+    // What arrives: every body back within half a quantum, and halfway between two frames
+    // exactly the average of both
+    std::vector<unsigned char> bytes;
+    ViewFrame a, b;
+    EncodeFrame(initial, {}, 1, 0.0, bytes);
+    DecodeFrame(bytes, a);
+    EncodeFrame(last, {}, 2, 1.0, bytes);
+    DecodeFrame(bytes, b);
+    double worstError = 0.0;
+    for (size_t i = 0; i < b.size(); ++i)
+    {
+        size_t k = last.slot[b.id[i]];
+        worstError = std::max({worstError, std::fabs(b.x[i] - last.px[k]), std::fabs(b.y[i] - last.py[k]), std::fabs(b.z[i] - last.pz[k])});
+    }
+    ViewTimeline timeline(0.0);
+    timeline.add(a);
+    timeline.add(b);
+    ViewState state;
+    timeline.sample(0.5, state);
+    double worstMidpoint = 0.0;
+    for (size_t i = 0; i < state.size(); ++i)
+    {
+        size_t k = initial.slot[state.id[i]]; // 'a' is in the initial order
+        worstMidpoint = std::max(worstMidpoint, (double)std::fabs(state.x[i] - 0.5f * (a.x[k] + b.x[i])));
+    }
+    if (std::thread::hardware_concurrency() < 5)
+        std::cout << "  (" << std::thread::hardware_concurrency() << " CPUs: the viewers take turns with the simulation on them)" << std::endl;
+    std::cout << "  max position error " << std::setprecision(3) << worstError << " (quantum " << b.quantum
+              << "), max midpoint error " << worstMidpoint << std::endl;
+    std::cout << std::endl;
+}
+
+// ===== CPU dispatch =====
+
+// Runs 'kernel' at every level the CPU supports and prints time per call and speedup
+// over the baseline build. 'kernel' gets the level and must reset its own inputs.
+void TimeKernelLevels(const char *name, const std::function<void(CpuLevel)> &kernel, int calls)
+{
+    double baseline = 0.0;
+    for (CpuLevel level : {CpuLevel::Baseline, CpuLevel::SSE42, CpuLevel::AVX2, CpuLevel::AVX512})
+    {
+        if (level > DetectCpuLevel())
+            break;
+        kernel(level); // Warm up
+        auto clock = std::chrono::steady_clock::now();
+        for (int c = 0; c < calls; ++c)
+            kernel(level);
+        double perCall = SecondsSince(clock) / calls;
+        if (level == CpuLevel::Baseline)
+            baseline = perCall;
+
+        std::cout << "  " << std::left << std::setw(24) << name << std::setw(10) << CpuLevelName(level) << std::right
+                  << std::setw(12) << std::setprecision(1) << std::fixed << perCall * 1e6 << " us"
+                  << std::setw(10) << std::setprecision(2) << baseline / perCall << "x" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+}
+
+// Times each dispatched kernel variant directly, bypassing the cached selection
+void BenchmarkDispatch()
+{
+    std::cout << "=== CPU dispatch (per-variant kernel timings) ===" << std::endl;
+    std::cout << "  kernel                  level       time / call   speedup" << std::endl;
+
+    // Gravity: all bodies of a 4000 asteroid belt, FORCE_LANES at a time
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = 4000;
+    World world = CreateWorld(scenario, 7);
+    const size_t n = world.size();
+    TimeKernelLevels("force lanes", [&](CpuLevel level)
+                     {
+                         ForceLanesKernelFunction kernel = ForceLanesKernelVariant(level);
+                         std::fill(world.ax.begin(), world.ax.end(), 0.0);
+                         std::fill(world.ay.begin(), world.ay.end(), 0.0);
+                         std::fill(world.az.begin(), world.az.end(), 0.0);
+                         for (size_t i = 0; i + FORCE_LANES <= n; i += FORCE_LANES)
+                             kernel(0, n, i, world.px.data(), world.py.data(), world.pz.data(), world.mass.data(), world.radius.data(),
+                                    world.G, world.minDistanceFactor, world.softening, world.ax.data(), world.ay.data(), world.az.data()); },
+                     3);
+
+    // Euler step on a copy so the world doesn't drift away between calls
+    World moving = world;
+    TimeKernelLevels("euler", [&](CpuLevel level)
+                     { EulerKernelVariant(level)(n, moving.fixed.data(), moving.px.data(), moving.py.data(), moving.pz.data(),
+                                                 moving.vx.data(), moving.vy.data(), moving.vz.data(),
+                                                 world.ax.data(), world.ay.data(), world.az.data(), 1e-6); },
+                     2000);
+
+    // Kepler drift of the same belt around the Sun
+    const size_t count = n - 1;
+    std::vector<double> orbit(6 * count), drifted(6 * count);
+    for (size_t k = 0; k < count; ++k)
+    {
+        orbit[k] = world.px[k + 1] - world.px[0];
+        orbit[count + k] = world.py[k + 1] - world.py[0];
+        orbit[2 * count + k] = world.pz[k + 1] - world.pz[0];
+        orbit[3 * count + k] = world.vx[k + 1];
+        orbit[4 * count + k] = world.vy[k + 1];
+        orbit[5 * count + k] = world.vz[k + 1];
+    }
+    const double mu = world.G * world.mass[0];
+    TimeKernelLevels("kepler drift", [&](CpuLevel level)
+                     {
+                         drifted = orbit;
+                         double *d = drifted.data();
+                         KeplerDriftKernelVariant(level)(count, mu, scenario.maxTimestep, d, d + count, d + 2 * count,
+                                                         d + 3 * count, d + 4 * count, d + 5 * count); },
+                     200);
+
+    // Ensemble rows: one body pair across a wide ensemble
+    const int M = 4096;
+    std::vector<float> row(16 * M, 1.0f), mj(M, 1e-3f);
+    for (int m = 0; m < M; ++m)
+        row[3 * M + m] = 2.0f + 1e-4f * m; // xj, so the bodies are apart
+    float *r = row.data();
+    TimeKernelLevels("ensemble force row", [&](CpuLevel level)
+                     { EnsembleForceRowVariant(level)(r, r + M, r + 2 * M, r + 6 * M, r + 7 * M, r + 8 * M, r + 3 * M,
+                                                      r + 4 * M, r + 5 * M, mj.data(), 1.0f, 0.01f, M); },
+                     20000);
+    std::vector<float> pair(12 * M, 0.0f);
+    std::vector<int> hits(M, 0);
+    TimeKernelLevels("ensemble collision row", [&](CpuLevel level)
+                     {
+                         // Overlapping and approaching in every member, so each lane takes the full path
+                         for (int m = 0; m < M; ++m)
+                         {
+                             pair[m] = 0.0f;
+                             pair[3 * M + m] = 0.05f;
+                             pair[6 * M + m] = 1.0f;
+                             pair[9 * M + m] = -1.0f;
+                         }
+                         float *p = pair.data();
+                         EnsembleCollisionRowVariant(level)(p, p + M, p + 2 * M, p + 3 * M, p + 4 * M, p + 5 * M, p + 6 * M,
+                                                            p + 7 * M, p + 8 * M, p + 9 * M, p + 10 * M, p + 11 * M, mj.data(),
+                                                            mj.data(), hits.data(), 0.1f, false, false, 0.8f, 0.5f, M); },
+                     5000);
+    TimeKernelLevels("ensemble integrate", [&](CpuLevel level)
+                     { EnsembleIntegrateRowVariant(level)(r + 9 * M, r + 10 * M, r + 11 * M, r + 12 * M, r + 13 * M,
+                                                          r + 14 * M, r, r + M, r + 2 * M, 1e-6f, M); },
+                     20000);
+}
+
+int main(int argc, char **argv)
+{
+    struct Section
+    {
+        const char *name;
+        std::function<void()> run;
+    };
+    std::vector<Section> sections = {
+        {"ensemble", BenchmarkEnsemble},
+        {"collisions", BenchmarkCollisions},
+        {"kepler", BenchmarkKepler},
+        {"precision", BenchmarkPrecision},
+        {"tiling", BenchmarkTiling},
+        {"tree", BenchmarkTree},
+        {"multipoles", BenchmarkMultipoles},
+        {"encounters", BenchmarkEncounters},
+        {"integrators", BenchmarkIntegrators},
+        {"orbits", BenchmarkOrbits},
+        {"timewarp", BenchmarkTimeWarp},
+        {"jobs", BenchmarkJobs},
+        {"numa", BenchmarkNuma},
+        {"morton", BenchmarkMorton},
+        {"viewers", BenchmarkViewers},
+        {"dispatch", BenchmarkDispatch},
+    };
+
+    LogCpuDispatch(std::cout);
+    for (const auto &section : sections)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::string(argv[i]) == section.name;
+        if (selected)
+            section.run();
+    }
+    return 0;
+}
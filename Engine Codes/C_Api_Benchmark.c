@@ -0,0 +1,176 @@
+//
+//  C_Api_Benchmark.c
+//  SpaceEngine
+//
+//  Plain C client of the shared library (Space_Engine_C.h). Checks that bulk adds, split
+//  and batched stepping and the zero-copy state views agree, and measures what crossing the
+//  library boundary once per se_step() call costs next to the physics of a step.
+//
+//      ./C_Api_Benchmark
+//      ./C_Api_Benchmark 5000 200           Asteroids and steps for the per-step comparison
+//
+//  Build (after libspaceengine.so, see Space_Engine_C.cpp):
+//      cc -std=c99 -O2 -I"Engine Codes" "Engine Codes/C_Api_Benchmark.c" -L. -lspaceengine -Wl,-rpath,. -lm -o c_api_benchmark
+//
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "Space_Engine_C.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int Check(se_status status, const char *what)
+{
+    if (status != SE_OK)
+        fprintf(stderr, "%s failed: %s\n", what, se_status_string(status));
+    return status == SE_OK;
+}
+
+// A sun and 'count' light bodies on circular orbits, added in one call
+static se_world *CreateRing(size_t count)
+{
+    se_config config;
+    se_default_config(&config);
+    se_world *world = NULL;
+    if (!Check(se_create(&config, &world), "se_create"))
+        return NULL;
+
+    size_t n = count + 1;
+    double *values = (double *)calloc(n * 8, sizeof(double));
+    if (!values)
+    {
+        se_destroy(world);
+        return NULL;
+    }
+    se_body_arrays arrays = {0};
+    double *px = values, *py = values + n, *pz = values + 2 * n;
+    double *vx = values + 3 * n, *vy = values + 4 * n, *vz = values + 5 * n;
+    double *mass = values + 6 * n, *radius = values + 7 * n;
+
+    mass[0] = 1000.0;
+    radius[0] = 1.0;
+    for (size_t i = 1; i < n; ++i)
+    {
+        double angle = 6.283185307179586 * (double)i / (double)count;
+        double r = 10.0 + 0.01 * (double)(i % 97);
+        double speed = sqrt(config.G * mass[0] / r);
+        px[i] = r * cos(angle);
+        pz[i] = r * sin(angle);
+        vx[i] = -speed * sin(angle);
+        vz[i] = speed * cos(angle);
+        mass[i] = 1e-6;
+        radius[i] = 0.001;
+    }
+    arrays.px = px, arrays.py = py, arrays.pz = pz;
+    arrays.vx = vx, arrays.vy = vy, arrays.vz = vz;
+    arrays.mass = mass, arrays.radius = radius;
+
+    uint32_t first = 0;
+    int ok = Check(se_add_bodies(world, n, &arrays, &first), "se_add_bodies") && first == 0 &&
+             se_body_count(world) == n;
+    free(values);
+    if (!ok)
+    {
+        se_destroy(world);
+        return NULL;
+    }
+    return world;
+}
+
+int main(int argc, char **argv)
+{
+    int asteroids = argc > 1 ? atoi(argv[1]) : 2000;
+    int physicsSteps = argc > 2 ? atoi(argv[2]) : 200;
+    const int tinySteps = 200000;
+    const double dt = 0.001;
+    int pass = 1;
+
+    printf("=== C API ===\n");
+    printf("API version %d (header %d)\n", se_api_version(), SE_API_VERSION);
+
+    // ===== Bulk add and zero-copy views =====
+    se_world *ring = CreateRing(1000);
+    if (!ring)
+        return 1;
+    double energyBefore = se_total_energy(ring);
+    if (!Check(se_step(ring, dt, 1000, NULL), "se_step"))
+        return 1;
+    const double *px = NULL, *py = NULL, *pz = NULL;
+    const double *vx = NULL, *vy = NULL, *vz = NULL;
+    se_positions(ring, &px, &py, &pz);
+    se_velocities(ring, &vx, &vy, &vz);
+    const uint32_t *ids = se_ids(ring);
+    double worst = 0.0;
+    for (size_t i = 0; i < se_body_count(ring); ++i)
+    {
+        if (ids[i] == 0)
+            continue;
+        double r = sqrt(px[i] * px[i] + py[i] * py[i] + pz[i] * pz[i]);
+        double expected = 10.0 + 0.01 * (double)(ids[i] % 97);
+        worst = fabs(r - expected) > worst ? fabs(r - expected) : worst;
+    }
+    double drift = fabs((se_total_energy(ring) - energyBefore) / energyBefore);
+    int ringOk = worst < 0.05 && drift < 1e-4; // Still on their orbits (default integrator, self-gravity on)
+    printf("Ring of 1000 added in one call, 1000 steps: orbit radius error %.2e, energy drift %.2e %s\n", worst,
+           drift, ringOk ? "PASS" : "FAIL");
+    pass &= ringOk;
+
+    se_status bad = se_step(ring, -1.0, 1, NULL);
+    printf("Negative dt rejected: %s %s\n", se_status_string(bad), bad == SE_INVALID_ARGUMENT ? "PASS" : "FAIL");
+    pass &= bad == SE_INVALID_ARGUMENT;
+    se_destroy(ring);
+
+    // ===== Call overhead on a two-body world =====
+    // Nearly all of a step here is the call itself, so this is the worst case
+    se_world *batched = CreateRing(1);
+    se_world *single = CreateRing(1);
+    if (!batched || !single)
+        return 1;
+    double start = Now();
+    se_step(batched, dt, tinySteps, NULL);
+    double batchedSeconds = Now() - start;
+    start = Now();
+    for (int i = 0; i < tinySteps; ++i)
+        se_step(single, dt, 1, NULL);
+    double singleSeconds = Now() - start;
+    double overheadNs = (singleSeconds - batchedSeconds) / tinySteps * 1e9;
+    int sameState = se_hash(batched) == se_hash(single);
+    printf("Two bodies, %d steps: one call %.3f s, one call per step %.3f s, overhead %.1f ns per call\n",
+           tinySteps, batchedSeconds, singleSeconds, overheadNs);
+    printf("Same state either way: %s\n", sameState ? "PASS" : "FAIL");
+    pass &= sameState;
+    se_destroy(batched);
+    se_destroy(single);
+
+    // ===== Against a real step =====
+    se_world *belt = NULL;
+    if (!Check(se_create_scenario("fast", 42, asteroids, NULL, &belt), "se_create_scenario"))
+        return 1;
+    start = Now();
+    for (int i = 0; i < physicsSteps; ++i)
+    {
+        se_step(belt, dt, 1, NULL);
+        se_positions(belt, &px, &py, &pz); // What a per-frame reader would do
+    }
+    double stepSeconds = (Now() - start) / physicsSteps;
+    double share = overheadNs > 0.0 ? overheadNs * 1e-9 / stepSeconds : 0.0;
+    printf("Fast scenario, %zu bodies: %.3f ms per step, call overhead %.5f%% of it\n", se_body_count(belt),
+           stepSeconds * 1000.0, share * 100.0);
+    int negligible = share < 0.01;
+    printf("Overhead below 1%%: %s\n", negligible ? "PASS" : "FAIL");
+    pass &= negligible;
+    se_destroy(belt);
+
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
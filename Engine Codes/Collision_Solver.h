@@ -0,0 +1,232 @@
+//
+//  Collision_Solver.h
+//  SpaceEngine
+//
+//  Broad phase plus a parallel contact solver for the headless World.
+//
+//  ResolveWorldCollision() moves and changes the velocity of both bodies, so two pairs
+//  that share a body can't be resolved at the same time. The solver therefore:
+//
+//    1. finds every overlapping pair with sort-and-sweep along x,
+//    2. colours the pairs greedily so that no two pairs of one colour share a movable body,
+//    3. resolves one colour after the other, each colour in parallel on the pool,
+//    4. repeats the whole sweep a few times so stacked contacts settle.
+//
+//  The colouring depends only on the pair list (sorted by body index), never on the
+//  thread count, so the result is just as reproducible as the serial loop. It is not
+//  bit-identical to the serial (i, j) loop though, because chained contacts are
+//  resolved in a different order; Benchmark.cpp measures the difference.
+//
+//  All buffers are step-local and come from StepArenas (Arena.h), so a sub-step does no
+//  heap allocation once the arenas have grown to the working size.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Thread_Pool.h"
+#include "Arena.h"
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+// Two bodies whose spheres overlap, a < b
+struct ContactPair
+{
+    uint32_t a, b;
+};
+
+// Contact pairs reordered by colour; batch k is pairs[batchStart[k] .. batchStart[k + 1])
+struct ContactBatches
+{
+    ArenaVector<ContactPair> pairs;
+    ArenaVector<size_t> batchStart;
+    size_t overflowStart = 0; // Pairs from here on could not be coloured and run serially
+
+    explicit ContactBatches(Arena &arena) : pairs(ArenaAllocator<ContactPair>(arena)), batchStart(ArenaAllocator<size_t>(arena)) {}
+
+    size_t batchCount() const { return batchStart.empty() ? 0 : batchStart.size() - 1; }
+};
+
+// Pairs one sweep block found, stored in the arena of the worker that ran the block
+struct BlockPairs
+{
+    const ContactPair *pairs = nullptr;
+    size_t count = 0;
+};
+
+// Step-local buffers of the solver. Build one per sub-step after StepArenas::resetAll().
+struct CollisionScratch
+{
+    StepArenas &arenas;
+    ArenaVector<uint32_t> order;        // Bodies sorted by the left edge of their sphere
+    ArenaVector<BlockPairs> blockPairs; // Pairs found by each sweep block
+    ArenaVector<ContactPair> pairs;
+    ArenaVector<uint64_t> usedColours; // Per body bit mask of the colours already touching it
+    ArenaVector<uint32_t> pairColour;
+    ArenaVector<size_t> colourCount;
+    ContactBatches batches;
+
+    explicit CollisionScratch(StepArenas &a)
+        : arenas(a),
+          order(ArenaAllocator<uint32_t>(a.worker(0))),
+          blockPairs(ArenaAllocator<BlockPairs>(a.worker(0))),
+          pairs(ArenaAllocator<ContactPair>(a.worker(0))),
+          usedColours(ArenaAllocator<uint64_t>(a.worker(0))),
+          pairColour(ArenaAllocator<uint32_t>(a.worker(0))),
+          colourCount(ArenaAllocator<size_t>(a.worker(0))),
+          batches(a.worker(0))
+    {
+    }
+};
+
+// Sort-and-sweep broad phase plus exact sphere test. The pairs come out sorted by (a, b).
+inline void FindContactPairs(const World &w, CollisionScratch &scratch, ThreadPool *pool = nullptr)
+{
+    const size_t n = w.size();
+    ArenaVector<uint32_t> &order = scratch.order;
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t l, uint32_t r)
+              {
+                  double left = w.px[l] - w.radius[l], right = w.px[r] - w.radius[r];
+                  return left < right || (left == right && l < r); });
+
+    // Every block of the sorted list sweeps forward on its own. Arenas aren't thread-safe,
+    // so without one arena per worker the sweep stays on this thread.
+    const size_t block = 256;
+    const size_t blocks = (n + block - 1) / block;
+    scratch.blockPairs.assign(blocks, BlockPairs());
+    if (!scratch.arenas.covers(pool))
+        pool = nullptr;
+
+    auto sweepBlock = [&](size_t b)
+    {
+        // The vector only borrows the worker's arena; its storage stays valid after it goes
+        // out of scope because arena memory is only reclaimed by reset()
+        ArenaVector<ContactPair> found{ArenaAllocator<ContactPair>(scratch.arenas.local())};
+        for (size_t k = b * block; k < std::min(n, (b + 1) * block); ++k)
+        {
+            uint32_t i = order[k];
+            double rightEdge = w.px[i] + w.radius[i];
+            for (size_t m = k + 1; m < n; ++m)
+            {
+                uint32_t j = order[m];
+                if (w.px[j] - w.radius[j] > rightEdge)
+                    break;
+
+                double dx = w.px[j] - w.px[i];
+                double dy = w.py[j] - w.py[i];
+                double dz = w.pz[j] - w.pz[i];
+                double reach = w.radius[i] + w.radius[j];
+                if (dx * dx + dy * dy + dz * dz < reach * reach)
+                    found.push_back({std::min(i, j), std::max(i, j)});
+            }
+        }
+        scratch.blockPairs[b] = {found.data(), found.size()};
+    };
+
+    if (pool)
+        pool->parallelFor(blocks, sweepBlock);
+    else
+        for (size_t b = 0; b < blocks; ++b)
+            sweepBlock(b);
+
+    size_t total = 0;
+    for (const auto &found : scratch.blockPairs)
+        total += found.count;
+    scratch.pairs.clear();
+    scratch.pairs.reserve(total);
+    for (const auto &found : scratch.blockPairs)
+        scratch.pairs.insert(scratch.pairs.end(), found.pairs, found.pairs + found.count);
+    std::sort(scratch.pairs.begin(), scratch.pairs.end(), [](const ContactPair &l, const ContactPair &r)
+              { return l.a < r.a || (l.a == r.a && l.b < r.b); });
+}
+
+// Greedy colouring: each pair takes the lowest colour that neither of its movable bodies
+// uses yet. Fixed bodies are never written by the solver, so they don't block colours.
+// Bodies in more than 64 contacts at once spill into a serial overflow batch.
+inline void ColorContacts(const World &w, CollisionScratch &scratch)
+{
+    const size_t pairCount = scratch.pairs.size();
+    scratch.usedColours.assign(w.size(), 0);
+    scratch.pairColour.resize(pairCount);
+    scratch.colourCount.assign(65, 0); // Slot 64 is the overflow
+
+    for (size_t p = 0; p < pairCount; ++p)
+    {
+        const ContactPair &pair = scratch.pairs[p];
+        uint64_t used = (w.fixed[pair.a] ? 0 : scratch.usedColours[pair.a]) |
+                        (w.fixed[pair.b] ? 0 : scratch.usedColours[pair.b]);
+
+        uint32_t colour = 64;
+        if (~used != 0)
+        {
+            colour = (uint32_t)__builtin_ctzll(~used); // Lowest free colour
+            scratch.usedColours[pair.a] |= 1ULL << colour;
+            scratch.usedColours[pair.b] |= 1ULL << colour;
+        }
+        scratch.pairColour[p] = colour;
+        scratch.colourCount[colour]++;
+    }
+
+    // Counting sort by colour, keeps the (a, b) order inside each batch
+    ContactBatches &batches = scratch.batches;
+    batches.batchStart.clear();
+    size_t next[65] = {};
+    size_t offset = 0;
+    for (uint32_t c = 0; c < 64; ++c)
+    {
+        if (scratch.colourCount[c] == 0)
+            break; // Greedy colours are contiguous from 0
+        batches.batchStart.push_back(offset);
+        next[c] = offset;
+        offset += scratch.colourCount[c];
+    }
+    batches.batchStart.push_back(offset);
+    batches.overflowStart = offset;
+    next[64] = offset;
+
+    batches.pairs.resize(pairCount);
+    for (size_t p = 0; p < pairCount; ++p)
+        batches.pairs[next[scratch.pairColour[p]]++] = scratch.pairs[p];
+}
+
+// Resolves all contacts 'iterations' times, one colour batch at a time, each batch in
+// parallel. Returns the number of pairs found in contact at the start of the step.
+inline int SolveCollisions(World &w, CollisionScratch &scratch, int iterations, ThreadPool *pool = nullptr)
+{
+    FindContactPairs(w, scratch, pool);
+    ColorContacts(w, scratch);
+
+    const ContactBatches &batches = scratch.batches;
+    const size_t grain = 64;
+
+    for (int iteration = 0; iteration < std::max(1, iterations); ++iteration)
+    {
+        for (size_t k = 0; k < batches.batchCount(); ++k)
+        {
+            size_t begin = batches.batchStart[k], end = batches.batchStart[k + 1];
+            size_t chunks = (end - begin + grain - 1) / grain;
+            auto resolveChunk = [&](size_t c)
+            {
+                for (size_t p = begin + c * grain; p < std::min(end, begin + (c + 1) * grain); ++p)
+                    ResolveWorldCollision(w, batches.pairs[p].a, batches.pairs[p].b);
+            };
+
+            if (pool && chunks > 1)
+                pool->parallelFor(chunks, resolveChunk);
+            else
+                for (size_t c = 0; c < chunks; ++c)
+                    resolveChunk(c);
+        }
+
+        // Pathological pile-ups, one at a time
+        for (size_t p = batches.overflowStart; p < batches.pairs.size(); ++p)
+            ResolveWorldCollision(w, batches.pairs[p].a, batches.pairs[p].b);
+    }
+
+    return (int)scratch.pairs.size();
+}
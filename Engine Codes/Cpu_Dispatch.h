@@ -0,0 +1,166 @@
+//
+//  Cpu_Dispatch.h
+//  SpaceEngine
+//
+//  Runtime selection between ISA variants of the hot kernels.
+//
+//  The tools are built without -march flags so one binary runs everywhere, which on x86
+//  means SSE2 code only. DISPATCHED_KERNEL(Name, (params), (args)) compiles Name##Body
+//  (an always-inline function with the actual loop) four times, for baseline, SSE4.2,
+//  AVX2+FMA and AVX-512, and defines Name() which calls the best variant the CPU supports.
+//  The choice is made once from cpuid and can be lowered for testing with
+//
+//      SPACE_ENGINE_CPU=baseline|sse4.2|avx2|avx512 ./Benchmark
+//
+//  Only x86 with GCC or Clang gets the extra variants. Elsewhere (the default task in
+//  tasks.json builds for arm64 macOS, where NEON is already the baseline) every level
+//  maps to the plain build.
+//
+//  The AVX2 and AVX-512 variants could contract a * b + c into FMA, which changes the last
+//  bits of a result, so every level would hash differently. With GCC the kernels turn
+//  contraction off themselves (KERNEL_FP_STRICT); Clang only contracts within one expression
+//  but still needs -ffp-contract=off, like the "build headless tool" task and Deterministic_Run,
+//  for identical bits on every machine.
+//
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SPACE_ENGINE_X86_DISPATCH 1
+#define CPU_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma"))) KERNEL_FP_STRICT
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx512dq,avx2,fma"))) KERNEL_FP_STRICT
+#else
+#define SPACE_ENGINE_X86_DISPATCH 0
+#endif
+
+// No FMA contraction in the kernels, whatever -ffp-contract the tool was built with.
+// Clang has no such attribute (see the top of this file).
+#if defined(__GNUC__) && !defined(__clang__)
+#define KERNEL_FP_STRICT __attribute__((optimize("fp-contract=off")))
+#else
+#define KERNEL_FP_STRICT
+#endif
+
+// Kernel bodies must be inlined into each variant, otherwise all variants would call
+// one shared baseline copy
+#define KERNEL_INLINE inline __attribute__((always_inline)) KERNEL_FP_STRICT
+
+enum class CpuLevel
+{
+    Baseline,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+inline const char *CpuLevelName(CpuLevel level)
+{
+    switch (level)
+    {
+    case CpuLevel::SSE42:
+        return "sse4.2";
+    case CpuLevel::AVX2:
+        return "avx2";
+    case CpuLevel::AVX512:
+        return "avx512";
+    default:
+        return "baseline";
+    }
+}
+
+// Best level this CPU (and OS) supports
+inline CpuLevel DetectCpuLevel()
+{
+#if SPACE_ENGINE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq"))
+        return CpuLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return CpuLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return CpuLevel::SSE42;
+#endif
+    return CpuLevel::Baseline;
+}
+
+// Parses a level name as printed by CpuLevelName(), returns false if unknown
+inline bool ParseCpuLevel(const std::string &name, CpuLevel &out)
+{
+    for (CpuLevel level : {CpuLevel::Baseline, CpuLevel::SSE42, CpuLevel::AVX2, CpuLevel::AVX512})
+    {
+        if (name == CpuLevelName(level))
+        {
+            out = level;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Level the kernels run at: the detected one, lowered by SPACE_ENGINE_CPU if set
+inline CpuLevel SelectedCpuLevel()
+{
+    static const CpuLevel selected = []
+    {
+        CpuLevel level = DetectCpuLevel();
+        CpuLevel requested;
+        const char *requestedName = std::getenv("SPACE_ENGINE_CPU");
+        if (requestedName && ParseCpuLevel(requestedName, requested) && requested < level)
+            level = requested;
+        return level;
+    }();
+    return selected;
+}
+
+// The startup line every tool prints
+inline void LogCpuDispatch(std::ostream &out)
+{
+    const char *requestedName = std::getenv("SPACE_ENGINE_CPU");
+    out << "CPU dispatch: " << CpuLevelName(SelectedCpuLevel()) << " kernels (detected "
+        << CpuLevelName(DetectCpuLevel()) << (requestedName ? ", SPACE_ENGINE_CPU=" : "")
+        << (requestedName ? requestedName : "") << ")" << std::endl;
+}
+
+// Defines Name##Baseline/SSE42/AVX2/AVX512 around Name##Body, Name##Variant(level) and the
+// dispatching Name(). Params and Args are parenthesised lists, e.g. (int n, float *x), (n, x).
+#if SPACE_ENGINE_X86_DISPATCH
+#define DISPATCHED_KERNEL(Name, Params, Args)                             \
+    inline void Name##Baseline Params { Name##Body Args; }                \
+    CPU_TARGET_SSE42 inline void Name##SSE42 Params { Name##Body Args; }  \
+    CPU_TARGET_AVX2 inline void Name##AVX2 Params { Name##Body Args; }    \
+    CPU_TARGET_AVX512 inline void Name##AVX512 Params { Name##Body Args; } \
+    using Name##Function = void(*) Params;                                \
+    inline Name##Function Name##Variant(CpuLevel level)                   \
+    {                                                                     \
+        switch (level)                                                    \
+        {                                                                 \
+        case CpuLevel::AVX512:                                            \
+            return Name##AVX512;                                          \
+        case CpuLevel::AVX2:                                              \
+            return Name##AVX2;                                            \
+        case CpuLevel::SSE42:                                             \
+            return Name##SSE42;                                           \
+        default:                                                          \
+            return Name##Baseline;                                        \
+        }                                                                 \
+    }                                                                     \
+    inline void Name Params                                               \
+    {                                                                     \
+        static const Name##Function selected = Name##Variant(SelectedCpuLevel()); \
+        selected Args;                                                    \
+    }
+#else
+#define DISPATCHED_KERNEL(Name, Params, Args)                 \
+    inline void Name##Baseline Params { Name##Body Args; }    \
+    using Name##Function = void(*) Params;                    \
+    inline Name##Function Name##Variant(CpuLevel)             \
+    {                                                         \
+        return Name##Baseline;                                \
+    }                                                         \
+    inline void Name Params { Name##Body Args; }
+#endif
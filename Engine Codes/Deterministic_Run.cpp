@@ -0,0 +1,184 @@
+//
+//  Deterministic_Run.cpp
+//  SpaceEngine
+//
+//  Runs one headless scenario with 1, 2, ... N threads and checks that the final state
+//  hashes identically every time. Exits with status 1 if any hash differs (or differs
+//  from --expect), so it can run unattended in CI before comparing performance changes.
+//
+//      ./Deterministic_Run --scenario fast --seed 42 --steps 500 --asteroids 200 --threads 8
+//      ./Deterministic_Run --expect 9f3c1a2b4d5e6f70   Also compare against a known hash
+//      ./Deterministic_Run --colored                   Check the parallel coloured contact solver
+//      ./Deterministic_Run --kepler                    Check the Kepler / N-body hybrid
+//      ./Deterministic_Run --mixed | --mixed-kahan     Check the float pair-term force kernels
+//      ./Deterministic_Run --tree                      Check Barnes-Hut gravity with tree refits
+//      ./Deterministic_Run --morton                    Check with periodic Morton reordering of the bodies
+//      ./Deterministic_Run --softening plummer|spline  Use a smooth softening kernel instead of the clamp
+//      ./Deterministic_Run --encounters                Check sub-cycling of close pairs
+//      ./Deterministic_Run --integrator rk4            Use another integrator than Euler (see Integrators.h)
+//      ./Deterministic_Run --first-touch --pin compact Workers place their own bodies and run pinned (see Numa.h)
+//
+//  Build: clang++ -std=c++17 -O3 -ffp-contract=off -pthread -I"Engine Codes" "Engine Codes/Deterministic_Run.cpp" -o deterministic_run
+//
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Thread_Pool.h"
+#include "Numa.h"
+#include "Cpu_Dispatch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+// Runs the scenario on 'threads' workers and returns the hash of the final state
+uint64_t RunAndHash(const Scenario &s, uint64_t seed, long long steps, unsigned threads, bool kahan,
+                    ForcePrecision precision, const SimulationSettings &settings, PinPolicy pin, long long &collisions)
+{
+    ThreadPool pool(threads);
+    if (pin != PinPolicy::None)
+        PinWorkers(pool, DetectNumaTopology(), pin);
+    Simulator sim(CreateWorld(s, seed), settings, &pool);
+    sim.world.compensatedSummation = kahan;
+    sim.world.forcePrecision = precision;
+
+    collisions = 0;
+    for (long long step = 0; step < steps; ++step)
+        collisions += sim.step(s.maxTimestep);
+    return HashWorld(sim.world);
+}
+
+std::string HashToString(uint64_t hash)
+{
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return out.str();
+}
+
+int main(int argc, char **argv)
+{
+    std::string scenarioName = "fast";
+    uint64_t seed = 42;
+    long long steps = 500;
+    int asteroids = 200;
+    unsigned maxThreads = std::max(4u, std::thread::hardware_concurrency());
+    bool kahan = false;
+    ForcePrecision precision = ForcePrecision::Double;
+    SimulationSettings settings;
+    Softening softening = Softening::Clamp;
+    PinPolicy pin = PinPolicy::None;
+    std::string expected;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue)
+            scenarioName = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--steps" && hasValue)
+            steps = std::atoll(argv[++i]);
+        else if (arg == "--asteroids" && hasValue)
+            asteroids = std::atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            maxThreads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--kahan")
+            kahan = true;
+        else if (arg == "--mixed")
+            precision = ForcePrecision::MixedDouble;
+        else if (arg == "--mixed-kahan")
+            precision = ForcePrecision::MixedKahan;
+        else if (arg == "--colored")
+            settings.coloredCollisions = true;
+        else if (arg == "--kepler")
+            settings.keplerHybrid = true;
+        else if (arg == "--tree")
+            settings.treeGravity = true;
+        else if (arg == "--morton")
+            settings.mortonSort = true;
+        else if (arg == "--softening" && hasValue)
+        {
+            if (!ParseSoftening(argv[++i], softening))
+            {
+                std::cerr << "Unknown softening '" << argv[i] << "' (use clamp, plummer or spline)" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--encounters")
+            settings.encounterSubcycling = true;
+        else if (arg == "--integrator" && hasValue)
+        {
+            if (!ParseIntegrator(argv[++i], settings.integrator))
+            {
+                std::cerr << "Unknown integrator '" << argv[i] << "' (use euler, leapfrog, yoshida, rk4, wh, kepler or ias15)" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--first-touch")
+            settings.firstTouch = true;
+        else if (arg == "--pin" && hasValue)
+        {
+            if (!ParsePinPolicy(argv[++i], pin))
+            {
+                std::cerr << "Unknown pinning policy '" << argv[i] << "' (use none, compact or scatter)" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--expect" && hasValue)
+            expected = argv[++i];
+        else
+        {
+            std::cerr << "Unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scenario scenario;
+    if (!ScenarioByName(scenarioName, scenario))
+    {
+        std::cerr << "Unknown scenario '" << scenarioName << "' (use fast or slow)" << std::endl;
+        return 1;
+    }
+    scenario.asteroidCount = asteroids;
+    scenario.softening = softening;
+
+    std::cout << "=== Deterministic run ===" << std::endl;
+    LogCpuDispatch(std::cout);
+    std::cout << "Scenario: " << scenario.name << ", seed: " << seed << ", steps: " << steps
+              << ", bodies: " << CreateWorld(scenario, seed).size()
+              << (kahan ? ", Kahan summation" : "")
+              << (precision != ForcePrecision::Double ? ", forces: " : "")
+              << (precision != ForcePrecision::Double ? ForcePrecisionName(precision) : "")
+              << (settings.coloredCollisions ? ", coloured contact solver" : "")
+              << (settings.keplerHybrid ? ", Kepler hybrid" : "")
+              << (settings.treeGravity ? ", tree gravity" : "")
+              << (settings.mortonSort ? ", Morton ordering" : "")
+              << (softening != Softening::Clamp ? ", softening: " : "")
+              << (softening != Softening::Clamp ? SofteningName(softening) : "")
+              << (settings.encounterSubcycling ? ", encounter sub-cycling" : "")
+              << (settings.integrator != Integrator::Euler ? ", integrator: " : "")
+              << (settings.integrator != Integrator::Euler ? IntegratorName(settings.integrator) : "")
+              << (settings.firstTouch ? ", first touch by the workers" : "")
+              << (pin != PinPolicy::None ? ", pinned " : "") << (pin != PinPolicy::None ? PinPolicyName(pin) : "") << std::endl;
+
+    bool ok = true;
+    std::string reference;
+    for (unsigned threads = 1; threads <= maxThreads; ++threads)
+    {
+        long long collisions = 0;
+        std::string hash = HashToString(RunAndHash(scenario, seed, steps, threads, kahan, precision, settings, pin, collisions));
+        if (threads == 1)
+            reference = hash;
+
+        bool match = hash == reference && (expected.empty() || hash == expected);
+        ok = ok && match;
+        std::cout << "threads " << std::setw(3) << threads << "  hash " << hash
+                  << "  collisions " << collisions << (match ? "" : "  MISMATCH") << std::endl;
+    }
+
+    std::cout << (ok ? "PASS: identical final state on every thread count" : "FAIL: final states differ") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+//
+//  Distributed_Run.cpp
+//  SpaceEngine
+//
+//  Runs one headless scenario split over several processes (see Domain_Decomposition.h)
+//  and compares the result with the same run in a single process.
+//
+//  The tool creates the shared memory rings, forks one process per domain and collects
+//  every body at the end. Exits with status 1 if a process failed or a body got lost or
+//  duplicated. The difference to the single-process run is only reported: with --theta 0
+//  the forces agree to rounding, but chained contacts across a domain boundary resolve in
+//  another order, so bodies in the dense belt drift apart (--ranks 1 agrees to rounding).
+//
+//      ./Distributed_Run --ranks 4 --steps 300 --asteroids 2000
+//      ./Distributed_Run --theta 0             Ship every body everywhere as a ghost
+//      ./Distributed_Run --theta 0.7           Far cells as pseudo-particles (default 0.5)
+//      ./Distributed_Run --rebalance 10        Check the load every 10 steps (0: never)
+//      ./Distributed_Run --colored             Graph coloured contact solver in every domain
+//      ./Distributed_Run --scenario slow --seed 7 --no-reference
+//
+//  Build: clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -pthread -I"Engine Codes" "Engine Codes/Distributed_Run.cpp" -o distributed_run
+//  (add -lrt for shm_open on glibc older than 2.34)
+//
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Domain_Decomposition.h"
+#include "Shm_Ring.h"
+#include "Cpu_Dispatch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// What a rank reports at the end besides its bodies
+struct RankSummary
+{
+    DomainStats stats;
+    double seconds;
+    long long contacts;
+    uint64_t bodiesAtStart;
+};
+
+// Splits the world by Morton key into 'ranks' domains of about equal body count
+std::vector<World> SplitWorld(const World &w, const DomainSettings &settings, int ranks, std::vector<uint32_t> &first)
+{
+    std::vector<uint64_t> keys(w.size());
+    ComputeMortonKeys(w, DomainCube(settings), keys.data());
+    std::vector<double> count(DOMAIN_BALANCE_BINS, 0.0);
+    for (uint64_t key : keys)
+        count[BalanceBin(key)] += 1.0;
+    first = SplitBins(count, ranks);
+
+    std::vector<World> domains(ranks, EmptyWorldLike(w));
+    for (size_t i = 0; i < w.size(); ++i)
+        AppendRecord(domains[OwnerOfBin(first, BalanceBin(keys[i]))], RecordOf(w, i));
+    return domains;
+}
+
+// Blocks until the ring has data. False (and every rank killed) if a rank died first.
+bool WaitForRank(ShmRing &ring, const std::vector<pid_t> &pids)
+{
+    while (ring.usedBytes() == 0)
+    {
+        int status = 0;
+        pid_t done = waitpid(-1, &status, WNOHANG);
+        if (done > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+        {
+            for (pid_t pid : pids)
+                kill(pid, SIGKILL);
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::string scenarioName = "fast";
+    uint64_t seed = 42;
+    long long steps = 300;
+    int asteroids = 2000;
+    int ranks = 4;
+    bool reference = true;
+    DomainSettings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue)
+            scenarioName = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--steps" && hasValue)
+            steps = std::atoll(argv[++i]);
+        else if (arg == "--asteroids" && hasValue)
+            asteroids = std::atoi(argv[++i]);
+        else if (arg == "--ranks" && hasValue)
+            ranks = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--theta" && hasValue)
+            settings.theta = std::atof(argv[++i]);
+        else if (arg == "--rebalance" && hasValue)
+            settings.rebalanceInterval = std::atoi(argv[++i]);
+        else if (arg == "--colored")
+            settings.coloredCollisions = true;
+        else if (arg == "--no-reference")
+            reference = false;
+        else
+        {
+            std::cerr << "Unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scenario scenario;
+    if (!ScenarioByName(scenarioName, scenario))
+    {
+        std::cerr << "Unknown scenario '" << scenarioName << "' (use fast or slow)" << std::endl;
+        return 1;
+    }
+    scenario.asteroidCount = asteroids;
+    const World initial = CreateWorld(scenario, seed);
+    const size_t n = initial.size();
+
+    std::cout << "=== Distributed run ===" << std::endl;
+    LogCpuDispatch(std::cout);
+    std::cout << "Scenario: " << scenario.name << ", seed: " << seed << ", steps: " << steps << ", bodies: " << n
+              << ", ranks: " << ranks << ", theta: " << settings.theta << ", rebalance every " << settings.rebalanceInterval
+              << " steps" << (settings.coloredCollisions ? ", coloured contact solver" : "") << std::endl;
+
+    std::vector<uint32_t> first;
+    std::vector<World> domains = SplitWorld(initial, settings, ranks, first);
+
+    // One ring per ordered pair of ranks, big enough for two messages carrying every body,
+    // plus one per rank for the results. The names go away right after creation, the
+    // forked ranks inherit the mappings.
+    const size_t messageBytes = n * sizeof(BodyRecord) + DOMAIN_BALANCE_BINS * sizeof(BinCost) + 4096;
+    const std::string prefix = "/spaceengine-" + std::to_string(getpid()) + "-";
+    std::vector<std::vector<std::unique_ptr<ShmRing>>> rings(ranks);
+    std::vector<std::unique_ptr<ShmRing>> results(ranks);
+    for (int a = 0; a < ranks; ++a)
+    {
+        rings[a].resize(ranks);
+        for (int b = 0; b < ranks; ++b)
+        {
+            if (a == b)
+                continue;
+            rings[a][b].reset(new ShmRing());
+            std::string name = prefix + std::to_string(a) + "-" + std::to_string(b);
+            if (!rings[a][b]->create(name, 2 * messageBytes))
+            {
+                std::cerr << "Could not create shared memory ring " << name << std::endl;
+                return 1;
+            }
+            rings[a][b]->unlink();
+        }
+        results[a].reset(new ShmRing());
+        std::string name = prefix + std::to_string(a) + "-result";
+        if (!results[a]->create(name, 1 << 20))
+        {
+            std::cerr << "Could not create shared memory ring " << name << std::endl;
+            return 1;
+        }
+        results[a]->unlink();
+    }
+
+    std::vector<pid_t> pids;
+    for (int r = 0; r < ranks; ++r)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::cerr << "fork failed" << std::endl;
+            for (pid_t started : pids)
+                kill(started, SIGKILL);
+            return 1;
+        }
+        if (pid == 0)
+        {
+            std::vector<ShmRing *> outgoing(ranks, nullptr), incoming(ranks, nullptr);
+            for (int other = 0; other < ranks; ++other)
+                if (other != r)
+                {
+                    outgoing[other] = rings[r][other].get();
+                    incoming[other] = rings[other][r].get();
+                }
+            RankSummary summary;
+            summary.bodiesAtStart = domains[r].size();
+            DomainRank domain(r, settings, std::move(domains[r]), first, outgoing, incoming);
+
+            summary.contacts = 0;
+            auto clock = std::chrono::steady_clock::now();
+            for (long long step = 0; step < steps; ++step)
+                summary.contacts += domain.step(scenario.maxTimestep);
+            summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock).count();
+            summary.stats = domain.stats();
+
+            std::vector<unsigned char> message;
+            MessageWriter writer(message);
+            writer.put(summary);
+            writer.putArray(domain.records());
+            results[r]->writeMessage(message);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+
+    std::vector<RankSummary> summaries(ranks);
+    std::vector<BodyRecord> bodies;
+    std::vector<unsigned char> message;
+    for (int r = 0; r < ranks; ++r)
+    {
+        if (!WaitForRank(*results[r], pids))
+        {
+            std::cerr << "FAIL: a rank exited early" << std::endl;
+            return 1;
+        }
+        results[r]->readMessage(message);
+        MessageReader reader(message);
+        summaries[r] = reader.get<RankSummary>();
+        std::vector<BodyRecord> part;
+        reader.getArray(part);
+        bodies.insert(bodies.end(), part.begin(), part.end());
+    }
+    bool ok = true;
+    for (pid_t pid : pids)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    std::cout << "  rank   bodies start/end   ghosts   pseudo   moved in/out   rebalances   imbalance   exchange [ms/step]   force [ms/step]   total [ms/step]" << std::endl;
+    double slowest = 0.0;
+    for (int r = 0; r < ranks; ++r)
+    {
+        const RankSummary &s = summaries[r];
+        std::cout << std::setw(6) << r << std::setw(10) << s.bodiesAtStart << " / " << std::left << std::setw(6)
+                  << s.bodiesAtStart + s.stats.migratedIn - s.stats.migratedOut << std::right
+                  << std::setw(9) << s.stats.ghosts << std::setw(9) << s.stats.pseudo
+                  << std::setw(8) << s.stats.migratedIn << " / " << std::left << std::setw(4) << s.stats.migratedOut << std::right
+                  << std::setw(13) << s.stats.rebalances << std::setw(12) << std::setprecision(3) << s.stats.imbalance
+                  << std::setw(21) << std::setprecision(4) << s.stats.exchangeSeconds / steps * 1000.0
+                  << std::setw(18) << s.stats.forceSeconds / steps * 1000.0
+                  << std::setw(18) << s.seconds / steps * 1000.0 << std::endl;
+        slowest = std::max(slowest, s.seconds);
+    }
+
+    // Every body exactly once
+    std::vector<int> seen(n, 0);
+    for (const BodyRecord &body : bodies)
+        if (body.id < n)
+            seen[body.id]++;
+    bool complete = bodies.size() == n && std::all_of(seen.begin(), seen.end(), [](int count)
+                                                      { return count == 1; });
+    std::cout << "Bodies collected: " << bodies.size() << " of " << n << (complete ? ", each exactly once" : ", LOST OR DUPLICATED") << std::endl;
+    ok = ok && complete;
+
+    if (reference && complete)
+    {
+        World distributed = initial;
+        for (const BodyRecord &body : bodies)
+            StoreRecord(distributed, body.id, body);
+
+        Simulator single(initial);
+        auto clock = std::chrono::steady_clock::now();
+        for (long long step = 0; step < steps; ++step)
+            single.step(scenario.maxTimestep);
+        double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock).count();
+
+        double worst = 0.0;
+        size_t matching = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            double dx = distributed.px[i] - single.world.px[i];
+            double dy = distributed.py[i] - single.world.py[i];
+            double dz = distributed.pz[i] - single.world.pz[i];
+            double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            worst = std::max(worst, distance);
+            matching += distance < 1e-9 ? 1 : 0;
+        }
+        double e0 = TotalEnergy(initial);
+        std::cout << "Single process: " << std::setprecision(4) << singleSeconds / steps * 1000.0 << " ms/step, "
+                  << ranks << " ranks: " << slowest / steps * 1000.0 << " ms/step (slowest rank)" << std::endl;
+        std::cout << "Bodies within 1e-9 of the single process: " << matching << " of " << n
+                  << ", max position difference: " << std::setprecision(3) << worst
+                  << ", |dE/E| single " << std::fabs(TotalEnergy(single.world) - e0) / std::fabs(e0)
+                  << ", distributed " << std::fabs(TotalEnergy(distributed) - e0) / std::fabs(e0) << std::endl;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
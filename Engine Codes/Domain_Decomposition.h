@@ -0,0 +1,612 @@
+//
+//  Domain_Decomposition.h
+//  SpaceEngine
+//
+//  Splits one simulation over several processes on the same machine.
+//
+//  One process runs out of memory bandwidth long before the biggest scenarios run out of
+//  bodies. Here every process (rank) owns a spatial domain and only steps its own bodies:
+//
+//    - domains are ranges of the Morton curve (Morton_Order.h) through a fixed cube, so a
+//      domain is a compact set of octree cells and ownership is one key comparison,
+//    - at the start of a step every rank sends every other rank what it needs for the
+//      forces: its bodies near that rank's domain as ghosts, and for cells far away
+//      (cell size < theta * distance to the domain) one pseudo-particle at the cell's
+//      centre of mass, the usual "locally essential tree",
+//    - forces (ComputeAccelerationsFor), the Euler step and the collisions are the same
+//      code as in one process, run on the local bodies plus ghosts; ghosts are dropped
+//      again afterwards, each side keeps its own half of a boundary contact,
+//    - at the end of the step bodies whose key left the domain move to their new owner,
+//    - every few steps all ranks swap a histogram of their work (force terms per key bin)
+//      and, if the busiest domain is too far above average, all of them compute the same
+//      new split from the summed histogram. The bodies follow with the next migration.
+//
+//  Ranks talk through one shared memory ring per direction and pair (Shm_Ring.h). Every
+//  rank writes to every other rank once per phase before it reads, so the rings double
+//  as a barrier and a rank is never more than one phase ahead of any other.
+//
+//  With theta = 0 all bodies go everywhere as ghosts and the forces only differ from a
+//  single process by summation order. Contacts don't: each side of a boundary resolves
+//  its chains of contacts in its own order. The Simulator's other settings (tree, integrators,
+//  Kepler hybrid) don't apply yet, this is the plain StepWorld() step.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Collision_Solver.h"
+#include "Morton_Order.h"
+#include "Shm_Ring.h"
+#include "Arena.h"
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+const int DOMAIN_BALANCE_BITS = 15;            // Load balancing works on the top 15 key bits (5 octree levels)
+const uint32_t DOMAIN_BALANCE_BINS = 1u << DOMAIN_BALANCE_BITS;
+const uint32_t DOMAIN_PSEUDO_ID = 0xffffffffu; // World::id of pseudo-particles among the ghosts
+
+struct DomainSettings
+{
+    double halfWidth = 24.0;        // Keys come from the cube [-halfWidth, halfWidth]^3, bodies outside clamp to its faces
+    double theta = 0.5;             // Cells smaller than theta * distance go to far domains as one pseudo-particle, 0: never
+    int cellLevel = 6;              // Octree level of those cells
+    int rebalanceInterval = 25;     // Steps between load checks, 0: fixed domains
+    double maxImbalance = 1.1;      // Repartition when the busiest domain has this much more than the average work
+    bool coloredCollisions = false; // Contact solver as in SimulationSettings
+    int collisionIterations = 4;
+};
+
+// One body as it travels between processes
+struct BodyRecord
+{
+    double px, py, pz, vx, vy, vz, mass, radius;
+    float cr, cg, cb;
+    uint32_t id;
+    uint32_t fixed;
+};
+
+inline BodyRecord RecordOf(const World &w, size_t i)
+{
+    return {w.px[i], w.py[i], w.pz[i], w.vx[i], w.vy[i], w.vz[i], w.mass[i], w.radius[i],
+            w.cr[i], w.cg[i], w.cb[i], w.id[i], w.fixed[i]};
+}
+
+// Adds a body that keeps its ID. World::slot isn't kept up to date in a domain.
+inline void AppendRecord(World &w, const BodyRecord &r)
+{
+    w.px.push_back(r.px);
+    w.py.push_back(r.py);
+    w.pz.push_back(r.pz);
+    w.vx.push_back(r.vx);
+    w.vy.push_back(r.vy);
+    w.vz.push_back(r.vz);
+    w.ax.push_back(0.0);
+    w.ay.push_back(0.0);
+    w.az.push_back(0.0);
+    w.mass.push_back(r.mass);
+    w.radius.push_back(r.radius);
+    w.cr.push_back(r.cr);
+    w.cg.push_back(r.cg);
+    w.cb.push_back(r.cb);
+    w.fixed.push_back((unsigned char)r.fixed);
+    w.id.push_back(r.id);
+}
+
+// Overwrites body i
+inline void StoreRecord(World &w, size_t i, const BodyRecord &r)
+{
+    w.px[i] = r.px;
+    w.py[i] = r.py;
+    w.pz[i] = r.pz;
+    w.vx[i] = r.vx;
+    w.vy[i] = r.vy;
+    w.vz[i] = r.vz;
+    w.mass[i] = r.mass;
+    w.radius[i] = r.radius;
+    w.cr[i] = r.cr;
+    w.cg[i] = r.cg;
+    w.cb[i] = r.cb;
+    w.fixed[i] = (unsigned char)r.fixed;
+    w.id[i] = r.id;
+}
+
+// Same constants as 'w', no bodies
+inline World EmptyWorldLike(const World &w)
+{
+    World empty;
+    empty.G = w.G;
+    empty.minDistanceFactor = w.minDistanceFactor;
+    empty.softening = w.softening;
+    empty.restitution = w.restitution;
+    empty.collisionDamping = w.collisionDamping;
+    empty.compensatedSummation = w.compensatedSummation;
+    empty.forcePrecision = w.forcePrecision;
+    empty.time = w.time;
+    return empty;
+}
+
+// Keeps the first 'count' bodies
+inline void TruncateWorld(World &w, size_t count)
+{
+    for (std::vector<double> *array : {&w.px, &w.py, &w.pz, &w.vx, &w.vy, &w.vz, &w.ax, &w.ay, &w.az, &w.mass, &w.radius})
+        array->resize(count);
+    for (std::vector<float> *array : {&w.cr, &w.cg, &w.cb})
+        array->resize(count);
+    w.fixed.resize(count);
+    w.id.resize(count);
+}
+
+inline MortonCube DomainCube(const DomainSettings &s)
+{
+    MortonCube cube;
+    cube.minX = cube.minY = cube.minZ = -s.halfWidth;
+    cube.scale = double((1u << MORTON_BITS) - 1) / (2.0 * s.halfWidth);
+    return cube;
+}
+
+inline uint32_t BalanceBin(uint64_t key)
+{
+    return (uint32_t)(key >> (3 * MORTON_BITS - DOMAIN_BALANCE_BITS));
+}
+
+// Cuts the bins into 'ranks' runs of about equal cost. Rank r owns the bins from
+// first[r] up to first[r + 1].
+inline std::vector<uint32_t> SplitBins(const std::vector<double> &cost, int ranks)
+{
+    double total = 0.0;
+    for (double c : cost)
+        total += c;
+
+    std::vector<uint32_t> first(ranks + 1, DOMAIN_BALANCE_BINS);
+    first[0] = 0;
+    double sum = 0.0;
+    uint32_t bin = 0;
+    for (int r = 1; r < ranks; ++r)
+    {
+        const double target = total * r / ranks;
+        while (bin < DOMAIN_BALANCE_BINS && sum + cost[bin] <= target)
+            sum += cost[bin++];
+        // The bin that crosses the target goes to whichever side it overshoots less
+        if (bin < DOMAIN_BALANCE_BINS && target - sum > sum + cost[bin] - target)
+            sum += cost[bin++];
+        first[r] = std::max(bin, first[r - 1]);
+    }
+    return first;
+}
+
+inline int OwnerOfBin(const std::vector<uint32_t> &first, uint32_t bin)
+{
+    int ranks = (int)first.size() - 1;
+    int owner = (int)(std::upper_bound(first.begin(), first.end(), bin) - first.begin()) - 1;
+    return std::min(std::max(owner, 0), ranks - 1);
+}
+
+// ===== Messages =====
+
+// Appends plain values to a byte buffer
+class MessageWriter
+{
+public:
+    explicit MessageWriter(std::vector<unsigned char> &target) : bytes(target) { bytes.clear(); }
+
+    template <typename T>
+    void put(const T &value)
+    {
+        size_t at = bytes.size();
+        bytes.resize(at + sizeof(T));
+        std::memcpy(bytes.data() + at, &value, sizeof(T));
+    }
+
+    template <typename T>
+    void putArray(const std::vector<T> &values)
+    {
+        put<uint64_t>(values.size());
+        size_t at = bytes.size();
+        bytes.resize(at + values.size() * sizeof(T));
+        if (!values.empty())
+            std::memcpy(bytes.data() + at, values.data(), values.size() * sizeof(T));
+    }
+
+private:
+    std::vector<unsigned char> &bytes;
+};
+
+class MessageReader
+{
+public:
+    explicit MessageReader(const std::vector<unsigned char> &source) : bytes(source) {}
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        std::memcpy(&value, bytes.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    void getArray(std::vector<T> &values)
+    {
+        values.resize((size_t)get<uint64_t>());
+        if (!values.empty())
+            std::memcpy(values.data(), bytes.data() + offset, values.size() * sizeof(T));
+        offset += values.size() * sizeof(T);
+    }
+
+private:
+    const std::vector<unsigned char> &bytes;
+    size_t offset = 0;
+};
+
+// ===== Ranks =====
+
+struct DomainBox
+{
+    double minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+    double maxX = -INFINITY, maxY = -INFINITY, maxZ = -INFINITY;
+
+    bool empty() const { return minX > maxX; }
+
+    void add(double x, double y, double z, double r)
+    {
+        minX = std::min(minX, x - r);
+        minY = std::min(minY, y - r);
+        minZ = std::min(minZ, z - r);
+        maxX = std::max(maxX, x + r);
+        maxY = std::max(maxY, y + r);
+        maxZ = std::max(maxZ, z + r);
+    }
+
+    double distanceTo(double x, double y, double z) const
+    {
+        double dx = std::max({minX - x, 0.0, x - maxX});
+        double dy = std::max({minY - y, 0.0, y - maxY});
+        double dz = std::max({minZ - z, 0.0, z - maxZ});
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+};
+
+struct PseudoParticle
+{
+    double x, y, z, mass;
+};
+
+// Work of one load balancing bin
+struct BinCost
+{
+    uint32_t bin;
+    double cost;
+};
+
+struct DomainStats
+{
+    size_t ghosts = 0;      // Bodies received as ghosts in the last step
+    size_t pseudo = 0;      // Pseudo-particles received in the last step
+    size_t migratedIn = 0;  // Bodies taken over, all steps
+    size_t migratedOut = 0; // Bodies handed over, all steps
+    int rebalances = 0;
+    double imbalance = 1.0; // Busiest domain over the average at the last check
+    double exchangeSeconds = 0.0; // Summed over all steps
+    double forceSeconds = 0.0;
+};
+
+class DomainRank
+{
+public:
+    // 'outgoing[r]' and 'incoming[r]' are the rings to and from rank r (ignored for r == rank).
+    // 'local' holds the bodies this rank owns under the partition 'firstBin'.
+    DomainRank(int rankIndex, const DomainSettings &s, World local, std::vector<uint32_t> firstBin,
+               std::vector<ShmRing *> outgoing, std::vector<ShmRing *> incoming)
+        : rank(rankIndex), ranks((int)firstBin.size() - 1), settings(s), w(std::move(local)),
+          first(std::move(firstBin)), out(std::move(outgoing)), in(std::move(incoming)),
+          knownBoxes(ranks), boxKnown(ranks, 0), cube(DomainCube(s))
+    {
+        localCount = w.size();
+    }
+
+    // One step of every local body, collective: all ranks have to call it. Returns the
+    // contacts involving local bodies (boundary contacts count on both sides).
+    int step(double dt)
+    {
+        auto clock = std::chrono::steady_clock::now();
+        exchangeGhosts();
+        stepStats.exchangeSeconds += SecondsFrom(clock);
+
+        clock = std::chrono::steady_clock::now();
+        localList.resize(localCount);
+        for (size_t i = 0; i < localCount; ++i)
+            localList[i] = (uint32_t)i;
+        ComputeAccelerationsFor(w, localList.data(), localCount);
+        workPerBody = (double)w.size();
+        stepStats.forceSeconds += SecondsFrom(clock);
+
+        EulerKernel(localCount, w.fixed.data(), w.px.data(), w.py.data(), w.pz.data(), w.vx.data(), w.vy.data(), w.vz.data(),
+                    w.ax.data(), w.ay.data(), w.az.data(), dt);
+        w.time += dt;
+        TruncateWorld(w, ghostEnd);
+        int contacts = resolveContacts();
+        TruncateWorld(w, localCount);
+
+        clock = std::chrono::steady_clock::now();
+        steps++;
+        migrate(settings.rebalanceInterval > 0 && steps % settings.rebalanceInterval == 0);
+        stepStats.exchangeSeconds += SecondsFrom(clock);
+        return contacts;
+    }
+
+    // Local bodies only between steps
+    const World &world() const { return w; }
+    size_t size() const { return localCount; }
+    const std::vector<uint32_t> &partition() const { return first; }
+    const DomainStats &stats() const { return stepStats; }
+
+    std::vector<BodyRecord> records() const
+    {
+        std::vector<BodyRecord> result;
+        for (size_t i = 0; i < localCount; ++i)
+            result.push_back(RecordOf(w, i));
+        return result;
+    }
+
+private:
+    int rank, ranks;
+    DomainSettings settings;
+    World w; // Local bodies first, then ghosts and pseudo-particles during a step
+    size_t localCount = 0;
+    std::vector<uint32_t> first;
+    std::vector<ShmRing *> out, in;
+    std::vector<DomainBox> knownBoxes; // Domain of every rank as of its last message
+    std::vector<unsigned char> boxKnown;
+    MortonCube cube;
+    long long steps = 0;
+    double workPerBody = 0.0; // Force terms per local body in the last step
+    DomainStats stepStats;
+    StepArenas arenas;
+
+    // Reused between steps
+    std::vector<uint32_t> localList;
+    std::vector<uint64_t> keys;
+    std::vector<std::pair<uint64_t, uint32_t>> byCell;
+    std::vector<unsigned char> message;
+    std::vector<BodyRecord> bodies;
+    std::vector<PseudoParticle> pseudo, receivedPseudo;
+    size_t ghostEnd = 0; // End of the ghosts, start of the pseudo-particles
+
+    static double SecondsFrom(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void computeKeys()
+    {
+        keys.resize(localCount);
+        ComputeMortonKeys(w, cube, keys.data());
+    }
+
+    // Sends every other rank the locally essential part of this domain and adds what
+    // they sent as ghosts behind the local bodies
+    void exchangeGhosts()
+    {
+        computeKeys();
+        DomainBox box;
+        for (size_t i = 0; i < localCount; ++i)
+            box.add(w.px[i], w.py[i], w.pz[i], w.radius[i]);
+
+        // Local bodies grouped by octree cell
+        const int shift = 3 * (MORTON_BITS - settings.cellLevel);
+        byCell.resize(localCount);
+        for (size_t i = 0; i < localCount; ++i)
+            byCell[i] = {keys[i] >> shift, (uint32_t)i};
+        std::sort(byCell.begin(), byCell.end());
+
+        for (int r = 0; r < ranks; ++r)
+        {
+            if (r == rank)
+                continue;
+            bodies.clear();
+            pseudo.clear();
+            for (size_t begin = 0; begin < byCell.size();)
+            {
+                size_t end = begin + 1;
+                while (end < byCell.size() && byCell[end].first == byCell[begin].first)
+                    end++;
+                addCell(begin, end, r);
+                begin = end;
+            }
+
+            MessageWriter writer(message);
+            writer.put(box);
+            writer.putArray(bodies);
+            writer.putArray(pseudo);
+            out[r]->writeMessage(message);
+        }
+
+        stepStats.ghosts = 0;
+        pseudo.clear();
+        for (int r = 0; r < ranks; ++r)
+        {
+            if (r == rank)
+                continue;
+            in[r]->readMessage(message);
+            MessageReader reader(message);
+            knownBoxes[r] = reader.get<DomainBox>();
+            boxKnown[r] = 1;
+            reader.getArray(bodies);
+            reader.getArray(receivedPseudo);
+            for (const BodyRecord &record : bodies)
+                AppendRecord(w, record);
+            pseudo.insert(pseudo.end(), receivedPseudo.begin(), receivedPseudo.end());
+            stepStats.ghosts += bodies.size();
+        }
+
+        // Pseudo-particles last, so the contacts can leave them out
+        ghostEnd = w.size();
+        for (const PseudoParticle &p : pseudo)
+            AppendRecord(w, {p.x, p.y, p.z, 0.0, 0.0, 0.0, p.mass, 0.0, 0.0f, 0.0f, 0.0f, DOMAIN_PSEUDO_ID, 1});
+        stepStats.pseudo = pseudo.size();
+    }
+
+    // Cell [begin, end) of byCell for rank r: one pseudo-particle if it is small enough
+    // seen from r's domain, its bodies otherwise
+    void addCell(size_t begin, size_t end, int r)
+    {
+        double mass = 0.0, x = 0.0, y = 0.0, z = 0.0;
+        DomainBox extent;
+        for (size_t k = begin; k < end; ++k)
+        {
+            uint32_t i = byCell[k].second;
+            mass += w.mass[i];
+            x += w.mass[i] * w.px[i];
+            y += w.mass[i] * w.py[i];
+            z += w.mass[i] * w.pz[i];
+            extent.add(w.px[i], w.py[i], w.pz[i], w.radius[i]);
+        }
+        if (boxKnown[r] && settings.theta > 0.0 && mass > 0.0 && !knownBoxes[r].empty())
+        {
+            x /= mass;
+            y /= mass;
+            z /= mass;
+            double size = std::max({extent.maxX - extent.minX, extent.maxY - extent.minY, extent.maxZ - extent.minZ});
+            if (size < settings.theta * knownBoxes[r].distanceTo(x, y, z))
+            {
+                pseudo.push_back({x, y, z, mass});
+                return;
+            }
+        }
+        for (size_t k = begin; k < end; ++k)
+            bodies.push_back(RecordOf(w, byCell[k].second));
+    }
+
+    // Contacts of the local bodies with each other and with the ghosts. Changes to the
+    // ghosts are thrown away with them, their owner resolves its side itself.
+    int resolveContacts()
+    {
+        if (settings.coloredCollisions)
+        {
+            arenas.resetAll();
+            CollisionScratch scratch(arenas);
+            SolveCollisions(w, scratch, settings.collisionIterations);
+            int contacts = 0;
+            for (const ContactPair &pair : scratch.pairs)
+                contacts += pair.a < localCount || pair.b < localCount ? 1 : 0;
+            return contacts;
+        }
+        int contacts = 0;
+        const size_t n = w.size();
+        for (size_t i = 0; i < localCount; ++i)
+            for (size_t j = i + 1; j < n; ++j)
+                if (ResolveWorldCollision(w, i, j))
+                    contacts++;
+        return contacts;
+    }
+
+    // Hands bodies that left the domain to their new owners, and on balance steps
+    // swaps the work histograms and repartitions if needed
+    void migrate(bool balance)
+    {
+        computeKeys();
+
+        // Sparse histogram of the local work per key bin
+        std::vector<BinCost> work;
+        if (balance)
+        {
+            for (size_t i = 0; i < localCount; ++i)
+                work.push_back({BalanceBin(keys[i]), workPerBody});
+            std::sort(work.begin(), work.end(), [](const BinCost &a, const BinCost &b)
+                      { return a.bin < b.bin; });
+            size_t merged = 0;
+            for (size_t k = 0; k < work.size(); ++k)
+            {
+                if (merged > 0 && work[merged - 1].bin == work[k].bin)
+                    work[merged - 1].cost += work[k].cost;
+                else
+                    work[merged++] = work[k];
+            }
+            work.resize(merged);
+        }
+
+        std::vector<int> owner(localCount);
+        for (size_t i = 0; i < localCount; ++i)
+            owner[i] = OwnerOfBin(first, BalanceBin(keys[i]));
+
+        for (int r = 0; r < ranks; ++r)
+        {
+            if (r == rank)
+                continue;
+            bodies.clear();
+            for (size_t i = 0; i < localCount; ++i)
+                if (owner[i] == r)
+                    bodies.push_back(RecordOf(w, i));
+            stepStats.migratedOut += bodies.size();
+            MessageWriter writer(message);
+            writer.putArray(bodies);
+            writer.putArray(work);
+            out[r]->writeMessage(message);
+        }
+
+        // Keep the staying bodies in order
+        size_t kept = 0;
+        for (size_t i = 0; i < localCount; ++i)
+        {
+            if (owner[i] != rank)
+                continue;
+            if (kept != i)
+                StoreRecord(w, kept, RecordOf(w, i));
+            kept++;
+        }
+        TruncateWorld(w, kept);
+
+        // Ranks are read in order, so every rank sums the histograms the same way
+        std::vector<double> cost;
+        if (balance)
+            cost.assign(DOMAIN_BALANCE_BINS, 0.0);
+        std::vector<BinCost> received;
+        for (int r = 0; r < ranks; ++r)
+        {
+            if (r == rank)
+            {
+                for (const BinCost &bin : work)
+                    cost[bin.bin] += bin.cost;
+                continue;
+            }
+            in[r]->readMessage(message);
+            MessageReader reader(message);
+            reader.getArray(bodies);
+            reader.getArray(received);
+            for (const BodyRecord &record : bodies)
+                AppendRecord(w, record);
+            stepStats.migratedIn += bodies.size();
+            for (const BinCost &bin : received)
+                cost[bin.bin] += bin.cost;
+        }
+        localCount = w.size();
+
+        if (balance)
+            rebalance(cost);
+    }
+
+    void rebalance(const std::vector<double> &cost)
+    {
+        std::vector<double> perRank(ranks, 0.0);
+        double total = 0.0;
+        for (uint32_t bin = 0; bin < DOMAIN_BALANCE_BINS; ++bin)
+        {
+            perRank[OwnerOfBin(first, bin)] += cost[bin];
+            total += cost[bin];
+        }
+        if (total <= 0.0)
+            return;
+        stepStats.imbalance = *std::max_element(perRank.begin(), perRank.end()) / (total / ranks);
+        if (stepStats.imbalance > settings.maxImbalance)
+        {
+            first = SplitBins(cost, ranks);
+            stepStats.rebalances++;
+        }
+    }
+};
@@ -0,0 +1,263 @@
+//
+//  Encounters.h
+//  SpaceEngine
+//
+//  Sub-cycling of close encounters between two bodies.
+//
+//  With one global step for everybody, close passes are where the error comes from: two
+//  asteroids that come within a few radii of each other turn their velocities around in
+//  much less than dt, and the semi-implicit Euler step takes the whole kick at once. The
+//  only cure so far was a smaller maxTimestep for the entire system. Instead:
+//
+//    - FindEncounters() sweeps over the moving bodies (sort-and-sweep on x like the Hill
+//      spheres in Kepler.h) and pairs up bodies closer than encounterFactor softening
+//      lengths h = (radiusA + radiusB) * minDistanceFactor, closest pairs first, so every
+//      body is in at most one pair,
+//    - SubcycleEncounters() takes the pair's mutual term back out of the accelerations of
+//      the global force pass, which leaves the pull of everything else, and integrates the
+//      pair through dt with RK4 sub-steps of ENCOUNTER_ETA times the pair's own dynamical
+//      time. Sub-steps shrink with the separation like in a time-transformed (Sundman)
+//      integrator, and the rest of the system acts as a constant acceleration over dt,
+//    - ApplyEncounters() puts the result back after the global integrator has moved
+//      everybody else.
+//
+//  Pairs with a fixed body are left alone: the Sun's softening length reaches most of the
+//  inner system, and bodies that dive into its core are already promoted out of the Kepler
+//  drift. Groups of three or more close bodies are split into pairs, the third body feels
+//  the others through the normal step.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Thread_Pool.h"
+#include "Arena.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+const double ENCOUNTER_ETA = 1.0 / 64.0;  // Sub-step over the pair's dynamical time
+const int ENCOUNTER_MAX_SUBSTEPS = 4096;  // Per global step, bounds the work of a head-on pass
+
+// Two bodies integrated together for one global step
+struct EncounterPair
+{
+    uint32_t i, j;
+    double closeness; // Separation over the encounter radius, for pairing the closest first
+    double state[12]; // Position and velocity of i, then of j, at the end of the step
+    int substeps;
+};
+
+// Counts of the last step
+struct EncounterStats
+{
+    size_t pairs = 0;
+    long long substeps = 0;
+};
+
+// Pairs up the listed bodies (all moving bodies if bodies == nullptr) that are closer than
+// encounterFactor softening lengths. Deterministic: ties are broken by index.
+inline void FindEncounters(const World &w, const uint32_t *bodies, size_t count, double encounterFactor,
+                           Arena &arena, ArenaVector<EncounterPair> &pairs)
+{
+    pairs.clear();
+    ArenaVector<uint32_t> order{ArenaAllocator<uint32_t>(arena)};
+    if (bodies)
+        order.assign(bodies, bodies + count);
+    else
+    {
+        order.reserve(w.size());
+        for (size_t i = 0; i < w.size(); ++i)
+            order.push_back((uint32_t)i);
+    }
+    order.erase(std::remove_if(order.begin(), order.end(), [&](uint32_t i)
+                               { return w.fixed[i] != 0; }),
+                order.end());
+
+    // Encounter radius of a pair is reach[i] + reach[j]
+    const double reachScale = encounterFactor * w.minDistanceFactor;
+    auto reach = [&](uint32_t i)
+    { return w.radius[i] * reachScale; };
+    std::sort(order.begin(), order.end(), [&](uint32_t l, uint32_t r)
+              {
+                  double left = w.px[l] - reach(l), right = w.px[r] - reach(r);
+                  return left < right || (left == right && l < r); });
+
+    ArenaVector<EncounterPair> candidates{ArenaAllocator<EncounterPair>(arena)};
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        uint32_t i = order[k];
+        double rightEdge = w.px[i] + reach(i);
+        for (size_t m = k + 1; m < order.size(); ++m)
+        {
+            uint32_t j = order[m];
+            if (w.px[j] - reach(j) > rightEdge)
+                break;
+
+            double dx = w.px[j] - w.px[i];
+            double dy = w.py[j] - w.py[i];
+            double dz = w.pz[j] - w.pz[i];
+            double limit = reach(i) + reach(j);
+            double d2 = dx * dx + dy * dy + dz * dz;
+            if (d2 < limit * limit)
+            {
+                EncounterPair pair{};
+                pair.i = std::min(i, j);
+                pair.j = std::max(i, j);
+                pair.closeness = std::sqrt(d2) / limit;
+                candidates.push_back(pair);
+            }
+        }
+    }
+
+    // Closest first, each body in one pair at most
+    std::sort(candidates.begin(), candidates.end(), [](const EncounterPair &l, const EncounterPair &r)
+              {
+                  if (l.closeness != r.closeness)
+                      return l.closeness < r.closeness;
+                  return l.i < r.i || (l.i == r.i && l.j < r.j); });
+    ArenaVector<unsigned char> taken{ArenaAllocator<unsigned char>(arena)};
+    taken.assign(w.size(), 0);
+    for (const EncounterPair &pair : candidates)
+    {
+        if (taken[pair.i] || taken[pair.j])
+            continue;
+        taken[pair.i] = taken[pair.j] = 1;
+        pairs.push_back(pair);
+    }
+}
+
+// Mutual acceleration of the pair at positions (xi, xj): i gets dx * scaleI, j gets -dx * scaleJ
+inline void EncounterScales(const World &w, uint32_t i, uint32_t j, double distance, double &scaleI, double &scaleJ)
+{
+    double h = (w.radius[i] + w.radius[j]) * w.minDistanceFactor;
+    scaleI = distance > 0.0 ? SoftenedScale(w.softening, w.G * w.mass[j], distance, h) : 0.0;
+    scaleJ = distance > 0.0 ? SoftenedScale(w.softening, w.G * w.mass[i], distance, h) : 0.0;
+}
+
+// Integrates one pair through dt from the current world state into pair.state. w.ax..az
+// must hold the full accelerations of this step; the pair's own term is removed here.
+inline void SubcycleEncounter(const World &w, EncounterPair &pair, double dt)
+{
+    const uint32_t i = pair.i, j = pair.j;
+    const double G = w.G, totalMass = w.mass[i] + w.mass[j];
+    const double h = (w.radius[i] + w.radius[j]) * w.minDistanceFactor;
+    const double eps = h / PLUMMER_SPLINE_RATIO;
+
+    // External accelerations: everything but the partner
+    double dx = w.px[j] - w.px[i], dy = w.py[j] - w.py[i], dz = w.pz[j] - w.pz[i];
+    double scaleI, scaleJ;
+    EncounterScales(w, i, j, std::sqrt(dx * dx + dy * dy + dz * dz), scaleI, scaleJ);
+    const double extI[3] = {w.ax[i] - dx * scaleI, w.ay[i] - dy * scaleI, w.az[i] - dz * scaleI};
+    const double extJ[3] = {w.ax[j] + dx * scaleJ, w.ay[j] + dy * scaleJ, w.az[j] + dz * scaleJ};
+
+    // State: xi, yi, zi, vxi, vyi, vzi, then the same for j
+    double *y = pair.state;
+    const std::vector<double> *arrays[6] = {&w.px, &w.py, &w.pz, &w.vx, &w.vy, &w.vz};
+    for (int c = 0; c < 6; ++c)
+    {
+        y[c] = (*arrays[c])[i];
+        y[6 + c] = (*arrays[c])[j];
+    }
+
+    auto derivative = [&](const double *s, double *out)
+    {
+        double rx = s[6] - s[0], ry = s[7] - s[1], rz = s[8] - s[2];
+        double a, b;
+        EncounterScales(w, i, j, std::sqrt(rx * rx + ry * ry + rz * rz), a, b);
+        double r[3] = {rx, ry, rz};
+        for (int c = 0; c < 3; ++c)
+        {
+            out[c] = s[3 + c];
+            out[3 + c] = extI[c] + r[c] * a;
+            out[6 + c] = s[9 + c];
+            out[9 + c] = extJ[c] - r[c] * b;
+        }
+    };
+
+    // The semi-implicit Euler step keeps velocities half a kick behind the positions
+    // (v(t - dt/2), as in leapfrog). Synchronise them before integrating the pair and hand
+    // them back the same way, otherwise every entry and exit of an encounter costs O(dt).
+    double rate[12];
+    derivative(y, rate);
+    for (int c = 0; c < 3; ++c)
+    {
+        y[3 + c] += 0.5 * dt * rate[3 + c];
+        y[9 + c] += 0.5 * dt * rate[9 + c];
+    }
+
+    double t = 0.0;
+    int substeps = 0;
+    while (t < dt)
+    {
+        // Dynamical time of the pair: free fall and crossing time at the softened separation
+        double rx = y[6] - y[0], ry = y[7] - y[1], rz = y[8] - y[2];
+        double ux = y[9] - y[3], uy = y[10] - y[4], uz = y[11] - y[5];
+        double r = std::sqrt(rx * rx + ry * ry + rz * rz + eps * eps);
+        double u = std::sqrt(ux * ux + uy * uy + uz * uz);
+        double tau = std::sqrt(r * r * r / (G * totalMass));
+        if (u > 0.0)
+            tau = std::min(tau, r / u);
+        double step = std::max(ENCOUNTER_ETA * tau, dt / ENCOUNTER_MAX_SUBSTEPS);
+        step = std::min(step, dt - t);
+
+        double k1[12], k2[12], k3[12], k4[12], tmp[12];
+        derivative(y, k1);
+        for (int c = 0; c < 12; ++c)
+            tmp[c] = y[c] + 0.5 * step * k1[c];
+        derivative(tmp, k2);
+        for (int c = 0; c < 12; ++c)
+            tmp[c] = y[c] + 0.5 * step * k2[c];
+        derivative(tmp, k3);
+        for (int c = 0; c < 12; ++c)
+            tmp[c] = y[c] + step * k3[c];
+        derivative(tmp, k4);
+        for (int c = 0; c < 12; ++c)
+            y[c] += step / 6.0 * (k1[c] + 2.0 * k2[c] + 2.0 * k3[c] + k4[c]);
+
+        t += step;
+        substeps++;
+    }
+    derivative(y, rate);
+    for (int c = 0; c < 3; ++c)
+    {
+        y[3 + c] -= 0.5 * dt * rate[3 + c];
+        y[9 + c] -= 0.5 * dt * rate[9 + c];
+    }
+    pair.substeps = substeps;
+}
+
+// Sub-cycles every pair, spread over the pool. Pairs are independent, so the result does
+// not depend on the thread count. Returns the total number of sub-steps.
+inline long long SubcycleEncounters(const World &w, ArenaVector<EncounterPair> &pairs, double dt, ThreadPool *pool = nullptr)
+{
+    if (!pool || pool->size() == 1 || pairs.size() < 2)
+    {
+        for (EncounterPair &pair : pairs)
+            SubcycleEncounter(w, pair, dt);
+    }
+    else
+        pool->parallelFor(pairs.size(), [&](size_t k)
+                          { SubcycleEncounter(w, pairs[k], dt); });
+
+    long long substeps = 0;
+    for (const EncounterPair &pair : pairs)
+        substeps += pair.substeps;
+    return substeps;
+}
+
+// Overwrites the pairs' bodies with their sub-cycled end state
+inline void ApplyEncounters(World &w, const ArenaVector<EncounterPair> &pairs)
+{
+    std::vector<double> *arrays[6] = {&w.px, &w.py, &w.pz, &w.vx, &w.vy, &w.vz};
+    for (const EncounterPair &pair : pairs)
+    {
+        for (int c = 0; c < 6; ++c)
+        {
+            (*arrays[c])[pair.i] = pair.state[c];
+            (*arrays[c])[pair.j] = pair.state[6 + c];
+        }
+    }
+}
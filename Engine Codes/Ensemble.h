@@ -0,0 +1,309 @@
+//
+//  Ensemble.h
+//  SpaceEngine
+//
+//  Many copies of one small system integrated together, one copy per SIMD lane.
+//
+//  A single 15-body system is far too small to fill vector registers: the inner loop of
+//  the force calculation only has 14 partners. For stability studies we need thousands
+//  of perturbed copies anyway, so the ensemble stores every quantity as [body][member]:
+//
+//      px[body * memberStride + member]
+//
+//  All loops over bodies stay scalar and the innermost loop always runs over members,
+//  which are contiguous in memory and independent of each other, so the compiler can
+//  turn it into plain vector code (no gathers, no horizontal sums). Every member runs
+//  the same physics as StepWorld() in Headless_Simulation.h, including the collision
+//  response, which is applied with per-lane masks instead of branches.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Cpu_Dispatch.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// Members are padded to a multiple of this so every row starts on a vector boundary
+const int ENSEMBLE_LANE_PADDING = 16;
+
+struct Ensemble
+{
+    int bodies = 0;       // Bodies per system
+    int members = 0;      // Systems in the ensemble
+    int memberStride = 0; // Members rounded up to ENSEMBLE_LANE_PADDING
+
+    // [body][member] arrays
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> ax, ay, az;
+    std::vector<float> mass;
+
+    // Per body, shared by every member
+    std::vector<float> radius;
+    std::vector<unsigned char> fixed;
+
+    // Per member
+    std::vector<int> collisions;
+
+    float G = 6.674f;
+    float minDistanceFactor = 2.0f;
+    float restitution = 0.8f;
+    float collisionDamping = 0.98f;
+
+    size_t index(int body, int member) const { return (size_t)body * memberStride + member; }
+};
+
+// Builds 'members' copies of the scenario. Each member gets its own asteroid belt seed and
+// a relative Gaussian perturbation of 'perturbation' on every position and velocity.
+inline Ensemble CreateEnsemble(const Scenario &s, int members, double perturbation, uint64_t seed)
+{
+    Ensemble e;
+    World reference = CreateWorld(s, seed);
+    e.bodies = (int)reference.size();
+    e.members = members;
+    e.memberStride = (members + ENSEMBLE_LANE_PADDING - 1) / ENSEMBLE_LANE_PADDING * ENSEMBLE_LANE_PADDING;
+    e.G = (float)s.G;
+    e.minDistanceFactor = (float)s.minDistanceFactor;
+    e.restitution = (float)s.restitution;
+    e.collisionDamping = (float)s.collisionDamping;
+
+    size_t total = (size_t)e.bodies * e.memberStride;
+    for (auto *array : {&e.px, &e.py, &e.pz, &e.vx, &e.vy, &e.vz, &e.ax, &e.ay, &e.az, &e.mass})
+        array->assign(total, 0.0f);
+    e.radius.assign(reference.radius.begin(), reference.radius.end());
+    e.fixed = reference.fixed;
+    e.collisions.assign(e.memberStride, 0);
+
+    for (int m = 0; m < e.memberStride; ++m)
+    {
+        // Padding lanes copy member 0 so they stay well behaved; they are never reported
+        bool padding = m >= members;
+        World w = (m == 0 || padding) ? reference : CreateWorld(s, seed + m);
+
+        for (int b = 0; b < e.bodies; ++b)
+        {
+            // Perturb each component relative to the size of the position / velocity
+            double jitter = (padding || w.fixed[b]) ? 0.0 : perturbation;
+            double r = std::sqrt(w.px[b] * w.px[b] + w.py[b] * w.py[b] + w.pz[b] * w.pz[b]);
+            double v = std::sqrt(w.vx[b] * w.vx[b] + w.vy[b] * w.vy[b] + w.vz[b] * w.vz[b]);
+
+            // Counter-based noise: stream per (member, body), so members are reproducible on their own
+            uint64_t stream = (uint64_t)m * e.bodies + b;
+            auto noise = [&](int k)
+            { return CounterNormal(seed ^ 0x5deece66dULL, stream, k); };
+
+            size_t k = e.index(b, m);
+            e.px[k] = float(w.px[b] + jitter * r * noise(0));
+            e.py[k] = float(w.py[b] + jitter * r * noise(1));
+            e.pz[k] = float(w.pz[b] + jitter * r * noise(2));
+            e.vx[k] = float(w.vx[b] + jitter * v * noise(3));
+            e.vy[k] = float(w.vy[b] + jitter * v * noise(4));
+            e.vz[k] = float(w.vz[b] + jitter * v * noise(5));
+            e.mass[k] = float(w.mass[b]);
+        }
+    }
+    return e;
+}
+
+// Acceleration of body i from body j in every member. Kept as its own function so the
+// __restrict parameters reach the vectoriser (GCC also needs -fno-math-errno and
+// -fno-trapping-math to vectorise the sqrt and the lane selects).
+KERNEL_INLINE void EnsembleForceRowBody(float *__restrict accX, float *__restrict accY, float *__restrict accZ,
+                                        const float *__restrict xi, const float *__restrict yi, const float *__restrict zi,
+                                        const float *__restrict xj, const float *__restrict yj, const float *__restrict zj,
+                                        const float *__restrict mj, float G, float minDistance, int M)
+{
+    for (int m = 0; m < M; ++m)
+    {
+        float dx = xj[m] - xi[m];
+        float dy = yj[m] - yi[m];
+        float dz = zj[m] - zi[m];
+        float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        float clamped = std::max(distance, minDistance);
+        float scale = G * mj[m] / (clamped * clamped * std::max(distance, 1e-30f));
+        accX[m] += dx * scale;
+        accY[m] += dy * scale;
+        accZ[m] += dz * scale;
+    }
+}
+
+DISPATCHED_KERNEL(EnsembleForceRow,
+                  (float *__restrict accX, float *__restrict accY, float *__restrict accZ, const float *__restrict xi,
+                   const float *__restrict yi, const float *__restrict zi, const float *__restrict xj,
+                   const float *__restrict yj, const float *__restrict zj, const float *__restrict mj,
+                   float G, float minDistance, int M),
+                  (accX, accY, accZ, xi, yi, zi, xj, yj, zj, mj, G, minDistance, M))
+
+// Gravity for every member at once. The member loop is the vectorised one.
+inline void ComputeEnsembleAccelerations(Ensemble &e)
+{
+    std::fill(e.ax.begin(), e.ax.end(), 0.0f);
+    std::fill(e.ay.begin(), e.ay.end(), 0.0f);
+    std::fill(e.az.begin(), e.az.end(), 0.0f);
+
+    for (int i = 0; i < e.bodies; ++i)
+    {
+        if (e.fixed[i])
+            continue;
+
+        size_t row = e.index(i, 0);
+        for (int j = 0; j < e.bodies; ++j)
+        {
+            if (j == i)
+                continue;
+            size_t source = e.index(j, 0);
+            EnsembleForceRow(&e.ax[row], &e.ay[row], &e.az[row],
+                             &e.px[row], &e.py[row], &e.pz[row],
+                             &e.px[source], &e.py[source], &e.pz[source], &e.mass[source],
+                             e.G, (e.radius[i] + e.radius[j]) * e.minDistanceFactor, e.memberStride);
+        }
+    }
+}
+
+// Collision response for bodies a and b in every member, branch free per lane
+KERNEL_INLINE void EnsembleCollisionRowBody(float *__restrict xa, float *__restrict ya, float *__restrict za,
+                                            float *__restrict xb, float *__restrict yb, float *__restrict zb,
+                                            float *__restrict vxa, float *__restrict vya, float *__restrict vza,
+                                            float *__restrict vxb, float *__restrict vyb, float *__restrict vzb,
+                                            const float *__restrict ma, const float *__restrict mb, int *__restrict hits,
+                                            float radiusSum, bool fixedA, bool fixedB, float restitution, float damping, int M)
+{
+    // 1 for a movable body, 0 for a fixed one, so the lane loop has no branches
+    const float movableA = fixedA ? 0.0f : 1.0f;
+    const float movableB = fixedB ? 0.0f : 1.0f;
+
+    for (int m = 0; m < M; ++m)
+    {
+        float dx = xb[m] - xa[m];
+        float dy = yb[m] - ya[m];
+        float dz = zb[m] - za[m];
+        float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        float overlap = radiusSum - dist;
+        float hit = overlap > 0.0f ? 1.0f : 0.0f;
+
+        // Normal, falls back to +x for coincident centres like ResolveCollision
+        bool separated = dist > 0.001f;
+        float invDist = 1.0f / std::max(dist, 0.001f);
+        float nx = separated ? dx * invDist : 1.0f;
+        float ny = separated ? dy * invDist : 0.0f;
+        float nz = separated ? dz * invDist : 0.0f;
+
+        // Positional correction split by mass
+        float invMassA = movableA / ma[m];
+        float invMassB = movableB / mb[m];
+        float invTotal = 1.0f / (ma[m] + mb[m]);
+        float ratioA = movableA * (movableB * mb[m] * invTotal + (1.0f - movableB));
+        float ratioB = movableB * (movableA * ma[m] * invTotal + (1.0f - movableA));
+        float push = hit * overlap;
+        xa[m] -= nx * push * ratioA;
+        ya[m] -= ny * push * ratioA;
+        za[m] -= nz * push * ratioA;
+        xb[m] += nx * push * ratioB;
+        yb[m] += ny * push * ratioB;
+        zb[m] += nz * push * ratioB;
+
+        // Impulse only for approaching pairs
+        float velAlongNormal = (vxb[m] - vxa[m]) * nx + (vyb[m] - vya[m]) * ny + (vzb[m] - vza[m]) * nz;
+        float approach = (velAlongNormal <= 0.0f) ? hit : 0.0f;
+        float j = -(1.0f + restitution) * velAlongNormal / std::max(invMassA + invMassB, 1e-30f) * approach;
+        float keepA = 1.0f - movableA * approach * (1.0f - damping);
+        float keepB = 1.0f - movableB * approach * (1.0f - damping);
+
+        vxa[m] = (vxa[m] - j * nx * invMassA) * keepA;
+        vya[m] = (vya[m] - j * ny * invMassA) * keepA;
+        vza[m] = (vza[m] - j * nz * invMassA) * keepA;
+        vxb[m] = (vxb[m] + j * nx * invMassB) * keepB;
+        vyb[m] = (vyb[m] + j * ny * invMassB) * keepB;
+        vzb[m] = (vzb[m] + j * nz * invMassB) * keepB;
+
+        hits[m] += (int)hit;
+    }
+}
+
+DISPATCHED_KERNEL(EnsembleCollisionRow,
+                  (float *__restrict xa, float *__restrict ya, float *__restrict za, float *__restrict xb,
+                   float *__restrict yb, float *__restrict zb, float *__restrict vxa, float *__restrict vya,
+                   float *__restrict vza, float *__restrict vxb, float *__restrict vyb, float *__restrict vzb,
+                   const float *__restrict ma, const float *__restrict mb, int *__restrict hits,
+                   float radiusSum, bool fixedA, bool fixedB, float restitution, float damping, int M),
+                  (xa, ya, za, xb, yb, zb, vxa, vya, vza, vxb, vyb, vzb, ma, mb, hits, radiusSum, fixedA, fixedB, restitution, damping, M))
+
+// Collision response for one body pair in every member
+inline void ResolveEnsembleCollisions(Ensemble &e, int a, int b)
+{
+    size_t rowA = e.index(a, 0), rowB = e.index(b, 0);
+    EnsembleCollisionRow(&e.px[rowA], &e.py[rowA], &e.pz[rowA],
+                         &e.px[rowB], &e.py[rowB], &e.pz[rowB],
+                         &e.vx[rowA], &e.vy[rowA], &e.vz[rowA],
+                         &e.vx[rowB], &e.vy[rowB], &e.vz[rowB],
+                         &e.mass[rowA], &e.mass[rowB], e.collisions.data(),
+                         e.radius[a] + e.radius[b], e.fixed[a], e.fixed[b],
+                         e.restitution, e.collisionDamping, e.memberStride);
+}
+
+// Semi-implicit Euler for one body in every member
+KERNEL_INLINE void EnsembleIntegrateRowBody(float *__restrict x, float *__restrict y, float *__restrict z,
+                                            float *__restrict u, float *__restrict v, float *__restrict w,
+                                            const float *__restrict accX, const float *__restrict accY, const float *__restrict accZ,
+                                            float dt, int M)
+{
+    for (int m = 0; m < M; ++m)
+    {
+        u[m] += accX[m] * dt;
+        v[m] += accY[m] * dt;
+        w[m] += accZ[m] * dt;
+        x[m] += u[m] * dt;
+        y[m] += v[m] * dt;
+        z[m] += w[m] * dt;
+    }
+}
+
+DISPATCHED_KERNEL(EnsembleIntegrateRow,
+                  (float *__restrict x, float *__restrict y, float *__restrict z, float *__restrict u,
+                   float *__restrict v, float *__restrict w, const float *__restrict accX, const float *__restrict accY,
+                   const float *__restrict accZ, float dt, int M),
+                  (x, y, z, u, v, w, accX, accY, accZ, dt, M))
+
+// One lockstep sub-step for every member: forces, semi-implicit Euler, collisions
+inline void StepEnsemble(Ensemble &e, float dt)
+{
+    ComputeEnsembleAccelerations(e);
+
+    for (int b = 0; b < e.bodies; ++b)
+    {
+        if (e.fixed[b])
+            continue;
+        size_t row = e.index(b, 0);
+        EnsembleIntegrateRow(&e.px[row], &e.py[row], &e.pz[row], &e.vx[row], &e.vy[row], &e.vz[row],
+                             &e.ax[row], &e.ay[row], &e.az[row], dt, e.memberStride);
+    }
+
+    for (int a = 0; a < e.bodies; ++a)
+        for (int b = a + 1; b < e.bodies; ++b)
+            ResolveEnsembleCollisions(e, a, b);
+}
+
+// Number of real members (padding excluded) with a body beyond 'escapeRadius'
+inline int CountEscapedMembers(const Ensemble &e, double escapeRadius)
+{
+    int escaped = 0;
+    const float limit = float(escapeRadius * escapeRadius);
+    for (int m = 0; m < e.members; ++m)
+    {
+        for (int b = 0; b < e.bodies; ++b)
+        {
+            size_t k = e.index(b, m);
+            float r2 = e.px[k] * e.px[k] + e.py[k] * e.py[k] + e.pz[k] * e.pz[k];
+            if (!std::isfinite(r2) || r2 > limit)
+            {
+                escaped++;
+                break;
+            }
+        }
+    }
+    return escaped;
+}
@@ -0,0 +1,1048 @@
+//
+//  Headless_Simulation.h
+//  SpaceEngine
+//
+//  Window-free version of the Solar System demos, for batch runs and analysis tools.
+//
+//  The bodies live in a structure-of-arrays World (one array per component, in double
+//  precision) instead of a std::vector<Object3D>. The physics is the same as in the
+//  Fast and Slow demos: pairwise gravity with a minimum distance, a semi-implicit
+//  Euler step and the same collision response. The hand-tuned constants of those demos
+//  are collected in a Scenario so they can be changed without editing code.
+//
+//  Close pairs are softened the same way as calculateGravitationalForce by default (the
+//  distance is clamped to (radiusA + radiusB) * minDistanceFactor), or with a smooth
+//  Plummer or spline kernel chosen per scenario, see Softening.
+//
+//  Runs are reproducible: the initial conditions come from a counter-based random
+//  generator (the same numbers on every platform and standard library), every body
+//  sums its forces in the same fixed partner order no matter how many threads share
+//  the work, and collisions are always resolved in (i, j) order. HashWorld() gives a
+//  fingerprint of the state to compare runs. Thread counts never change the hash; to
+//  match across compilers and CPUs the builds must also agree on floating point
+//  contraction (-ffp-contract=off) and on the libm used for the initial sin/cos.
+//
+
+#pragma once
+
+#include "Thread_Pool.h"
+#include "Cpu_Dispatch.h"
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <chrono>
+
+// ===== Deterministic random numbers =====
+
+// SplitMix64 finaliser, scrambles all 64 bits
+inline uint64_t MixBits(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Counter-based generator: the number depends only on (seed, stream, counter), so it does
+// not matter which thread asks or in which order, and no state has to be carried around
+inline uint64_t CounterRandom(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+    return MixBits(MixBits(seed + 0x9e3779b97f4a7c15ULL * (stream + 1)) ^ (counter * 0xd1b54a32d192ed03ULL));
+}
+
+// Uniform double in [0, 1)
+inline double CounterUniform(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+    return (CounterRandom(seed, stream, counter) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Standard normal deviate (Box-Muller), uses counters 2k and 2k + 1
+inline double CounterNormal(uint64_t seed, uint64_t stream, uint64_t k)
+{
+    double u1 = 1.0 - CounterUniform(seed, stream, 2 * k); // (0, 1], keeps the log finite
+    double u2 = CounterUniform(seed, stream, 2 * k + 1);
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+
+// How gravity is softened between bodies closer than h = (radiusA + radiusB) * minDistanceFactor
+enum class Softening
+{
+    Clamp,   // Distance clamped to h like calculateGravitationalForce (the demos); the force has a kink at h
+    Plummer, // G m / (r^2 + eps^2) with eps = h / PLUMMER_SPLINE_RATIO, smooth but never exactly Newtonian
+    Spline   // Cubic spline kernel with support h (as in GADGET): smooth and exactly Newtonian beyond h
+};
+
+// Spline support over the Plummer length with the same potential at r = 0
+const double PLUMMER_SPLINE_RATIO = 2.8;
+
+inline const char *SofteningName(Softening softening)
+{
+    switch (softening)
+    {
+    case Softening::Plummer:
+        return "plummer";
+    case Softening::Spline:
+        return "spline";
+    default:
+        return "clamp";
+    }
+}
+
+// Parses a name as printed by SofteningName(), returns false if unknown
+inline bool ParseSoftening(const std::string &name, Softening &out)
+{
+    for (Softening softening : {Softening::Clamp, Softening::Plummer, Softening::Spline})
+    {
+        if (name == SofteningName(softening))
+        {
+            out = softening;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tunable constants of a Solar System run. The defaults are the Fast demo.
+struct Scenario
+{
+    std::string name = "fast";
+
+    double G = 6.674;                   // Gravitational constant
+    double sunMass = 5000.0;            // Mass of the fixed central star
+    double innerVelocityFactor = 0.95;  // Planet 1 speed relative to a circular orbit
+    double middleVelocityFactor = 1.0;  // Planets 2 and 3
+    double outerVelocityFactor = 0.92;  // Planet 4
+    double outerVerticalVelocity = 0.1; // Out of plane speed of planet 4
+    double moonVelocityFactor = 1.0;    // Moon speed around planet 2
+    double asteroidVelocityMin = 0.98;  // Asteroid speed = circular * (min + range * random)
+    double asteroidVelocityRange = 0.04;
+    int asteroidCount = 8;
+    double beltRadius = 9.5;        // Mean distance of the asteroid belt from the star
+    double beltWidth = 0.3;         // Radial spread of the belt
+    double beltThickness = 0.0;     // Vertical spread of the belt (flat in the demos)
+    double asteroidMassScale = 1.0; // Asteroid mass = scale * (0.5 + random)
+
+    double maxTimestep = 0.001;     // Physics step (MAX_TIMESTEP in the demos)
+    double minDistanceFactor = 2.0; // Gravity uses at least (radiusA + radiusB) * factor as distance
+    Softening softening = Softening::Clamp; // How that distance is applied
+    double restitution = 0.8;       // Bounciness of collisions
+    double collisionDamping = 0.98; // Velocity kept after a collision
+    double escapeRadius = 64.0;     // Bodies further out than this count as escaped
+};
+
+// Same constants as "Solar_System_(Fast).cpp"
+inline Scenario FastScenario()
+{
+    return Scenario();
+}
+
+// Same constants as "Solar_System_(Slow).cpp"
+inline Scenario SlowScenario()
+{
+    Scenario s;
+    s.name = "slow";
+    s.G = 1.0;
+    s.sunMass = 1000.0;
+    s.innerVelocityFactor = 0.7;
+    s.middleVelocityFactor = 0.7;
+    s.outerVelocityFactor = 0.65;
+    s.outerVerticalVelocity = 0.05;
+    s.moonVelocityFactor = 0.5;
+    s.asteroidVelocityMin = 0.6;
+    s.asteroidVelocityRange = 0.1;
+    s.maxTimestep = 0.01;
+    return s;
+}
+
+// Looks up a scenario by name ("fast" or "slow"), returns false if unknown
+inline bool ScenarioByName(const std::string &name, Scenario &out)
+{
+    if (name == "fast")
+        out = FastScenario();
+    else if (name == "slow")
+        out = SlowScenario();
+    else
+        return false;
+    return true;
+}
+
+// Sets one scenario constant by name, used by command line tools. Returns false if unknown.
+inline bool SetScenarioParameter(Scenario &s, const std::string &name, double value)
+{
+    if (name == "G")
+        s.G = value;
+    else if (name == "sunMass")
+        s.sunMass = value;
+    else if (name == "innerVelocityFactor")
+        s.innerVelocityFactor = value;
+    else if (name == "middleVelocityFactor")
+        s.middleVelocityFactor = value;
+    else if (name == "outerVelocityFactor")
+        s.outerVelocityFactor = value;
+    else if (name == "outerVerticalVelocity")
+        s.outerVerticalVelocity = value;
+    else if (name == "moonVelocityFactor")
+        s.moonVelocityFactor = value;
+    else if (name == "asteroidVelocityMin")
+        s.asteroidVelocityMin = value;
+    else if (name == "asteroidVelocityRange")
+        s.asteroidVelocityRange = value;
+    else if (name == "asteroidCount")
+        s.asteroidCount = (int)value;
+    else if (name == "beltRadius")
+        s.beltRadius = value;
+    else if (name == "beltWidth")
+        s.beltWidth = value;
+    else if (name == "beltThickness")
+        s.beltThickness = value;
+    else if (name == "asteroidMassScale")
+        s.asteroidMassScale = value;
+    else if (name == "maxTimestep")
+        s.maxTimestep = value;
+    else if (name == "minDistanceFactor")
+        s.minDistanceFactor = value;
+    else if (name == "restitution")
+        s.restitution = value;
+    else if (name == "collisionDamping")
+        s.collisionDamping = value;
+    else if (name == "escapeRadius")
+        s.escapeRadius = value;
+    else
+        return false;
+    return true;
+}
+
+// How the gravity sum is evaluated
+enum class ForcePrecision
+{
+    Double,      // Everything in double (the default, matches the demos)
+    MixedDouble, // Pair terms in float, each body's sum in double
+    MixedKahan   // Pair terms in float, each body's sum in float with Kahan compensation
+};
+
+inline const char *ForcePrecisionName(ForcePrecision precision)
+{
+    switch (precision)
+    {
+    case ForcePrecision::MixedDouble:
+        return "float terms, double sums";
+    case ForcePrecision::MixedKahan:
+        return "float terms, Kahan float sums";
+    default:
+        return "double";
+    }
+}
+
+// All bodies of a simulation, one array per component
+struct World
+{
+    std::vector<double> px, py, pz; // Position
+    std::vector<double> vx, vy, vz; // Velocity
+    std::vector<double> ax, ay, az; // Acceleration of the current step
+    std::vector<double> mass;
+    std::vector<double> radius;
+    std::vector<float> cr, cg, cb;    // Colour, only needed by viewers
+    std::vector<unsigned char> fixed; // Immovable bodies (e.g. the sun)
+
+    // Bodies may be reordered for locality (see Morton_Order.h). id[i] is the creation
+    // index of the body in slot i and never changes; slot[id] finds it again.
+    std::vector<uint32_t> id, slot;
+
+    double G = 6.674;
+    double minDistanceFactor = 2.0;
+    Softening softening = Softening::Clamp;
+    double restitution = 0.8;
+    double collisionDamping = 0.98;
+    bool compensatedSummation = false; // Kahan summation of each body's forces
+    ForcePrecision forcePrecision = ForcePrecision::Double;
+    double time = 0.0;
+
+    // Single-precision copies of position, G * mass and radius for the mixed force modes,
+    // refreshed at the start of every force evaluation
+    std::vector<float> spx, spy, spz, sGm, sRadius;
+
+    size_t size() const { return px.size(); }
+
+    void addBody(double x, double y, double z, double velX, double velY, double velZ,
+                 double m, float red, float green, float blue, double r, bool isFixed = false)
+    {
+        px.push_back(x);
+        py.push_back(y);
+        pz.push_back(z);
+        vx.push_back(velX);
+        vy.push_back(velY);
+        vz.push_back(velZ);
+        ax.push_back(0.0);
+        ay.push_back(0.0);
+        az.push_back(0.0);
+        mass.push_back(m);
+        radius.push_back(r);
+        cr.push_back(red);
+        cg.push_back(green);
+        cb.push_back(blue);
+        fixed.push_back(isFixed ? 1 : 0);
+        id.push_back((uint32_t)slot.size());
+        slot.push_back((uint32_t)slot.size());
+    }
+};
+
+// Builds the same system as CreateObjects() in the Fast/Slow demos. The asteroid belt is
+// randomised from 'seed' with the counter-based generator instead of rand(): asteroid i
+// draws from stream i, so the same seed gives the same belt everywhere.
+inline World CreateWorld(const Scenario &s, uint64_t seed)
+{
+    World world;
+    world.G = s.G;
+    world.minDistanceFactor = s.minDistanceFactor;
+    world.softening = s.softening;
+    world.restitution = s.restitution;
+    world.collisionDamping = s.collisionDamping;
+
+    const double G = s.G;
+    const double sunMass = s.sunMass;
+
+    // Central star (Sun), fixed in place
+    world.addBody(0.0, 0.0, 0.0, 0.0, 0.0, 0.0, sunMass, 1.0f, 0.9f, 0.3f, 1.5, true);
+
+    // Planet 1 - Inner orbit
+    double r1 = 5.0;
+    double v1 = std::sqrt(G * sunMass / r1) * s.innerVelocityFactor;
+    world.addBody(r1, 0.0, 0.0, 0.0, 0.0, v1, 10.0, 0.8f, 0.4f, 0.2f, 0.3);
+
+    // Planet 2 - Middle orbit
+    double r2 = 8.0;
+    double v2 = std::sqrt(G * sunMass / r2) * s.middleVelocityFactor;
+    world.addBody(r2, 0.0, 0.0, 0.0, 0.0, v2, 15.0, 0.2f, 0.5f, 1.0f, 0.4);
+
+    // Planet 3 - Outer orbit
+    double r3 = 12.0;
+    double v3 = std::sqrt(G * sunMass / r3) * s.middleVelocityFactor;
+    world.addBody(r3, 0.0, 0.0, 0.0, 0.0, v3, 20.0, 1.0f, 0.3f, 0.3f, 0.5);
+
+    // Planet 4 - Far orbit, slightly out of plane
+    double r4 = 16.0;
+    double v4 = std::sqrt(G * sunMass / r4) * s.outerVelocityFactor;
+    world.addBody(r4, 0.0, 0.0, 0.0, s.outerVerticalVelocity, v4, 18.0, 0.5f, 0.3f, 0.8f, 0.45);
+
+    // Moon orbiting planet 2
+    double moonOrbitRadius = 1.2;
+    double moonOrbitalSpeed = std::sqrt(G * 15.0 / moonOrbitRadius) * s.moonVelocityFactor;
+    world.addBody(r2 + moonOrbitRadius, 0.0, 0.0, 0.0, 0.0, v2 + moonOrbitalSpeed, 2.0, 0.8f, 0.8f, 0.8f, 0.15);
+
+    // Asteroid belt
+    for (int i = 0; i < s.asteroidCount; i++)
+    {
+        auto random01 = [&](int draw)
+        { return CounterUniform(seed, i, draw); };
+
+        double angle = i * 2.0 * M_PI / s.asteroidCount;
+        double asteroidR = s.beltRadius + s.beltWidth * (random01(0) - 0.5);
+        double asteroidV = std::sqrt(G * sunMass / asteroidR) * (s.asteroidVelocityMin + s.asteroidVelocityRange * random01(1));
+        double m = (0.5 + random01(2)) * s.asteroidMassScale;
+        float red = float(0.5 + 0.3 * random01(3));
+        float green = float(0.4 + 0.3 * random01(4));
+        float blue = float(0.3 + 0.3 * random01(5));
+        double r = 0.05 + 0.05 * random01(6);
+        double height = s.beltThickness > 0.0 ? s.beltThickness * (random01(7) - 0.5) : 0.0;
+
+        world.addBody(asteroidR * std::cos(angle), height, asteroidR * std::sin(angle),
+                      -asteroidV * std::sin(angle), 0.0, asteroidV * std::cos(angle),
+                      m, red, green, blue, r);
+    }
+
+    return world;
+}
+
+// Units of the SCALED demo: AU, kg and seconds
+const double SCALED_AU_METERS = 149597870700.0;
+const double SCALED_G = 1.993560809749174e-44; // AU^3 kg^-1 s^-2
+const double SCALED_RADIUS_SCALE = 0.005;       // Visual radii, also the force clamp distance
+
+// Builds the same Sun and eight planets as CreateObjects() in "Solar_System_(SCALED).cpp".
+// Nothing is fixed there, the Sun moves too, and gravity is clamped at radiusA + radiusB.
+inline World CreateScaledWorld()
+{
+    World world;
+    world.G = SCALED_G;
+    world.minDistanceFactor = 1.0;
+    auto kmps = [](double speed)
+    { return speed * 1000.0 / SCALED_AU_METERS; };
+
+    struct Planet
+    {
+        double distance, speed, mass, radius;
+        float red, green, blue;
+    };
+    const Planet bodies[] = {{0.0, 0.0, 1.989e30, 65.0, 1.0f, 0.9f, 0.3f},     // Sun
+                             {0.387, 47.36, 3.3011e23, 0.383, 0.7f, 0.4f, 0.2f}, // Mercury
+                             {0.723, 35.02, 4.8675e24, 0.949, 0.9f, 0.7f, 0.4f}, // Venus
+                             {1.0, 29.78, 5.97237e24, 1.0, 0.2f, 0.4f, 0.7f},    // Earth
+                             {1.524, 24.07, 6.4171e23, 0.532, 0.9f, 0.5f, 0.3f}, // Mars
+                             {5.203, 13.07, 1.8982e27, 11.21, 1.0f, 0.5f, 0.2f}, // Jupiter
+                             {9.537, 9.69, 5.6834e26, 9.45, 0.8f, 0.7f, 0.6f},   // Saturn
+                             {19.191, 6.81, 8.6810e25, 4.01, 0.6f, 0.8f, 0.9f},  // Uranus
+                             {30.07, 5.43, 1.02413e26, 3.88, 0.3f, 0.5f, 0.9f}}; // Neptune
+    for (const Planet &p : bodies)
+        world.addBody(p.distance, 0.0, 0.0, 0.0, kmps(p.speed), 0.0, p.mass, p.red, p.green, p.blue,
+                      p.radius * SCALED_RADIUS_SCALE);
+    return world;
+}
+
+// ===== Softening kernels =====
+
+// Acceleration per unit separation vector from a body with G * m = gm at 'distance', with
+// softening length h: a = dx * SoftenedScale(). Branch free so it vectorizes in the lane
+// kernels; the caller drops the self term (distance 0).
+template <Softening S, typename T>
+KERNEL_INLINE T SoftenedScale(T gm, T distance, T h)
+{
+    if (S == Softening::Clamp)
+    {
+        T clamped = std::max(distance, h);
+        return gm / (clamped * clamped * distance);
+    }
+    if (S == Softening::Plummer)
+    {
+        T eps = h * T(1.0 / PLUMMER_SPLINE_RATIO);
+        T squared = distance * distance + eps * eps;
+        return gm / (squared * std::sqrt(squared));
+    }
+
+    // Spline: polynomials in u = r / h inside the support, 1 / r^3 outside
+    T hInverse = T(1) / h;
+    T u = distance * hInverse;
+    T h3 = hInverse * hInverse * hInverse;
+    T inner = h3 * (T(32.0 / 3.0) + u * u * (T(32) * u - T(38.4)));
+    T outer = h3 * (T(64.0 / 3.0) - T(48) * u + T(38.4) * u * u - T(32.0 / 3.0) * u * u * u - T(1.0 / 15.0) / (u * u * u));
+    T newton = T(1) / (distance * distance * distance);
+    return gm * (u < T(0.5) ? inner : (u < T(1) ? outer : newton));
+}
+
+// Same with the kernel chosen at run time, for the scalar paths
+template <typename T>
+inline T SoftenedScale(Softening softening, T gm, T distance, T h)
+{
+    switch (softening)
+    {
+    case Softening::Plummer:
+        return SoftenedScale<Softening::Plummer>(gm, distance, h);
+    case Softening::Spline:
+        return SoftenedScale<Softening::Spline>(gm, distance, h);
+    default:
+        return SoftenedScale<Softening::Clamp>(gm, distance, h);
+    }
+}
+
+// Potential matching SoftenedScale() per unit G m1 m2 (so E_pot = -G m1 m2 * this). The
+// clamp keeps the demos' 1 / max(r, h), which is not the exact potential of its force.
+inline double SoftenedInversePotential(Softening softening, double distance, double h)
+{
+    if (softening == Softening::Plummer)
+    {
+        double eps = h / PLUMMER_SPLINE_RATIO;
+        return 1.0 / std::sqrt(distance * distance + eps * eps);
+    }
+    if (softening == Softening::Spline && distance < h)
+    {
+        double u = distance / h;
+        double w = u < 0.5 ? -2.8 + u * u * (16.0 / 3.0 + u * u * (6.4 * u - 9.6))
+                           : -3.2 + 1.0 / (15.0 * u) + u * u * (32.0 / 3.0 + u * (-16.0 + u * (9.6 - 32.0 / 15.0 * u)));
+        return -w / h;
+    }
+    return 1.0 / std::max(distance, h);
+}
+
+// Pairwise gravity on body i, same minimum distance rule as calculateGravitationalForce.
+// The partners are summed in index order, so the result does not depend on how the
+// bodies are split between threads.
+inline void ComputeBodyAcceleration(World &w, size_t i)
+{
+    const size_t n = w.size();
+    double accX = 0.0, accY = 0.0, accZ = 0.0;
+    double lostX = 0.0, lostY = 0.0, lostZ = 0.0; // Kahan compensation terms
+    if (!w.fixed[i])
+    {
+        for (size_t j = 0; j < n; ++j)
+        {
+            if (j == i)
+                continue;
+            double dx = w.px[j] - w.px[i];
+            double dy = w.py[j] - w.py[i];
+            double dz = w.pz[j] - w.pz[i];
+            double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (distance <= 0.0)
+                continue;
+
+            double minDistance = (w.radius[i] + w.radius[j]) * w.minDistanceFactor;
+
+            // a = G * m_j / d^2 along the unit direction, softened inside minDistance
+            double scale = SoftenedScale(w.softening, w.G * w.mass[j], distance, minDistance);
+            if (w.compensatedSummation)
+            {
+                double termX = dx * scale - lostX, sumX = accX + termX;
+                double termY = dy * scale - lostY, sumY = accY + termY;
+                double termZ = dz * scale - lostZ, sumZ = accZ + termZ;
+                lostX = (sumX - accX) - termX;
+                lostY = (sumY - accY) - termY;
+                lostZ = (sumZ - accZ) - termZ;
+                accX = sumX;
+                accY = sumY;
+                accZ = sumZ;
+            }
+            else
+            {
+                accX += dx * scale;
+                accY += dy * scale;
+                accZ += dz * scale;
+            }
+        }
+    }
+    w.ax[i] = accX;
+    w.ay[i] = accY;
+    w.az[i] = accZ;
+}
+
+// Bodies handled together by ForceLanesKernel, one per SIMD lane
+const size_t FORCE_LANES = 8;
+
+// Adds the gravity of sources [sourceBegin, sourceEnd) to bodies [first, first + FORCE_LANES).
+// Every lane does exactly the arithmetic of ComputeBodyAcceleration in the same order, so
+// running the sources in one go or tile by tile gives bit-identical results; the self
+// term (distance 0) is selected away instead of skipped so the lane loop has no branches.
+template <Softening S>
+KERNEL_INLINE void ForceLanesBody(size_t sourceBegin, size_t sourceEnd, size_t first,
+                                        const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                                        const double *__restrict mass, const double *__restrict radius,
+                                        double G, double minDistanceFactor,
+                                        double *__restrict ax, double *__restrict ay, double *__restrict az)
+{
+    double xi[FORCE_LANES], yi[FORCE_LANES], zi[FORCE_LANES], ri[FORCE_LANES];
+    double accX[FORCE_LANES], accY[FORCE_LANES], accZ[FORCE_LANES];
+    for (size_t lane = 0; lane < FORCE_LANES; ++lane)
+    {
+        xi[lane] = px[first + lane];
+        yi[lane] = py[first + lane];
+        zi[lane] = pz[first + lane];
+        ri[lane] = radius[first + lane];
+        accX[lane] = ax[first + lane];
+        accY[lane] = ay[first + lane];
+        accZ[lane] = az[first + lane];
+    }
+
+    for (size_t j = sourceBegin; j < sourceEnd; ++j)
+    {
+        const double xj = px[j], yj = py[j], zj = pz[j], mj = mass[j], rj = radius[j];
+        for (size_t lane = 0; lane < FORCE_LANES; ++lane)
+        {
+            double dx = xj - xi[lane];
+            double dy = yj - yi[lane];
+            double dz = zj - zi[lane];
+            double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            double minDistance = (ri[lane] + rj) * minDistanceFactor;
+            double scale = SoftenedScale<S>(G * mj, distance, minDistance);
+            scale = distance > 0.0 ? scale : 0.0;
+            accX[lane] += dx * scale;
+            accY[lane] += dy * scale;
+            accZ[lane] += dz * scale;
+        }
+    }
+
+    for (size_t lane = 0; lane < FORCE_LANES; ++lane)
+    {
+        ax[first + lane] = accX[lane];
+        ay[first + lane] = accY[lane];
+        az[first + lane] = accZ[lane];
+    }
+}
+
+// One kernel for all softening kinds, the switch is outside the loops
+KERNEL_INLINE void ForceLanesKernelBody(size_t sourceBegin, size_t sourceEnd, size_t first,
+                                        const double *__restrict px, const double *__restrict py, const double *__restrict pz,
+                                        const double *__restrict mass, const double *__restrict radius,
+                                        double G, double minDistanceFactor, Softening softening,
+                                        double *__restrict ax, double *__restrict ay, double *__restrict az)
+{
+    switch (softening)
+    {
+    case Softening::Plummer:
+        ForceLanesBody<Softening::Plummer>(sourceBegin, sourceEnd, first, px, py, pz, mass, radius, G, minDistanceFactor, ax, ay, az);
+        break;
+    case Softening::Spline:
+        ForceLanesBody<Softening::Spline>(sourceBegin, sourceEnd, first, px, py, pz, mass, radius, G, minDistanceFactor, ax, ay, az);
+        break;
+    default:
+        ForceLanesBody<Softening::Clamp>(sourceBegin, sourceEnd, first, px, py, pz, mass, radius, G, minDistanceFactor, ax, ay, az);
+        break;
+    }
+}
+
+DISPATCHED_KERNEL(ForceLanesKernel,
+                  (size_t sourceBegin, size_t sourceEnd, size_t first, const double *__restrict px,
+                   const double *__restrict py, const double *__restrict pz, const double *__restrict mass,
+                   const double *__restrict radius, double G, double minDistanceFactor, Softening softening,
+                   double *__restrict ax, double *__restrict ay, double *__restrict az),
+                  (sourceBegin, sourceEnd, first, px, py, pz, mass, radius, G, minDistanceFactor, softening, ax, ay, az))
+
+// Bodies handled together by the float kernels: twice as many fit in a register
+const size_t MIXED_FORCE_LANES = 16;
+
+// Float version of ForceLanesKernelBody for bodies [first, first + MIXED_FORCE_LANES).
+// The pair terms are float, so the lanes are twice as wide; only the sums are kept more
+// precisely, either in double or as float plus a Kahan compensation term. Without that a
+// far asteroid's 1e-7 contribution vanishes next to the Sun's term.
+template <bool Kahan, Softening S>
+KERNEL_INLINE void ForceLanesFloatBody(size_t n, size_t first,
+                                       const float *__restrict px, const float *__restrict py, const float *__restrict pz,
+                                       const float *__restrict gm, const float *__restrict radius, float minDistanceFactor,
+                                       double *__restrict ax, double *__restrict ay, double *__restrict az)
+{
+    using Sum = typename std::conditional<Kahan, float, double>::type;
+    float xi[MIXED_FORCE_LANES], yi[MIXED_FORCE_LANES], zi[MIXED_FORCE_LANES], ri[MIXED_FORCE_LANES];
+    Sum accX[MIXED_FORCE_LANES], accY[MIXED_FORCE_LANES], accZ[MIXED_FORCE_LANES];
+    float lostX[MIXED_FORCE_LANES], lostY[MIXED_FORCE_LANES], lostZ[MIXED_FORCE_LANES];
+    for (size_t lane = 0; lane < MIXED_FORCE_LANES; ++lane)
+    {
+        xi[lane] = px[first + lane];
+        yi[lane] = py[first + lane];
+        zi[lane] = pz[first + lane];
+        ri[lane] = radius[first + lane];
+        accX[lane] = accY[lane] = accZ[lane] = 0;
+        lostX[lane] = lostY[lane] = lostZ[lane] = 0.0f;
+    }
+
+    for (size_t j = 0; j < n; ++j)
+    {
+        const float xj = px[j], yj = py[j], zj = pz[j], gmj = gm[j], rj = radius[j];
+        for (size_t lane = 0; lane < MIXED_FORCE_LANES; ++lane)
+        {
+            float dx = xj - xi[lane];
+            float dy = yj - yi[lane];
+            float dz = zj - zi[lane];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float minDistance = (ri[lane] + rj) * minDistanceFactor;
+            float scale = SoftenedScale<S>(gmj, distance, minDistance);
+            scale = distance > 0.0f ? scale : 0.0f;
+            if (Kahan)
+            {
+                float termX = dx * scale - lostX[lane], sumX = accX[lane] + termX;
+                float termY = dy * scale - lostY[lane], sumY = accY[lane] + termY;
+                float termZ = dz * scale - lostZ[lane], sumZ = accZ[lane] + termZ;
+                lostX[lane] = (sumX - accX[lane]) - termX;
+                lostY[lane] = (sumY - accY[lane]) - termY;
+                lostZ[lane] = (sumZ - accZ[lane]) - termZ;
+                accX[lane] = sumX;
+                accY[lane] = sumY;
+                accZ[lane] = sumZ;
+            }
+            else
+            {
+                accX[lane] += dx * scale;
+                accY[lane] += dy * scale;
+                accZ[lane] += dz * scale;
+            }
+        }
+    }
+
+    for (size_t lane = 0; lane < MIXED_FORCE_LANES; ++lane)
+    {
+        ax[first + lane] = accX[lane];
+        ay[first + lane] = accY[lane];
+        az[first + lane] = accZ[lane];
+    }
+}
+
+template <bool Kahan>
+KERNEL_INLINE void ForceLanesFloatKernel(size_t n, size_t first, const float *px, const float *py, const float *pz,
+                                         const float *gm, const float *radius, float minDistanceFactor, Softening softening,
+                                         double *ax, double *ay, double *az)
+{
+    switch (softening)
+    {
+    case Softening::Plummer:
+        ForceLanesFloatBody<Kahan, Softening::Plummer>(n, first, px, py, pz, gm, radius, minDistanceFactor, ax, ay, az);
+        break;
+    case Softening::Spline:
+        ForceLanesFloatBody<Kahan, Softening::Spline>(n, first, px, py, pz, gm, radius, minDistanceFactor, ax, ay, az);
+        break;
+    default:
+        ForceLanesFloatBody<Kahan, Softening::Clamp>(n, first, px, py, pz, gm, radius, minDistanceFactor, ax, ay, az);
+        break;
+    }
+}
+
+KERNEL_INLINE void ForceLanesMixedKernelBody(size_t n, size_t first, const float *px, const float *py, const float *pz,
+                                             const float *gm, const float *radius, float minDistanceFactor, Softening softening,
+                                             double *ax, double *ay, double *az)
+{
+    ForceLanesFloatKernel<false>(n, first, px, py, pz, gm, radius, minDistanceFactor, softening, ax, ay, az);
+}
+
+KERNEL_INLINE void ForceLanesKahanKernelBody(size_t n, size_t first, const float *px, const float *py, const float *pz,
+                                             const float *gm, const float *radius, float minDistanceFactor, Softening softening,
+                                             double *ax, double *ay, double *az)
+{
+    ForceLanesFloatKernel<true>(n, first, px, py, pz, gm, radius, minDistanceFactor, softening, ax, ay, az);
+}
+
+DISPATCHED_KERNEL(ForceLanesMixedKernel,
+                  (size_t n, size_t first, const float *px, const float *py, const float *pz, const float *gm,
+                   const float *radius, float minDistanceFactor, Softening softening, double *ax, double *ay, double *az),
+                  (n, first, px, py, pz, gm, radius, minDistanceFactor, softening, ax, ay, az))
+
+DISPATCHED_KERNEL(ForceLanesKahanKernel,
+                  (size_t n, size_t first, const float *px, const float *py, const float *pz, const float *gm,
+                   const float *radius, float minDistanceFactor, Softening softening, double *ax, double *ay, double *az),
+                  (n, first, px, py, pz, gm, radius, minDistanceFactor, softening, ax, ay, az))
+
+// Fills the single-precision copies used by the mixed force modes
+inline void RefreshSinglePrecision(World &w)
+{
+    const size_t n = w.size();
+    w.spx.resize(n);
+    w.spy.resize(n);
+    w.spz.resize(n);
+    w.sGm.resize(n);
+    w.sRadius.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        w.spx[i] = (float)w.px[i];
+        w.spy[i] = (float)w.py[i];
+        w.spz[i] = (float)w.pz[i];
+        w.sGm[i] = (float)(w.G * w.mass[i]);
+        w.sRadius[i] = (float)w.radius[i];
+    }
+}
+
+// Zeroes the acceleration of fixed bodies in [begin, end)
+inline void ClearFixedAccelerations(World &w, size_t begin, size_t end)
+{
+    for (size_t k = begin; k < end; ++k)
+        if (w.fixed[k])
+            w.ax[k] = w.ay[k] = w.az[k] = 0.0;
+}
+
+// Gravity for bodies [begin, end). Full lane groups go through the dispatched kernels
+// (float ones in the mixed modes, which need RefreshSinglePrecision() first); Kahan
+// summation in double and the leftovers take the scalar path.
+//
+// In double the sources are walked in tiles of 'sourceTile' bodies (0: all at once): each
+// tile is used by every lane group of the range while it is still in L1, instead of the
+// whole array streaming through the cache once per group.
+inline void ComputeAccelerationRange(World &w, size_t begin, size_t end, size_t sourceTile = 0)
+{
+    size_t i = begin;
+    if (w.forcePrecision != ForcePrecision::Double)
+    {
+        auto kernel = w.forcePrecision == ForcePrecision::MixedKahan ? ForceLanesKahanKernel : ForceLanesMixedKernel;
+        for (; i + MIXED_FORCE_LANES <= end; i += MIXED_FORCE_LANES)
+        {
+            kernel(w.size(), i, w.spx.data(), w.spy.data(), w.spz.data(), w.sGm.data(), w.sRadius.data(),
+                   (float)w.minDistanceFactor, w.softening, w.ax.data(), w.ay.data(), w.az.data());
+            ClearFixedAccelerations(w, i, i + MIXED_FORCE_LANES);
+        }
+    }
+    else if (!w.compensatedSummation)
+    {
+        const size_t n = w.size();
+        const size_t groupsEnd = begin + (end - begin) / FORCE_LANES * FORCE_LANES;
+        const size_t tile = sourceTile ? sourceTile : n;
+        std::fill(w.ax.begin() + begin, w.ax.begin() + groupsEnd, 0.0);
+        std::fill(w.ay.begin() + begin, w.ay.begin() + groupsEnd, 0.0);
+        std::fill(w.az.begin() + begin, w.az.begin() + groupsEnd, 0.0);
+        for (size_t sourceBegin = 0; sourceBegin < n; sourceBegin += tile)
+        {
+            size_t sourceEnd = std::min(n, sourceBegin + tile);
+            for (size_t group = begin; group < groupsEnd; group += FORCE_LANES)
+                ForceLanesKernel(sourceBegin, sourceEnd, group, w.px.data(), w.py.data(), w.pz.data(), w.mass.data(),
+                                 w.radius.data(), w.G, w.minDistanceFactor, w.softening, w.ax.data(), w.ay.data(), w.az.data());
+        }
+        ClearFixedAccelerations(w, begin, groupsEnd);
+        i = groupsEnd;
+    }
+    for (; i < end; ++i)
+        ComputeBodyAcceleration(w, i);
+}
+
+// ===== Force tiling =====
+
+// Cache blocking of the direct sum: targets are processed in blocks of targetTile bodies
+// (also the unit of work handed to the pool), sources in tiles of sourceTile bodies
+struct ForceTiling
+{
+    size_t targetTile = 64; // A multiple of both lane counts
+    size_t sourceTile = 0;  // 0: no source tiling
+};
+
+const size_t FORCE_TILING_MIN_BODIES = 1024; // Below this everything fits in L2 anyway
+const size_t FORCE_TUNING_BODIES = 8192;     // Sources used to time the candidates
+const size_t FORCE_TUNING_TARGETS = 256;
+
+// Times every candidate tiling on a synthetic belt and returns the fastest. All of them
+// give identical results, so this only changes speed.
+inline ForceTiling TuneForceTiling()
+{
+    Scenario scenario = FastScenario();
+    scenario.asteroidCount = (int)FORCE_TUNING_BODIES;
+    World world = CreateWorld(scenario, 1);
+
+    ForceTiling best;
+    double bestSeconds = 1e30;
+    for (size_t targetTile : {32, 64, 128, 256})
+    {
+        for (size_t sourceTile : {0, 256, 512, 1024, 2048, 4096})
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t begin = 0; begin < FORCE_TUNING_TARGETS; begin += targetTile)
+                ComputeAccelerationRange(world, begin, begin + targetTile, sourceTile);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                best.targetTile = targetTile;
+                best.sourceTile = sourceTile;
+            }
+        }
+    }
+    return best;
+}
+
+// Tiling for a world of n bodies: tuned once on first use, untiled for small worlds
+inline ForceTiling SelectedForceTiling(size_t n)
+{
+    if (n < FORCE_TILING_MIN_BODIES)
+        return ForceTiling();
+    static const ForceTiling tuned = TuneForceTiling();
+    return tuned;
+}
+
+// Gravity for every body with the given tiling, spread over the pool if one is given
+inline void ComputeAccelerationsTiled(World &w, const ForceTiling &tiling, ThreadPool *pool = nullptr)
+{
+    const size_t n = w.size();
+    const size_t block = tiling.targetTile;
+    const size_t blocks = (n + block - 1) / block;
+    if (w.forcePrecision != ForcePrecision::Double)
+        RefreshSinglePrecision(w);
+    if (!pool || pool->size() == 1 || blocks == 1)
+    {
+        for (size_t b = 0; b < blocks; ++b)
+            ComputeAccelerationRange(w, b * block, std::min(n, (b + 1) * block), tiling.sourceTile);
+        return;
+    }
+    pool->parallelFor(blocks, [&](size_t b)
+                      { ComputeAccelerationRange(w, b * block, std::min(n, (b + 1) * block), tiling.sourceTile); });
+}
+
+// Gravity for every body, spread over the pool if one is given
+inline void ComputeAccelerations(World &w, ThreadPool *pool = nullptr)
+{
+    ComputeAccelerationsTiled(w, SelectedForceTiling(w.size()), pool);
+}
+
+// Gravity for the listed bodies only, the others keep their old acceleration
+inline void ComputeAccelerationsFor(World &w, const uint32_t *bodies, size_t count, ThreadPool *pool = nullptr)
+{
+    const size_t block = 64;
+    auto runBlock = [&](size_t b)
+    {
+        for (size_t k = b * block; k < std::min(count, (b + 1) * block); ++k)
+            ComputeBodyAcceleration(w, bodies[k]);
+    };
+    size_t blocks = (count + block - 1) / block;
+    if (!pool || pool->size() == 1 || count <= block)
+    {
+        for (size_t b = 0; b < blocks; ++b)
+            runBlock(b);
+        return;
+    }
+    pool->parallelFor(blocks, runBlock);
+}
+
+// Elastic-ish collision response between bodies a and b, same as ResolveCollision in the demos.
+// Returns true if the bodies overlapped.
+inline bool ResolveWorldCollision(World &w, size_t a, size_t b)
+{
+    double dx = w.px[b] - w.px[a];
+    double dy = w.py[b] - w.py[a];
+    double dz = w.pz[b] - w.pz[a];
+    double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+    double overlap = w.radius[a] + w.radius[b] - dist;
+    if (overlap <= 0.0)
+        return false;
+
+    // Collision normal
+    double nx = 1.0, ny = 0.0, nz = 0.0;
+    if (dist > 0.001)
+    {
+        nx = dx / dist;
+        ny = dy / dist;
+        nz = dz / dist;
+    }
+
+    // Push the bodies apart, heavier bodies move less
+    bool fixedA = w.fixed[a], fixedB = w.fixed[b];
+    if (!fixedA && !fixedB)
+    {
+        double totalMass = w.mass[a] + w.mass[b];
+        double ratioA = w.mass[b] / totalMass;
+        double ratioB = w.mass[a] / totalMass;
+        w.px[a] -= nx * overlap * ratioA;
+        w.py[a] -= ny * overlap * ratioA;
+        w.pz[a] -= nz * overlap * ratioA;
+        w.px[b] += nx * overlap * ratioB;
+        w.py[b] += ny * overlap * ratioB;
+        w.pz[b] += nz * overlap * ratioB;
+    }
+    else if (fixedA && !fixedB)
+    {
+        w.px[b] += nx * overlap;
+        w.py[b] += ny * overlap;
+        w.pz[b] += nz * overlap;
+    }
+    else if (!fixedA && fixedB)
+    {
+        w.px[a] -= nx * overlap;
+        w.py[a] -= ny * overlap;
+        w.pz[a] -= nz * overlap;
+    }
+
+    // Don't resolve if velocities are separating
+    double velAlongNormal = (w.vx[b] - w.vx[a]) * nx + (w.vy[b] - w.vy[a]) * ny + (w.vz[b] - w.vz[a]) * nz;
+    if (velAlongNormal > 0.0)
+        return true;
+
+    double invMassA = fixedA ? 0.0 : 1.0 / w.mass[a];
+    double invMassB = fixedB ? 0.0 : 1.0 / w.mass[b];
+    if (invMassA + invMassB <= 0.0)
+        return true;
+    double j = -(1.0 + w.restitution) * velAlongNormal / (invMassA + invMassB);
+
+    if (!fixedA)
+    {
+        w.vx[a] = (w.vx[a] - j * nx * invMassA) * w.collisionDamping;
+        w.vy[a] = (w.vy[a] - j * ny * invMassA) * w.collisionDamping;
+        w.vz[a] = (w.vz[a] - j * nz * invMassA) * w.collisionDamping;
+    }
+    if (!fixedB)
+    {
+        w.vx[b] = (w.vx[b] + j * nx * invMassB) * w.collisionDamping;
+        w.vy[b] = (w.vy[b] + j * ny * invMassB) * w.collisionDamping;
+        w.vz[b] = (w.vz[b] + j * nz * invMassB) * w.collisionDamping;
+    }
+    return true;
+}
+
+// Checks every pair once and resolves overlaps in a fixed (i, j) order, i < j, so the
+// outcome of chained contacts is the same on every run. Returns the number of collisions.
+inline int ResolveWorldCollisions(World &w)
+{
+    int collisions = 0;
+    const size_t n = w.size();
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = i + 1; j < n; ++j)
+            if (ResolveWorldCollision(w, i, j))
+                collisions++;
+    return collisions;
+}
+
+// Semi-implicit Euler (like updatePosition) for every movable body
+KERNEL_INLINE void EulerKernelBody(size_t n, const unsigned char *__restrict fixed,
+                                   double *__restrict px, double *__restrict py, double *__restrict pz,
+                                   double *__restrict vx, double *__restrict vy, double *__restrict vz,
+                                   const double *__restrict ax, const double *__restrict ay, const double *__restrict az,
+                                   double dt)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        bool movable = !fixed[i];
+        double newVx = vx[i] + ax[i] * dt;
+        double newVy = vy[i] + ay[i] * dt;
+        double newVz = vz[i] + az[i] * dt;
+        double newPx = px[i] + newVx * dt;
+        double newPy = py[i] + newVy * dt;
+        double newPz = pz[i] + newVz * dt;
+        vx[i] = movable ? newVx : vx[i];
+        vy[i] = movable ? newVy : vy[i];
+        vz[i] = movable ? newVz : vz[i];
+        px[i] = movable ? newPx : px[i];
+        py[i] = movable ? newPy : py[i];
+        pz[i] = movable ? newPz : pz[i];
+    }
+}
+
+DISPATCHED_KERNEL(EulerKernel,
+                  (size_t n, const unsigned char *__restrict fixed, double *__restrict px, double *__restrict py,
+                   double *__restrict pz, double *__restrict vx, double *__restrict vy, double *__restrict vz,
+                   const double *__restrict ax, const double *__restrict ay, const double *__restrict az, double dt),
+                  (n, fixed, px, py, pz, vx, vy, vz, ax, ay, az, dt))
+
+// Euler step for the whole world through the dispatched kernel
+inline void IntegrateWorld(World &w, double dt)
+{
+    EulerKernel(w.size(), w.fixed.data(), w.px.data(), w.py.data(), w.pz.data(),
+                w.vx.data(), w.vy.data(), w.vz.data(), w.ax.data(), w.ay.data(), w.az.data(), dt);
+}
+
+// One physics sub-step: forces, semi-implicit Euler (like updatePosition), collisions.
+// The pool (optional) only changes the speed, never the result.
+// Returns the number of collisions in this step.
+inline int StepWorld(World &w, double dt, ThreadPool *pool = nullptr)
+{
+    ComputeAccelerations(w, pool);
+    IntegrateWorld(w, dt);
+
+    w.time += dt;
+    return ResolveWorldCollisions(w);
+}
+
+// Total kinetic plus potential energy (potential uses the same softening as the force)
+inline double TotalEnergy(const World &w)
+{
+    const size_t n = w.size();
+    double kinetic = 0.0, potential = 0.0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!w.fixed[i])
+            kinetic += 0.5 * w.mass[i] * (w.vx[i] * w.vx[i] + w.vy[i] * w.vy[i] + w.vz[i] * w.vz[i]);
+
+        for (size_t j = i + 1; j < n; ++j)
+        {
+            double dx = w.px[j] - w.px[i];
+            double dy = w.py[j] - w.py[i];
+            double dz = w.pz[j] - w.pz[i];
+            double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            double minDistance = (w.radius[i] + w.radius[j]) * w.minDistanceFactor;
+            if (w.softening == Softening::Clamp)
+                potential -= w.G * w.mass[i] * w.mass[j] / std::max(distance, minDistance);
+            else
+                potential -= w.G * w.mass[i] * w.mass[j] * SoftenedInversePotential(w.softening, distance, minDistance);
+        }
+    }
+    return kinetic + potential;
+}
+
+// FNV-1a hash of every position and velocity, to check that two runs ended identically
+inline uint64_t HashWorld(const World &w)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const std::vector<double> *array : {&w.px, &w.py, &w.pz, &w.vx, &w.vy, &w.vz})
+    {
+        // In creation order, so reordering the bodies alone doesn't change the hash
+        for (uint32_t slot : w.slot)
+        {
+            double value = (*array)[slot];
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int byte = 0; byte < 8; ++byte)
+            {
+                hash ^= (bits >> (8 * byte)) & 0xff;
+                hash *= 0x100000001b3ULL;
+            }
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,825 @@
+//
+//  Integrators.h
+//  SpaceEngine
+//
+//  Time integrators for a headless World, all driven through the same call as the
+//  demos' updatePosition(dt): advance every movable body by dt.
+//
+//  The force backend is passed in as a callable that fills w.ax/ay/az for the current
+//  positions (direct sum, tree, any precision), so every integrator works with every
+//  backend. Gravity doesn't depend on velocity, so only positions are ever updated
+//  before a force call.
+//
+//    - Euler     semi-implicit Euler like updatePosition, 1st order, 1 force call
+//    - Leapfrog  drift-kick-drift, 2nd order and symplectic, 1 force call
+//    - Yoshida   leapfrog composed three times with weights w1, w0, w1 (Yoshida 1990,
+//                Forest & Ruth 1990), 4th order and symplectic, 3 force calls
+//    - RK4       classic Runge-Kutta, 4th order but not symplectic, 4 force calls
+//    - WisdomHolman  Kepler orbits around the heaviest body plus kicks from everybody
+//                else (Wisdom & Holman 1991, democratic heliocentric form of Duncan,
+//                Levison & Lee 1998). 2nd order in the planet masses, so steps of a
+//                twentieth of the shortest orbit stay accurate, 2 force calls
+//    - Kepler    every body on its own two-body orbit around the heaviest one, exact at
+//                any dt, no force calls. Drops the interactions, for time warp far beyond
+//                what they can be followed at
+//    - IAS15     15th order Gauss-Radau with adaptive steps (Rein & Spiegel 2015).
+//                Takes as many internal steps as its error estimate needs to land on
+//                dt, and keeps the energy error at the level of double round-off. Meant for
+//                smooth, accuracy-critical runs like SCALED: clamped close passes and
+//                collisions in the asteroid belts kink the forces and drive its steps down
+//
+//  Euler keeps the velocities half a kick behind the positions; the others return
+//  synchronised positions and velocities.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Kepler.h"
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+enum class Integrator
+{
+    Euler,
+    Leapfrog,
+    Yoshida,
+    RK4,
+    WisdomHolman,
+    Kepler,
+    IAS15
+};
+
+inline const char *IntegratorName(Integrator integrator)
+{
+    switch (integrator)
+    {
+    case Integrator::Leapfrog:
+        return "leapfrog";
+    case Integrator::Yoshida:
+        return "yoshida";
+    case Integrator::RK4:
+        return "rk4";
+    case Integrator::WisdomHolman:
+        return "wh";
+    case Integrator::Kepler:
+        return "kepler";
+    case Integrator::IAS15:
+        return "ias15";
+    default:
+        return "euler";
+    }
+}
+
+// Parses a name as printed by IntegratorName(), returns false if unknown
+inline bool ParseIntegrator(const std::string &name, Integrator &out)
+{
+    for (Integrator integrator : {Integrator::Euler, Integrator::Leapfrog, Integrator::Yoshida, Integrator::RK4,
+                                  Integrator::WisdomHolman, Integrator::Kepler, Integrator::IAS15})
+    {
+        if (name == IntegratorName(integrator))
+        {
+            out = integrator;
+            return true;
+        }
+    }
+    return false;
+}
+
+// x += v * dt for every movable body
+inline void DriftWorld(World &w, double dt)
+{
+    for (size_t i = 0; i < w.size(); ++i)
+    {
+        if (w.fixed[i])
+            continue;
+        w.px[i] += w.vx[i] * dt;
+        w.py[i] += w.vy[i] * dt;
+        w.pz[i] += w.vz[i] * dt;
+    }
+}
+
+// v += a * dt for every movable body
+inline void KickWorld(World &w, double dt)
+{
+    for (size_t i = 0; i < w.size(); ++i)
+    {
+        if (w.fixed[i])
+            continue;
+        w.vx[i] += w.ax[i] * dt;
+        w.vy[i] += w.ay[i] * dt;
+        w.vz[i] += w.az[i] * dt;
+    }
+}
+
+// Drift-kick-drift leapfrog
+template <typename Forces>
+void StepLeapfrog(World &w, double dt, Forces &&forces)
+{
+    DriftWorld(w, 0.5 * dt);
+    forces(w);
+    KickWorld(w, dt);
+    DriftWorld(w, 0.5 * dt);
+}
+
+// Weights of the 4th order composition: w1 + w0 + w1 = 1, and the negative middle step
+// cancels the 3rd order error of the outer two
+const double YOSHIDA_W1 = 1.0 / (2.0 - std::cbrt(2.0));
+const double YOSHIDA_W0 = 1.0 - 2.0 * YOSHIDA_W1;
+
+// Three leapfrogs of w1 dt, w0 dt, w1 dt. The half drifts between them are merged, so it
+// is four drifts and three kicks.
+template <typename Forces>
+void StepYoshida(World &w, double dt, Forces &&forces)
+{
+    const double drift[4] = {0.5 * YOSHIDA_W1, 0.5 * (YOSHIDA_W0 + YOSHIDA_W1), 0.5 * (YOSHIDA_W0 + YOSHIDA_W1), 0.5 * YOSHIDA_W1};
+    const double kick[3] = {YOSHIDA_W1, YOSHIDA_W0, YOSHIDA_W1};
+    for (int stage = 0; stage < 3; ++stage)
+    {
+        DriftWorld(w, drift[stage] * dt);
+        forces(w);
+        KickWorld(w, kick[stage] * dt);
+    }
+    DriftWorld(w, drift[3] * dt);
+}
+
+// Copies of the state the multi-stage integrators start every step from
+struct IntegratorScratch
+{
+    std::vector<double> px, py, pz, vx, vy, vz;
+    std::vector<double> sumX, sumY, sumZ, sumVx, sumVy, sumVz; // Weighted stage sums
+    std::vector<uint32_t> orbiting;                             // Bodies around the central one (Wisdom-Holman)
+
+    void save(const World &w)
+    {
+        px.assign(w.px.begin(), w.px.end());
+        py.assign(w.py.begin(), w.py.end());
+        pz.assign(w.pz.begin(), w.pz.end());
+        vx.assign(w.vx.begin(), w.vx.end());
+        vy.assign(w.vy.begin(), w.vy.end());
+        vz.assign(w.vz.begin(), w.vz.end());
+        for (std::vector<double> *sum : {&sumX, &sumY, &sumZ, &sumVx, &sumVy, &sumVz})
+            sum->assign(w.size(), 0.0);
+    }
+};
+
+// Classic RK4 on (x, v). Stage k evaluates the forces at x0 + c_k dt * v_(k-1).
+template <typename Forces>
+void StepRK4(World &w, IntegratorScratch &s, double dt, Forces &&forces)
+{
+    s.save(w);
+    const size_t n = w.size();
+    const double stageStep[4] = {0.0, 0.5 * dt, 0.5 * dt, dt};
+    const double weight[4] = {dt / 6.0, dt / 3.0, dt / 3.0, dt / 6.0};
+
+    for (int stage = 0; stage < 4; ++stage)
+    {
+        // w.vx..vz hold the stage velocity, w.px..pz the stage position
+        forces(w);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (w.fixed[i])
+                continue;
+            s.sumX[i] += weight[stage] * w.vx[i];
+            s.sumY[i] += weight[stage] * w.vy[i];
+            s.sumZ[i] += weight[stage] * w.vz[i];
+            s.sumVx[i] += weight[stage] * w.ax[i];
+            s.sumVy[i] += weight[stage] * w.ay[i];
+            s.sumVz[i] += weight[stage] * w.az[i];
+            if (stage == 3)
+                continue;
+
+            double next = stageStep[stage + 1];
+            double vx = s.vx[i] + next * w.ax[i];
+            double vy = s.vy[i] + next * w.ay[i];
+            double vz = s.vz[i] + next * w.az[i];
+            w.px[i] = s.px[i] + next * w.vx[i];
+            w.py[i] = s.py[i] + next * w.vy[i];
+            w.pz[i] = s.pz[i] + next * w.vz[i];
+            w.vx[i] = vx;
+            w.vy[i] = vy;
+            w.vz[i] = vz;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (w.fixed[i])
+            continue;
+        w.px[i] = s.px[i] + s.sumX[i];
+        w.py[i] = s.py[i] + s.sumY[i];
+        w.pz[i] = s.pz[i] + s.sumZ[i];
+        w.vx[i] = s.vx[i] + s.sumVx[i];
+        w.vy[i] = s.vy[i] + s.sumVy[i];
+        w.vz[i] = s.vz[i] + s.sumVz[i];
+    }
+}
+
+// Index of the heaviest body, the one the others orbit in the Wisdom-Holman split
+inline int HeaviestBody(const World &w)
+{
+    int heaviest = -1;
+    for (size_t i = 0; i < w.size(); ++i)
+        if (heaviest < 0 || w.mass[i] > w.mass[heaviest])
+            heaviest = (int)i;
+    return heaviest;
+}
+
+// Lists the moving bodies other than 'central' in s.orbiting and sizes the scratch arrays
+// for them. Returns their count.
+inline size_t GatherOrbiting(const World &w, int central, IntegratorScratch &s)
+{
+    s.orbiting.clear();
+    for (size_t i = 0; i < w.size(); ++i)
+        if ((int)i != central && !w.fixed[i])
+            s.orbiting.push_back((uint32_t)i);
+    for (std::vector<double> *v : {&s.px, &s.py, &s.pz, &s.vx, &s.vy, &s.vz})
+        v->resize(s.orbiting.size());
+    return s.orbiting.size();
+}
+
+// One Wisdom-Holman step: kick dt/2, jump dt/2, Kepler drift dt, jump dt/2, kick dt/2.
+//
+// The moving bodies are kept in democratic heliocentric coordinates: positions Q relative
+// to the central body, velocities u relative to the barycentre. The Kepler drift moves
+// every Q around G * M of the central body, the jump shifts all Q by the central body's
+// recoil (sum m u / M), and the kicks apply the accelerations of the force backend minus
+// the central body's own term. With a fixed central body there is no recoil.
+template <typename Forces>
+void StepWisdomHolman(World &w, IntegratorScratch &s, double dt, Forces &&forces)
+{
+    const int central = HeaviestBody(w);
+    if (central < 0)
+        return;
+    const double centralMass = w.mass[central];
+    const bool recoil = !w.fixed[central];
+    const size_t count = GatherOrbiting(w, central, s);
+
+    // Barycentre of the central body and everything orbiting it
+    double total = centralMass;
+    double cm[3] = {centralMass * w.px[central], centralMass * w.py[central], centralMass * w.pz[central]};
+    double vcm[3] = {centralMass * w.vx[central], centralMass * w.vy[central], centralMass * w.vz[central]};
+    for (uint32_t i : s.orbiting)
+    {
+        total += w.mass[i];
+        cm[0] += w.mass[i] * w.px[i];
+        cm[1] += w.mass[i] * w.py[i];
+        cm[2] += w.mass[i] * w.pz[i];
+        vcm[0] += w.mass[i] * w.vx[i];
+        vcm[1] += w.mass[i] * w.vy[i];
+        vcm[2] += w.mass[i] * w.vz[i];
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        cm[c] /= total;
+        vcm[c] = recoil ? vcm[c] / total : 0.0;
+    }
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        uint32_t i = s.orbiting[k];
+        s.px[k] = w.px[i] - w.px[central];
+        s.py[k] = w.py[i] - w.py[central];
+        s.pz[k] = w.pz[i] - w.pz[central];
+        s.vx[k] = w.vx[i] - vcm[0];
+        s.vy[k] = w.vy[i] - vcm[1];
+        s.vz[k] = w.vz[i] - vcm[2];
+    }
+
+    // Back to world positions: the barycentre moves with vcm, the central body sits where
+    // it keeps the barycentre there
+    auto placeBodies = [&](double elapsed)
+    {
+        double offset[3] = {0.0, 0.0, 0.0};
+        if (recoil)
+        {
+            for (size_t k = 0; k < count; ++k)
+            {
+                double m = w.mass[s.orbiting[k]] / total;
+                offset[0] += m * s.px[k];
+                offset[1] += m * s.py[k];
+                offset[2] += m * s.pz[k];
+            }
+            w.px[central] = cm[0] + vcm[0] * elapsed - offset[0];
+            w.py[central] = cm[1] + vcm[1] * elapsed - offset[1];
+            w.pz[central] = cm[2] + vcm[2] * elapsed - offset[2];
+        }
+        for (size_t k = 0; k < count; ++k)
+        {
+            uint32_t i = s.orbiting[k];
+            w.px[i] = w.px[central] + s.px[k];
+            w.py[i] = w.py[central] + s.py[k];
+            w.pz[i] = w.pz[central] + s.pz[k];
+        }
+    };
+
+    // Everything but the central body's pull, from the current world positions
+    auto kick = [&](double h)
+    {
+        forces(w);
+        const double gm = w.G * centralMass;
+        for (size_t k = 0; k < count; ++k)
+        {
+            uint32_t i = s.orbiting[k];
+            double dx = -s.px[k], dy = -s.py[k], dz = -s.pz[k];
+            double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            double scale = SoftenedScale(w.softening, gm, distance, (w.radius[i] + w.radius[central]) * w.minDistanceFactor);
+            s.vx[k] += h * (w.ax[i] - dx * scale);
+            s.vy[k] += h * (w.ay[i] - dy * scale);
+            s.vz[k] += h * (w.az[i] - dz * scale);
+        }
+    };
+
+    auto jump = [&](double h)
+    {
+        if (!recoil)
+            return;
+        double momentum[3] = {0.0, 0.0, 0.0};
+        for (size_t k = 0; k < count; ++k)
+        {
+            double m = w.mass[s.orbiting[k]];
+            momentum[0] += m * s.vx[k];
+            momentum[1] += m * s.vy[k];
+            momentum[2] += m * s.vz[k];
+        }
+        for (size_t k = 0; k < count; ++k)
+        {
+            s.px[k] += h * momentum[0] / centralMass;
+            s.py[k] += h * momentum[1] / centralMass;
+            s.pz[k] += h * momentum[2] / centralMass;
+        }
+    };
+
+    kick(0.5 * dt);
+    jump(0.5 * dt);
+    DriftKeplerArrays(count, w.G * centralMass, dt, s.px.data(), s.py.data(), s.pz.data(),
+                      s.vx.data(), s.vy.data(), s.vz.data());
+    jump(0.5 * dt);
+    placeBodies(dt);
+    kick(0.5 * dt);
+
+    double momentum[3] = {0.0, 0.0, 0.0};
+    for (size_t k = 0; k < count; ++k)
+    {
+        uint32_t i = s.orbiting[k];
+        w.vx[i] = vcm[0] + s.vx[k];
+        w.vy[i] = vcm[1] + s.vy[k];
+        w.vz[i] = vcm[2] + s.vz[k];
+        momentum[0] += w.mass[i] * s.vx[k];
+        momentum[1] += w.mass[i] * s.vy[k];
+        momentum[2] += w.mass[i] * s.vz[k];
+    }
+    if (recoil)
+    {
+        w.vx[central] = vcm[0] - momentum[0] / centralMass;
+        w.vy[central] = vcm[1] - momentum[1] / centralMass;
+        w.vz[central] = vcm[2] - momentum[2] / centralMass;
+    }
+}
+
+// Every moving body on its own two-body orbit, without interactions. The bodies are
+// taken outwards from the heaviest one in Jacobi coordinates: each orbits the barycentre
+// of the central body and everything further in, with G times their combined mass, so
+// the outer planets circle the Sun-Jupiter barycentre like they really do. Exact for any
+// dt, the result doesn't depend on the step size. Around a fixed central body the orbits
+// are plain heliocentric ones.
+inline void StepKepler(World &w, IntegratorScratch &s, double dt)
+{
+    const int central = HeaviestBody(w);
+    if (central < 0)
+        return;
+    const size_t count = GatherOrbiting(w, central, s);
+    const bool recoil = !w.fixed[central];
+
+    auto distance2 = [&](uint32_t i)
+    {
+        double dx = w.px[i] - w.px[central], dy = w.py[i] - w.py[central], dz = w.pz[i] - w.pz[central];
+        return dx * dx + dy * dy + dz * dz;
+    };
+    std::sort(s.orbiting.begin(), s.orbiting.end(), [&](uint32_t l, uint32_t r)
+              {
+                  double left = distance2(l), right = distance2(r);
+                  return left < right || (left == right && l < r); });
+
+    // To Jacobi coordinates: relative to the barycentre of the bodies further in
+    double interiorMass = w.mass[central];
+    double barycentre[6] = {w.px[central], w.py[central], w.pz[central], w.vx[central], w.vy[central], w.vz[central]};
+    for (size_t k = 0; k < count; ++k)
+    {
+        uint32_t i = s.orbiting[k];
+        s.px[k] = w.px[i] - barycentre[0];
+        s.py[k] = w.py[i] - barycentre[1];
+        s.pz[k] = w.pz[i] - barycentre[2];
+        s.vx[k] = w.vx[i] - barycentre[3];
+        s.vy[k] = w.vy[i] - barycentre[4];
+        s.vz[k] = w.vz[i] - barycentre[5];
+        double mass = recoil ? interiorMass + w.mass[i] : interiorMass;
+        DriftKeplerArrays(1, w.G * mass, dt, &s.px[k], &s.py[k], &s.pz[k], &s.vx[k], &s.vy[k], &s.vz[k]);
+        if (!recoil)
+            continue;
+
+        double share = w.mass[i] / mass;
+        barycentre[0] += share * (w.px[i] - barycentre[0]);
+        barycentre[1] += share * (w.py[i] - barycentre[1]);
+        barycentre[2] += share * (w.pz[i] - barycentre[2]);
+        barycentre[3] += share * (w.vx[i] - barycentre[3]);
+        barycentre[4] += share * (w.vy[i] - barycentre[4]);
+        barycentre[5] += share * (w.vz[i] - barycentre[5]);
+        interiorMass = mass;
+    }
+
+    // Back again from the outside in: the barycentre of everything keeps its velocity
+    if (recoil)
+    {
+        barycentre[0] += barycentre[3] * dt;
+        barycentre[1] += barycentre[4] * dt;
+        barycentre[2] += barycentre[5] * dt;
+    }
+    for (size_t k = count; k-- > 0;)
+    {
+        uint32_t i = s.orbiting[k];
+        double share = 0.0;
+        if (recoil)
+        {
+            share = w.mass[i] / interiorMass;
+            interiorMass -= w.mass[i];
+        }
+        barycentre[0] -= share * s.px[k];
+        barycentre[1] -= share * s.py[k];
+        barycentre[2] -= share * s.pz[k];
+        barycentre[3] -= share * s.vx[k];
+        barycentre[4] -= share * s.vy[k];
+        barycentre[5] -= share * s.vz[k];
+        w.px[i] = barycentre[0] + s.px[k];
+        w.py[i] = barycentre[1] + s.py[k];
+        w.pz[i] = barycentre[2] + s.pz[k];
+        w.vx[i] = barycentre[3] + s.vx[k];
+        w.vy[i] = barycentre[4] + s.vy[k];
+        w.vz[i] = barycentre[5] + s.vz[k];
+    }
+    if (recoil)
+    {
+        w.px[central] = barycentre[0];
+        w.py[central] = barycentre[1];
+        w.pz[central] = barycentre[2];
+        w.vx[central] = barycentre[3];
+        w.vy[central] = barycentre[4];
+        w.vz[central] = barycentre[5];
+    }
+}
+
+// ===== IAS15 =====
+
+const double IAS15_EPSILON = 1e-9;       // Relative size of the last series term allowed
+const double IAS15_SAFETY = 0.25;        // Steps change by at most 4x; shrinking more rejects the step
+const int IAS15_MAX_ITERATIONS = 12;     // Predictor-corrector iterations per step
+const int IAS15_MAX_STEPS = 1 << 20;     // Per call, a runaway step size can't hang the caller
+const double IAS15_MAX_PREDICTION = 20.0; // Larger step increases start the series from zero
+
+// Gauss-Radau spacings on [0, 1]: the 8 point rule integrates polynomials up to degree 14 exactly
+const double IAS15_NODES[8] = {0.0,
+                               0.0562625605369221464656521910318,
+                               0.180240691736892364987579942780,
+                               0.352624717113169637373907769648,
+                               0.547153626330555383001448554766,
+                               0.734210177215410531523210605558,
+                               0.885320946839095768090359771030,
+                               0.977520613561287501891174488626};
+
+// Adaptive 15th order integrator. Within a step of length T the acceleration of every
+// coordinate is a polynomial in h = t / T,
+//
+//     a(h) = a0 + b0 h + b1 h^2 + ... + b6 h^7
+//          = a0 + g1 h + g2 h (h - h1) + ... + g7 h (h - h1) ... (h - h6),
+//
+// fitted to the forces at the seven Radau nodes h1..h7 by iterating predictor and
+// corrector until the g stop changing. Positions and velocities are the integrals of
+// that series; the step is accepted if |b6| / |a| is small enough, and the next step
+// size follows from it. The b of a finished step, shifted to the next one, are the
+// starting guess, so usually two iterations suffice.
+class IAS15Integrator
+{
+public:
+    IAS15Integrator()
+    {
+        // coefficient[k][j]: coefficient of h^j in h (h - h1) ... (h - h_(k-1)), k = 1..7
+        for (int k = 1; k < 8; ++k)
+        {
+            double poly[9] = {0.0, 1.0}; // h
+            for (int m = 1; m < k; ++m)
+            {
+                for (int j = 8; j > 0; --j)
+                    poly[j] = poly[j - 1] - IAS15_NODES[m] * poly[j];
+                poly[0] = -IAS15_NODES[m] * poly[0];
+            }
+            for (int j = 0; j < 8; ++j)
+                coefficient[k][j] = poly[j];
+        }
+    }
+
+    // Internal steps, rejected steps and force calls of the last advance()
+    struct Stats
+    {
+        int steps = 0;
+        int rejected = 0;
+        int forceCalls = 0;
+        double lastStep = 0.0; // Size of the last full internal step
+    };
+    const Stats &stats() const { return lastStats; }
+
+    // Forget the step size and series, e.g. after the bodies changed or were reordered
+    void reset()
+    {
+        stepSize = 0.0;
+        bodies = 0;
+    }
+
+    // Moves the world forward by exactly dt
+    template <typename Forces>
+    void advance(World &w, double dt, Forces &&forces)
+    {
+        lastStats = Stats();
+        if (w.size() != bodies)
+            resize(w.size());
+        if (stepSize <= 0.0)
+            stepSize = dt;
+
+        double done = 0.0;
+        while (done < dt && lastStats.steps < IAS15_MAX_STEPS)
+        {
+            // The last step is cut to land on dt, without touching the adaptive size
+            double step = std::min(stepSize, dt - done);
+            bool last = step < stepSize;
+            double proposed = attempt(w, step, forces);
+            if (proposed < 0.0)
+            {
+                // Rejected, try again from the same state with the smaller step
+                stepSize = -proposed;
+                lastStats.rejected++;
+                continue;
+            }
+            done += step;
+            lastStats.steps++;
+            if (!last)
+            {
+                lastStats.lastStep = step;
+                stepSize = proposed;
+            }
+        }
+    }
+
+private:
+    double coefficient[8][8] = {};
+    double stepSize = 0.0;   // Adaptive internal step
+    double seriesStep = 0.0; // Step the b and e series are scaled for
+    size_t bodies = 0;
+    Stats lastStats;
+
+    // Per coordinate (3 * body + axis)
+    std::vector<double> x0, v0, a0, compensationX, compensationV;
+    std::vector<double> b[7], g[7], e[7];
+    std::vector<unsigned char> movable;
+
+    void resize(size_t n)
+    {
+        bodies = n;
+        for (std::vector<double> *array : {&x0, &v0, &a0, &compensationX, &compensationV})
+            array->assign(3 * n, 0.0);
+        for (int k = 0; k < 7; ++k)
+        {
+            b[k].assign(3 * n, 0.0);
+            g[k].assign(3 * n, 0.0);
+            e[k].assign(3 * n, 0.0);
+        }
+        seriesStep = 0.0;
+    }
+
+    // Rescales the series from seriesStep to 'step' (same start time): b_k scales with q^(k+1)
+    void rescaleSeries(double step)
+    {
+        if (seriesStep <= 0.0 || step == seriesStep)
+        {
+            seriesStep = step;
+            return;
+        }
+        double q = step / seriesStep, power = q;
+        if (q > IAS15_MAX_PREDICTION)
+        {
+            // E.g. after a short last step: q^7 would blow the old series up
+            clearSeries();
+            seriesStep = step;
+            return;
+        }
+        for (int k = 0; k < 7; ++k)
+        {
+            for (size_t c = 0; c < b[k].size(); ++c)
+            {
+                b[k][c] *= power;
+                e[k][c] *= power;
+            }
+            power *= q;
+        }
+        seriesStep = step;
+    }
+
+    // One step of size 'step'. Returns the proposed next step, or minus the step to retry
+    // with if this one was rejected (the world is then left unchanged).
+    template <typename Forces>
+    double attempt(World &w, double step, Forces &&forces)
+    {
+        const size_t n = w.size();
+        const size_t coordinates = 3 * n;
+        rescaleSeries(step);
+
+        // Start of the step
+        forces(w);
+        lastStats.forceCalls++;
+        movable.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            movable[i] = !w.fixed[i];
+            const double position[3] = {w.px[i], w.py[i], w.pz[i]};
+            const double velocity[3] = {w.vx[i], w.vy[i], w.vz[i]};
+            const double acceleration[3] = {w.ax[i], w.ay[i], w.az[i]};
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                x0[3 * i + axis] = position[axis];
+                v0[3 * i + axis] = velocity[axis];
+                a0[3 * i + axis] = movable[i] ? acceleration[axis] : 0.0;
+            }
+        }
+
+        // g from the predicted b (the basis change is triangular with a unit diagonal)
+        for (size_t c = 0; c < coordinates; ++c)
+        {
+            for (int k = 7; k >= 1; --k)
+            {
+                double value = b[k - 1][c];
+                for (int m = k + 1; m <= 7; ++m)
+                    value -= g[m - 1][c] * coefficient[m][k];
+                g[k - 1][c] = value;
+            }
+        }
+
+        // Predictor-corrector
+        double lastError = 2.0;
+        for (int iteration = 0; iteration < IAS15_MAX_ITERATIONS; ++iteration)
+        {
+            double maxChange = 0.0, maxAcceleration = 0.0;
+            for (int node = 1; node < 8; ++node)
+            {
+                const double h = IAS15_NODES[node];
+                setPositions(w, step, h);
+                forces(w);
+                lastStats.forceCalls++;
+
+                for (size_t i = 0; i < n; ++i)
+                {
+                    if (!movable[i])
+                        continue;
+                    const double acceleration[3] = {w.ax[i], w.ay[i], w.az[i]};
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        size_t c = 3 * i + axis;
+
+                        // Divided differences: new g of this node from the ones before it
+                        double value = (acceleration[axis] - a0[c]) / h;
+                        for (int m = 1; m < node; ++m)
+                            value = (value - g[m - 1][c]) / (h - IAS15_NODES[m]);
+                        double change = value - g[node - 1][c];
+                        g[node - 1][c] = value;
+                        for (int j = 1; j <= node; ++j)
+                            b[j - 1][c] += change * coefficient[node][j];
+
+                        if (node == 7)
+                        {
+                            maxChange = std::max(maxChange, std::fabs(change));
+                            maxAcceleration = std::max(maxAcceleration, std::fabs(acceleration[axis]));
+                        }
+                    }
+                }
+            }
+
+            double error = maxAcceleration > 0.0 ? maxChange / maxAcceleration : 0.0;
+            if (error < 1e-16 || (iteration > 1 && error >= lastError))
+                break;
+            lastError = error;
+        }
+
+        // Step size control on the last series term
+        double maxB6 = 0.0, maxAcceleration = 0.0;
+        for (size_t c = 0; c < coordinates; ++c)
+        {
+            maxB6 = std::max(maxB6, std::fabs(b[6][c]));
+            maxAcceleration = std::max(maxAcceleration, std::fabs(a0[c]));
+        }
+        double proposed = step / IAS15_SAFETY;
+        if (maxB6 > 0.0 && maxAcceleration > 0.0)
+            proposed = std::min(proposed, step * std::pow(IAS15_EPSILON / (maxB6 / maxAcceleration), 1.0 / 7.0));
+        if (!std::isfinite(proposed) || proposed < IAS15_SAFETY * step)
+        {
+            // Put the world back where the step started
+            for (size_t i = 0; i < n; ++i)
+            {
+                w.px[i] = x0[3 * i];
+                w.py[i] = x0[3 * i + 1];
+                w.pz[i] = x0[3 * i + 2];
+            }
+            double retry = std::isfinite(proposed) ? proposed : IAS15_SAFETY * step;
+            return -retry;
+        }
+
+        // Accept: integrate the series over the whole step, with compensated summation
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!movable[i])
+                continue;
+            double *position[3] = {&w.px[i], &w.py[i], &w.pz[i]};
+            double *velocity[3] = {&w.vx[i], &w.vy[i], &w.vz[i]};
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                size_t c = 3 * i + axis;
+                double dx = step * v0[c] + step * step * (a0[c] / 2.0 + b[0][c] / 6.0 + b[1][c] / 12.0 + b[2][c] / 20.0 +
+                                                          b[3][c] / 30.0 + b[4][c] / 42.0 + b[5][c] / 56.0 + b[6][c] / 72.0);
+                double dv = step * (a0[c] + b[0][c] / 2.0 + b[1][c] / 3.0 + b[2][c] / 4.0 + b[3][c] / 5.0 +
+                                    b[4][c] / 6.0 + b[5][c] / 7.0 + b[6][c] / 8.0);
+                *position[axis] = CompensatedAdd(x0[c], dx, compensationX[c]);
+                *velocity[axis] = CompensatedAdd(v0[c], dv, compensationV[c]);
+            }
+        }
+
+        predictNextStep(proposed / step);
+        seriesStep = proposed;
+        return proposed;
+    }
+
+    // Positions at h of the current step, from the series
+    void setPositions(World &w, double step, double h)
+    {
+        const double s = step * h;
+        for (size_t i = 0; i < w.size(); ++i)
+        {
+            if (!movable[i])
+                continue;
+            double *position[3] = {&w.px[i], &w.py[i], &w.pz[i]};
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                size_t c = 3 * i + axis;
+                double series = a0[c] / 2.0 + h * (b[0][c] / 6.0 + h * (b[1][c] / 12.0 + h * (b[2][c] / 20.0 + h * (b[3][c] / 30.0 + h * (b[4][c] / 42.0 + h * (b[5][c] / 56.0 + h * b[6][c] / 72.0))))));
+                *position[axis] = x0[c] + s * v0[c] + s * s * series;
+            }
+        }
+    }
+
+    // Kahan sum: returns base + increment, carrying the lost low bits in 'compensation'
+    static double CompensatedAdd(double base, double increment, double &compensation)
+    {
+        double term = increment - compensation;
+        double sum = base + term;
+        compensation = (sum - base) - term;
+        return sum;
+    }
+
+    void clearSeries()
+    {
+        for (int k = 0; k < 7; ++k)
+        {
+            std::fill(b[k].begin(), b[k].end(), 0.0);
+            std::fill(e[k].begin(), e[k].end(), 0.0);
+        }
+    }
+
+    // Shifts the series of the finished step to start at its end, scaled by q = next / done.
+    // The correction the iterations made to the last prediction is carried over.
+    void predictNextStep(double q)
+    {
+        if (q > IAS15_MAX_PREDICTION)
+        {
+            clearSeries();
+            return;
+        }
+        const double q2 = q * q, q3 = q2 * q, q4 = q3 * q, q5 = q4 * q, q6 = q5 * q, q7 = q6 * q;
+        for (size_t c = 0; c < b[0].size(); ++c)
+        {
+            double correction[7];
+            for (int k = 0; k < 7; ++k)
+                correction[k] = b[k][c] - e[k][c];
+
+            const double b0 = b[0][c], b1 = b[1][c], b2 = b[2][c], b3 = b[3][c], b4 = b[4][c], b5 = b[5][c], b6 = b[6][c];
+            e[0][c] = q * (b6 * 7.0 + b5 * 6.0 + b4 * 5.0 + b3 * 4.0 + b2 * 3.0 + b1 * 2.0 + b0);
+            e[1][c] = q2 * (b6 * 21.0 + b5 * 15.0 + b4 * 10.0 + b3 * 6.0 + b2 * 3.0 + b1);
+            e[2][c] = q3 * (b6 * 35.0 + b5 * 20.0 + b4 * 10.0 + b3 * 4.0 + b2);
+            e[3][c] = q4 * (b6 * 35.0 + b5 * 15.0 + b4 * 5.0 + b3);
+            e[4][c] = q5 * (b6 * 21.0 + b5 * 6.0 + b4);
+            e[5][c] = q6 * (b6 * 7.0 + b5);
+            e[6][c] = q7 * b6;
+
+            for (int k = 0; k < 7; ++k)
+                b[k][c] = e[k][c] + correction[k];
+        }
+    }
+};
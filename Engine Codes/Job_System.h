@@ -0,0 +1,415 @@
+//
+//  Job_System.h
+//  SpaceEngine
+//
+//  Lock-free work-stealing job system and a task graph for the stages of a frame.
+//
+//  A frame of the demos is a fixed sequence: input, forces, integrate, collisions, trails,
+//  light, draw. Several of those don't depend on each other, and the big ones split into
+//  chunks. TaskGraph describes the stages once, with the stages each one has to wait for,
+//  and JobSystem runs a frame of it:
+//
+//    - every worker owns a Chase-Lev deque (Le, Pop, Cohen & Zappa Nardelli 2013). It
+//      pushes and pops at the bottom without locking; idle workers steal from the top of
+//      the others with one compare-and-swap,
+//    - a stage whose last predecessor finishes is pushed onto the deque of the worker
+//      that finished it, so data stays in that core's cache unless somebody is idle,
+//    - parallelFor() pushes a few copies of one job that hand out chunks from an atomic
+//      counter; whoever picks a copy up joins in, and the caller helps with any queued
+//      work until its chunks are done, so it also works from inside a stage,
+//    - each stage is timed (wall time, plus the time other workers spent on its chunks)
+//      and handed to a Profiler after the frame.
+//
+//  The only lock is the one idle workers sleep on between frames. Call run() and
+//  parallelFor() from the thread that created the system or from inside its jobs; that
+//  thread works as worker 0, like in ThreadPool.
+//
+
+#pragma once
+
+#include "Profiler.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+const int64_t JOB_QUEUE_CAPACITY = 4096; // Jobs per worker deque, a power of two. Full: run inline.
+
+// Unit of work. Queues only hold pointers, a job lives with whoever created it.
+struct Job
+{
+    void (*execute)(Job *job, unsigned worker) = nullptr;
+};
+
+// Single-owner deque: push() and pop() from the owning worker only, steal() from anyone
+class JobQueue
+{
+public:
+    JobQueue()
+    {
+        for (auto &slot : slots)
+            slot.store(nullptr, std::memory_order_relaxed);
+    }
+
+    bool push(Job *job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= JOB_QUEUE_CAPACITY)
+            return false;
+        slots[b & (JOB_QUEUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release); // Publishes the slot and the job behind it
+        return true;
+    }
+
+    Job *pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed); // Was empty
+            return nullptr;
+        }
+        Job *job = slots[b & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // Last job: race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job *steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        Job *job = slots[t & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; // Somebody else got it
+        return job;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<Job *> slots[JOB_QUEUE_CAPACITY];
+};
+
+class JobSystem
+{
+public:
+    explicit JobSystem(unsigned threadCount = std::thread::hardware_concurrency())
+    {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned i = 0; i < threadCount; ++i)
+            queues.emplace_back(new JobQueue());
+        for (unsigned i = 1; i < threadCount; ++i)
+            threads.emplace_back([this, i]
+                                 { workerLoop(i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleep.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // Number of workers including the calling thread
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    // Index of the worker running the current job (0 for the calling thread)
+    static unsigned currentWorker() { return workerIndex(); }
+
+    // Time other workers spent on chunks of parallelFor() calls made from this thread
+    static double &helpedSeconds()
+    {
+        static thread_local double seconds = 0.0;
+        return seconds;
+    }
+
+    // Queues a job on the calling worker's deque, or runs it right away if that is full
+    void submit(Job *job)
+    {
+        unsigned self = workerIndex();
+        if (!queues[self]->push(job))
+            job->execute(job, self);
+    }
+
+    // Keeps the other workers awake while there is work on the way
+    void beginWork()
+    {
+        if (active.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            sleep.notify_all();
+        }
+    }
+
+    void endWork() { active.fetch_sub(1, std::memory_order_acq_rel); }
+
+    // Runs queued jobs (own first, then stolen) until done() is true
+    template <typename Done>
+    void helpUntil(const Done &done)
+    {
+        unsigned self = workerIndex();
+        while (!done())
+            if (!runOne(self))
+                std::this_thread::yield();
+    }
+
+    // Runs body(i) for every i in [0, count), in chunks of 'grain', and returns when all
+    // of them are done. Doesn't allocate.
+    template <typename Body>
+    void parallelFor(size_t count, const Body &body, size_t grain = 1)
+    {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(1, grain);
+        size_t chunks = (count + grain - 1) / grain;
+        if (size() == 1 || chunks == 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+                body(i);
+            return;
+        }
+
+        ForJob job;
+        job.execute = &ForJob::Run<Body>;
+        job.body = &body;
+        job.count = count;
+        job.grain = grain;
+        job.chunks = chunks;
+        job.owner = workerIndex();
+
+        // Copies for the thieves, this thread runs one more itself
+        int copies = (int)std::min<size_t>(size() - 1, chunks - 1);
+        beginWork();
+        for (int c = 0; c < copies; ++c)
+            submit(&job);
+        job.execute(&job, job.owner);
+
+        // Every copy has to come back before 'job' goes out of scope
+        helpUntil([&]
+                  { return job.finished.load(std::memory_order_acquire) == copies + 1; });
+        endWork();
+        helpedSeconds() += job.helperNanos.load(std::memory_order_relaxed) * 1e-9;
+    }
+
+private:
+    // One parallelFor() call; every copy of it claims chunks until none are left
+    struct ForJob : Job
+    {
+        const void *body = nullptr;
+        size_t count = 0, grain = 1, chunks = 0;
+        unsigned owner = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<int> finished{0};
+        std::atomic<int64_t> helperNanos{0};
+
+        template <typename Body>
+        static void Run(Job *base, unsigned worker)
+        {
+            ForJob &job = *static_cast<ForJob *>(base);
+            const Body &body = *static_cast<const Body *>(job.body);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t c = job.next.fetch_add(1, std::memory_order_relaxed); c < job.chunks;
+                 c = job.next.fetch_add(1, std::memory_order_relaxed))
+            {
+                for (size_t i = c * job.grain; i < std::min(job.count, (c + 1) * job.grain); ++i)
+                    body(i);
+            }
+            if (worker != job.owner)
+                job.helperNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::steady_clock::now() - start)
+                                              .count(),
+                                          std::memory_order_relaxed);
+            job.finished.fetch_add(1, std::memory_order_acq_rel);
+        }
+    };
+
+    std::vector<std::unique_ptr<JobQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> active{0}; // Open beginWork() calls, workers spin while positive
+
+    std::mutex sleepMutex;
+    std::condition_variable sleep;
+    bool stopping = false;
+
+    static unsigned &workerIndex()
+    {
+        static thread_local unsigned index = 0;
+        return index;
+    }
+
+    bool runOne(unsigned self)
+    {
+        Job *job = queues[self]->pop();
+        for (unsigned k = 1; !job && k < size(); ++k)
+            job = queues[(self + k) % size()]->steal();
+        if (!job)
+            return false;
+        job->execute(job, self);
+        return true;
+    }
+
+    void workerLoop(unsigned self)
+    {
+        workerIndex() = self;
+        while (true)
+        {
+            if (runOne(self))
+                continue;
+            if (active.load(std::memory_order_acquire) > 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleep.wait(lock, [this]
+                       { return stopping || active.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+// Stages of a frame and what each waits for. Built once, run() every frame.
+class TaskGraph
+{
+public:
+    // A stage that runs body() once. Returns its index for the 'after' lists of later stages.
+    int add(const std::string &name, std::function<void()> body, std::initializer_list<int> after = {})
+    {
+        auto node = std::unique_ptr<Node>(new Node());
+        node->body = std::move(body);
+        return insert(name, std::move(node), after);
+    }
+
+    // A stage split into chunks: body(i) for every i in [0, count()), count() is asked
+    // again every frame
+    int addParallel(const std::string &name, std::function<size_t()> count, std::function<void(size_t)> body,
+                    size_t grain, std::initializer_list<int> after = {})
+    {
+        auto node = std::unique_ptr<Node>(new Node());
+        node->count = std::move(count);
+        node->chunkBody = std::move(body);
+        node->grain = grain;
+        return insert(name, std::move(node), after);
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    // Runs every stage once, independent ones at the same time, and returns when all are
+    // done. The stage timings go to the profiler if one is given.
+    void run(JobSystem &jobs, Profiler *profiler = nullptr)
+    {
+        system = &jobs;
+        frameStart = std::chrono::steady_clock::now();
+        for (auto &node : nodes)
+            node->pending.store(node->predecessors, std::memory_order_relaxed);
+        remaining.store((int)nodes.size(), std::memory_order_release);
+
+        jobs.beginWork();
+        // Deques are LIFO for their owner: push the roots backwards so the first one runs first
+        for (size_t k = nodes.size(); k-- > 0;)
+            if (nodes[k]->predecessors == 0)
+                jobs.submit(nodes[k].get());
+        jobs.helpUntil([this]
+                       { return remaining.load(std::memory_order_acquire) == 0; });
+        jobs.endWork();
+
+        if (profiler)
+        {
+            for (const auto &node : nodes)
+                profiler->record(node->name, node->start, node->wall, node->cpu, node->worker);
+            profiler->recordFrame(secondsSince(frameStart));
+        }
+    }
+
+private:
+    struct Node : Job
+    {
+        TaskGraph *graph = nullptr;
+        std::string name;
+        std::function<void()> body;
+        std::function<size_t()> count;
+        std::function<void(size_t)> chunkBody;
+        size_t grain = 1;
+        std::vector<Node *> successors;
+        int predecessors = 0;
+        std::atomic<int> pending{0};
+        double start = 0.0, wall = 0.0, cpu = 0.0; // Of the last run
+        unsigned worker = 0;
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::atomic<int> remaining{0};
+    JobSystem *system = nullptr;
+    std::chrono::steady_clock::time_point frameStart;
+
+    static double secondsSince(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+    }
+
+    int insert(const std::string &name, std::unique_ptr<Node> node, std::initializer_list<int> after)
+    {
+        node->graph = this;
+        node->name = name;
+        node->execute = &TaskGraph::Execute;
+        for (int k : after)
+        {
+            nodes[k]->successors.push_back(node.get());
+            node->predecessors++;
+        }
+        nodes.push_back(std::move(node));
+        return (int)nodes.size() - 1;
+    }
+
+    static void Execute(Job *job, unsigned worker)
+    {
+        Node &node = *static_cast<Node *>(job);
+        TaskGraph &graph = *node.graph;
+        JobSystem &jobs = *graph.system;
+
+        auto begin = std::chrono::steady_clock::now();
+        double helped = JobSystem::helpedSeconds();
+        if (node.chunkBody)
+            jobs.parallelFor(node.count(), node.chunkBody, node.grain);
+        else
+            node.body();
+        node.start = std::chrono::duration<double>(begin - graph.frameStart).count();
+        node.wall = secondsSince(begin);
+        node.cpu = node.wall + (JobSystem::helpedSeconds() - helped);
+        node.worker = worker;
+
+        for (Node *next : node.successors)
+            if (next->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                jobs.submit(next);
+        graph.remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+};
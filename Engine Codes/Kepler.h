@@ -0,0 +1,256 @@
+//
+//  Kepler.h
+//  SpaceEngine
+//
+//  Analytic two-body propagation for bodies that only feel the central star.
+//
+//  In the Fast and Slow scenarios the fixed Sun dominates almost everything. A body with
+//  nobody else inside its Hill sphere is, for a sub-step, on a plain Kepler orbit, so it
+//  can be moved with the universal-variable solution instead of summing n pair forces:
+//
+//    - ClassifyKeplerBodies() sweeps over Hill spheres (sort-and-sweep on x like the
+//      contact broad phase) and promotes bodies with a neighbour inside hillFactor Hill
+//      radii (3 by default, the usual close-encounter radius of hybrid integrators), or
+//      that are close enough to the star for the force softening to matter,
+//    - the promoted bodies get full N-body forces, the rest are drifted by
+//      DriftKeplerBodies().
+//
+//  The drift kernel works on SoA arrays with a fixed number of Newton iterations and
+//  Stumpff functions from a series plus a fixed number of argument quarterings, so the
+//  loop has no data-dependent branches and vectorizes across bodies.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Cpu_Dispatch.h"
+#include "Arena.h"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+
+const int KEPLER_NEWTON_ITERATIONS = 8; // Fixed so every lane does the same work
+const int KEPLER_QUARTERINGS = 4;       // Stumpff series at z / 4^4, then doubled back up
+const double KEPLER_MAX_Z = 20.0;       // Larger steps are split so |z| stays in range
+
+// Stumpff functions c2(z) = (1 - cos sqrt z) / z and c3(z) = (sqrt z - sin sqrt z) / z^1.5
+// for any sign of z, without branches
+KERNEL_INLINE void StumpffC2C3(double z, double &c2, double &c3)
+{
+    double small = z * (1.0 / 256.0); // z / 4^KEPLER_QUARTERINGS
+
+    // Series, good to double precision for |small| < 0.1
+    c2 = 1.0 / 2.0 - small * (1.0 / 24.0 - small * (1.0 / 720.0 - small * (1.0 / 40320.0 - small * (1.0 / 3628800.0 - small * (1.0 / 479001600.0)))));
+    c3 = 1.0 / 6.0 - small * (1.0 / 120.0 - small * (1.0 / 5040.0 - small * (1.0 / 362880.0 - small * (1.0 / 39916800.0 - small * (1.0 / 6227020800.0)))));
+
+    // c2(4z) = c2 (1 + c0) / 2, c3(4z) = (c3 + c1 c2) / 4 with c0 = 1 - z c2, c1 = 1 - z c3
+    for (int q = 0; q < KEPLER_QUARTERINGS; ++q)
+    {
+        double c0 = 1.0 - small * c2;
+        double c1 = 1.0 - small * c3;
+        c3 = (c3 + c1 * c2) * 0.25;
+        c2 = c2 * (1.0 + c0) * 0.5;
+        small *= 4.0;
+    }
+}
+
+// Moves 'count' bodies (positions and velocities relative to the star) along their
+// Kepler orbits for dt. mu = G * M of the star.
+KERNEL_INLINE void KeplerDriftKernelBody(size_t count, double mu, double dt,
+                                         double *__restrict x, double *__restrict y, double *__restrict z,
+                                         double *__restrict vx, double *__restrict vy, double *__restrict vz)
+{
+    const double sqrtMu = std::sqrt(mu);
+    for (size_t i = 0; i < count; ++i)
+    {
+        double r0 = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        double v2 = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+        double rv = (x[i] * vx[i] + y[i] * vy[i] + z[i] * vz[i]) / sqrtMu;
+        double alpha = 2.0 / r0 - v2 / mu; // 1 / semi-major axis
+        double beta = 1.0 - alpha * r0;
+
+        // Solve the universal Kepler equation for chi with Newton's method
+        double chi = sqrtMu * dt / r0;
+        for (int iteration = 0; iteration < KEPLER_NEWTON_ITERATIONS; ++iteration)
+        {
+            double chi2 = chi * chi;
+            double psi = alpha * chi2;
+            double c2, c3;
+            StumpffC2C3(psi, c2, c3);
+            double f = rv * chi2 * c2 + beta * chi2 * chi * c3 + r0 * chi - sqrtMu * dt;
+            double df = rv * chi * (1.0 - psi * c3) + beta * chi2 * c2 + r0;
+            chi -= f / df;
+        }
+
+        double chi2 = chi * chi;
+        double psi = alpha * chi2;
+        double c2, c3;
+        StumpffC2C3(psi, c2, c3);
+
+        // Lagrange coefficients
+        double f = 1.0 - chi2 * c2 / r0;
+        double g = dt - chi2 * chi * c3 / sqrtMu;
+        double nx = f * x[i] + g * vx[i];
+        double ny = f * y[i] + g * vy[i];
+        double nz = f * z[i] + g * vz[i];
+        double r = std::sqrt(nx * nx + ny * ny + nz * nz);
+        double fDot = sqrtMu / (r * r0) * chi * (psi * c3 - 1.0);
+        double gDot = 1.0 - chi2 * c2 / r;
+
+        double nvx = fDot * x[i] + gDot * vx[i];
+        double nvy = fDot * y[i] + gDot * vy[i];
+        double nvz = fDot * z[i] + gDot * vz[i];
+        x[i] = nx;
+        y[i] = ny;
+        z[i] = nz;
+        vx[i] = nvx;
+        vy[i] = nvy;
+        vz[i] = nvz;
+    }
+}
+
+DISPATCHED_KERNEL(KeplerDriftKernel,
+                  (size_t count, double mu, double dt, double *__restrict x, double *__restrict y,
+                   double *__restrict z, double *__restrict vx, double *__restrict vy, double *__restrict vz),
+                  (count, mu, dt, x, y, z, vx, vy, vz))
+
+// Index of the body the others orbit: the heaviest fixed body, -1 if nothing is fixed
+inline int FindCentralBody(const World &w)
+{
+    int central = -1;
+    for (size_t i = 0; i < w.size(); ++i)
+        if (w.fixed[i] && (central < 0 || w.mass[i] > w.mass[central]))
+            central = (int)i;
+    return central;
+}
+
+// Splits the moving bodies into those that need N-body forces this step and those that
+// can follow their Kepler orbit around 'central'
+inline void ClassifyKeplerBodies(const World &w, int central, double hillFactor, Arena &arena,
+                                 ArenaVector<uint32_t> &nbody, ArenaVector<uint32_t> &kepler)
+{
+    const size_t n = w.size();
+    const double cx = w.px[central], cy = w.py[central], cz = w.pz[central];
+    const double centralMass = w.mass[central];
+
+    // Hill radius r * cbrt(m / 3M), scaled by hillFactor
+    ArenaVector<double> reach{ArenaAllocator<double>(arena)};
+    ArenaVector<unsigned char> promoted{ArenaAllocator<unsigned char>(arena)};
+    ArenaVector<uint32_t> order{ArenaAllocator<uint32_t>(arena)};
+    reach.resize(n);
+    promoted.assign(n, 0);
+    order.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if ((int)i == central)
+            continue;
+        double dx = w.px[i] - cx, dy = w.py[i] - cy, dz = w.pz[i] - cz;
+        double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        reach[i] = hillFactor * distance * std::cbrt(w.mass[i] / (3.0 * centralMass));
+
+        // Inside the softened core (or touching the star) the orbit isn't Keplerian
+        double core = (w.radius[i] + w.radius[central]) * w.minDistanceFactor * 1.5;
+        if (distance < core)
+            promoted[i] = 1;
+        order.push_back((uint32_t)i);
+    }
+
+    // Sort-and-sweep over the Hill spheres
+    std::sort(order.begin(), order.end(), [&](uint32_t l, uint32_t r)
+              {
+                  double left = w.px[l] - reach[l], right = w.px[r] - reach[r];
+                  return left < right || (left == right && l < r); });
+
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+        uint32_t i = order[k];
+        double rightEdge = w.px[i] + reach[i];
+        for (size_t m = k + 1; m < order.size(); ++m)
+        {
+            uint32_t j = order[m];
+            if (w.px[j] - reach[j] > rightEdge)
+                break;
+
+            double dx = w.px[j] - w.px[i];
+            double dy = w.py[j] - w.py[i];
+            double dz = w.pz[j] - w.pz[i];
+            double limit = std::max(reach[i], reach[j]);
+            if (dx * dx + dy * dy + dz * dz < limit * limit)
+                promoted[i] = promoted[j] = 1;
+        }
+    }
+
+    nbody.clear();
+    kepler.clear();
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (w.fixed[i])
+            continue;
+        (promoted[i] ? nbody : kepler).push_back((uint32_t)i);
+    }
+}
+
+// Moves 'count' bodies (positions and velocities relative to the star, in contiguous
+// arrays) along their Kepler orbits for dt of any length
+inline void DriftKeplerArrays(size_t count, double mu, double dt, double *x, double *y, double *z,
+                              double *vx, double *vy, double *vz)
+{
+    double zMax = 0.0;
+    for (size_t k = 0; k < count; ++k)
+    {
+        // psi ~ alpha * (sqrt(mu) dt / r_min)^2, with r_min estimated by the periapsis
+        double r = std::sqrt(x[k] * x[k] + y[k] * y[k] + z[k] * z[k]);
+        double v2 = vx[k] * vx[k] + vy[k] * vy[k] + vz[k] * vz[k];
+        double alpha = 2.0 / r - v2 / mu;
+        double hx = y[k] * vz[k] - z[k] * vy[k];
+        double hy = z[k] * vx[k] - x[k] * vz[k];
+        double hz = x[k] * vy[k] - y[k] * vx[k];
+        double p = (hx * hx + hy * hy + hz * hz) / mu;     // Semi-latus rectum
+        double e = std::sqrt(std::max(0.0, 1.0 - p * alpha)); // Eccentricity
+        double periapsis = std::max(p / (1.0 + e), 1e-12);
+        zMax = std::max(zMax, std::fabs(alpha) * mu * dt * dt / (periapsis * periapsis));
+    }
+
+    // Long steps (time warp) are split so the Stumpff series stays in range
+    int pieces = std::max(1, (int)std::ceil(std::sqrt(zMax / KEPLER_MAX_Z)));
+    for (int piece = 0; piece < pieces; ++piece)
+        KeplerDriftKernel(count, mu, dt / pieces, x, y, z, vx, vy, vz);
+}
+
+// Advances the listed bodies along their two-body orbits around 'central' for dt
+inline void DriftKeplerBodies(World &w, int central, const ArenaVector<uint32_t> &bodies, double dt, Arena &arena)
+{
+    const size_t count = bodies.size();
+    if (count == 0)
+        return;
+    const double mu = w.G * w.mass[central];
+    const double cx = w.px[central], cy = w.py[central], cz = w.pz[central];
+
+    // Gather into contiguous arrays relative to the star
+    double *x = static_cast<double *>(arena.allocate(6 * count * sizeof(double), 64));
+    double *y = x + count, *z = y + count, *vx = z + count, *vy = vx + count, *vz = vy + count;
+    for (size_t k = 0; k < count; ++k)
+    {
+        uint32_t i = bodies[k];
+        x[k] = w.px[i] - cx;
+        y[k] = w.py[i] - cy;
+        z[k] = w.pz[i] - cz;
+        vx[k] = w.vx[i];
+        vy[k] = w.vy[i];
+        vz[k] = w.vz[i];
+    }
+    DriftKeplerArrays(count, mu, dt, x, y, z, vx, vy, vz);
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        uint32_t i = bodies[k];
+        w.px[i] = x[k] + cx;
+        w.py[i] = y[k] + cy;
+        w.pz[i] = z[k] + cz;
+        w.vx[i] = vx[k];
+        w.vy[i] = vy[k];
+        w.vz[i] = vz[k];
+    }
+}
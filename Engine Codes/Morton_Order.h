@@ -0,0 +1,301 @@
+//
+//  Morton_Order.h
+//  SpaceEngine
+//
+//  Keeps bodies that are close in space close in memory.
+//
+//  CreateWorld() adds the asteroids in creation order, which is random around the belt,
+//  and even a sorted world scrambles as the bodies orbit. Tree walks, the contact broad
+//  phase and culling all touch bodies by neighbourhood, so MortonSorter periodically
+//  reorders every per-body array of the World along a 3D Morton (Z-order) curve:
+//
+//    - keys are 21 bits per axis inside the bounding cube, sorted with a parallel LSD
+//      radix sort (8 bits per pass, passes where every key has the same digit skipped),
+//    - World::id / World::slot keep a stable external ID for every body,
+//    - how often is adaptive: every few steps the sorter measures how many neighbours in
+//      memory have drifted apart in space (a cheap cache-miss proxy) and, with tree
+//      gravity and if asked for, the walk time per interaction. It sorts when either got
+//      worse and checks less often while nothing changes.
+//
+//  Reordering changes the summation order of the forces, so results differ in the last
+//  bits from an unsorted run. With the spread check alone they are still identical for
+//  every thread count; walk timings depend on the machine load, so they are opt-in.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Thread_Pool.h"
+#include "Arena.h"
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+const int MORTON_BITS = 21;                   // Per axis, 63 bit keys
+const int MORTON_MIN_CHECK_INTERVAL = 8;      // Steps between locality checks right after a sort
+const int MORTON_MAX_CHECK_INTERVAL = 256;    // ... growing up to this while nothing changes
+const double MORTON_SPREAD_CELLS = 64.0;      // Neighbours further apart than cube / 64 count as scattered
+const double MORTON_MAX_SPREAD_GROWTH = 0.1;  // Sort once 10% more neighbours are scattered than after the sort
+const double MORTON_MAX_WALK_SLOWDOWN = 1.25; // ... or tree walks got this much slower per term
+const size_t MORTON_SORT_BLOCK = 4096;        // Bodies per radix sort job
+
+// Spreads the low 21 bits of v so there are two zero bits between each of them
+inline uint64_t SpreadBits21(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+// Cube the keys are quantized in. Kept between sorts, so one fast body moving the
+// bounds doesn't change every key.
+struct MortonCube
+{
+    double minX = 0.0, minY = 0.0, minZ = 0.0;
+    double scale = 0.0; // Cells per unit length
+};
+
+// Bounding cube of all bodies with 'margin' (relative) on every side
+inline MortonCube MortonCubeAround(const World &w, double margin = 0.1)
+{
+    MortonCube cube;
+    const size_t n = w.size();
+    if (n == 0)
+        return cube;
+    double minX = w.px[0], minY = w.py[0], minZ = w.pz[0];
+    double maxX = minX, maxY = minY, maxZ = minZ;
+    for (size_t i = 1; i < n; ++i)
+    {
+        minX = std::min(minX, w.px[i]);
+        minY = std::min(minY, w.py[i]);
+        minZ = std::min(minZ, w.pz[i]);
+        maxX = std::max(maxX, w.px[i]);
+        maxY = std::max(maxY, w.py[i]);
+        maxZ = std::max(maxZ, w.pz[i]);
+    }
+    double extent = std::max({maxX - minX, maxY - minY, maxZ - minZ}) * (1.0 + 2.0 * margin);
+    cube.minX = 0.5 * (minX + maxX) - 0.5 * extent;
+    cube.minY = 0.5 * (minY + maxY) - 0.5 * extent;
+    cube.minZ = 0.5 * (minZ + maxZ) - 0.5 * extent;
+    cube.scale = extent > 0.0 ? double((1u << MORTON_BITS) - 1) / extent : 0.0;
+    return cube;
+}
+
+// Morton key of every body, positions outside the cube are clamped to its faces
+inline void ComputeMortonKeys(const World &w, const MortonCube &cube, uint64_t *keys, ThreadPool *pool = nullptr)
+{
+    const size_t n = w.size();
+    const double cells = double((1u << MORTON_BITS) - 1);
+    auto quantize = [&](double value, double min)
+    { return (uint64_t)std::min(cells, std::max(0.0, (value - min) * cube.scale)); };
+
+    auto runBlock = [&](size_t b)
+    {
+        for (size_t i = b * MORTON_SORT_BLOCK; i < std::min(n, (b + 1) * MORTON_SORT_BLOCK); ++i)
+        {
+            uint64_t x = quantize(w.px[i], cube.minX);
+            uint64_t y = quantize(w.py[i], cube.minY);
+            uint64_t z = quantize(w.pz[i], cube.minZ);
+            keys[i] = SpreadBits21(x) | SpreadBits21(y) << 1 | SpreadBits21(z) << 2;
+        }
+    };
+    size_t blocks = (n + MORTON_SORT_BLOCK - 1) / MORTON_SORT_BLOCK;
+    if (!pool || pool->size() == 1 || blocks == 1)
+    {
+        for (size_t b = 0; b < blocks; ++b)
+            runBlock(b);
+    }
+    else
+        pool->parallelFor(blocks, runBlock);
+}
+
+// Stable LSD radix sort of (keys, values) by the low 'bits' bits of the keys. Each pass
+// counts digits per block in parallel, turns the counts into per-block offsets, then
+// scatters in parallel. The result doesn't depend on the number of threads.
+inline void RadixSortByKey(uint64_t *keys, uint32_t *values, size_t n, int bits, Arena &arena, ThreadPool *pool = nullptr)
+{
+    const size_t blocks = std::max<size_t>(1, (n + MORTON_SORT_BLOCK - 1) / MORTON_SORT_BLOCK);
+    uint64_t *keyTemp = static_cast<uint64_t *>(arena.allocate(n * sizeof(uint64_t), 64));
+    uint32_t *valueTemp = static_cast<uint32_t *>(arena.allocate(n * sizeof(uint32_t), 64));
+    size_t *counts = static_cast<size_t *>(arena.allocate(blocks * 256 * sizeof(size_t), 64));
+    const bool parallel = pool && pool->size() > 1 && blocks > 1;
+
+    for (int shift = 0; shift < bits; shift += 8)
+    {
+        auto countBlock = [&](size_t b)
+        {
+            size_t *count = counts + b * 256;
+            std::fill(count, count + 256, 0);
+            for (size_t i = b * MORTON_SORT_BLOCK; i < std::min(n, (b + 1) * MORTON_SORT_BLOCK); ++i)
+                count[(keys[i] >> shift) & 0xff]++;
+        };
+        if (parallel)
+            pool->parallelFor(blocks, countBlock);
+        else
+            for (size_t b = 0; b < blocks; ++b)
+                countBlock(b);
+
+        // Digit-major prefix sum: block b's keys with digit d go after every smaller digit
+        // and after the digit-d keys of blocks before b
+        bool allSame = false;
+        size_t running = 0;
+        for (size_t digit = 0; digit < 256; ++digit)
+        {
+            size_t total = 0;
+            for (size_t b = 0; b < blocks; ++b)
+            {
+                size_t count = counts[b * 256 + digit];
+                counts[b * 256 + digit] = running;
+                running += count;
+                total += count;
+            }
+            allSame = allSame || total == n;
+        }
+        if (allSame)
+            continue; // Nothing to reorder in this digit
+
+        auto scatterBlock = [&](size_t b)
+        {
+            size_t *offset = counts + b * 256;
+            for (size_t i = b * MORTON_SORT_BLOCK; i < std::min(n, (b + 1) * MORTON_SORT_BLOCK); ++i)
+            {
+                size_t target = offset[(keys[i] >> shift) & 0xff]++;
+                keyTemp[target] = keys[i];
+                valueTemp[target] = values[i];
+            }
+        };
+        if (parallel)
+            pool->parallelFor(blocks, scatterBlock);
+        else
+            for (size_t b = 0; b < blocks; ++b)
+                scatterBlock(b);
+
+        std::memcpy(keys, keyTemp, n * sizeof(uint64_t));
+        std::memcpy(values, valueTemp, n * sizeof(uint32_t));
+    }
+}
+
+// array[k] = old array[order[k]], through a temporary buffer from the arena
+template <typename T>
+void PermuteArray(std::vector<T> &array, const uint32_t *order, Arena &arena)
+{
+    const size_t n = array.size();
+    T *temp = static_cast<T *>(arena.allocate(n * sizeof(T), 64));
+    for (size_t k = 0; k < n; ++k)
+        temp[k] = array[order[k]];
+    std::copy(temp, temp + n, array.begin());
+}
+
+// Moves body order[k] to slot k in every per-body array and updates the ID mapping
+inline void PermuteWorld(World &w, const uint32_t *order, Arena &arena)
+{
+    for (std::vector<double> *array : {&w.px, &w.py, &w.pz, &w.vx, &w.vy, &w.vz, &w.ax, &w.ay, &w.az, &w.mass, &w.radius})
+        PermuteArray(*array, order, arena);
+    for (std::vector<float> *array : {&w.cr, &w.cg, &w.cb})
+        PermuteArray(*array, order, arena);
+    PermuteArray(w.fixed, order, arena);
+    PermuteArray(w.id, order, arena);
+    for (size_t k = 0; k < w.size(); ++k)
+        w.slot[w.id[k]] = (uint32_t)k;
+}
+
+// Fraction of neighbours in memory that are more than one coarse cell (1 / 64 of the
+// cube) apart, a cheap proxy for cache misses in spatial loops. A fresh Morton order keeps
+// most neighbours together, a random one almost none.
+inline double MortonSpread(const World &w, const MortonCube &cube)
+{
+    const size_t n = w.size();
+    if (n < 2 || cube.scale <= 0.0)
+        return 0.0;
+    const double cell = double(1u << MORTON_BITS) / (MORTON_SPREAD_CELLS * cube.scale);
+    size_t apart = 0;
+    for (size_t i = 0; i + 1 < n; ++i)
+    {
+        double dx = w.px[i + 1] - w.px[i], dy = w.py[i + 1] - w.py[i], dz = w.pz[i + 1] - w.pz[i];
+        apart += dx * dx + dy * dy + dz * dz > cell * cell ? 1 : 0;
+    }
+    return double(apart) / double(n - 1);
+}
+
+struct MortonStats
+{
+    long long sorts = 0;
+    long long checks = 0;
+    double spread = 0.0;       // At the last check
+    double sortedSpread = 0.0; // Right after the last sort
+    double sortSeconds = 0.0;  // Of the last sort
+    int checkInterval = MORTON_MIN_CHECK_INTERVAL;
+};
+
+class MortonSorter
+{
+public:
+    const MortonStats &stats() const { return lastStats; }
+
+    // Call once per sub-step. walkSecondsPerTerm is the last tree walk's time per
+    // interaction (0 without tree gravity). Returns true if the bodies were reordered,
+    // which makes every body index held elsewhere stale.
+    bool update(World &w, Arena &arena, ThreadPool *pool = nullptr, double walkSecondsPerTerm = 0.0)
+    {
+        // Walk times are noisy: compare a running average against the best since the sort
+        if (walkSecondsPerTerm > 0.0)
+        {
+            bestWalkCost = bestWalkCost > 0.0 ? std::min(bestWalkCost, walkSecondsPerTerm) : walkSecondsPerTerm;
+            averageWalkCost = averageWalkCost > 0.0 ? 0.8 * averageWalkCost + 0.2 * walkSecondsPerTerm : walkSecondsPerTerm;
+        }
+        if (++stepsSinceCheck < lastStats.checkInterval && lastStats.sorts > 0)
+            return false;
+        stepsSinceCheck = 0;
+        lastStats.checks++;
+
+        if (lastStats.sorts > 0)
+        {
+            lastStats.spread = MortonSpread(w, cube);
+            bool scattered = lastStats.spread > lastStats.sortedSpread + MORTON_MAX_SPREAD_GROWTH;
+            bool slower = bestWalkCost > 0.0 && averageWalkCost > bestWalkCost * MORTON_MAX_WALK_SLOWDOWN;
+            if (!scattered && !slower)
+            {
+                lastStats.checkInterval = std::min(MORTON_MAX_CHECK_INTERVAL, lastStats.checkInterval * 2);
+                return false;
+            }
+        }
+
+        const size_t n = w.size();
+        uint64_t *keys = static_cast<uint64_t *>(arena.allocate(n * sizeof(uint64_t), 64));
+        cube = MortonCubeAround(w);
+        ComputeMortonKeys(w, cube, keys, pool);
+        sort(w, keys, arena, pool);
+        lastStats.spread = lastStats.sortedSpread = MortonSpread(w, cube);
+        lastStats.checkInterval = MORTON_MIN_CHECK_INTERVAL;
+        bestWalkCost = averageWalkCost = 0.0;
+        return true;
+    }
+
+private:
+    MortonStats lastStats;
+    MortonCube cube;
+    int stepsSinceCheck = 0;
+    double bestWalkCost = 0.0;
+    double averageWalkCost = 0.0;
+
+    void sort(World &w, uint64_t *keys, Arena &arena, ThreadPool *pool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const size_t n = w.size();
+        uint32_t *order = static_cast<uint32_t *>(arena.allocate(n * sizeof(uint32_t), 64));
+        for (size_t i = 0; i < n; ++i)
+            order[i] = (uint32_t)i;
+        RadixSortByKey(keys, order, n, 3 * MORTON_BITS, arena, pool);
+        PermuteWorld(w, order, arena);
+
+        lastStats.sorts++;
+        lastStats.sortSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
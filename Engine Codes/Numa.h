@@ -0,0 +1,327 @@
+//
+//  Numa.h
+//  SpaceEngine
+//
+//  Memory placement and thread pinning for big runs on multi-socket machines.
+//
+//  Linux puts a page on the NUMA node of the thread that first writes to it. World's
+//  arrays are filled by whoever creates the world, so on a two-socket box a 10M body run
+//  has all of them on one node and half the workers read every position from the other
+//  socket. The fix is to let every worker write its own part first:
+//
+//    - the ThreadPool deals contiguous blocks of a range to its workers, worker k always
+//      starts on block k (ThreadPool::firstChunkOf()),
+//    - FirstTouchWorld() copies every per-body array into fresh pages, each worker copying
+//      exactly the bodies it owns in the force loop, so its targets, accelerations and
+//      velocities are local (the sources are read by everyone and live in the caches),
+//    - FirstTouchArenas() lets every worker allocate its own step arena,
+//    - PinWorkers() fixes the workers to CPUs so they don't wander away from their pages,
+//      compact (fill one node, then the next) or scatter (round-robin over the nodes),
+//      and tells the pool which workers share a node, so thieves steal there first.
+//
+//  The topology comes from /sys/devices/system/node. Without it (other systems, or a
+//  container hiding it) everything is one node and pinning is a no-op. To try the policies
+//  on a single-node box, SplitTopology() cuts the CPUs into pretend nodes, the same thing
+//  'numactl --cpunodebind' experiments do by hand.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Thread_Pool.h"
+#include "Arena.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const unsigned MAX_NUMA_NODES = 256; // Highest node number looked for in sysfs
+
+// CPUs of every node, node k is nodeCpus[k]
+struct NumaTopology
+{
+    std::vector<std::vector<unsigned>> nodeCpus;
+
+    unsigned nodes() const { return (unsigned)nodeCpus.size(); }
+
+    unsigned cpus() const
+    {
+        unsigned total = 0;
+        for (const auto &cpus : nodeCpus)
+            total += (unsigned)cpus.size();
+        return total;
+    }
+};
+
+enum class PinPolicy
+{
+    None,    // Leave the threads to the scheduler
+    Compact, // Worker k on the k-th CPU, filling one node before the next
+    Scatter  // Round-robin over the nodes, spreads the memory bandwidth
+};
+
+inline const char *PinPolicyName(PinPolicy policy)
+{
+    switch (policy)
+    {
+    case PinPolicy::Compact:
+        return "compact";
+    case PinPolicy::Scatter:
+        return "scatter";
+    default:
+        return "none";
+    }
+}
+
+inline bool ParsePinPolicy(const std::string &name, PinPolicy &out)
+{
+    for (PinPolicy policy : {PinPolicy::None, PinPolicy::Compact, PinPolicy::Scatter})
+        if (name == PinPolicyName(policy))
+        {
+            out = policy;
+            return true;
+        }
+    return false;
+}
+
+// "0-3,8-11" -> 0 1 2 3 8 9 10 11
+inline std::vector<unsigned> ParseCpuList(const std::string &list)
+{
+    std::vector<unsigned> cpus;
+    std::stringstream in(list);
+    std::string part;
+    while (std::getline(in, part, ','))
+    {
+        if (part.empty() || part[0] < '0' || part[0] > '9')
+            continue;
+        size_t dash = part.find('-');
+        unsigned first = (unsigned)std::atoi(part.c_str());
+        unsigned last = dash == std::string::npos ? first : (unsigned)std::atoi(part.c_str() + dash + 1);
+        for (unsigned cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Nodes with CPUs from sysfs, or one node with every CPU if that isn't available
+inline NumaTopology DetectNumaTopology()
+{
+    NumaTopology topology;
+    for (unsigned node = 0; node < MAX_NUMA_NODES; ++node)
+    {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file)
+            continue; // Node numbers can have gaps
+        std::string list;
+        std::getline(file, list);
+        std::vector<unsigned> cpus = ParseCpuList(list);
+        if (!cpus.empty()) // Memory-only nodes have no CPUs to pin to
+            topology.nodeCpus.push_back(cpus);
+    }
+    if (topology.nodeCpus.empty())
+    {
+        topology.nodeCpus.emplace_back();
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            topology.nodeCpus[0].push_back(cpu);
+    }
+    return topology;
+}
+
+// Same CPUs cut into 'nodes' pretend nodes of equal size, for trying the policies and the
+// partitioning on a single-node machine
+inline NumaTopology SplitTopology(const NumaTopology &real, unsigned nodes)
+{
+    std::vector<unsigned> all;
+    for (const auto &cpus : real.nodeCpus)
+        all.insert(all.end(), cpus.begin(), cpus.end());
+    nodes = std::max(1u, std::min(nodes, (unsigned)all.size()));
+
+    NumaTopology split;
+    split.nodeCpus.resize(nodes);
+    for (size_t k = 0; k < all.size(); ++k)
+        split.nodeCpus[k * nodes / all.size()].push_back(all[k]);
+    return split;
+}
+
+// CPU for every worker under the policy, -1 for unpinned. With more workers than CPUs
+// the assignment wraps around.
+inline std::vector<int> AssignWorkerCpus(const NumaTopology &topology, unsigned workers, PinPolicy policy)
+{
+    std::vector<int> cpus(workers, -1);
+    if (policy == PinPolicy::None || topology.cpus() == 0)
+        return cpus;
+
+    std::vector<unsigned> order;
+    if (policy == PinPolicy::Compact)
+    {
+        for (const auto &node : topology.nodeCpus)
+            order.insert(order.end(), node.begin(), node.end());
+    }
+    else
+    {
+        for (size_t k = 0; order.size() < topology.cpus(); ++k)
+            for (const auto &node : topology.nodeCpus)
+                if (k < node.size())
+                    order.push_back(node[k]);
+    }
+    for (unsigned w = 0; w < workers; ++w)
+        cpus[w] = (int)order[w % order.size()];
+    return cpus;
+}
+
+// Node of a CPU, 0 if it isn't in the topology
+inline int NodeOfCpu(const NumaTopology &topology, int cpu)
+{
+    for (unsigned node = 0; node < topology.nodes(); ++node)
+        for (unsigned c : topology.nodeCpus[node])
+            if ((int)c == cpu)
+                return (int)node;
+    return 0;
+}
+
+// Binds the calling thread to one CPU. False if that isn't possible here.
+inline bool PinCurrentThread(int cpu)
+{
+#if defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Pins every worker of the pool under the policy, the calling thread included (it is
+// worker 0), and hands the node of each worker to the pool's thieves. Returns the number
+// of workers actually pinned.
+inline unsigned PinWorkers(ThreadPool &pool, const NumaTopology &topology, PinPolicy policy)
+{
+    std::vector<int> cpus = AssignWorkerCpus(topology, pool.size(), policy);
+    std::vector<int> nodes(pool.size(), 0);
+    for (unsigned w = 0; w < pool.size(); ++w)
+        nodes[w] = NodeOfCpu(topology, cpus[w]);
+    pool.setWorkerNodes(nodes);
+
+    std::vector<unsigned char> pinned(pool.size(), 0);
+    pool.forEachWorker([&](unsigned worker)
+                       { pinned[worker] = PinCurrentThread(cpus[worker]) ? 1 : 0; });
+    return (unsigned)std::count(pinned.begin(), pinned.end(), 1);
+}
+
+// Hands whole pages inside [data, data + bytes) back to the kernel. Their next write maps
+// fresh zero pages on the node of the writing thread. No-op where that isn't available.
+inline void ReleasePages(void *data, size_t bytes)
+{
+#if defined(__linux__)
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)data + page - 1) / page * page;
+    uintptr_t end = ((uintptr_t)data + bytes) / page * page;
+    if (end > begin)
+        madvise((void *)begin, end - begin, MADV_DONTNEED);
+#else
+    (void)data;
+    (void)bytes;
+#endif
+}
+
+// Node the page holding 'address' lives on, -1 if unknown (not touched yet, or no way to ask)
+inline int PageNode(const void *address)
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+    void *page = const_cast<void *>(address);
+    int status = -1;
+    if (syscall(SYS_move_pages, 0, 1, &page, nullptr, &status, 0) != 0)
+        return -1;
+    return status;
+#else
+    (void)address;
+    return -1;
+#endif
+}
+
+// Moves the array into new pages, each worker writing the bodies it owns when the pool
+// runs over blocks of 'block' bodies
+template <typename T>
+void FirstTouchArray(std::vector<T> &array, ThreadPool &pool, size_t block)
+{
+    const size_t n = array.size();
+    const size_t chunks = (n + block - 1) / block;
+    std::vector<T> placed(n);
+    ReleasePages(placed.data(), n * sizeof(T)); // Untouched again, the workers place them
+    pool.forEachWorker([&](unsigned worker)
+                       {
+        size_t begin = std::min(n, pool.firstChunkOf(worker, chunks) * block);
+        size_t end = std::min(n, pool.firstChunkOf(worker + 1, chunks) * block);
+        std::copy(array.begin() + begin, array.begin() + end, placed.begin() + begin); });
+    array.swap(placed);
+}
+
+// Block size of the direct force loop, which the placement follows
+inline size_t PlacementBlock(const World &w)
+{
+    return SelectedForceTiling(w.size()).targetTile;
+}
+
+// First touch of every per-body array by the worker that owns the bodies in the force
+// loop. Morton reordering permutes in place, so the placement survives it.
+inline void FirstTouchWorld(World &w, ThreadPool &pool)
+{
+    const size_t block = PlacementBlock(w);
+    for (std::vector<double> *array : {&w.px, &w.py, &w.pz, &w.vx, &w.vy, &w.vz, &w.ax, &w.ay, &w.az, &w.mass, &w.radius})
+        FirstTouchArray(*array, pool, block);
+    for (std::vector<float> *array : {&w.cr, &w.cg, &w.cb, &w.spx, &w.spy, &w.spz, &w.sGm, &w.sRadius})
+        FirstTouchArray(*array, pool, block);
+    FirstTouchArray(w.fixed, pool, block);
+    FirstTouchArray(w.id, pool, block);
+}
+
+// Every worker allocates its own step arena
+inline void FirstTouchArenas(StepArenas &arenas, ThreadPool &pool)
+{
+    pool.forEachWorker([&](unsigned worker)
+                       {
+        if (worker < arenas.size())
+            arenas.renew(worker); });
+}
+
+// Share of the pages of each worker's bodies (in px) that sit on that worker's node.
+// 'nodes' is the node of every worker; pages the kernel won't report are left out.
+inline double LocalPageShare(const World &w, const ThreadPool &pool, const std::vector<int> &nodes)
+{
+    const size_t n = w.size();
+    const size_t block = PlacementBlock(w);
+    const size_t chunks = (n + block - 1) / block;
+    const size_t perPage = std::max<size_t>(1, 4096 / sizeof(double));
+    size_t local = 0, known = 0;
+    for (unsigned worker = 0; worker < pool.size(); ++worker)
+    {
+        size_t begin = std::min(n, pool.firstChunkOf(worker, chunks) * block);
+        size_t end = std::min(n, pool.firstChunkOf(worker + 1, chunks) * block);
+        for (size_t i = begin; i < end; i += perPage)
+        {
+            int node = PageNode(&w.px[i]);
+            if (node < 0)
+                continue;
+            known++;
+            local += node == nodes[worker] ? 1 : 0;
+        }
+    }
+    return known ? double(local) / known : 0.0;
+}
@@ -0,0 +1,443 @@
+//
+//  Octree.h
+//  SpaceEngine
+//
+//  Barnes-Hut gravity with a tree that is kept between sub-steps.
+//
+//  Bodies move a tiny fraction of a cell per sub-step, so building the tree from scratch
+//  every time is mostly wasted work. Octree keeps its topology (which body sits in which
+//  leaf) and each sub-step only refits it: node bounds and multipoles are recomputed
+//  bottom-up in one pass over the nodes. The opening test uses the refitted bounds, so a
+//  stale tree still gives correct forces, it just gets slower as leaves spread out.
+//
+//  The tree is rebuilt when that happens, judged by two quality metrics:
+//
+//    - inflation: total size of all nodes relative to right after the build,
+//    - walk growth: interactions per force evaluation relative to the first walk after
+//      the build (a measured cost, so it also catches shear that inflation misses),
+//
+//  and of course when there is no tree yet, the body count changed or invalidate() was
+//  called because the bodies were reordered.
+//
+//  Nodes also carry their quadrupole moment. With the quadrupole term added to the point
+//  mass, an opening angle of 0.7 is about as accurate as a monopole-only walk at 0.4
+//  (see the 'multipoles' section of Benchmark), which opens far fewer nodes.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Thread_Pool.h"
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+const int OCTREE_LEAF_SIZE = 8;              // Bodies per leaf before it is split
+const int OCTREE_MAX_DEPTH = 32;             // Coincident bodies stop splitting here
+const double OCTREE_MAX_WALK_GROWTH = 1.25;  // Rebuild once walks cost 25% more than after the build
+const size_t OCTREE_BLOCK = 64;              // Targets per pool job
+
+struct OctreeNode
+{
+    double minX, minY, minZ, maxX, maxY, maxZ; // Tight bounds of the bodies below
+    double mass;
+    double comX, comY, comZ; // Centre of mass
+    double size;             // Longest side of the bounds
+    double offset;           // Distance from the centre of mass to the centre of the bounds
+    double maxRadius;        // Largest body radius below, for the softening check
+    double bmax;             // Distance from the centre of mass to the furthest body
+    double qxx, qxy, qxz, qyy, qyz, qzz; // Traceless quadrupole sum m (3 x x^T - |x|^2 I) about the centre of mass
+    double builtSize;        // 'size' right after the last build
+    int firstChild;          // Children are stored next to each other, -1 for a leaf
+    int childCount;
+    int bodyBegin, bodyCount; // Range in Octree::order, contiguous for inner nodes too
+};
+
+// Timings and quality of the last update() and force evaluation
+struct OctreeStats
+{
+    bool rebuilt = false;
+    double buildSeconds = 0.0; // Partitioning plus the first refit
+    double refitSeconds = 0.0;
+    double walkSeconds = 0.0;
+    double inflation = 1.0;
+    long long interactions = 0; // Body-body plus body-node terms of the last walk
+    long long builds = 0;
+    long long refits = 0;
+};
+
+class Octree
+{
+public:
+    const std::vector<OctreeNode> &nodes() const { return tree; }
+    const std::vector<uint32_t> &bodyOrder() const { return order; }
+    const OctreeStats &stats() const { return lastStats; }
+
+    // Forces a rebuild on the next update(), e.g. after the World was reordered
+    void invalidate() { tree.clear(); }
+
+    // Refits the tree to the current positions, or rebuilds it if there is none, the body
+    // count changed or the quality metrics say so. maxInflation <= 1 rebuilds every time.
+    void update(const World &w, double maxInflation)
+    {
+        auto start = std::chrono::steady_clock::now();
+        lastStats.rebuilt = false;
+        lastStats.buildSeconds = lastStats.refitSeconds = 0.0;
+
+        if (maxInflation > 1.0 && !tree.empty() && order.size() == w.size())
+        {
+            refit(w);
+            lastStats.refits++;
+            lastStats.refitSeconds = SecondsSince(start);
+            bool walksGrew = builtInteractions > 0 && lastStats.interactions > builtInteractions * OCTREE_MAX_WALK_GROWTH;
+            if (lastStats.inflation <= maxInflation && !walksGrew)
+                return;
+            start = std::chrono::steady_clock::now();
+        }
+
+        build(w);
+        lastStats.rebuilt = true;
+        lastStats.builds++;
+        lastStats.buildSeconds = SecondsSince(start);
+    }
+
+    // Barnes-Hut accelerations for all bodies (targets == nullptr) or the listed ones.
+    // A node is used as a whole if d > size / theta + offset, with theta <= 1 so a node
+    // never stands in for a body inside it, and only if none of its bodies can be within
+    // the softening distance, where the direct sum clamps the force. 'quadrupole' adds the
+    // quadrupole term to every node used as a whole.
+    void computeAccelerations(World &w, double theta, bool quadrupole, ThreadPool *pool = nullptr,
+                              const uint32_t *targets = nullptr, size_t count = 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const double inverseTheta = 1.0 / std::min(theta, 1.0);
+        if (!targets)
+        {
+            // Tree order, so neighbouring targets walk the same nodes
+            targets = order.data();
+            count = order.size();
+        }
+
+        std::atomic<long long> interactions{0};
+        auto runBlock = [&](size_t b)
+        {
+            long long local = 0;
+            for (size_t k = b * OCTREE_BLOCK; k < std::min(count, (b + 1) * OCTREE_BLOCK); ++k)
+                local += quadrupole ? walk<true>(w, targets[k], inverseTheta) : walk<false>(w, targets[k], inverseTheta);
+            interactions.fetch_add(local, std::memory_order_relaxed);
+        };
+        size_t blocks = (count + OCTREE_BLOCK - 1) / OCTREE_BLOCK;
+        if (!pool || pool->size() == 1 || blocks <= 1)
+        {
+            for (size_t b = 0; b < blocks; ++b)
+                runBlock(b);
+        }
+        else
+            pool->parallelFor(blocks, runBlock);
+
+        lastStats.interactions = interactions.load();
+        if (lastStats.rebuilt || builtInteractions == 0)
+            builtInteractions = lastStats.interactions;
+        lastStats.walkSeconds = SecondsSince(start);
+    }
+
+private:
+    std::vector<OctreeNode> tree;
+    std::vector<uint32_t> order;   // Body indices grouped by node
+    std::vector<uint32_t> scratch; // Partition buffer
+    long long builtInteractions = 0;
+    OctreeStats lastStats;
+
+    static double SecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void build(const World &w)
+    {
+        const size_t n = w.size();
+        order.resize(n);
+        scratch.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            order[i] = (uint32_t)i;
+        tree.clear();
+        if (n == 0)
+            return;
+
+        // Root cube around every body
+        double minX = w.px[0], minY = w.py[0], minZ = w.pz[0];
+        double maxX = minX, maxY = minY, maxZ = minZ;
+        for (size_t i = 1; i < n; ++i)
+        {
+            minX = std::min(minX, w.px[i]);
+            minY = std::min(minY, w.py[i]);
+            minZ = std::min(minZ, w.pz[i]);
+            maxX = std::max(maxX, w.px[i]);
+            maxY = std::max(maxY, w.py[i]);
+            maxZ = std::max(maxZ, w.pz[i]);
+        }
+        double half = 0.5 * std::max({maxX - minX, maxY - minY, maxZ - minZ}) * 1.0001 + 1e-12;
+
+        tree.push_back(MakeNode(0, (int)n));
+        split(w, 0, 0.5 * (minX + maxX), 0.5 * (minY + maxY), 0.5 * (minZ + maxZ), half, 0);
+
+        // Headroom so later rebuilds don't reallocate mid-run
+        if (tree.capacity() < tree.size() * 3 / 2)
+            tree.reserve(tree.size() * 2);
+
+        refit(w);
+        for (auto &node : tree)
+            node.builtSize = node.size;
+        lastStats.inflation = 1.0;
+        builtInteractions = 0;
+    }
+
+    static OctreeNode MakeNode(int begin, int count)
+    {
+        OctreeNode node = {};
+        node.firstChild = -1;
+        node.bodyBegin = begin;
+        node.bodyCount = count;
+        return node;
+    }
+
+    // Sorts the node's bodies into octants around (cx, cy, cz) and recurses
+    void split(const World &w, int index, double cx, double cy, double cz, double half, int depth)
+    {
+        const int begin = tree[index].bodyBegin, count = tree[index].bodyCount;
+        if (count <= OCTREE_LEAF_SIZE || depth >= OCTREE_MAX_DEPTH)
+            return;
+
+        auto octant = [&](uint32_t i)
+        { return (w.px[i] >= cx ? 1 : 0) | (w.py[i] >= cy ? 2 : 0) | (w.pz[i] >= cz ? 4 : 0); };
+
+        int counts[8] = {};
+        for (int k = begin; k < begin + count; ++k)
+            counts[octant(order[k])]++;
+        int starts[8];
+        int next = begin;
+        for (int o = 0; o < 8; ++o)
+        {
+            starts[o] = next;
+            next += counts[o];
+        }
+        int fill[8];
+        std::copy(starts, starts + 8, fill);
+        for (int k = begin; k < begin + count; ++k)
+            scratch[fill[octant(order[k])]++] = order[k];
+        std::copy(scratch.begin() + begin, scratch.begin() + begin + count, order.begin() + begin);
+
+        const int firstChild = (int)tree.size();
+        int children = 0;
+        for (int o = 0; o < 8; ++o)
+        {
+            if (counts[o] == 0)
+                continue;
+            tree.push_back(MakeNode(starts[o], counts[o]));
+            children++;
+        }
+        tree[index].firstChild = firstChild;
+        tree[index].childCount = children;
+
+        const double quarter = 0.5 * half;
+        int child = firstChild;
+        for (int o = 0; o < 8; ++o)
+        {
+            if (counts[o] == 0)
+                continue;
+            split(w, child++, cx + (o & 1 ? quarter : -quarter), cy + (o & 2 ? quarter : -quarter),
+                  cz + (o & 4 ? quarter : -quarter), quarter, depth + 1);
+        }
+    }
+
+    // Bounds and multipoles bottom-up. Children always come after their parent, so one
+    // backwards pass over the nodes is enough.
+    void refit(const World &w)
+    {
+        double totalSize = 0.0, totalBuiltSize = 0.0;
+        for (int index = (int)tree.size() - 1; index >= 0; --index)
+        {
+            OctreeNode &node = tree[index];
+            double minX = 1e300, minY = 1e300, minZ = 1e300;
+            double maxX = -1e300, maxY = -1e300, maxZ = -1e300;
+            double mass = 0.0, sumX = 0.0, sumY = 0.0, sumZ = 0.0, maxRadius = 0.0;
+            if (node.firstChild < 0)
+            {
+                for (int k = node.bodyBegin; k < node.bodyBegin + node.bodyCount; ++k)
+                {
+                    uint32_t i = order[k];
+                    minX = std::min(minX, w.px[i]);
+                    minY = std::min(minY, w.py[i]);
+                    minZ = std::min(minZ, w.pz[i]);
+                    maxX = std::max(maxX, w.px[i]);
+                    maxY = std::max(maxY, w.py[i]);
+                    maxZ = std::max(maxZ, w.pz[i]);
+                    mass += w.mass[i];
+                    sumX += w.mass[i] * w.px[i];
+                    sumY += w.mass[i] * w.py[i];
+                    sumZ += w.mass[i] * w.pz[i];
+                    maxRadius = std::max(maxRadius, w.radius[i]);
+                }
+            }
+            else
+            {
+                for (int c = node.firstChild; c < node.firstChild + node.childCount; ++c)
+                {
+                    const OctreeNode &child = tree[c];
+                    minX = std::min(minX, child.minX);
+                    minY = std::min(minY, child.minY);
+                    minZ = std::min(minZ, child.minZ);
+                    maxX = std::max(maxX, child.maxX);
+                    maxY = std::max(maxY, child.maxY);
+                    maxZ = std::max(maxZ, child.maxZ);
+                    mass += child.mass;
+                    sumX += child.mass * child.comX;
+                    sumY += child.mass * child.comY;
+                    sumZ += child.mass * child.comZ;
+                    maxRadius = std::max(maxRadius, child.maxRadius);
+                }
+            }
+
+            node.minX = minX;
+            node.minY = minY;
+            node.minZ = minZ;
+            node.maxX = maxX;
+            node.maxY = maxY;
+            node.maxZ = maxZ;
+            node.mass = mass;
+            node.maxRadius = maxRadius;
+            double centreX = 0.5 * (minX + maxX), centreY = 0.5 * (minY + maxY), centreZ = 0.5 * (minZ + maxZ);
+            node.comX = mass > 0.0 ? sumX / mass : centreX;
+            node.comY = mass > 0.0 ? sumY / mass : centreY;
+            node.comZ = mass > 0.0 ? sumZ / mass : centreZ;
+            node.size = std::max({maxX - minX, maxY - minY, maxZ - minZ});
+            double ox = node.comX - centreX, oy = node.comY - centreY, oz = node.comZ - centreZ;
+            node.offset = std::sqrt(ox * ox + oy * oy + oz * oz);
+
+            // Second moments about the new centre of mass: from the bodies in a leaf, from
+            // the children (parallel axis theorem) in an inner node
+            double bmax = 0.0, qxx = 0.0, qxy = 0.0, qxz = 0.0, qyy = 0.0, qyz = 0.0, qzz = 0.0;
+            auto addPoint = [&](double m, double x, double y, double z)
+            {
+                double r2 = x * x + y * y + z * z;
+                qxx += m * (3.0 * x * x - r2);
+                qxy += m * 3.0 * x * y;
+                qxz += m * 3.0 * x * z;
+                qyy += m * (3.0 * y * y - r2);
+                qyz += m * 3.0 * y * z;
+                qzz += m * (3.0 * z * z - r2);
+                return std::sqrt(r2);
+            };
+            if (node.firstChild < 0)
+            {
+                for (int k = node.bodyBegin; k < node.bodyBegin + node.bodyCount; ++k)
+                {
+                    uint32_t i = order[k];
+                    bmax = std::max(bmax, addPoint(w.mass[i], w.px[i] - node.comX, w.py[i] - node.comY, w.pz[i] - node.comZ));
+                }
+            }
+            else
+            {
+                for (int c = node.firstChild; c < node.firstChild + node.childCount; ++c)
+                {
+                    const OctreeNode &child = tree[c];
+                    double shift = addPoint(child.mass, child.comX - node.comX, child.comY - node.comY, child.comZ - node.comZ);
+                    bmax = std::max(bmax, child.bmax + shift);
+                    qxx += child.qxx;
+                    qxy += child.qxy;
+                    qxz += child.qxz;
+                    qyy += child.qyy;
+                    qyz += child.qyz;
+                    qzz += child.qzz;
+                }
+            }
+            node.bmax = bmax;
+            node.qxx = qxx;
+            node.qxy = qxy;
+            node.qxz = qxz;
+            node.qyy = qyy;
+            node.qyz = qyz;
+            node.qzz = qzz;
+
+            totalSize += node.size;
+            totalBuiltSize += node.builtSize;
+        }
+        lastStats.inflation = totalBuiltSize > 0.0 ? totalSize / totalBuiltSize : 1.0;
+    }
+
+    // Acceleration on body i, returns the number of terms summed
+    template <bool Quadrupole>
+    long long walk(World &w, uint32_t i, double inverseTheta) const
+    {
+        double accX = 0.0, accY = 0.0, accZ = 0.0;
+        long long terms = 0;
+        if (!w.fixed[i])
+        {
+            const double xi = w.px[i], yi = w.py[i], zi = w.pz[i], ri = w.radius[i];
+            int stack[8 * OCTREE_MAX_DEPTH + 8];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const OctreeNode &node = tree[stack[--top]];
+                double dx = node.comX - xi, dy = node.comY - yi, dz = node.comZ - zi;
+                double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+                double softened = node.bmax + (ri + node.maxRadius) * w.minDistanceFactor;
+                if (distance > node.size * inverseTheta + node.offset && distance > softened)
+                {
+                    // Far enough: the whole node as a point mass
+                    double inverse2 = 1.0 / (distance * distance);
+                    double scale = w.G * node.mass * inverse2 / distance;
+                    accX += dx * scale;
+                    accY += dy * scale;
+                    accZ += dz * scale;
+                    if (Quadrupole)
+                    {
+                        // a += G (5/2 (d.Q.d) d / |d|^7 - Q d / |d|^5), d from the target to the node
+                        double qx = node.qxx * dx + node.qxy * dy + node.qxz * dz;
+                        double qy = node.qxy * dx + node.qyy * dy + node.qyz * dz;
+                        double qz = node.qxz * dx + node.qyz * dy + node.qzz * dz;
+                        double inverse5 = inverse2 * inverse2 / distance;
+                        double radial = 2.5 * (dx * qx + dy * qy + dz * qz) * inverse2;
+                        accX += w.G * inverse5 * (radial * dx - qx);
+                        accY += w.G * inverse5 * (radial * dy - qy);
+                        accZ += w.G * inverse5 * (radial * dz - qz);
+                    }
+                    terms++;
+                }
+                else if (node.firstChild < 0)
+                {
+                    // Leaf: exact pair forces with the same softening as the direct sum
+                    for (int k = node.bodyBegin; k < node.bodyBegin + node.bodyCount; ++k)
+                    {
+                        uint32_t j = order[k];
+                        if (j == i)
+                            continue;
+                        double bx = w.px[j] - xi, by = w.py[j] - yi, bz = w.pz[j] - zi;
+                        double d = std::sqrt(bx * bx + by * by + bz * bz);
+                        if (d <= 0.0)
+                            continue;
+                        double scale = SoftenedScale(w.softening, w.G * w.mass[j], d, (ri + w.radius[j]) * w.minDistanceFactor);
+                        accX += bx * scale;
+                        accY += by * scale;
+                        accZ += bz * scale;
+                        terms++;
+                    }
+                }
+                else
+                {
+                    for (int c = node.firstChild; c < node.firstChild + node.childCount; ++c)
+                        stack[top++] = c;
+                }
+            }
+        }
+        w.ax[i] = accX;
+        w.ay[i] = accY;
+        w.az[i] = accZ;
+        return terms;
+    }
+};
@@ -0,0 +1,264 @@
+//
+//  Parameter_Sweep.cpp
+//  SpaceEngine
+//
+//  Runs many headless variants of a Solar System scenario across all cores and writes
+//  a summary table (stability, collisions, energy drift, run time) for each variant.
+//
+//  The Fast and Slow demos are the same program with different hand-tuned constants.
+//  Instead of editing and re-running them, give this tool a scenario and ranges:
+//
+//      ./Parameter_Sweep --scenario slow --param G=0.5:2:16 --param innerVelocityFactor=0.5:1:16
+//                        --seeds 4 --duration 20 --out sweep.csv
+//
+//  --param name=min:max:count   Sweep 'name' over 'count' evenly spaced values (repeatable,
+//                               all combinations are run). Names are the Scenario fields.
+//  --seeds N                    Asteroid belt seeds per combination (default 1)
+//  --duration T                 Simulated seconds per run (default 10)
+//  --threads N                  Worker threads, 0 = all cores (default 0)
+//  --out file.csv               Where to write the table (default sweep.csv)
+//  --scaling                    Also rerun the sweep at 1, 2, 4 ... threads and report speedup
+//  --colored                    Use the graph coloured contact solver instead of the serial loop
+//  --kepler                     Move bodies alone in their Hill sphere on analytic Kepler orbits
+//
+//  Build: clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -pthread -I"Engine Codes" "Engine Codes/Parameter_Sweep.cpp" -o sweep
+//
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Thread_Pool.h"
+#include "Cpu_Dispatch.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+// One swept parameter
+struct ParameterRange
+{
+    std::string name;
+    double minValue, maxValue;
+    int count;
+
+    double value(int k) const
+    {
+        return count <= 1 ? minValue : minValue + (maxValue - minValue) * k / (count - 1);
+    }
+};
+
+// One simulation to run
+struct SweepJob
+{
+    Scenario scenario;
+    std::vector<double> values; // Value of each swept parameter
+    uint64_t seed;
+    RunResult result;
+};
+
+// Parses "name=min:max:count"
+bool ParseRange(const std::string &text, ParameterRange &out)
+{
+    size_t eq = text.find('=');
+    if (eq == std::string::npos)
+        return false;
+    out.name = text.substr(0, eq);
+
+    std::stringstream rest(text.substr(eq + 1));
+    char colon1 = 0, colon2 = 0;
+    if (!(rest >> out.minValue >> colon1 >> out.maxValue >> colon2 >> out.count) || colon1 != ':' || colon2 != ':')
+        return false;
+    return out.count > 0;
+}
+
+// Expands the ranges into every combination times every seed
+std::vector<SweepJob> BuildJobs(const Scenario &base, const std::vector<ParameterRange> &ranges, int seeds)
+{
+    std::vector<SweepJob> jobs;
+    std::vector<int> index(ranges.size(), 0);
+
+    while (true)
+    {
+        Scenario variant = base;
+        std::vector<double> values;
+        for (size_t p = 0; p < ranges.size(); ++p)
+        {
+            double v = ranges[p].value(index[p]);
+            SetScenarioParameter(variant, ranges[p].name, v);
+            values.push_back(v);
+        }
+        for (int s = 0; s < seeds; ++s)
+            jobs.push_back({variant, values, 1000u + (uint64_t)s, RunResult()});
+
+        // Advance the combination counter like an odometer
+        size_t p = 0;
+        while (p < ranges.size() && ++index[p] == ranges[p].count)
+            index[p++] = 0;
+        if (p == ranges.size())
+            break;
+    }
+    return jobs;
+}
+
+// Runs every job on the pool and returns the wall clock time
+double RunJobs(std::vector<SweepJob> &jobs, unsigned threads, double duration, const SimulationSettings &settings)
+{
+    ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+
+    // One simulation per task; each job writes only its own slot so nothing is shared
+    pool.parallelFor(jobs.size(), [&](size_t i)
+                     { jobs[i].result = RunHeadless(jobs[i].scenario, jobs[i].seed, duration, settings); });
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void WriteTable(std::ostream &out, const std::vector<ParameterRange> &ranges, const std::vector<SweepJob> &jobs)
+{
+    for (const auto &range : ranges)
+        out << range.name << ",";
+    out << "seed,stable,escaped,collisions,energy_drift,run_seconds\n";
+
+    for (const auto &job : jobs)
+    {
+        for (double v : job.values)
+            out << v << ",";
+        out << job.seed << ","
+            << (job.result.stable ? "yes" : "no") << ","
+            << job.result.escapedBodies << ","
+            << job.result.collisions << ","
+            << job.result.energyDrift << ","
+            << job.result.runSeconds << "\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string scenarioName = "fast";
+    std::vector<ParameterRange> ranges;
+    int seeds = 1;
+    double duration = 10.0;
+    unsigned threads = 0;
+    std::string outPath = "sweep.csv";
+    bool scaling = false;
+    SimulationSettings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue)
+            scenarioName = argv[++i];
+        else if (arg == "--param" && hasValue)
+        {
+            ParameterRange range;
+            if (!ParseRange(argv[++i], range))
+            {
+                std::cerr << "Bad --param '" << argv[i] << "', expected name=min:max:count" << std::endl;
+                return 1;
+            }
+            ranges.push_back(range);
+        }
+        else if (arg == "--seeds" && hasValue)
+            seeds = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--duration" && hasValue)
+            duration = std::atof(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if (arg == "--scaling")
+            scaling = true;
+        else if (arg == "--colored")
+            settings.coloredCollisions = true;
+        else if (arg == "--kepler")
+            settings.keplerHybrid = true;
+        else
+        {
+            std::cerr << "Unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scenario base;
+    if (!ScenarioByName(scenarioName, base))
+    {
+        std::cerr << "Unknown scenario '" << scenarioName << "' (use fast or slow)" << std::endl;
+        return 1;
+    }
+    for (const auto &range : ranges)
+    {
+        Scenario probe;
+        if (!SetScenarioParameter(probe, range.name, range.minValue))
+        {
+            std::cerr << "Unknown parameter '" << range.name << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<SweepJob> jobs = BuildJobs(base, ranges, seeds);
+    std::cout << "=== Parameter Sweep ===" << std::endl;
+    LogCpuDispatch(std::cout);
+    std::cout << "Scenario: " << base.name << ", runs: " << jobs.size()
+              << ", simulated seconds per run: " << duration << ", threads: " << threads << std::endl;
+
+    double wall = RunJobs(jobs, threads, duration, settings);
+
+    // Summary
+    int stableRuns = 0;
+    long long totalSteps = 0;
+    double cpuSeconds = 0.0;
+    for (const auto &job : jobs)
+    {
+        stableRuns += job.result.stable ? 1 : 0;
+        totalSteps += job.result.steps;
+        cpuSeconds += job.result.runSeconds;
+    }
+
+    std::cout << "Stable runs: " << stableRuns << " / " << jobs.size() << std::endl;
+    std::cout << "Wall time: " << wall << " s, summed run time: " << cpuSeconds << " s" << std::endl;
+    std::cout << "Throughput: " << jobs.size() / wall << " runs/s, " << totalSteps / wall << " steps/s" << std::endl;
+
+    std::ofstream file(outPath);
+    if (!file)
+    {
+        std::cerr << "Could not open " << outPath << std::endl;
+        return 1;
+    }
+    WriteTable(file, ranges, jobs);
+    std::cout << "Table written to " << outPath << std::endl;
+
+    // Optional strong scaling check on the same jobs
+    if (scaling)
+    {
+        std::cout << std::endl
+                  << "threads   wall [s]   runs/s   speedup   efficiency" << std::endl;
+        std::vector<unsigned> counts;
+        for (unsigned t = 1; t < threads; t *= 2)
+            counts.push_back(t);
+        counts.push_back(threads);
+
+        double baseline = 0.0;
+        for (unsigned t : counts)
+        {
+            std::vector<SweepJob> copy = jobs;
+            double seconds = RunJobs(copy, t, duration, settings);
+            if (t == 1)
+                baseline = seconds;
+            double speedup = baseline / seconds;
+            std::cout << std::setw(7) << t << std::setw(11) << std::setprecision(4) << seconds
+                      << std::setw(9) << std::setprecision(5) << copy.size() / seconds
+                      << std::setw(10) << std::setprecision(3) << speedup
+                      << std::setw(12) << std::setprecision(3) << speedup / t << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+//
+//  Profiler.h
+//  SpaceEngine
+//
+//  Running timings of the named stages of a frame.
+//
+//  Stages are recorded once per frame from one thread (the task graph hands over the
+//  timings of its jobs after the frame, see Job_System.h), so there is no locking. For
+//  every stage the profiler keeps the wall time from start to end, the CPU time summed
+//  over all the workers that helped, and smoothed and worst values of both.
+//
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+struct ProfileStage
+{
+    std::string name;
+    long long samples = 0;
+    double lastSeconds = 0.0;    // Wall time of the last frame, first start to last end
+    double averageSeconds = 0.0; // Smoothed wall time
+    double worstSeconds = 0.0;
+    double cpuSeconds = 0.0;     // Smoothed time summed over the workers
+    double startSeconds = 0.0;   // Smoothed start, relative to the start of the frame
+    unsigned lastWorker = 0;     // Worker that started the stage last frame
+};
+
+class Profiler
+{
+public:
+    explicit Profiler(double smoothing = 0.05) : smoothing(smoothing) {}
+
+    // Adds one frame of a stage. start is relative to the start of the frame.
+    void record(const std::string &name, double start, double seconds, double cpu, unsigned worker = 0)
+    {
+        ProfileStage &stage = find(name);
+        double weight = stage.samples == 0 ? 1.0 : smoothing;
+        stage.samples++;
+        stage.lastSeconds = seconds;
+        stage.averageSeconds += weight * (seconds - stage.averageSeconds);
+        stage.cpuSeconds += weight * (cpu - stage.cpuSeconds);
+        stage.startSeconds += weight * (start - stage.startSeconds);
+        stage.worstSeconds = std::max(stage.worstSeconds, seconds);
+        stage.lastWorker = worker;
+    }
+
+    // Whole frame, the reference for the stages' share
+    void recordFrame(double seconds)
+    {
+        double weight = frames == 0 ? 1.0 : smoothing;
+        frames++;
+        frameSeconds += weight * (seconds - frameSeconds);
+    }
+
+    const std::vector<ProfileStage> &stages() const { return list; }
+    double averageFrameSeconds() const { return frameSeconds; }
+
+    void reset()
+    {
+        list.clear();
+        frames = 0;
+        frameSeconds = 0.0;
+    }
+
+    // One line per stage in the order they were first recorded. Overlap is the CPU time
+    // of all stages over the frame time: above 1 stages or chunks ran at the same time.
+    void printReport(std::ostream &out) const
+    {
+        double cpu = 0.0;
+        out << "Profile over " << frames << " frames, " << std::fixed << std::setprecision(3)
+            << frameSeconds * 1000.0 << " ms per frame" << std::endl;
+        out << "  stage                 start [ms]   wall [ms]   worst [ms]   cpu [ms]" << std::endl;
+        for (const ProfileStage &stage : list)
+        {
+            out << "  " << std::left << std::setw(20) << stage.name << std::right
+                << std::setw(13) << stage.startSeconds * 1000.0 << std::setw(12) << stage.averageSeconds * 1000.0
+                << std::setw(13) << stage.worstSeconds * 1000.0 << std::setw(11) << stage.cpuSeconds * 1000.0 << std::endl;
+            cpu += stage.cpuSeconds;
+        }
+        out << "  overlap " << std::setprecision(2) << (frameSeconds > 0.0 ? cpu / frameSeconds : 0.0) << "x" << std::endl;
+        out.unsetf(std::ios::floatfield);
+    }
+
+private:
+    double smoothing;
+    std::vector<ProfileStage> list;
+    long long frames = 0;
+    double frameSeconds = 0.0;
+
+    ProfileStage &find(const std::string &name)
+    {
+        for (ProfileStage &stage : list)
+            if (stage.name == name)
+                return stage;
+        list.emplace_back();
+        list.back().name = name;
+        return list.back();
+    }
+};
@@ -0,0 +1,685 @@
+//
+//  Remote_View.h
+//  SpaceEngine
+//
+//  Streams the state of a headless simulation to viewers in other processes.
+//
+//  The demos draw the World they step, so a long run with a million bodies has to carry a
+//  window around, and closing the window ends the run. Here the simulation only publishes
+//  compact frames and any number of viewers can come and go:
+//
+//    - a frame holds every body as 16 bytes: ID, position quantized to 16 bits per axis
+//      inside the frame's bounding cube, radius, 8-bit colour and flags (a World body is
+//      over 100 bytes), plus the trail points sampled since the previous frame, so trails
+//      keep the simulation's resolution even when frames are much rarer than steps. The
+//      cube only spans bodies inside the scenario's escape radius; one escaped asteroid
+//      would otherwise stretch the grid over its distance for the rest of the run. Bodies
+//      outside are clamped to the cube's edge and flagged,
+//    - FrameBroadcast keeps the last few frames in slots of one shared memory segment
+//      (same segment helpers as Shm_Ring.h). The publisher overwrites the oldest slot and
+//      never waits; a viewer copies every frame newer than the last one it read that is
+//      still in the segment, checking each slot's sequence number before and after (a
+//      seqlock). A viewer falling more than VIEW_SLOTS frames behind misses frames (and
+//      their trail points), a stuck one never holds the publisher up. The publisher's
+//      cost is the same with zero viewers or twenty,
+//    - frames carry the publisher's wall clock. ViewTimeline plays them back a little
+//      more than one frame interval late and interpolates every body between the two
+//      frames around the playback time, so a 20 Hz stream still moves smoothly at 144 Hz.
+//
+//  Publisher and viewers are on the same machine (shared memory, native byte order), so
+//  steady_clock is the same clock in both.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Shm_Ring.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+const uint64_t VIEW_MAGIC = 0x5745495645435053ULL; // "SPCEVIEW"
+const uint32_t VIEW_PROTOCOL_VERSION = 1;
+const uint32_t VIEW_SLOTS = 4;          // Frames kept in the segment
+const uint16_t VIEW_FIXED_BODY = 1;     // PackedBody::flags
+const uint16_t VIEW_OUTSIDE = 2;        // PackedBody::flags, PackedTrailPoint::flags: clamped to the cube
+const double VIEW_QUANTUM_STEPS = 65535.0;
+
+// Seconds on the clock shared by publisher and viewers
+inline double ViewClock()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ===== Wire format =====
+
+struct FrameHeader
+{
+    uint32_t version;
+    uint32_t bodyCount;
+    uint32_t trailCount;
+    uint32_t reserved;
+    uint64_t number;    // Running frame number, starts at 1
+    double simTime;     // World::time
+    double wallTime;    // ViewClock() when published
+    float origin[3];    // Position = origin + quantized * scale
+    float scale;
+    float radiusScale;  // Radius = quantized * radiusScale
+    float reserved2;
+};
+
+struct PackedBody
+{
+    uint32_t id;
+    uint16_t x, y, z;
+    uint16_t radius;
+    uint8_t r, g, b;
+    uint8_t flags;
+};
+
+struct PackedTrailPoint
+{
+    uint32_t id;
+    uint16_t x, y, z;
+    uint16_t flags;
+};
+
+static_assert(sizeof(PackedBody) == 16, "PackedBody is part of the protocol");
+static_assert(sizeof(PackedTrailPoint) == 12, "PackedTrailPoint is part of the protocol");
+
+inline size_t FrameBytes(size_t bodies, size_t trailPoints)
+{
+    return sizeof(FrameHeader) + bodies * sizeof(PackedBody) + trailPoints * sizeof(PackedTrailPoint);
+}
+
+// One trail point in simulation coordinates
+struct TrailSample
+{
+    uint32_t id;
+    double x, y, z;
+};
+
+inline uint16_t Quantize(double value, double origin, double inverseScale)
+{
+    double q = std::floor((value - origin) * inverseScale + 0.5);
+    return (uint16_t)(q >= 0.0 ? std::min(q, VIEW_QUANTUM_STEPS) : 0.0); // NaN ends up at 0 too
+}
+
+inline uint8_t QuantizeColor(float c)
+{
+    return (uint8_t)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+}
+
+// Packs the world and the trail points into 'out'. The position grid spans what lies within
+// 'extent' of the origin (everything if nothing does); the rest is clamped and flagged.
+inline void EncodeFrame(const World &w, const std::vector<TrailSample> &trail, uint64_t number, double wallTime,
+                        std::vector<unsigned char> &out, double extent = INFINITY)
+{
+    const size_t n = w.size();
+
+    auto inside = [&](double x, double y, double z)
+    {
+        return x * x + y * y + z * z <= extent * extent; // False for NaN
+    };
+
+    // Bounding cube of everything in the frame that is inside
+    double lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    double maxRadius = 0.0;
+    auto extend = [&](double x, double y, double z)
+    {
+        if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z) || !inside(x, y, z))
+            return;
+        lo[0] = std::min(lo[0], x), hi[0] = std::max(hi[0], x);
+        lo[1] = std::min(lo[1], y), hi[1] = std::max(hi[1], y);
+        lo[2] = std::min(lo[2], z), hi[2] = std::max(hi[2], z);
+    };
+    for (int pass = 0; pass < 2 && lo[0] > hi[0]; ++pass)
+    {
+        if (pass == 1)
+            extent = INFINITY; // Nothing inside: fall back to all finite bodies
+        for (size_t i = 0; i < n; ++i)
+            extend(w.px[i], w.py[i], w.pz[i]);
+        for (const TrailSample &point : trail)
+            extend(point.x, point.y, point.z);
+    }
+    for (size_t i = 0; i < n; ++i)
+        maxRadius = std::max(maxRadius, w.radius[i]);
+    if (lo[0] > hi[0])
+        lo[0] = lo[1] = lo[2] = hi[0] = hi[1] = hi[2] = 0.0;
+    double size = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], 1e-6});
+
+    FrameHeader header = {};
+    header.version = VIEW_PROTOCOL_VERSION;
+    header.bodyCount = (uint32_t)n;
+    header.trailCount = (uint32_t)trail.size();
+    header.number = number;
+    header.simTime = w.time;
+    header.wallTime = wallTime;
+    for (int axis = 0; axis < 3; ++axis)
+        header.origin[axis] = (float)lo[axis];
+    header.scale = (float)(size / VIEW_QUANTUM_STEPS);
+    header.radiusScale = (float)(std::max(maxRadius, 1e-6) / VIEW_QUANTUM_STEPS);
+
+    // Quantize against the float origin and scale the viewer will use
+    const double inverseScale = 1.0 / header.scale;
+    const double inverseRadius = 1.0 / header.radiusScale;
+    const double ox = header.origin[0], oy = header.origin[1], oz = header.origin[2];
+
+    out.resize(FrameBytes(n, trail.size()));
+    std::memcpy(out.data(), &header, sizeof(header));
+    PackedBody *bodies = reinterpret_cast<PackedBody *>(out.data() + sizeof(FrameHeader));
+    for (size_t i = 0; i < n; ++i)
+    {
+        PackedBody &body = bodies[i];
+        body.id = w.id[i];
+        body.x = Quantize(w.px[i], ox, inverseScale);
+        body.y = Quantize(w.py[i], oy, inverseScale);
+        body.z = Quantize(w.pz[i], oz, inverseScale);
+        body.radius = Quantize(w.radius[i], 0.0, inverseRadius);
+        body.r = QuantizeColor(w.cr[i]);
+        body.g = QuantizeColor(w.cg[i]);
+        body.b = QuantizeColor(w.cb[i]);
+        body.flags = (w.fixed[i] ? VIEW_FIXED_BODY : 0) | (inside(w.px[i], w.py[i], w.pz[i]) ? 0 : VIEW_OUTSIDE);
+    }
+    PackedTrailPoint *points = reinterpret_cast<PackedTrailPoint *>(bodies + n);
+    for (size_t k = 0; k < trail.size(); ++k)
+        points[k] = {trail[k].id, Quantize(trail[k].x, ox, inverseScale), Quantize(trail[k].y, oy, inverseScale),
+                     Quantize(trail[k].z, oz, inverseScale),
+                     inside(trail[k].x, trail[k].y, trail[k].z) ? uint16_t(0) : VIEW_OUTSIDE};
+}
+
+// A frame back in floats, bodies in the publisher's slot order
+struct ViewFrame
+{
+    uint64_t number = 0;
+    double simTime = 0.0;
+    double wallTime = 0.0;
+    std::vector<uint32_t> id;
+    std::vector<float> x, y, z, radius;
+    std::vector<float> cr, cg, cb;
+    std::vector<unsigned char> fixed;
+    std::vector<unsigned char> outside; // Clamped to the edge of the position grid
+    std::vector<uint32_t> trailId;
+    std::vector<float> trailX, trailY, trailZ;
+    float quantum = 0.0f; // Position step of this frame
+
+    size_t size() const { return id.size(); }
+};
+
+// False if the bytes aren't a frame of this protocol version
+inline bool DecodeFrame(const std::vector<unsigned char> &bytes, ViewFrame &frame)
+{
+    FrameHeader header;
+    if (bytes.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.version != VIEW_PROTOCOL_VERSION || bytes.size() != FrameBytes(header.bodyCount, header.trailCount))
+        return false;
+
+    const size_t n = header.bodyCount;
+    frame.number = header.number;
+    frame.simTime = header.simTime;
+    frame.wallTime = header.wallTime;
+    frame.quantum = header.scale;
+    for (std::vector<float> *array : {&frame.x, &frame.y, &frame.z, &frame.radius, &frame.cr, &frame.cg, &frame.cb})
+        array->resize(n);
+    frame.id.resize(n);
+    frame.fixed.resize(n);
+    frame.outside.resize(n);
+
+    const PackedBody *bodies = reinterpret_cast<const PackedBody *>(bytes.data() + sizeof(FrameHeader));
+    for (size_t i = 0; i < n; ++i)
+    {
+        const PackedBody &body = bodies[i];
+        frame.id[i] = body.id;
+        frame.x[i] = header.origin[0] + body.x * header.scale;
+        frame.y[i] = header.origin[1] + body.y * header.scale;
+        frame.z[i] = header.origin[2] + body.z * header.scale;
+        frame.radius[i] = body.radius * header.radiusScale;
+        frame.cr[i] = body.r / 255.0f;
+        frame.cg[i] = body.g / 255.0f;
+        frame.cb[i] = body.b / 255.0f;
+        frame.fixed[i] = (body.flags & VIEW_FIXED_BODY) ? 1 : 0;
+        frame.outside[i] = (body.flags & VIEW_OUTSIDE) ? 1 : 0;
+    }
+
+    // Clamped trail points would draw a line to the edge of the grid, they are left out
+    const size_t m = header.trailCount;
+    const PackedTrailPoint *points = reinterpret_cast<const PackedTrailPoint *>(bodies + n);
+    frame.trailId.clear();
+    for (std::vector<float> *array : {&frame.trailX, &frame.trailY, &frame.trailZ})
+        array->clear();
+    for (size_t k = 0; k < m; ++k)
+    {
+        if (points[k].flags & VIEW_OUTSIDE)
+            continue;
+        frame.trailId.push_back(points[k].id);
+        frame.trailX.push_back(header.origin[0] + points[k].x * header.scale);
+        frame.trailY.push_back(header.origin[1] + points[k].y * header.scale);
+        frame.trailZ.push_back(header.origin[2] + points[k].z * header.scale);
+    }
+    return true;
+}
+
+// ===== Broadcast =====
+
+// Last VIEW_SLOTS frames in shared memory, one writer, any number of readers
+class FrameBroadcast
+{
+public:
+    FrameBroadcast() = default;
+    ~FrameBroadcast() { close(); }
+
+    FrameBroadcast(const FrameBroadcast &) = delete;
+    FrameBroadcast &operator=(const FrameBroadcast &) = delete;
+
+    // Publisher side: new segment for frames of up to 'slotBytes'. Fails if the name exists.
+    bool create(const std::string &segmentName, size_t slotBytes)
+    {
+        close();
+        slotBytes = (slotBytes + 63) / 64 * 64;
+        size_t bytes = SegmentBytes(slotBytes);
+        void *memory = CreateSharedSegment(segmentName, bytes);
+        if (!memory)
+            return false;
+        attach(memory, bytes);
+        name = segmentName;
+        header->slotCount = VIEW_SLOTS;
+        header->slotBytes = slotBytes;
+        header->version = VIEW_PROTOCOL_VERSION;
+        header->created = ViewClock();
+        header->published.store(0, std::memory_order_relaxed);
+        header->viewers.store(0, std::memory_order_relaxed);
+        header->magic = VIEW_MAGIC;
+        return true;
+    }
+
+    // Viewer side
+    bool open(const std::string &segmentName)
+    {
+        close();
+        size_t bytes = 0;
+        void *memory = OpenSharedSegment(segmentName, bytes);
+        if (!memory)
+            return false;
+        attach(memory, bytes);
+        if (bytes < sizeof(Header) || header->magic != VIEW_MAGIC || header->version != VIEW_PROTOCOL_VERSION ||
+            header->slotCount != VIEW_SLOTS || SegmentBytes(header->slotBytes) > bytes)
+        {
+            close();
+            return false;
+        }
+        viewer = true;
+        header->viewers.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void unlink()
+    {
+        if (!name.empty())
+            UnlinkSharedSegment(name);
+        name.clear();
+    }
+
+    void close()
+    {
+        if (header && viewer)
+            header->viewers.fetch_sub(1, std::memory_order_relaxed);
+        if (header)
+            UnmapSharedSegment(header, mappedBytes);
+        header = nullptr;
+        mappedBytes = 0;
+        viewer = false;
+    }
+
+    bool valid() const { return header != nullptr; }
+    size_t slotBytes() const { return header ? (size_t)header->slotBytes : 0; }
+
+    // Tells a restarted publisher under the same name apart
+    double createdAt() const { return header ? header->created : 0.0; }
+
+    // Frames published so far, the newest has this number
+    uint64_t published() const { return header->published.load(std::memory_order_acquire); }
+
+    // Viewers attached right now (a viewer that crashed stays counted)
+    unsigned viewers() const { return header->viewers.load(std::memory_order_relaxed); }
+
+    // Publisher side, never waits. False if the frame doesn't fit a slot.
+    bool publish(const std::vector<unsigned char> &frame)
+    {
+        if (frame.size() > header->slotBytes)
+            return false;
+        uint64_t number = header->published.load(std::memory_order_relaxed) + 1;
+        Slot &slot = slotOf(number);
+        slot.sequence.store(2 * number - 1, std::memory_order_relaxed); // Odd: being written
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(dataOf(number), frame.data(), frame.size());
+        slot.bytes.store(frame.size(), std::memory_order_relaxed);
+        slot.sequence.store(2 * number, std::memory_order_release);
+        header->published.store(number, std::memory_order_release);
+        return true;
+    }
+
+    // Viewer side: copies the oldest frame newer than 'after' that is still in the segment.
+    // 'number' jumps past 'after' + 1 only if the publisher overwrote those frames before
+    // they were read. False if there is no newer frame (or the publisher kept overwriting).
+    bool readNext(uint64_t after, std::vector<unsigned char> &frame, uint64_t &number)
+    {
+        for (int attempt = 0; attempt < 4; ++attempt)
+        {
+            uint64_t newest = published();
+            if (newest <= after)
+                return false;
+            uint64_t oldest = newest >= VIEW_SLOTS ? newest - VIEW_SLOTS + 1 : 1;
+            for (number = std::max(after + 1, oldest); number <= newest; ++number)
+                if (readSlot(number, frame))
+                    return true;
+        }
+        return false;
+    }
+
+private:
+    struct Header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint64_t slotBytes;
+        double created;
+        alignas(64) std::atomic<uint64_t> published;
+        alignas(64) std::atomic<uint32_t> viewers;
+    };
+
+    struct Slot
+    {
+        alignas(64) std::atomic<uint64_t> sequence; // 2 * frame number once complete
+        std::atomic<uint64_t> bytes;
+    };
+
+    static const size_t HEADER_BYTES = (sizeof(Header) + 63) / 64 * 64;
+
+    Header *header = nullptr;
+    size_t mappedBytes = 0;
+    bool viewer = false;
+    std::string name;
+
+    static size_t SegmentBytes(size_t slotBytes)
+    {
+        return HEADER_BYTES + VIEW_SLOTS * (sizeof(Slot) + slotBytes);
+    }
+
+    void attach(void *memory, size_t bytes)
+    {
+        header = static_cast<Header *>(memory);
+        mappedBytes = bytes;
+    }
+
+    // Copies frame 'number' if its slot still holds it, complete and unchanged while copied
+    bool readSlot(uint64_t number, std::vector<unsigned char> &frame)
+    {
+        Slot &slot = slotOf(number);
+        if (slot.sequence.load(std::memory_order_acquire) != 2 * number)
+            return false; // Being replaced by a newer frame
+        size_t bytes = (size_t)std::min<uint64_t>(slot.bytes.load(std::memory_order_relaxed), header->slotBytes);
+        frame.resize(bytes);
+        std::memcpy(frame.data(), dataOf(number), bytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == 2 * number;
+    }
+
+    Slot &slotOf(uint64_t number)
+    {
+        Slot *slots = reinterpret_cast<Slot *>(reinterpret_cast<unsigned char *>(header) + HEADER_BYTES);
+        return slots[number % VIEW_SLOTS];
+    }
+
+    unsigned char *dataOf(uint64_t number)
+    {
+        unsigned char *first = reinterpret_cast<unsigned char *>(header) + HEADER_BYTES + VIEW_SLOTS * sizeof(Slot);
+        return first + (number % VIEW_SLOTS) * header->slotBytes;
+    }
+};
+
+// ===== Publisher =====
+
+struct ViewPublishSettings
+{
+    double frameRate = 60.0;     // Frames per wall clock second at most
+    uint32_t trailBodies = 16;   // Bodies with an ID below this get trail points (the Sun and planets come first)
+    int trailInterval = 10;      // Steps between trail points
+    size_t maxTrailPoints = 8192; // Per frame, points sampled beyond it are dropped (droppedTrailPoints())
+    double extent = INFINITY;     // Position grid around what is this close to the origin (escape radius)
+};
+
+// Simulation side: call afterStep() once per step, it samples the trails and publishes
+// a frame whenever one is due
+class FramePublisher
+{
+public:
+    explicit FramePublisher(const ViewPublishSettings &s = ViewPublishSettings()) : settings(s) {}
+
+    // Creates the segment for worlds of up to 'maxBodies'
+    bool start(const std::string &segmentName, size_t maxBodies)
+    {
+        return broadcast.create(segmentName, FrameBytes(maxBodies, settings.maxTrailPoints));
+    }
+
+    void stop()
+    {
+        broadcast.unlink();
+        broadcast.close();
+    }
+
+    // True if a frame went out
+    bool afterStep(const World &w)
+    {
+        if (++steps % settings.trailInterval == 0)
+            sampleTrails(w);
+
+        double now = ViewClock();
+        if (settings.frameRate > 0.0 && now - lastFrame < 1.0 / settings.frameRate)
+            return false;
+        lastFrame = now;
+        return publish(w, now);
+    }
+
+    // Sends a frame right away
+    bool publish(const World &w, double now = ViewClock())
+    {
+        auto clock = std::chrono::steady_clock::now();
+        EncodeFrame(w, pending, broadcast.published() + 1, now, frame, settings.extent);
+        bool sent = broadcast.publish(frame);
+        if (sent)
+            pending.clear();
+        else
+            dropped++;
+        encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - clock).count();
+        return sent;
+    }
+
+    const FrameBroadcast &channel() const { return broadcast; }
+    uint64_t frames() const { return broadcast.published(); }
+    uint64_t droppedFrames() const { return dropped; }
+    uint64_t droppedTrailPoints() const { return droppedPoints; }
+    size_t lastFrameBytes() const { return frame.size(); }
+    double publishSeconds() const { return encodeSeconds; } // Encoding and copying, all frames
+
+private:
+    ViewPublishSettings settings;
+    FrameBroadcast broadcast;
+    std::vector<TrailSample> pending;
+    std::vector<unsigned char> frame;
+    long long steps = 0;
+    double lastFrame = -INFINITY;
+    uint64_t dropped = 0;
+    uint64_t droppedPoints = 0;
+    double encodeSeconds = 0.0;
+
+    void sampleTrails(const World &w)
+    {
+        for (uint32_t id = 0; id < settings.trailBodies && id < w.slot.size(); ++id)
+        {
+            uint32_t i = w.slot[id];
+            if (w.fixed[i])
+                continue;
+            if (pending.size() >= settings.maxTrailPoints)
+            {
+                droppedPoints++;
+                continue;
+            }
+            pending.push_back({id, w.px[i], w.py[i], w.pz[i]});
+        }
+    }
+};
+
+// ===== Viewer side =====
+
+// Interpolated bodies for one rendered frame
+struct ViewState
+{
+    double simTime = 0.0;
+    std::vector<uint32_t> id;
+    std::vector<float> x, y, z, radius;
+    std::vector<float> cr, cg, cb;
+    std::vector<unsigned char> fixed;
+    std::vector<unsigned char> outside;
+
+    size_t size() const { return id.size(); }
+};
+
+// The last few frames of a stream, played back with a small delay
+class ViewTimeline
+{
+public:
+    // Playback runs 'delayFrames' frame intervals behind the newest frame
+    explicit ViewTimeline(double delayFrames = 1.5) : delay(delayFrames) {}
+
+    // Frames have to arrive in order; a restarted publisher (lower number) starts over
+    void add(ViewFrame frame)
+    {
+        if (!frames.empty() && frame.number <= frames.back().number)
+            clear();
+        if (!frames.empty())
+        {
+            double gap = (frame.wallTime - frames.back().wallTime) / double(frame.number - frames.back().number);
+            interval = interval > 0.0 ? 0.9 * interval + 0.1 * gap : gap;
+            skipped += frame.number - frames.back().number - 1;
+        }
+        frames.push_back(std::move(frame));
+        indexOf.push_back(IndexIds(frames.back()));
+        if (frames.size() > VIEW_SLOTS)
+        {
+            // Playback hasn't reached the oldest frame yet: its trail points go with the next one
+            ViewFrame &oldest = frames[0], &next = frames[1];
+            if (oldest.number > trailFrame)
+            {
+                next.trailId.insert(next.trailId.begin(), oldest.trailId.begin(), oldest.trailId.end());
+                next.trailX.insert(next.trailX.begin(), oldest.trailX.begin(), oldest.trailX.end());
+                next.trailY.insert(next.trailY.begin(), oldest.trailY.begin(), oldest.trailY.end());
+                next.trailZ.insert(next.trailZ.begin(), oldest.trailZ.begin(), oldest.trailZ.end());
+            }
+            frames.erase(frames.begin());
+            indexOf.erase(indexOf.begin());
+        }
+    }
+
+    void clear()
+    {
+        frames.clear();
+        indexOf.clear();
+        interval = 0.0;
+        trailFrame = 0;
+    }
+
+    bool empty() const { return frames.empty(); }
+    const ViewFrame &newest() const { return frames.back(); }
+    double frameInterval() const { return interval; }
+    uint64_t skippedFrames() const { return skipped; }
+
+    // Wall time being shown at 'now'
+    double playbackTime(double now) const { return now - delay * interval; }
+
+    // Bodies at playbackTime(now): the newer frame's bodies, moved back towards where the
+    // older frame had them. Before the first frame or past the last one it holds still.
+    bool sample(double now, ViewState &out) const
+    {
+        if (frames.empty())
+            return false;
+        const double t = playbackTime(now);
+        size_t newer = 0;
+        while (newer + 1 < frames.size() && frames[newer].wallTime < t)
+            newer++;
+        const ViewFrame &b = frames[newer];
+        const ViewFrame &a = frames[newer > 0 ? newer - 1 : 0];
+        const std::vector<int> &indexInA = indexOf[newer > 0 ? newer - 1 : 0];
+        double span = b.wallTime - a.wallTime;
+        float f = span > 0.0 ? (float)std::min(1.0, std::max(0.0, (t - a.wallTime) / span)) : 1.0f;
+
+        out.simTime = a.simTime + (b.simTime - a.simTime) * f;
+        out.id = b.id;
+        out.radius = b.radius;
+        out.cr = b.cr;
+        out.cg = b.cg;
+        out.cb = b.cb;
+        out.fixed = b.fixed;
+        out.outside = b.outside;
+        for (std::vector<float> *array : {&out.x, &out.y, &out.z})
+            array->resize(b.size());
+        for (size_t i = 0; i < b.size(); ++i)
+        {
+            int j = b.id[i] < indexInA.size() ? indexInA[b.id[i]] : -1;
+            if (j < 0)
+            {
+                out.x[i] = b.x[i];
+                out.y[i] = b.y[i];
+                out.z[i] = b.z[i];
+                continue;
+            }
+            out.x[i] = a.x[j] + (b.x[i] - a.x[j]) * f;
+            out.y[i] = a.y[j] + (b.y[i] - a.y[j]) * f;
+            out.z[i] = a.z[j] + (b.z[i] - a.z[j]) * f;
+        }
+        return true;
+    }
+
+    // Calls point(id, x, y, z) for the trail points of every frame playback reached since
+    // the last call, so trails grow in step with the interpolated bodies
+    template <typename PointFn>
+    void takeTrailPoints(double now, PointFn &&point)
+    {
+        const double t = playbackTime(now);
+        for (const ViewFrame &frame : frames)
+        {
+            if (frame.number <= trailFrame || frame.wallTime > t)
+                continue;
+            for (size_t k = 0; k < frame.trailId.size(); ++k)
+                point(frame.trailId[k], frame.trailX[k], frame.trailY[k], frame.trailZ[k]);
+            trailFrame = frame.number;
+        }
+    }
+
+private:
+    double delay;
+    std::vector<ViewFrame> frames;          // Oldest first
+    std::vector<std::vector<int>> indexOf;  // Per frame: slot of every ID, -1 if absent
+    double interval = 0.0;                  // Smoothed wall time between frames
+    uint64_t trailFrame = 0;                // Newest frame whose trail points were taken
+    uint64_t skipped = 0;
+
+    static std::vector<int> IndexIds(const ViewFrame &frame)
+    {
+        uint32_t maxId = 0;
+        for (uint32_t id : frame.id)
+            maxId = std::max(maxId, id);
+        std::vector<int> index(frame.size() ? maxId + 1 : 0, -1);
+        for (size_t i = 0; i < frame.size(); ++i)
+            index[frame.id[i]] = (int)i;
+        return index;
+    }
+};
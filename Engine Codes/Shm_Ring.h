@@ -0,0 +1,304 @@
+//
+//  Shm_Ring.h
+//  SpaceEngine
+//
+//  Single-producer single-consumer byte ring in POSIX shared memory.
+//
+//  The header holds two running byte counters, 'head' (written so far, only the producer
+//  moves it) and 'tail' (read so far, only the consumer moves it), each on its own cache
+//  line; the data follows as a power-of-two sized buffer. Nothing else is shared, so a
+//  write or read is a copy plus one atomic store, and the two sides can live in different
+//  processes as long as both map the same segment:
+//
+//    - create() makes a new segment under a name ('/spaceengine-...'), open() maps an
+//      existing one from another process,
+//    - a segment created before fork() is inherited by the children, so the creator can
+//      unlink() the name right away and nothing is left behind if a process dies.
+//
+//  Messages are just bytes: writeMessage() / readMessage() put a 64-bit length in front.
+//  The blocking calls spin with yield, a ring is meant for processes that exchange data
+//  every step anyway, not for idle waiting.
+//
+//  The segment functions at the top also serve other layouts (the frame broadcast in
+//  Remote_View.h).
+//
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SPACE_SHM_RING 1
+#endif
+
+const uint64_t SHM_RING_MAGIC = 0x52474e4952454353ULL; // "SCERINGR"
+
+// ===== Segments =====
+
+// Maps a new zeroed segment of 'bytes' under 'name', nullptr if the name already exists
+// (or there is no shared memory here)
+inline void *CreateSharedSegment(const std::string &name, size_t bytes)
+{
+#if SPACE_SHM_RING
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        return nullptr;
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, (off_t)bytes) == 0)
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    return memory;
+#else
+    (void)name;
+    (void)bytes;
+    return nullptr;
+#endif
+}
+
+// Maps an existing segment, 'bytes' receives its size
+inline void *OpenSharedSegment(const std::string &name, size_t &bytes)
+{
+#if SPACE_SHM_RING
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    void *memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        bytes = (size_t)info.st_size;
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    return memory == MAP_FAILED ? nullptr : memory;
+#else
+    (void)name;
+    (void)bytes;
+    return nullptr;
+#endif
+}
+
+inline void UnmapSharedSegment(void *memory, size_t bytes)
+{
+#if SPACE_SHM_RING
+    munmap(memory, bytes);
+#else
+    (void)memory;
+    (void)bytes;
+#endif
+}
+
+// Removes the name, existing mappings stay valid
+inline void UnlinkSharedSegment(const std::string &name)
+{
+#if SPACE_SHM_RING
+    shm_unlink(name.c_str());
+#else
+    (void)name;
+#endif
+}
+
+// ===== Ring =====
+
+class ShmRing
+{
+public:
+    ShmRing() = default;
+    ~ShmRing() { close(); }
+
+    ShmRing(const ShmRing &) = delete;
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    // New segment of at least 'capacity' data bytes (rounded up to a power of two).
+    // Fails if the name already exists.
+    bool create(const std::string &segmentName, size_t capacity)
+    {
+        close();
+        size_t bytes = 4096;
+        while (bytes < capacity)
+            bytes *= 2;
+        void *memory = CreateSharedSegment(segmentName, HEADER_BYTES + bytes);
+        if (!memory)
+            return false;
+        attach(memory, HEADER_BYTES + bytes);
+        name = segmentName;
+        header->capacity = bytes;
+        header->head.store(0, std::memory_order_relaxed);
+        header->tail.store(0, std::memory_order_relaxed);
+        header->magic = SHM_RING_MAGIC;
+        return true;
+    }
+
+    // Maps a segment somebody else created
+    bool open(const std::string &segmentName)
+    {
+        close();
+        size_t bytes = 0;
+        void *memory = OpenSharedSegment(segmentName, bytes);
+        if (!memory)
+            return false;
+        attach(memory, bytes);
+        if (bytes < HEADER_BYTES || header->magic != SHM_RING_MAGIC || HEADER_BYTES + header->capacity > mappedBytes)
+        {
+            close();
+            return false;
+        }
+        name = segmentName;
+        return true;
+    }
+
+    // Removes the name, mappings (also in other processes) stay valid
+    void unlink()
+    {
+        if (!name.empty())
+            UnlinkSharedSegment(name);
+        name.clear();
+    }
+
+    void close()
+    {
+        if (header)
+            UnmapSharedSegment(header, mappedBytes);
+        header = nullptr;
+        data = nullptr;
+        mappedBytes = 0;
+    }
+
+    bool valid() const { return header != nullptr; }
+    size_t capacity() const { return header ? (size_t)header->capacity : 0; }
+
+    size_t usedBytes() const
+    {
+        return (size_t)(header->head.load(std::memory_order_acquire) - header->tail.load(std::memory_order_acquire));
+    }
+
+    size_t freeBytes() const { return capacity() - usedBytes(); }
+
+    // Producer side: all of 'bytes' or nothing
+    bool tryWrite(const void *source, size_t bytes)
+    {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        if (header->capacity - (head - tail) < bytes)
+            return false;
+        copyIn(head, static_cast<const unsigned char *>(source), bytes);
+        header->head.store(head + bytes, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: all of 'bytes' or nothing
+    bool tryRead(void *target, size_t bytes)
+    {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        if (head - tail < bytes)
+            return false;
+        copyOut(tail, static_cast<unsigned char *>(target), bytes);
+        header->tail.store(tail + bytes, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking versions. Data larger than the ring streams through in pieces.
+    void write(const void *source, size_t bytes)
+    {
+        const unsigned char *bytesIn = static_cast<const unsigned char *>(source);
+        while (bytes > 0)
+        {
+            size_t piece = std::min(bytes, freeBytes());
+            if (piece == 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            tryWrite(bytesIn, piece);
+            bytesIn += piece;
+            bytes -= piece;
+        }
+    }
+
+    void read(void *target, size_t bytes)
+    {
+        unsigned char *bytesOut = static_cast<unsigned char *>(target);
+        while (bytes > 0)
+        {
+            size_t piece = std::min(bytes, usedBytes());
+            if (piece == 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            tryRead(bytesOut, piece);
+            bytesOut += piece;
+            bytes -= piece;
+        }
+    }
+
+    // Length-prefixed messages
+    void writeMessage(const std::vector<unsigned char> &message)
+    {
+        uint64_t length = message.size();
+        write(&length, sizeof(length));
+        write(message.data(), message.size());
+    }
+
+    void readMessage(std::vector<unsigned char> &message)
+    {
+        uint64_t length = 0;
+        read(&length, sizeof(length));
+        message.resize((size_t)length);
+        read(message.data(), message.size());
+    }
+
+private:
+    struct Header
+    {
+        uint64_t magic;
+        uint64_t capacity;
+        alignas(64) std::atomic<uint64_t> head; // Bytes written so far
+        alignas(64) std::atomic<uint64_t> tail; // Bytes read so far
+    };
+    static const size_t HEADER_BYTES = (sizeof(Header) + 63) / 64 * 64;
+
+    Header *header = nullptr;
+    unsigned char *data = nullptr;
+    size_t mappedBytes = 0;
+    std::string name;
+
+    void attach(void *memory, size_t bytes)
+    {
+        header = static_cast<Header *>(memory);
+        data = static_cast<unsigned char *>(memory) + HEADER_BYTES;
+        mappedBytes = bytes;
+    }
+
+    void copyIn(uint64_t position, const unsigned char *source, size_t bytes)
+    {
+        size_t offset = (size_t)(position & (header->capacity - 1));
+        size_t first = std::min(bytes, (size_t)header->capacity - offset);
+        std::memcpy(data + offset, source, first);
+        std::memcpy(data, source + first, bytes - first);
+    }
+
+    void copyOut(uint64_t position, unsigned char *target, size_t bytes) const
+    {
+        size_t offset = (size_t)(position & (header->capacity - 1));
+        size_t first = std::min(bytes, (size_t)header->capacity - offset);
+        std::memcpy(target, data + offset, first);
+        std::memcpy(target + first, data, bytes - first);
+    }
+};
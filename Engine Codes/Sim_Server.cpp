@@ -0,0 +1,162 @@
+//
+//  Sim_Server.cpp
+//  SpaceEngine
+//
+//  Runs one headless scenario for as long as wanted and streams it to remote viewers
+//  (see Remote_View.h and "3D Rendering Codes/Remote_Viewer.cpp"). Viewers can attach and
+//  detach at any time under the stream's name; they never slow the simulation down.
+//
+//      ./Sim_Server --name belt --asteroids 20000 --threads 8 --tree
+//      ./Sim_Server --speed 0                   As many steps as the machine manages (default: real time)
+//      ./Sim_Server --rate 30                   Frames per second (default 60)
+//      ./Sim_Server --trail-bodies 64 --trail-every 5
+//      ./Sim_Server --steps 100000              Stop after that many steps (default: until killed)
+//      ./Sim_Server --scenario slow --seed 7 --colored --morton
+//
+//  Build: clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -pthread -I"Engine Codes" "Engine Codes/Sim_Server.cpp" -o sim_server
+//
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Thread_Pool.h"
+#include "Remote_View.h"
+#include "Cpu_Dispatch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstdlib>
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void RequestStop(int)
+{
+    stopRequested = 1;
+}
+
+int main(int argc, char **argv)
+{
+    std::string scenarioName = "fast";
+    std::string streamName = "default";
+    uint64_t seed = 42;
+    long long steps = 0;
+    int asteroids = 2000;
+    unsigned threads = 1;
+    double speed = 1.0;
+    SimulationSettings settings;
+    ViewPublishSettings publish;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue)
+            scenarioName = argv[++i];
+        else if (arg == "--name" && hasValue)
+            streamName = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--steps" && hasValue)
+            steps = std::atoll(argv[++i]);
+        else if (arg == "--asteroids" && hasValue)
+            asteroids = std::atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--speed" && hasValue)
+            speed = std::atof(argv[++i]);
+        else if (arg == "--rate" && hasValue)
+            publish.frameRate = std::atof(argv[++i]);
+        else if (arg == "--trail-bodies" && hasValue)
+            publish.trailBodies = (uint32_t)std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--trail-every" && hasValue)
+            publish.trailInterval = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--colored")
+            settings.coloredCollisions = true;
+        else if (arg == "--tree")
+            settings.treeGravity = true;
+        else if (arg == "--morton")
+            settings.mortonSort = true;
+        else
+        {
+            std::cerr << "Unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scenario scenario;
+    if (!ScenarioByName(scenarioName, scenario))
+    {
+        std::cerr << "Unknown scenario '" << scenarioName << "' (use fast or slow)" << std::endl;
+        return 1;
+    }
+    scenario.asteroidCount = asteroids;
+    publish.extent = scenario.escapeRadius; // Escaped bodies don't stretch the position grid
+
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 1)
+        pool.reset(new ThreadPool(threads));
+    Simulator sim(CreateWorld(scenario, seed), settings, pool.get());
+
+    const std::string segment = "/spaceengine-view-" + streamName;
+    FramePublisher publisher(publish);
+    if (!publisher.start(segment, sim.world.size()))
+    {
+        std::cerr << "Could not create stream '" << streamName << "' (already running? remove /dev/shm" << segment << ")" << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, RequestStop);
+    std::signal(SIGTERM, RequestStop);
+
+    std::cout << "=== Simulation server ===" << std::endl;
+    LogCpuDispatch(std::cout);
+    std::cout << "Scenario: " << scenario.name << ", seed: " << seed << ", bodies: " << sim.world.size()
+              << ", threads: " << threads << ", stream: " << streamName << " (" << publish.frameRate << " frames/s, "
+              << publisher.channel().slotBytes() / 1024 << " KiB per frame slot)" << std::endl;
+    std::cout << "View with: ./Remote_Viewer " << streamName << ", stop with Ctrl+C" << std::endl;
+
+    const double dt = scenario.maxTimestep;
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    long long step = 0, reportStep = 0;
+    uint64_t reportFrames = 0;
+    double reportPublishSeconds = 0.0;
+    while (!stopRequested && (steps <= 0 || step < steps))
+    {
+        sim.step(dt);
+        step++;
+        publisher.afterStep(sim.world);
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        if (speed > 0.0 && sim.world.time > elapsed * speed)
+            std::this_thread::sleep_for(std::chrono::duration<double>(sim.world.time / speed - elapsed));
+
+        double sinceReport = std::chrono::duration<double>(now - lastReport).count();
+        if (sinceReport >= 5.0)
+        {
+            uint64_t frames = publisher.frames() - reportFrames;
+            std::cout << "t = " << std::fixed << std::setprecision(2) << sim.world.time << std::defaultfloat
+                      << "  steps/s " << std::setprecision(5) << (step - reportStep) / sinceReport
+                      << "  frames/s " << std::setprecision(3) << frames / sinceReport
+                      << "  publish " << std::setprecision(3)
+                      << (frames ? (publisher.publishSeconds() - reportPublishSeconds) / frames * 1000.0 : 0.0) << " ms/frame, "
+                      << publisher.lastFrameBytes() / 1024 << " KiB"
+                      << "  viewers " << publisher.channel().viewers() << std::endl;
+            lastReport = now;
+            reportStep = step;
+            reportFrames = publisher.frames();
+            reportPublishSeconds = publisher.publishSeconds();
+        }
+    }
+
+    std::cout << "Stopped after " << step << " steps, " << publisher.frames() << " frames";
+    if (publisher.droppedTrailPoints() > 0)
+        std::cout << " (" << publisher.droppedTrailPoints() << " trail points dropped, more than a frame holds)";
+    std::cout << std::endl;
+    publisher.stop();
+    return 0;
+}
@@ -0,0 +1,261 @@
+//
+//  Simulator.h
+//  SpaceEngine
+//
+//  Drives a headless World one sub-step at a time with the selected algorithms.
+//
+//  StepWorld() in Headless_Simulation.h is the plain reference step that matches the
+//  demos. Simulator wraps a World together with its settings, the optional thread pool
+//  and the per-step arenas the faster algorithms draw their scratch buffers from, so
+//  tools only have to pick settings and call step().
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Collision_Solver.h"
+#include "Kepler.h"
+#include "Octree.h"
+#include "Morton_Order.h"
+#include "Encounters.h"
+#include "Integrators.h"
+#include "Thread_Pool.h"
+#include "Arena.h"
+#include "Numa.h"
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+// Which algorithms a Simulator uses. The defaults reproduce StepWorld() exactly.
+struct SimulationSettings
+{
+    bool coloredCollisions = false; // Broad phase + graph coloured parallel contact solver
+    int collisionIterations = 4;    // Solver sweeps per sub-step when coloredCollisions is on
+    bool keplerHybrid = false;      // Bodies alone in their Hill sphere follow analytic Kepler orbits
+    double hillFactor = 3.0;        // Promote to N-body when a neighbour is within this many Hill radii
+    bool treeGravity = false;       // Barnes-Hut forces from an Octree kept between sub-steps
+    double treeTheta = 0.7;         // Opening angle, at most 1
+    bool treeQuadrupole = true;     // Quadrupole corrections for nodes used as a whole
+    double treeMaxInflation = 1.3;  // Rebuild once the refitted nodes grew this much (<= 1: every step)
+    bool mortonSort = false;        // Reorder the bodies along a Morton curve when locality degrades
+    bool mortonWalkTimings = false; // Also sort when tree walks slow down (wall clock, so not reproducible)
+    bool encounterSubcycling = false; // Integrate close pairs separately with small RK4 sub-steps (Euler only)
+    Integrator integrator = Integrator::Euler; // Time integrator of the full N-body path (the hybrid always uses Euler)
+    double encounterFactor = 3.0;     // Pairs closer than this many softening lengths count as close
+    bool firstTouch = false;          // Let every pool worker place its own bodies and arena (NUMA)
+};
+
+class Simulator
+{
+public:
+    World world;
+    SimulationSettings settings;
+    ThreadPool *pool = nullptr; // Optional, only changes the speed
+
+    Simulator(World w, SimulationSettings s = SimulationSettings(), ThreadPool *p = nullptr)
+        : world(std::move(w)), settings(s), pool(p), arenas(p ? p->size() : 1)
+    {
+        if (pool && settings.firstTouch)
+        {
+            FirstTouchWorld(world, *pool);
+            FirstTouchArenas(arenas, *pool);
+        }
+    }
+
+    // Step-local memory, reset at the start of every sub-step
+    const StepArenas &stepArenas() const { return arenas; }
+
+    // Bodies moved analytically in the last step (keplerHybrid only)
+    size_t keplerBodies() const { return lastKeplerBodies; }
+
+    // Build / refit / walk timings of the last step (treeGravity only)
+    const Octree &octree() const { return tree; }
+
+    // Sort count, disorder and check interval (mortonSort only)
+    const MortonSorter &mortonSorter() const { return sorter; }
+
+    // Pairs and sub-steps of the last step (encounterSubcycling only)
+    const EncounterStats &encounters() const { return lastEncounters; }
+
+    // Force evaluations of the last step (more than one for the higher order integrators)
+    int forceCalls() const { return lastForceCalls; }
+
+    // Internal steps of the last step (IAS15 only)
+    const IAS15Integrator &ias15() const { return adaptive; }
+
+    // One sub-step: forces, semi-implicit Euler, collisions. Returns the collisions found.
+    int step(double dt)
+    {
+        arenas.resetAll();
+
+        if (settings.mortonSort)
+        {
+            const OctreeStats &treeStats = tree.stats();
+            double walkCost = settings.mortonWalkTimings && settings.treeGravity && treeStats.interactions > 0
+                                  ? treeStats.walkSeconds / treeStats.interactions
+                                  : 0.0;
+            if (sorter.update(world, arenas.worker(0), pool, walkCost))
+            {
+                tree.invalidate();
+                adaptive.reset();
+            }
+        }
+
+        // Close pairs, found and sub-cycled once the forces of the step are known
+        ArenaVector<EncounterPair> pairs{ArenaAllocator<EncounterPair>(arenas.worker(0))};
+        auto subcycle = [&](const uint32_t *bodies, size_t count)
+        {
+            if (!settings.encounterSubcycling)
+                return;
+            FindEncounters(world, bodies, count, settings.encounterFactor, arenas.worker(0), pairs);
+            lastEncounters.pairs = pairs.size();
+            lastEncounters.substeps = SubcycleEncounters(world, pairs, dt, pool);
+        };
+
+        lastForceCalls = 0;
+        int central = settings.keplerHybrid ? FindCentralBody(world) : -1;
+        if (central >= 0)
+        {
+            // Full forces only for bodies with company, the rest stay on their orbits
+            Arena &arena = arenas.worker(0);
+            ArenaVector<uint32_t> nbody{ArenaAllocator<uint32_t>(arena)};
+            ArenaVector<uint32_t> kepler{ArenaAllocator<uint32_t>(arena)};
+            ClassifyKeplerBodies(world, central, settings.hillFactor, arena, nbody, kepler);
+
+            if (settings.treeGravity)
+            {
+                tree.update(world, settings.treeMaxInflation);
+                tree.computeAccelerations(world, settings.treeTheta, settings.treeQuadrupole, pool, nbody.data(), nbody.size());
+            }
+            else
+                ComputeAccelerationsFor(world, nbody.data(), nbody.size(), pool);
+            lastForceCalls = 1;
+            subcycle(nbody.data(), nbody.size());
+            for (uint32_t i : nbody)
+                integrate(i, dt);
+            DriftKeplerBodies(world, central, kepler, dt, arena);
+            lastKeplerBodies = kepler.size();
+        }
+        else
+        {
+            auto forces = [&](World &w)
+            {
+                if (settings.treeGravity)
+                {
+                    tree.update(w, settings.treeMaxInflation);
+                    tree.computeAccelerations(w, settings.treeTheta, settings.treeQuadrupole, pool);
+                }
+                else
+                    ComputeAccelerations(w, pool);
+                lastForceCalls++;
+            };
+            switch (settings.integrator)
+            {
+            case Integrator::Leapfrog:
+                StepLeapfrog(world, dt, forces);
+                break;
+            case Integrator::Yoshida:
+                StepYoshida(world, dt, forces);
+                break;
+            case Integrator::RK4:
+                StepRK4(world, stages, dt, forces);
+                break;
+            case Integrator::WisdomHolman:
+                StepWisdomHolman(world, stages, dt, forces);
+                break;
+            case Integrator::Kepler:
+                StepKepler(world, stages, dt);
+                break;
+            case Integrator::IAS15:
+                adaptive.advance(world, dt, forces);
+                break;
+            default:
+                forces(world);
+                subcycle(nullptr, 0);
+                IntegrateWorld(world, dt);
+                break;
+            }
+            lastKeplerBodies = 0;
+        }
+        ApplyEncounters(world, pairs);
+        world.time += dt;
+
+        if (settings.coloredCollisions)
+        {
+            CollisionScratch scratch(arenas);
+            return SolveCollisions(world, scratch, settings.collisionIterations, pool);
+        }
+        return ResolveWorldCollisions(world);
+    }
+
+private:
+    StepArenas arenas;
+    Octree tree;
+    MortonSorter sorter;
+    size_t lastKeplerBodies = 0;
+    EncounterStats lastEncounters;
+    IntegratorScratch stages;
+    IAS15Integrator adaptive;
+    int lastForceCalls = 0;
+
+    // Semi-implicit Euler, same as updatePosition in the demos
+    void integrate(size_t i, double dt)
+    {
+        world.vx[i] += world.ax[i] * dt;
+        world.vy[i] += world.ay[i] * dt;
+        world.vz[i] += world.az[i] * dt;
+        world.px[i] += world.vx[i] * dt;
+        world.py[i] += world.vy[i] * dt;
+        world.pz[i] += world.vz[i] * dt;
+    }
+};
+
+// Summary of one headless run
+struct RunResult
+{
+    bool stable = true;       // No body escaped and the state stayed finite
+    int escapedBodies = 0;    // Bodies beyond the scenario's escape radius at the end
+    long long collisions = 0; // Collisions resolved over the whole run
+    double energyDrift = 0.0; // |E_end - E_start| / |E_start|
+    double runSeconds = 0.0;  // Wall clock time of the run
+    long long steps = 0;
+};
+
+// Counts escaped bodies; any non-finite position counts as escaped too
+inline int CountEscapedBodies(const World &w, double escapeRadius)
+{
+    int escaped = 0;
+    for (size_t i = 0; i < w.size(); ++i)
+    {
+        double r2 = w.px[i] * w.px[i] + w.py[i] * w.py[i] + w.pz[i] * w.pz[i];
+        if (!std::isfinite(r2) || r2 > escapeRadius * escapeRadius)
+            escaped++;
+    }
+    return escaped;
+}
+
+// Runs a scenario without a window for 'duration' simulated seconds
+inline RunResult RunHeadless(const Scenario &s, uint64_t seed, double duration,
+                             const SimulationSettings &settings = SimulationSettings(), ThreadPool *pool = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    RunResult result;
+    Simulator sim(CreateWorld(s, seed), settings, pool);
+    const World &world = sim.world;
+    double initialEnergy = TotalEnergy(world);
+
+    long long steps = std::max(1LL, (long long)std::ceil(duration / s.maxTimestep));
+    double dt = duration / steps;
+    for (long long step = 0; step < steps; ++step)
+        result.collisions += sim.step(dt);
+
+    double finalEnergy = TotalEnergy(world);
+    result.steps = steps;
+    result.energyDrift = std::fabs(finalEnergy - initialEnergy) / std::max(std::fabs(initialEnergy), 1e-300);
+    result.escapedBodies = CountEscapedBodies(world, s.escapeRadius);
+    result.stable = result.escapedBodies == 0 && std::isfinite(finalEnergy);
+    result.runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
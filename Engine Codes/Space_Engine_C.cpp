@@ -0,0 +1,265 @@
+//
+//  Space_Engine_C.cpp
+//  SpaceEngine
+//
+//  Implementation of the C interface in Space_Engine_C.h, the only translation unit of
+//  the shared library. Everything from the engine headers stays hidden; only SE_API
+//  functions are exported.
+//
+//  Build (the "build libspaceengine.so" task in .vscode/tasks.json runs the same):
+//      clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -ffp-contract=off -pthread -fPIC -shared -fvisibility=hidden -fvisibility-inlines-hidden -DSPACE_ENGINE_BUILD -Wl,--version-script="Engine Codes/Space_Engine_C.map" -I"Engine Codes" "Engine Codes/Space_Engine_C.cpp" -o libspaceengine.so
+//  (check the exports with: nm -D --defined-only libspaceengine.so)
+//
+//  -fvisibility=hidden covers the engine's own code, but std:: template instances keep default
+//  visibility; the version script (on macOS: -exported_symbol "_se_*") hides those too.
+//
+
+#include "Space_Engine_C.h"
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Thread_Pool.h"
+
+#include <memory>
+#include <new>
+#include <cstring>
+#include <algorithm>
+
+struct se_world
+{
+    SimulationSettings settings;
+    std::unique_ptr<ThreadPool> pool;
+    std::unique_ptr<Simulator> sim;
+};
+
+namespace
+{
+    // Runs 'body', turning exceptions into a status so none crosses into C
+    template <typename Body>
+    se_status Guarded(Body &&body)
+    {
+        try
+        {
+            return body();
+        }
+        catch (const std::bad_alloc &)
+        {
+            return SE_OUT_OF_MEMORY;
+        }
+        catch (...)
+        {
+            return SE_INTERNAL_ERROR;
+        }
+    }
+
+    // The caller's config over the defaults, as far as the caller's struct goes
+    bool ReadConfig(const se_config *config, se_config &out)
+    {
+        se_default_config(&out);
+        if (!config)
+            return true;
+        if (config->size < sizeof(size_t))
+            return false;
+        std::memcpy(&out, config, std::min(config->size, sizeof(se_config)));
+        out.size = sizeof(se_config);
+        return out.threads >= 1 && out.integrator >= SE_INTEGRATOR_EULER && out.integrator <= SE_INTEGRATOR_IAS15 &&
+               out.softening >= SE_SOFTENING_CLAMP && out.softening <= SE_SOFTENING_SPLINE;
+    }
+
+    se_status CreateWorldHandle(World w, const se_config &config, se_world **world)
+    {
+        std::unique_ptr<se_world> handle(new se_world());
+        handle->settings.integrator = static_cast<Integrator>(config.integrator);
+        handle->settings.treeGravity = config.tree_gravity != 0;
+        handle->settings.treeTheta = config.tree_theta;
+        handle->settings.coloredCollisions = config.colored_collisions != 0;
+        handle->settings.mortonSort = config.morton_sort != 0;
+        if (config.threads > 1)
+            handle->pool.reset(new ThreadPool((unsigned)config.threads));
+        handle->sim.reset(new Simulator(std::move(w), handle->settings, handle->pool.get()));
+        *world = handle.release();
+        return SE_OK;
+    }
+}
+
+extern "C"
+{
+    int se_api_version(void)
+    {
+        return SE_API_VERSION;
+    }
+
+    const char *se_status_string(se_status status)
+    {
+        switch (status)
+        {
+        case SE_OK:
+            return "ok";
+        case SE_INVALID_ARGUMENT:
+            return "invalid argument";
+        case SE_UNKNOWN_SCENARIO:
+            return "unknown scenario";
+        case SE_OUT_OF_MEMORY:
+            return "out of memory";
+        default:
+            return "internal error";
+        }
+    }
+
+    void se_default_config(se_config *config)
+    {
+        if (!config)
+            return;
+        const World defaults;
+        const SimulationSettings settings;
+        std::memset(config, 0, sizeof(se_config));
+        config->size = sizeof(se_config);
+        config->G = defaults.G;
+        config->min_distance_factor = defaults.minDistanceFactor;
+        config->restitution = defaults.restitution;
+        config->collision_damping = defaults.collisionDamping;
+        config->softening = static_cast<int>(defaults.softening);
+        config->threads = 1;
+        config->integrator = static_cast<int>(settings.integrator);
+        config->tree_gravity = settings.treeGravity ? 1 : 0;
+        config->tree_theta = settings.treeTheta;
+        config->colored_collisions = settings.coloredCollisions ? 1 : 0;
+        config->morton_sort = settings.mortonSort ? 1 : 0;
+    }
+
+    se_status se_create(const se_config *config, se_world **world)
+    {
+        se_config c;
+        if (!world || !ReadConfig(config, c))
+            return SE_INVALID_ARGUMENT;
+        return Guarded([&]
+                       {
+            World w;
+            w.G = c.G;
+            w.minDistanceFactor = c.min_distance_factor;
+            w.restitution = c.restitution;
+            w.collisionDamping = c.collision_damping;
+            w.softening = static_cast<Softening>(c.softening);
+            return CreateWorldHandle(std::move(w), c, world); });
+    }
+
+    se_status se_create_scenario(const char *name, uint64_t seed, int asteroids, const se_config *config,
+                                 se_world **world)
+    {
+        se_config c;
+        if (!name || !world || asteroids < 0 || !ReadConfig(config, c))
+            return SE_INVALID_ARGUMENT;
+        return Guarded([&]
+                       {
+            Scenario scenario;
+            if (!ScenarioByName(name, scenario))
+                return SE_UNKNOWN_SCENARIO;
+            scenario.asteroidCount = asteroids;
+            return CreateWorldHandle(CreateWorld(scenario, seed), c, world); });
+    }
+
+    void se_destroy(se_world *world)
+    {
+        delete world;
+    }
+
+    se_status se_add_bodies(se_world *world, size_t count, const se_body_arrays *bodies, uint32_t *first_id)
+    {
+        if (!world || (count > 0 && !bodies))
+            return SE_INVALID_ARGUMENT;
+        if (count > 0 && (!bodies->px || !bodies->py || !bodies->pz || !bodies->vx || !bodies->vy || !bodies->vz ||
+                          !bodies->mass || !bodies->radius))
+            return SE_INVALID_ARGUMENT;
+        return Guarded([&]
+                       {
+            // Tree, Morton order and integrator state all assume a fixed body count, so the
+            // simulator starts over around the grown world
+            World w = std::move(world->sim->world);
+            world->sim.reset();
+            if (first_id)
+                *first_id = (uint32_t)w.slot.size();
+            for (size_t i = 0; i < count; ++i)
+                w.addBody(bodies->px[i], bodies->py[i], bodies->pz[i], bodies->vx[i], bodies->vy[i], bodies->vz[i],
+                          bodies->mass[i], bodies->cr ? bodies->cr[i] : 1.0f, bodies->cg ? bodies->cg[i] : 1.0f,
+                          bodies->cb ? bodies->cb[i] : 1.0f, bodies->radius[i], bodies->fixed && bodies->fixed[i]);
+            world->sim.reset(new Simulator(std::move(w), world->settings, world->pool.get()));
+            return SE_OK; });
+    }
+
+    se_status se_step(se_world *world, double dt, int64_t steps, int64_t *collisions)
+    {
+        if (!world || !world->sim || steps < 0 || !(dt > 0.0))
+            return SE_INVALID_ARGUMENT;
+        return Guarded([&]
+                       {
+            int64_t total = 0;
+            for (int64_t step = 0; step < steps; ++step)
+                total += world->sim->step(dt);
+            if (collisions)
+                *collisions = total;
+            return SE_OK; });
+    }
+
+    size_t se_body_count(const se_world *world)
+    {
+        return world && world->sim ? world->sim->world.size() : 0;
+    }
+
+    double se_time(const se_world *world)
+    {
+        return world && world->sim ? world->sim->world.time : 0.0;
+    }
+
+    se_status se_positions(const se_world *world, const double **px, const double **py, const double **pz)
+    {
+        if (!world || !world->sim)
+            return SE_INVALID_ARGUMENT;
+        const World &w = world->sim->world;
+        if (px)
+            *px = w.px.data();
+        if (py)
+            *py = w.py.data();
+        if (pz)
+            *pz = w.pz.data();
+        return SE_OK;
+    }
+
+    se_status se_velocities(const se_world *world, const double **vx, const double **vy, const double **vz)
+    {
+        if (!world || !world->sim)
+            return SE_INVALID_ARGUMENT;
+        const World &w = world->sim->world;
+        if (vx)
+            *vx = w.vx.data();
+        if (vy)
+            *vy = w.vy.data();
+        if (vz)
+            *vz = w.vz.data();
+        return SE_OK;
+    }
+
+    const double *se_masses(const se_world *world)
+    {
+        return world && world->sim ? world->sim->world.mass.data() : nullptr;
+    }
+
+    const double *se_radii(const se_world *world)
+    {
+        return world && world->sim ? world->sim->world.radius.data() : nullptr;
+    }
+
+    const uint32_t *se_ids(const se_world *world)
+    {
+        return world && world->sim ? world->sim->world.id.data() : nullptr;
+    }
+
+    double se_total_energy(const se_world *world)
+    {
+        return world && world->sim ? TotalEnergy(world->sim->world) : 0.0;
+    }
+
+    uint64_t se_hash(const se_world *world)
+    {
+        return world && world->sim ? HashWorld(world->sim->world) : 0;
+    }
+}
@@ -0,0 +1,161 @@
+//
+//  Space_Engine_C.h
+//  SpaceEngine
+//
+//  C interface to the headless engine, for driving it from other languages and tools.
+//
+//  A world is an opaque handle around a Simulator (Simulator.h). Bodies go in as whole
+//  arrays, steps run inside the library, and the state comes back as const pointers into
+//  the engine's own structure-of-arrays storage, so nothing is copied either way:
+//
+//      se_config config;
+//      se_default_config(&config);
+//      se_world *world = NULL;
+//      se_create(&config, &world);
+//      se_add_bodies(world, n, &arrays, NULL);
+//      se_step(world, 0.001, 1000, NULL);
+//      const double *px, *py, *pz;
+//      se_positions(world, &px, &py, &pz);  // n doubles each, valid until the next call that
+//                                           // changes the world (step, add, destroy)
+//      se_destroy(world);
+//
+//  Bodies keep the ID they were added with (0, 1, 2, ... in order). With Morton ordering
+//  on they move between slots; se_ids() gives the ID in every slot.
+//
+//  Only what this header declares is exported from the shared library (it is built with
+//  -fvisibility=hidden); its functions never throw and report failures as se_status.
+//  se_config starts with its own size, so the library can grow the struct without
+//  breaking callers built against an older header.
+//
+//  Build (shared library, see Space_Engine_C.cpp):
+//      clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -pthread -fPIC -shared -fvisibility=hidden
+//              -fvisibility-inlines-hidden -DSPACE_ENGINE_BUILD -Wl,--version-script="Engine Codes/Space_Engine_C.map"
+//              -I"Engine Codes" "Engine Codes/Space_Engine_C.cpp" -o libspaceengine.so
+//
+
+#ifndef SPACE_ENGINE_C_H
+#define SPACE_ENGINE_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(SPACE_ENGINE_BUILD)
+#define SE_API __declspec(dllexport)
+#else
+#define SE_API __declspec(dllimport)
+#endif
+#else
+#define SE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define SE_API_VERSION 1
+
+typedef struct se_world se_world;
+
+typedef enum se_status
+{
+    SE_OK = 0,
+    SE_INVALID_ARGUMENT = -1,
+    SE_UNKNOWN_SCENARIO = -2,
+    SE_OUT_OF_MEMORY = -3,
+    SE_INTERNAL_ERROR = -4
+} se_status;
+
+// Values are part of the ABI, new ones only get appended
+typedef enum se_integrator
+{
+    SE_INTEGRATOR_EULER = 0,
+    SE_INTEGRATOR_LEAPFROG = 1,
+    SE_INTEGRATOR_YOSHIDA = 2,
+    SE_INTEGRATOR_RK4 = 3,
+    SE_INTEGRATOR_WISDOM_HOLMAN = 4,
+    SE_INTEGRATOR_KEPLER = 5,
+    SE_INTEGRATOR_IAS15 = 6
+} se_integrator;
+
+typedef enum se_softening
+{
+    SE_SOFTENING_CLAMP = 0,
+    SE_SOFTENING_PLUMMER = 1,
+    SE_SOFTENING_SPLINE = 2
+} se_softening;
+
+typedef struct se_config
+{
+    size_t size; // sizeof(se_config), set by se_default_config()
+
+    // Physical constants (the defaults are the Fast demo's)
+    double G;
+    double min_distance_factor; // Forces use at least (r_i + r_j) * this as the distance
+    double restitution;
+    double collision_damping;
+    int softening;              // se_softening
+
+    // Algorithms, see SimulationSettings in Simulator.h
+    int threads;                // Worker threads, 1: run on the calling thread
+    int integrator;             // se_integrator
+    int tree_gravity;           // Barnes-Hut instead of all pairs
+    double tree_theta;
+    int colored_collisions;     // Parallel graph coloured contact solver
+    int morton_sort;            // Reorder bodies along a Morton curve now and then (see se_ids)
+} se_config;
+
+// What se_add_bodies() reads, 'count' values per array. fixed, cr, cg and cb may be NULL
+// (movable, white).
+typedef struct se_body_arrays
+{
+    const double *px, *py, *pz;
+    const double *vx, *vy, *vz;
+    const double *mass;
+    const double *radius;
+    const unsigned char *fixed;
+    const float *cr, *cg, *cb;
+} se_body_arrays;
+
+SE_API int se_api_version(void);
+SE_API const char *se_status_string(se_status status);
+
+SE_API void se_default_config(se_config *config);
+
+// Empty world. 'config' may be NULL for the defaults.
+SE_API se_status se_create(const se_config *config, se_world **world);
+
+// One of the headless scenarios ("fast", "slow") with 'asteroids' belt bodies, physical
+// constants from the scenario, algorithms from 'config' (may be NULL)
+SE_API se_status se_create_scenario(const char *name, uint64_t seed, int asteroids, const se_config *config,
+                                    se_world **world);
+
+SE_API void se_destroy(se_world *world);
+
+// Appends 'count' bodies. 'first_id' (may be NULL) receives the ID of the first one,
+// the others follow in order.
+SE_API se_status se_add_bodies(se_world *world, size_t count, const se_body_arrays *bodies, uint32_t *first_id);
+
+// 'steps' steps of 'dt'. 'collisions' (may be NULL) receives the collisions resolved.
+SE_API se_status se_step(se_world *world, double dt, int64_t steps, int64_t *collisions);
+
+SE_API size_t se_body_count(const se_world *world);
+SE_API double se_time(const se_world *world);
+
+// Zero-copy views of the state, se_body_count() values each. Any pointer may be NULL
+// if that array isn't wanted.
+SE_API se_status se_positions(const se_world *world, const double **px, const double **py, const double **pz);
+SE_API se_status se_velocities(const se_world *world, const double **vx, const double **vy, const double **vz);
+SE_API const double *se_masses(const se_world *world);
+SE_API const double *se_radii(const se_world *world);
+SE_API const uint32_t *se_ids(const se_world *world);
+
+SE_API double se_total_energy(const se_world *world);
+SE_API uint64_t se_hash(const se_world *world); // Same value as HashWorld(), for comparing runs
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
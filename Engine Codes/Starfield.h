@@ -0,0 +1,391 @@
+//
+//  Starfield.h
+//  SpaceEngine
+//
+//  Procedural background starfield shared by the 2D and 3D renderers.
+//
+//  The stars are generated once from a catalog-like distribution (star counts grow
+//  with magnitude like the real sky, faint stars crowd towards a tilted galactic
+//  plane, colours follow a B-V index) and uploaded into a static VBO. Every frame the
+//  whole field is drawn with a single glDrawArrays(GL_POINTS) call with depth writes
+//  off, so even millions of stars cost almost nothing on the CPU.
+//
+//  Usage (3D, core profile):
+//      Starfield stars = CreateStarfield3D(200000, 1977);
+//      DrawStarfield3D(stars, view, projection); // first thing after glClear
+//      DestroyStarfield(stars);
+//
+//  Usage (2D, legacy profile with glOrtho):
+//      Starfield stars = CreateStarfield2D(200, 1977, 400.0f, 300.0f);
+//      DrawStarfield2D(stars);
+//
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <iostream>
+
+// One star as it is stored in the VBO (20 bytes)
+struct StarVertex
+{
+    float x, y, z;
+    float size;               // Point size in pixels, derived from the magnitude
+    unsigned char r, g, b, a; // Colour, alpha carries the brightness
+};
+
+// Handle to an uploaded starfield
+struct Starfield
+{
+    unsigned int vao = 0; // Only used by the 3D (core profile) path
+    unsigned int vbo = 0;
+    unsigned int shader = 0;
+    int viewRotationLoc = -1; // Uniform locations of the 3D shader, looked up once at creation
+    int projectionLoc = -1;
+    GLsizei count = 0;
+    bool legacy = false; // True for the 2D renderer which runs on the fixed-function context
+};
+
+// Starfield shaders //
+
+// Core profile shaders used by the 3D renderers
+static const char *const starVertexShader3D = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in float aSize;
+layout (location = 2) in vec4 aColor;
+
+out vec4 starColor;
+
+uniform mat4 viewRotation;
+uniform mat4 projection;
+
+void main()
+{
+    // Stars sit on a unit sphere around the camera, only the rotation of the view is applied
+    gl_Position = projection * viewRotation * vec4(aPos, 1.0);
+    gl_PointSize = aSize;
+    starColor = aColor;
+}
+)";
+
+static const char *const starFragmentShader3D = R"(
+#version 330 core
+out vec4 FragColor;
+
+in vec4 starColor;
+
+void main()
+{
+    // Round, soft edged points instead of squares
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float falloff = 1.0 - dot(offset, offset);
+    if (falloff <= 0.0)
+        discard;
+    FragColor = vec4(starColor.rgb, starColor.a * falloff);
+}
+)";
+
+// GLSL 1.20 shaders for the 2D renderer, which uses glOrtho on the default context
+static const char *const starVertexShader2D = R"(
+#version 120
+attribute vec3 aPos;
+attribute float aSize;
+attribute vec4 aColor;
+
+varying vec4 starColor;
+
+void main()
+{
+    gl_Position = gl_ModelViewProjectionMatrix * vec4(aPos, 1.0);
+    gl_PointSize = aSize;
+    starColor = aColor;
+}
+)";
+
+static const char *const starFragmentShader2D = R"(
+#version 120
+varying vec4 starColor;
+
+void main()
+{
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float falloff = 1.0 - dot(offset, offset);
+    if (falloff <= 0.0)
+        discard;
+    gl_FragColor = vec4(starColor.rgb, starColor.a * falloff);
+}
+)";
+
+// Generates 'count' stars with a catalog-like magnitude, colour and sky distribution.
+// Positions are unit directions; the 2D path rescales them afterwards.
+inline std::vector<StarVertex> GenerateStars(int count, unsigned seed)
+{
+    std::vector<StarVertex> stars;
+    if (count <= 0)
+        return stars;
+    stars.reserve(count);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> colourIndex(0.65f, 0.35f);
+
+    // Star counts grow roughly as N(<m) ~ 10^(0.5 m). About 9000 stars are brighter than
+    // magnitude 6.5 on the real sky, so the faint limit moves out as more stars are asked for.
+    const float slope = 0.5f;
+    const float brightest = -1.5f;
+    const float faintest = 6.5f + std::log10(std::max(count, 1) / 9000.0f) / slope;
+    const float minFraction = std::pow(10.0f, slope * (brightest - faintest));
+
+    // Galactic plane tilted against the orbital plane of the demos
+    const float tilt = 1.1f;
+    const float sinTilt = std::sin(tilt), cosTilt = std::cos(tilt);
+
+    for (int i = 0; i < count; ++i)
+    {
+        // Inverse transform sampling of the magnitude distribution
+        float u = minFraction + (1.0f - minFraction) * uniform(rng);
+        float magnitude = faintest + std::log10(u) / slope;
+        float faintness = (magnitude - brightest) / (faintest - brightest); // 0 = brightest, 1 = faintest
+
+        // Uniform direction, then rejection towards the galactic plane (stronger for faint stars)
+        float gx, gy, gz;
+        while (true)
+        {
+            gz = 2.0f * uniform(rng) - 1.0f;
+            float phi = 2.0f * float(M_PI) * uniform(rng);
+            float ring = std::sqrt(std::max(0.0f, 1.0f - gz * gz));
+            gx = ring * std::cos(phi);
+            gy = ring * std::sin(phi);
+
+            float planeWeight = 0.6f * faintness;
+            float accept = (1.0f - planeWeight) + planeWeight * std::exp(-std::fabs(gz) / 0.15f);
+            if (uniform(rng) <= accept)
+                break;
+        }
+
+        StarVertex star;
+        star.x = gx;
+        star.y = gy * cosTilt - gz * sinTilt;
+        star.z = gy * sinTilt + gz * cosTilt;
+
+        // Brighter stars get bigger points, the faint majority stays at one pixel
+        float brightness = 1.0f - faintness;
+        star.size = 1.0f + 3.5f * brightness * brightness * brightness;
+
+        // B-V colour index: blue-white stars around -0.3, sun-like around 0.65, red around 1.6
+        float bv = std::min(std::max(colourIndex(rng), -0.3f), 1.8f);
+        float t = (bv + 0.3f) / 2.1f;
+        glm::vec3 colour;
+        if (t < 0.45f)
+            colour = glm::mix(glm::vec3(0.65f, 0.75f, 1.0f), glm::vec3(1.0f, 1.0f, 1.0f), t / 0.45f);
+        else
+            colour = glm::mix(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(1.0f, 0.65f, 0.4f), (t - 0.45f) / 0.55f);
+
+        // Apparent brightness through alpha, never fully invisible
+        float flux = std::pow(10.0f, -0.4f * (magnitude - (faintest - 4.0f)));
+        float alpha = std::min(std::max(flux, 0.2f), 1.0f);
+
+        star.r = (unsigned char)(colour.r * 255.0f);
+        star.g = (unsigned char)(colour.g * 255.0f);
+        star.b = (unsigned char)(colour.b * 255.0f);
+        star.a = (unsigned char)(alpha * 255.0f);
+        stars.push_back(star);
+    }
+
+    return stars;
+}
+
+// Compiles and links one starfield shader program
+inline unsigned int CreateStarfieldProgram(const char *vertexSource, const char *fragmentSource, bool legacy)
+{
+    int success;
+    char infoLog[512];
+
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(vertexShader);
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+        std::cerr << "Starfield vertex shader compilation failed:\n"
+                  << infoLog << std::endl;
+    }
+
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(fragmentShader);
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+        std::cerr << "Starfield fragment shader compilation failed:\n"
+                  << infoLog << std::endl;
+    }
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+
+    // GLSL 1.20 has no layout qualifiers, so pin the attribute slots before linking
+    if (legacy)
+    {
+        glBindAttribLocation(program, 0, "aPos");
+        glBindAttribLocation(program, 1, "aSize");
+        glBindAttribLocation(program, 2, "aColor");
+    }
+
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cerr << "Starfield shader program linking failed:\n"
+                  << infoLog << std::endl;
+    }
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    return program;
+}
+
+// Points the bound VBO at attribute slots 0 (position), 1 (size) and 2 (colour)
+inline void SetStarfieldAttributes()
+{
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(StarVertex), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(StarVertex), (void *)(4 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+}
+
+// Creates a starfield on the celestial sphere for the 3D renderers (needs a core profile context)
+inline Starfield CreateStarfield3D(int count, unsigned seed)
+{
+    Starfield field;
+    std::vector<StarVertex> stars = GenerateStars(count, seed);
+    field.count = (GLsizei)stars.size();
+    field.shader = CreateStarfieldProgram(starVertexShader3D, starFragmentShader3D, false);
+    field.viewRotationLoc = glGetUniformLocation(field.shader, "viewRotation");
+    field.projectionLoc = glGetUniformLocation(field.shader, "projection");
+
+    glGenVertexArrays(1, &field.vao);
+    glGenBuffers(1, &field.vbo);
+
+    glBindVertexArray(field.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, field.vbo);
+    glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(StarVertex), stars.data(), GL_STATIC_DRAW);
+    SetStarfieldAttributes();
+    glBindVertexArray(0);
+
+    std::cout << "Starfield: " << field.count << " stars ("
+              << (stars.size() * sizeof(StarVertex)) / 1024 << " KB in a static VBO)" << std::endl;
+    return field;
+}
+
+// Creates a flat starfield filling [-halfWidth, halfWidth] x [-halfHeight, halfHeight]
+// for the 2D renderer (fixed-function context, so no VAO is used)
+inline Starfield CreateStarfield2D(int count, unsigned seed, float halfWidth, float halfHeight)
+{
+    Starfield field;
+    field.legacy = true;
+
+    std::vector<StarVertex> stars = GenerateStars(count, seed);
+
+    // Spread the stars over the screen; keep the magnitude and colour from the catalog
+    std::mt19937 rng(seed ^ 0x9e3779b9u);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (auto &star : stars)
+    {
+        star.x = uniform(rng) * halfWidth;
+        star.y = uniform(rng) * halfHeight;
+        star.z = 0.0f;
+    }
+
+    field.count = (GLsizei)stars.size();
+    field.shader = CreateStarfieldProgram(starVertexShader2D, starFragmentShader2D, true);
+
+    glGenBuffers(1, &field.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, field.vbo);
+    glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(StarVertex), stars.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return field;
+}
+
+// Draws the whole 3D starfield in one call. Call it right after glClear so that
+// everything else is drawn on top; the stars never write depth.
+inline void DrawStarfield3D(const Starfield &field, const glm::mat4 &view, const glm::mat4 &projection)
+{
+    if (field.count == 0)
+        return;
+
+    // Drop the translation so the stars stay infinitely far away
+    glm::mat4 viewRotation = glm::mat4(glm::mat3(view));
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+
+    glUseProgram(field.shader);
+    glUniformMatrix4fv(field.viewRotationLoc, 1, GL_FALSE, glm::value_ptr(viewRotation));
+    glUniformMatrix4fv(field.projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+    glBindVertexArray(field.vao);
+    glDrawArrays(GL_POINTS, 0, field.count);
+    glBindVertexArray(0);
+
+    glDepthMask(GL_TRUE);
+}
+
+// Draws the whole 2D starfield in one call using the current glOrtho projection
+inline void DrawStarfield2D(const Starfield &field)
+{
+    if (field.count == 0)
+        return;
+
+    GLboolean blendWasEnabled = glIsEnabled(GL_BLEND);
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glEnable(GL_POINT_SPRITE); // gl_PointCoord needs point sprites on the legacy pipeline
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(field.shader);
+    glBindBuffer(GL_ARRAY_BUFFER, field.vbo);
+    SetStarfieldAttributes();
+
+    glDrawArrays(GL_POINTS, 0, field.count);
+
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(2);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+
+    glDisable(GL_POINT_SPRITE);
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    if (!blendWasEnabled)
+        glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
+
+// Frees the GPU resources of a starfield
+inline void DestroyStarfield(Starfield &field)
+{
+    if (field.vao)
+        glDeleteVertexArrays(1, &field.vao);
+    if (field.vbo)
+        glDeleteBuffers(1, &field.vbo);
+    if (field.shader)
+        glDeleteProgram(field.shader);
+    field = Starfield();
+}
@@ -0,0 +1,296 @@
+//
+//  Thread_Pool.h
+//  SpaceEngine
+//
+//  Small work-stealing thread pool for the headless tools.
+//
+//  parallelFor() cuts an index range into chunks and deals them out to one queue per
+//  worker. Each worker takes chunks from the back of its own queue and, once that is
+//  empty, steals from the front of the other queues, so uneven jobs (a simulation that
+//  blows up early, a crowded part of the belt) still keep every core busy. The calling
+//  thread works as worker 0, the pool only starts threadCount - 1 extra threads.
+//
+//  parallelFor() itself never allocates once the queues have grown to their working size:
+//  the body is passed by pointer instead of through std::function, and each queue is a
+//  plain vector whose capacity is kept between calls.
+//
+//  Worker k always starts on the k-th contiguous block of the range (firstChunkOf()), so
+//  memory first-touched that way stays local to it on NUMA machines (see Numa.h). Thieves
+//  try the workers of their own node first once setWorkerNodes() told the pool about them.
+//
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency())
+    {
+        threadCount = std::max(1u, threadCount);
+        queues.resize(threadCount);
+        for (auto &queue : queues)
+            queue.reset(new WorkerQueue());
+        setWorkerNodes(std::vector<int>(threadCount, 0));
+
+        for (unsigned i = 1; i < threadCount; ++i)
+            threads.emplace_back([this, i]
+                                 { workerLoop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Number of workers including the calling thread
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    // Index of the worker running the current job (0 for the calling thread)
+    static unsigned currentWorker() { return workerIndex(); }
+
+    // First of the contiguous chunks parallelFor() deals to 'worker' when the range has
+    // 'chunks' of them; the worker's block ends where the next one's begins
+    size_t firstChunkOf(unsigned worker, size_t chunks) const
+    {
+        size_t perWorker = (chunks + size() - 1) / size();
+        return std::min(chunks, worker * perWorker);
+    }
+
+    // NUMA node of every worker. Thieves look at the queues of their own node first.
+    void setWorkerNodes(const std::vector<int> &nodeOfWorker)
+    {
+        victims.assign(size(), std::vector<unsigned>());
+        for (unsigned self = 0; self < size(); ++self)
+        {
+            for (int remote = 0; remote < 2; ++remote)
+                for (unsigned k = 1; k < size(); ++k)
+                {
+                    unsigned other = (self + k) % size();
+                    if ((nodeOfWorker[other] != nodeOfWorker[self]) == (remote == 1))
+                        victims[self].push_back(other);
+                }
+        }
+    }
+
+    // Runs body(worker) once on every worker thread, e.g. to pin it or to first-touch the
+    // memory it will work on. Nothing is stolen: body(k) always runs on worker k.
+    template <typename Body>
+    void forEachWorker(const Body &body)
+    {
+        if (size() == 1)
+        {
+            body(0u);
+            return;
+        }
+        for (unsigned w = 0; w < size(); ++w)
+        {
+            WorkerQueue &queue = *queues[w];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.ranges.clear();
+            queue.head = 0;
+            queue.ranges.push_back({w, w + 1});
+        }
+        auto perWorker = [&](size_t w)
+        { body((unsigned)w); };
+        runJob(perWorker, size(), false);
+    }
+
+    // Runs body(i) for every i in [0, count) and returns when all of them are done.
+    // Indices are handed out in chunks of 'grain'.
+    template <typename Body>
+    void parallelFor(size_t count, const Body &body, size_t grain = 1)
+    {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(1, grain);
+
+        // Single worker or tiny range: no point waking anyone
+        if (size() == 1 || count <= grain)
+        {
+            for (size_t i = 0; i < count; ++i)
+                body(i);
+            return;
+        }
+
+        // Deal contiguous blocks of chunks to the workers so neighbours stay together
+        size_t chunks = (count + grain - 1) / grain;
+        for (auto &queue : queues)
+        {
+            std::lock_guard<std::mutex> lock(queue->lock);
+            queue->ranges.clear();
+            queue->head = 0;
+        }
+        for (size_t c = 0; c < chunks; ++c)
+        {
+            size_t begin = c * grain;
+            size_t end = std::min(count, begin + grain);
+            WorkerQueue &queue = *queues[workerOfChunk(c, chunks)];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.ranges.push_back({begin, end});
+        }
+        runJob(body, chunks, true);
+    }
+
+private:
+    struct Range
+    {
+        size_t begin, end;
+    };
+
+    // Owner pops from the back, thieves take ranges[head] and move head forward
+    struct WorkerQueue
+    {
+        std::mutex lock;
+        std::vector<Range> ranges;
+        size_t head = 0;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::vector<unsigned>> victims; // Per worker, the queues to steal from in order
+    std::vector<std::thread> threads;
+
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void (*job)(const void *, size_t) = nullptr; // Calls the current body, see InvokeBody
+    const void *jobBody = nullptr;
+    std::atomic<size_t> remainingChunks{0};
+    bool stealing = true; // Off for forEachWorker()
+    unsigned busyWorkers = 0;
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    unsigned workerOfChunk(size_t c, size_t chunks) const
+    {
+        size_t perWorker = (chunks + size() - 1) / size();
+        return (unsigned)std::min<size_t>(c / perWorker, size() - 1);
+    }
+
+    // Starts the workers on the ranges already dealt to the queues and helps as worker 0
+    template <typename Body>
+    void runJob(const Body &body, size_t chunks, bool allowStealing)
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            job = &InvokeBody<Body>;
+            jobBody = &body;
+            remainingChunks = chunks;
+            stealing = allowStealing;
+            busyWorkers = size() - 1;
+            generation++;
+        }
+        wake.notify_all();
+
+        // The caller helps out as worker 0
+        unsigned previous = workerIndex();
+        workerIndex() = 0;
+        runChunks(0);
+        workerIndex() = previous;
+
+        // Wait until every worker has left the job so 'body' can go out of scope
+        std::unique_lock<std::mutex> lock(stateMutex);
+        done.wait(lock, [this]
+                  { return busyWorkers == 0; });
+        job = nullptr;
+        jobBody = nullptr;
+    }
+
+    template <typename Body>
+    static void InvokeBody(const void *body, size_t i)
+    {
+        (*static_cast<const Body *>(body))(i);
+    }
+
+    static unsigned &workerIndex()
+    {
+        static thread_local unsigned index = 0;
+        return index;
+    }
+
+    // Pops from the back of our own queue
+    bool popOwn(unsigned self, Range &out)
+    {
+        WorkerQueue &queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.head == queue.ranges.size())
+            return false;
+        out = queue.ranges.back();
+        queue.ranges.pop_back();
+        return true;
+    }
+
+    // Steals from the front of somebody else's queue, own node first
+    bool steal(unsigned self, Range &out)
+    {
+        for (unsigned victim : victims[self])
+        {
+            WorkerQueue &queue = *queues[victim];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.head < queue.ranges.size())
+            {
+                out = queue.ranges[queue.head++];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Runs chunks until none are left anywhere
+    void runChunks(unsigned self)
+    {
+        Range range;
+        while (remainingChunks.load(std::memory_order_acquire) > 0)
+        {
+            if (!popOwn(self, range) && !(stealing && steal(self, range)))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = range.begin; i < range.end; ++i)
+                job(jobBody, i);
+            remainingChunks.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void workerLoop(unsigned self)
+    {
+        workerIndex() = self;
+        unsigned long long seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(stateMutex);
+                wake.wait(lock, [&]
+                          { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+
+            runChunks(self);
+
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                busyWorkers--;
+            }
+            done.notify_all();
+        }
+    }
+};
@@ -0,0 +1,180 @@
+//
+//  Time_Warp.h
+//  SpaceEngine
+//
+//  Time warp for the SCALED demo, from real time up to 1e8x.
+//
+//  The SCALED units are seconds, so at 1x Neptune needs 165 years for one orbit. Just
+//  multiplying dt by the warp breaks the orbits long before that: at 1e5x a 60 fps frame
+//  is already 20 minutes, at 1e8x it is 19 days, a fifth of Mercury's year. Instead the
+//  controller picks an integrator and a step size for every frame:
+//
+//    - Leapfrog        steps of at most 1/1000 of the shortest orbit, follows anything
+//    - Wisdom-Holman   steps of 1/20 of the shortest orbit, the Kepler part is exact so
+//                      only the planet-planet kicks limit the step
+//    - Kepler          one analytic step per frame, interactions dropped
+//
+//  and takes the first one (most general first) that needs at most a few steps per frame
+//  and whose steps fit into the physics budget of a frame. Near-Keplerian orbits are where
+//  Wisdom-Holman wins: at the same cost its steps can be 50 times longer than leapfrog's,
+//  so leapfrog is only kept while a frame is a handful of its steps. The cost per step of
+//  each regime is measured while it runs, so the switch points follow the machine and the
+//  body count rather than fixed warp thresholds. Going back to a more general regime needs
+//  some headroom, so the choice doesn't flicker at the boundary.
+//
+
+#pragma once
+
+#include "Headless_Simulation.h"
+#include "Integrators.h"
+#include "Simulator.h"
+
+#include <ostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+const double TIME_WARP_MIN = 1.0;
+const double TIME_WARP_MAX = 1e8;
+const double SECONDS_PER_YEAR = 365.25 * 86400.0;
+
+// One way of advancing the system, from most general to cheapest
+struct WarpRegime
+{
+    Integrator integrator;
+    double orbitFraction; // Largest step as a fraction of the shortest orbit, 0: one step per frame
+};
+
+const WarpRegime WARP_REGIMES[] = {{Integrator::Leapfrog, 1.0 / 1000.0},
+                                   {Integrator::WisdomHolman, 1.0 / 20.0},
+                                   {Integrator::Kepler, 0.0}};
+const int WARP_REGIME_COUNT = 3;
+
+struct TimeWarpSettings
+{
+    double targetFrameSeconds = 1.0 / 60.0; // Frame rate to hold
+    double physicsShare = 0.5;              // Part of the frame the physics may use
+    double switchBackShare = 0.7;           // Return to a more general regime below this part of the budget
+    int maxStepsPerFrame = 16;              // Beyond this the next regime is the better deal
+    double maxFrameSeconds = 0.1;           // Longer frames (window dragged, debugger) are cut to this
+    double smoothing = 0.1;                 // Weight of the newest frame in the running averages
+};
+
+class TimeWarpController
+{
+public:
+    explicit TimeWarpController(TimeWarpSettings s = TimeWarpSettings()) : settings(s) {}
+
+    double warp() const { return currentWarp; }
+    void setWarp(double warp) { currentWarp = std::min(std::max(warp, TIME_WARP_MIN), TIME_WARP_MAX); }
+    void faster() { setWarp(currentWarp * 10.0); }
+    void slower() { setWarp(currentWarp / 10.0); }
+
+    // What the last frame did
+    Integrator integrator() const { return WARP_REGIMES[regime].integrator; }
+    double stepSize() const { return lastStep; }
+    int steps() const { return lastSteps; }
+    double physicsSeconds() const { return lastPhysicsSeconds; }
+
+    // Smoothed simulated time per wall clock second, the warp actually reached
+    double simulatedYearsPerSecond() const { return yearsPerSecond; }
+
+    // Advances the simulation by frameSeconds * warp. Returns the simulated seconds.
+    double advance(Simulator &sim, double frameSeconds)
+    {
+        frameSeconds = std::min(std::max(frameSeconds, 0.0), settings.maxFrameSeconds);
+        const double span = frameSeconds * currentWarp;
+        if (span <= 0.0)
+            return 0.0;
+
+        const double period = ShortestOrbit(sim.world);
+        const double budget = settings.targetFrameSeconds * settings.physicsShare;
+        int chosen = WARP_REGIME_COUNT - 1;
+        for (int r = 0; r < WARP_REGIME_COUNT; ++r)
+        {
+            // The current regime keeps going up to the full budget, the ones before it
+            // have to fit with some room to spare
+            double allowed = r < regime ? budget * settings.switchBackShare : budget;
+            bool fits = stepsFor(r, span, period) <= settings.maxStepsPerFrame &&
+                        estimatedCost(r, span, period) <= allowed;
+            if (fits || r == WARP_REGIME_COUNT - 1)
+            {
+                chosen = r;
+                break;
+            }
+        }
+        regime = chosen;
+
+        lastSteps = stepsFor(regime, span, period);
+        lastStep = span / lastSteps;
+        sim.settings.integrator = WARP_REGIMES[regime].integrator;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < lastSteps; ++s)
+            sim.step(lastStep);
+        lastPhysicsSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double perStep = lastPhysicsSeconds / lastSteps;
+        if (costPerStep[regime] > 0.0)
+            costPerStep[regime] += settings.smoothing * (perStep - costPerStep[regime]);
+        else
+            costPerStep[regime] = perStep;
+        double rate = span / std::max(frameSeconds, lastPhysicsSeconds) / SECONDS_PER_YEAR;
+        yearsPerSecond = yearsPerSecond > 0.0 ? yearsPerSecond + settings.smoothing * (rate - yearsPerSecond) : rate;
+        return span;
+    }
+
+    void printReport(std::ostream &out) const
+    {
+        out << "Time warp: " << currentWarp << "x, " << IntegratorName(integrator()) << " with " << lastSteps
+            << (lastSteps == 1 ? " step" : " steps") << " of " << lastStep / 86400.0 << " days per frame, physics "
+            << lastPhysicsSeconds * 1000.0 << " ms, " << yearsPerSecond << " simulated years per second" << std::endl;
+    }
+
+private:
+    TimeWarpSettings settings;
+    double currentWarp = 1.0;
+    int regime = 0;
+    double costPerStep[WARP_REGIME_COUNT] = {}; // Measured seconds per step, 0 until a regime has run
+    double lastStep = 0.0;
+    int lastSteps = 0;
+    double lastPhysicsSeconds = 0.0;
+    double yearsPerSecond = 0.0;
+
+    static int stepsFor(int r, double span, double period)
+    {
+        double limit = WARP_REGIMES[r].orbitFraction * period;
+        if (limit <= 0.0)
+            return 1;
+        return (int)std::min(std::max(std::ceil(span / limit), 1.0), 1e9);
+    }
+
+    // Regimes that haven't run yet are guessed at the cost of the slowest one measured
+    double estimatedCost(int r, double span, double period) const
+    {
+        double perStep = costPerStep[r];
+        if (perStep <= 0.0)
+            perStep = *std::max_element(costPerStep, costPerStep + WARP_REGIME_COUNT);
+        return stepsFor(r, span, period) * perStep;
+    }
+
+    // Shortest two-body period of a moving body around the heaviest one. Unbound bodies
+    // don't count; without any bound body there is no limit.
+    static double ShortestOrbit(const World &w)
+    {
+        const int central = HeaviestBody(w);
+        double shortest = INFINITY;
+        for (size_t i = 0; central >= 0 && i < w.size(); ++i)
+        {
+            if ((int)i == central || w.fixed[i])
+                continue;
+            double dx = w.px[i] - w.px[central], dy = w.py[i] - w.py[central], dz = w.pz[i] - w.pz[central];
+            double ux = w.vx[i] - w.vx[central], uy = w.vy[i] - w.vy[central], uz = w.vz[i] - w.vz[central];
+            double mu = w.G * (w.mass[central] + w.mass[i]);
+            double alpha = 2.0 / std::sqrt(dx * dx + dy * dy + dz * dz) - (ux * ux + uy * uy + uz * uz) / mu;
+            if (alpha > 0.0)
+                shortest = std::min(shortest, 2.0 * M_PI / std::sqrt(mu * alpha * alpha * alpha));
+        }
+        return shortest;
+    }
+};
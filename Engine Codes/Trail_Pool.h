@@ -0,0 +1,457 @@
+//
+//  Trail_Pool.h
+//  SpaceEngine
+//
+//  Pooled orbit trails for the 3D demos.
+//
+//  Every Object3D used to own a std::vector<glm::vec3> of up to 1000 points (~12 KB),
+//  even asteroids nobody was looking at. Now a body only holds a small TrailHandle and the
+//  points live in fixed-size ring buffers carved out of large slabs:
+//
+//    - a trail is acquired on demand (when the body is on screen or selected),
+//    - trails that haven't been wanted for a while age out and return to the free list,
+//    - when the memory budget is used up the least recently wanted trail is recycled,
+//
+//  so trail memory stays under the budget whatever the body count.
+//
+//  Points pushed with a TrailTolerance go through the incremental Douglas-Peucker simplifier
+//  of Trail_Simplify.h first, so the ring holds vertices rather than raw samples. Every point
+//  is stamped with its sample number and a trail is always drawn over its last
+//  pointsPerTrail samples, simplified or not, so it looks as long as it always did.
+//
+//  TrailGpu keeps a copy of the slabs in vertex buffers with the same layout, positions and
+//  stamps. Only the points written since the last SyncTrailGpu() are uploaded, and the trail
+//  shader fades every point by its age (newest stamp - its stamp), so nothing has to be
+//  rewritten as a trail gets older:
+//
+//      TrailGpu gpu;                          // after the GL context exists
+//      SyncTrailGpu(gpu, pool);               // once per frame, before drawing
+//      DrawTrail(gpu, pool, handle);          // with currentTime = pool.newestStamp(handle)
+//      DestroyTrailGpu(gpu);
+//
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "Trail_Simplify.h"
+
+// Refers to one trail in a TrailPool. Goes stale (valid() == false) once the trail is recycled.
+struct TrailHandle
+{
+    int slot = -1;
+    uint32_t generation = 0;
+};
+
+class TrailPool
+{
+public:
+    // pointsPerTrail: ring buffer length, memoryBudget: upper bound for the point storage in bytes
+    TrailPool(int pointsPerTrail, size_t memoryBudget, int trailsPerSlab = 32)
+        : pointsPerTrail(pointsPerTrail), trailsPerSlab(trailsPerSlab)
+    {
+        size_t slabBytes = trailsPerSlab * trailBytes();
+        maxSlabs = std::max<size_t>(1, memoryBudget / slabBytes);
+    }
+
+    bool valid(TrailHandle h) const
+    {
+        return h.slot >= 0 && h.slot < (int)slots.size() &&
+               slots[h.slot].live && slots[h.slot].generation == h.generation;
+    }
+
+    // Hands out an empty trail. Grows by one slab if the budget allows, otherwise recycles the
+    // least recently used trail. Returns an invalid handle if every trail was used this frame.
+    TrailHandle acquire(long long frame)
+    {
+        if (freeSlots.empty() && slabs.size() < maxSlabs)
+            addSlab();
+
+        int slot = -1;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else if (frame == exhaustedFrame)
+            return TrailHandle(); // Nothing got older since the last scan found nothing
+        else
+        {
+            long long oldest = frame;
+            for (int s = 0; s < (int)slots.size(); ++s)
+            {
+                if (slots[s].live && slots[s].lastUsed < oldest)
+                {
+                    oldest = slots[s].lastUsed;
+                    slot = s;
+                }
+            }
+            if (slot < 0)
+            {
+                exhaustedFrame = frame;
+                return TrailHandle();
+            }
+            evictions++;
+            liveCount -= 1; // Counted again below
+        }
+
+        Slot &entry = slots[slot];
+        entry.live = true;
+        entry.generation++;
+        entry.head = 0;
+        entry.count = 0;
+        entry.lastUsed = frame;
+        entry.run = TrailRun();
+        entry.samples = 0;
+        entry.unsynced = 0;
+        liveCount += 1;
+        return {slot, entry.generation};
+    }
+
+    // Marks the trail as wanted this frame so it doesn't age out
+    void touch(TrailHandle h, long long frame)
+    {
+        if (valid(h))
+            slots[h.slot].lastUsed = frame;
+    }
+
+    // Appends a point, overwriting the oldest one once the ring is full
+    void push(TrailHandle h, const glm::vec3 &point)
+    {
+        if (!valid(h))
+            return;
+        Slot &entry = slots[h.slot];
+        append(h.slot, point, float(entry.samples++));
+        samplesAdded++;
+        verticesAdded++;
+    }
+
+    // Same, but only keeps the vertices needed to stay within 'tolerance' of the raw samples
+    void push(TrailHandle h, const glm::vec3 &point, const TrailTolerance &tolerance)
+    {
+        if (!valid(h))
+            return;
+        const int slot = h.slot;
+        const float stamp = float(slots[slot].samples++);
+        AddTrailSample(slots[slot].run, pending(slot), TrailVertex{point.x, point.y, point.z, stamp}, tolerance,
+                       [&](const TrailVertex &s)
+                       {
+                           append(slot, glm::vec3(s.x, s.y, s.z), s.t);
+                           verticesAdded++;
+                       },
+                       [&](const TrailVertex &s)
+                       {
+                           Slot &entry = slots[slot];
+                           int last = (entry.head + pointsPerTrail - 1) % pointsPerTrail;
+                           data(slot)[last] = glm::vec3(s.x, s.y, s.z);
+                           stamps(slot)[last] = s.t;
+                           entry.unsynced = std::max(entry.unsynced, 1);
+                       });
+        samplesAdded++;
+    }
+
+    void release(TrailHandle &h)
+    {
+        if (valid(h))
+            freeSlot(h.slot);
+        h = TrailHandle();
+    }
+
+    // Frees every trail not wanted in the last 'maxIdleFrames' frames. Returns how many were freed.
+    int ageOut(long long frame, long long maxIdleFrames)
+    {
+        int freed = 0;
+        for (int s = 0; s < (int)slots.size(); ++s)
+        {
+            if (slots[s].live && frame - slots[s].lastUsed > maxIdleFrames)
+            {
+                freeSlot(s);
+                freed++;
+            }
+        }
+        return freed;
+    }
+
+    // Frees every trail but keeps the slabs for reuse (simulation reset)
+    void releaseAll()
+    {
+        for (int s = 0; s < (int)slots.size(); ++s)
+            if (slots[s].live)
+                freeSlot(s);
+    }
+
+    // The trail from oldest to newest point is older[0 .. olderCount) followed by newer[0 .. newerCount).
+    // It starts at the newest vertex no later than the first of the last pointsPerTrail samples.
+    void segments(TrailHandle h, const glm::vec3 *&older, int &olderCount, const glm::vec3 *&newer, int &newerCount) const
+    {
+        older = newer = nullptr;
+        olderCount = newerCount = 0;
+        if (!valid(h))
+            return;
+
+        const Slot &entry = slots[h.slot];
+        const glm::vec3 *ring = data(h.slot);
+        const float *stamp = stamps(h.slot);
+        const int first = entry.count < pointsPerTrail ? 0 : entry.head;
+        const float since = float(entry.samples - pointsPerTrail);
+
+        // Stamps only grow along the trail, so the cut is a binary search
+        int low = 0, high = entry.count;
+        while (low < high)
+        {
+            int mid = (low + high) / 2;
+            if (stamp[(first + mid) % pointsPerTrail] < since)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        const int skip = std::max(0, low - 1);
+        const int start = (first + skip) % pointsPerTrail;
+        const int count = entry.count - skip;
+
+        older = ring + start;
+        olderCount = std::min(count, pointsPerTrail - start);
+        if (count > olderCount)
+        {
+            newer = ring;
+            newerCount = count - olderCount;
+        }
+    }
+
+    // Where a trail's ring is: trail 'index' of slab 'slab'. Oldest point first, it is
+    // ring[head .. pointsPerTrail) followed by ring[0 .. head) once full, ring[0 .. count) before.
+    bool ring(TrailHandle h, int &slab, int &index, int &head, int &count) const
+    {
+        if (!valid(h))
+            return false;
+        slab = h.slot / trailsPerSlab;
+        index = h.slot % trailsPerSlab;
+        head = slots[h.slot].head;
+        count = slots[h.slot].count;
+        return true;
+    }
+
+    // Calls write(slab, index, first, count, points, stamps) for every run of ring positions
+    // first .. first + count written since the last call (at most two per trail, the ring wraps)
+    template <typename Write>
+    void takeWrites(Write &&write)
+    {
+        for (int s = 0; s < (int)slots.size(); ++s)
+        {
+            Slot &entry = slots[s];
+            if (!entry.live || entry.unsynced == 0)
+                continue;
+            const int slab = s / trailsPerSlab, index = s % trailsPerSlab;
+            const int first = (entry.head - entry.unsynced + pointsPerTrail) % pointsPerTrail;
+            const int tail = std::min(entry.unsynced, pointsPerTrail - first);
+            write(slab, index, first, tail, data(s) + first, stamps(s) + first);
+            if (entry.unsynced > tail)
+                write(slab, index, 0, entry.unsynced - tail, data(s), stamps(s));
+            entry.unsynced = 0;
+        }
+    }
+
+    // Stamp of the trail's newest point (its sample clock), what the trail shader ages points against
+    float newestStamp(TrailHandle h) const { return valid(h) ? float(slots[h.slot].samples - 1) : 0.0f; }
+
+    int pointCount(TrailHandle h) const { return valid(h) ? slots[h.slot].count : 0; }
+    int trailLength() const { return pointsPerTrail; }
+    int slabTrails() const { return trailsPerSlab; }
+    int slabCount() const { return (int)slabs.size(); }
+    int liveTrails() const { return liveCount; }
+    int capacityTrails() const { return int(maxSlabs) * trailsPerSlab; }
+    size_t reservedBytes() const { return slabs.size() * trailsPerSlab * trailBytes(); }
+    size_t budgetBytes() const { return maxSlabs * trailsPerSlab * trailBytes(); }
+    size_t usedBytes() const { return size_t(liveCount) * trailBytes(); }
+
+    // Samples pushed per vertex stored, 1 without simplification
+    double simplification() const { return verticesAdded ? double(samplesAdded) / verticesAdded : 1.0; }
+
+    void printReport(std::ostream &out) const
+    {
+        out << "Trails: " << liveCount << " live / " << capacityTrails() << " max, "
+            << usedBytes() / 1024 << " KB used, " << reservedBytes() / 1024 << " KB reserved in "
+            << slabs.size() << " slabs, budget " << budgetBytes() / 1024 << " KB, "
+            << evictions << " recycled, " << samplesAdded << " samples -> " << verticesAdded << " vertices ("
+            << simplification() << "x fewer)" << std::endl;
+    }
+
+private:
+    struct Slot
+    {
+        int head = 0;  // Where the next point goes
+        int count = 0; // Points stored, up to pointsPerTrail
+        uint32_t generation = 0;
+        long long lastUsed = 0; // Frame the trail was last wanted
+        bool live = false;
+        long long samples = 0; // Samples pushed, the stamp of the next one
+        int unsynced = 0;      // Newest points not yet handed out by takeWrites()
+        TrailRun run;          // Simplifier state, its pending samples are in pendingSlabs
+    };
+
+    int pointsPerTrail;
+    int trailsPerSlab;
+    size_t maxSlabs;
+    std::vector<std::unique_ptr<glm::vec3[]>> slabs;
+    std::vector<std::unique_ptr<float[]>> stampSlabs;         // Sample number of every point, same layout
+    std::vector<std::unique_ptr<TrailVertex[]>> pendingSlabs; // TRAIL_SIMPLIFY_WINDOW per trail
+    std::vector<Slot> slots;
+    std::vector<int> freeSlots;
+    int liveCount = 0;
+    long long evictions = 0;
+    long long exhaustedFrame = -1; // Frame in which no trail was old enough to recycle
+    long long samplesAdded = 0;
+    long long verticesAdded = 0;
+
+    size_t slabPoints() const { return size_t(pointsPerTrail) * trailsPerSlab; }
+    size_t trailBytes() const
+    {
+        return size_t(pointsPerTrail) * (sizeof(glm::vec3) + sizeof(float)) + TRAIL_SIMPLIFY_WINDOW * sizeof(TrailVertex);
+    }
+
+    glm::vec3 *data(int slot) { return slabs[slot / trailsPerSlab].get() + size_t(slot % trailsPerSlab) * pointsPerTrail; }
+    const glm::vec3 *data(int slot) const { return slabs[slot / trailsPerSlab].get() + size_t(slot % trailsPerSlab) * pointsPerTrail; }
+    float *stamps(int slot) { return stampSlabs[slot / trailsPerSlab].get() + size_t(slot % trailsPerSlab) * pointsPerTrail; }
+    const float *stamps(int slot) const { return stampSlabs[slot / trailsPerSlab].get() + size_t(slot % trailsPerSlab) * pointsPerTrail; }
+    TrailVertex *pending(int slot) { return pendingSlabs[slot / trailsPerSlab].get() + size_t(slot % trailsPerSlab) * TRAIL_SIMPLIFY_WINDOW; }
+
+    void append(int slot, const glm::vec3 &point, float stamp)
+    {
+        Slot &entry = slots[slot];
+        data(slot)[entry.head] = point;
+        stamps(slot)[entry.head] = stamp;
+        entry.head = (entry.head + 1) % pointsPerTrail;
+        entry.count = std::min(entry.count + 1, pointsPerTrail);
+        entry.unsynced = std::min(entry.unsynced + 1, pointsPerTrail);
+    }
+
+    void addSlab()
+    {
+        int first = (int)slots.size();
+        slabs.emplace_back(new glm::vec3[slabPoints()]);
+        stampSlabs.emplace_back(new float[slabPoints()]);
+        pendingSlabs.emplace_back(new TrailVertex[size_t(TRAIL_SIMPLIFY_WINDOW) * trailsPerSlab]);
+        slots.resize(slots.size() + trailsPerSlab);
+        // Push in reverse so slots are handed out in increasing order
+        for (int s = first + trailsPerSlab - 1; s >= first; --s)
+            freeSlots.push_back(s);
+    }
+
+    void freeSlot(int slot)
+    {
+        slots[slot].live = false;
+        slots[slot].count = 0;
+        freeSlots.push_back(slot);
+        liveCount -= 1;
+    }
+};
+
+// True if 'point' is in front of the camera and roughly inside the viewport
+inline bool PointInView(const glm::mat4 &viewProjection, const glm::vec3 &point, float margin = 1.2f)
+{
+    glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+    if (clip.w <= 0.0f)
+        return false;
+    float limit = clip.w * margin;
+    return clip.x >= -limit && clip.x <= limit && clip.y >= -limit && clip.y <= limit;
+}
+
+// Pixel error bound of simplified trails for a camera at 'eye' (see Trail_Simplify.h)
+inline TrailTolerance TrailToleranceFor(const glm::vec3 &eye, float fovYRadians, int viewportHeight, float pixels)
+{
+    return MakeTrailTolerance(eye.x, eye.y, eye.z, fovYRadians, viewportHeight, pixels);
+}
+
+// Vertex buffers mirroring a TrailPool's slabs (see the top of this file). Every ring gets one
+// point more than in the pool: ring[0] is repeated after the end, so a full trail is drawn
+// as two line strips, ring[head .. pointsPerTrail] and ring[0 .. head), without a gap.
+struct TrailGpu
+{
+    std::vector<unsigned int> vaos;
+    std::vector<unsigned int> buffers;
+    int trailsPerSlab = 0;
+    int pointsPerRing = 0; // pointsPerTrail + 1
+    long long uploadedBytes = 0;
+};
+
+// Creates buffers for slabs the pool added since the last call and uploads the points written
+// since then. Attribute 0 is the position, attribute 1 the stamp.
+inline void SyncTrailGpu(TrailGpu &gpu, TrailPool &pool)
+{
+    gpu.trailsPerSlab = pool.slabTrails();
+    gpu.pointsPerRing = pool.trailLength() + 1;
+    const size_t slabPoints = size_t(gpu.trailsPerSlab) * gpu.pointsPerRing;
+    const size_t stampOffset = slabPoints * sizeof(glm::vec3);
+
+    while ((int)gpu.buffers.size() < pool.slabCount())
+    {
+        unsigned int vao, buffer;
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &buffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, slabPoints * (sizeof(glm::vec3) + sizeof(float)), nullptr, GL_DYNAMIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)stampOffset);
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        gpu.vaos.push_back(vao);
+        gpu.buffers.push_back(buffer);
+    }
+
+    auto upload = [&](int slab, size_t point, int count, const glm::vec3 *points, const float *stamps)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, gpu.buffers[slab]);
+        glBufferSubData(GL_ARRAY_BUFFER, point * sizeof(glm::vec3), count * sizeof(glm::vec3), points);
+        glBufferSubData(GL_ARRAY_BUFFER, stampOffset + point * sizeof(float), count * sizeof(float), stamps);
+        gpu.uploadedBytes += count * (sizeof(glm::vec3) + sizeof(float));
+    };
+    pool.takeWrites([&](int slab, int index, int first, int count, const glm::vec3 *points, const float *stamps)
+                    {
+        const size_t ringStart = size_t(index) * gpu.pointsPerRing;
+        upload(slab, ringStart + first, count, points, stamps);
+        if (first == 0)
+            upload(slab, ringStart + gpu.pointsPerRing - 1, 1, points, stamps); }); // The repeat after the end
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Draws a trail uploaded by SyncTrailGpu() as line strips. Returns the number of points.
+inline int DrawTrail(const TrailGpu &gpu, const TrailPool &pool, TrailHandle h)
+{
+    int slab, index, head, count;
+    if (!pool.ring(h, slab, index, head, count) || count < 2 || slab >= (int)gpu.vaos.size())
+        return 0;
+
+    const int ringStart = index * gpu.pointsPerRing;
+    glBindVertexArray(gpu.vaos[slab]);
+    if (count < pool.trailLength() || head == 0)
+        glDrawArrays(GL_LINE_STRIP, ringStart, count); // Oldest point first already
+    else
+    {
+        glDrawArrays(GL_LINE_STRIP, ringStart + head, gpu.pointsPerRing - head); // Up to the repeat of ring[0]
+        if (head > 1)
+            glDrawArrays(GL_LINE_STRIP, ringStart, head);
+    }
+    glBindVertexArray(0);
+    return count;
+}
+
+inline void DestroyTrailGpu(TrailGpu &gpu)
+{
+    if (!gpu.buffers.empty())
+    {
+        glDeleteVertexArrays((GLsizei)gpu.vaos.size(), gpu.vaos.data());
+        glDeleteBuffers((GLsizei)gpu.buffers.size(), gpu.buffers.data());
+    }
+    gpu.vaos.clear();
+    gpu.buffers.clear();
+}
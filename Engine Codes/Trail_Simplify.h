@@ -0,0 +1,192 @@
+//
+//  Trail_Simplify.h
+//  SpaceEngine
+//
+//  Incremental Douglas-Peucker simplification of orbit trails.
+//
+//  Trails are raw position samples, so the gentle stretches of an orbit store (and upload)
+//  many points that lie on a straight line as far as the screen can tell. Here every new
+//  sample joins a short pending run that starts at the last kept vertex:
+//
+//    - while every sample of the run stays within the error bound of the straight segment
+//      from the run's start to the newest sample, only that segment is drawn; the newest
+//      sample is the trail's open end and moves along with the body,
+//    - when a sample breaks the bound (or the run is full) the run is simplified with
+//      Douglas-Peucker, the vertices it keeps become final and a new run starts.
+//
+//  The bound is in pixels: a dropped sample may be at most 'pixels' away from the drawn line
+//  as seen from the camera at the time it was added, so distant trails thin out further
+//  than close ones and fast, tightly curving bodies keep more vertices than slow ones.
+//
+//  No GL here, the trail storage is the caller's (TrailPool in Trail_Pool.h, or plain
+//  vectors in Trail_Simplify_Check.cpp).
+//
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+// Longest pending run; also bounds the work per sample
+const int TRAIL_SIMPLIFY_WINDOW = 32;
+
+// A trail point and its stamp (sample number or time, whatever the caller orders trails by)
+struct TrailVertex
+{
+    float x, y, z;
+    float t;
+};
+
+// The screen-space error bound as a world-space one, depending on the distance to the eye
+struct TrailTolerance
+{
+    float eyeX = 0.0f, eyeY = 0.0f, eyeZ = 0.0f;
+    float worldPerPixel = 0.0f; // Size of a pixel at distance 1: 2 tan(fovY / 2) / viewport height
+    float pixels = 0.0f;        // 0 keeps every sample
+
+    // Squared world-space bound at 'p'
+    float boundSquared(const TrailVertex &p) const
+    {
+        float dx = p.x - eyeX, dy = p.y - eyeY, dz = p.z - eyeZ;
+        float scale = pixels * worldPerPixel;
+        return scale * scale * (dx * dx + dy * dy + dz * dz);
+    }
+};
+
+inline TrailTolerance MakeTrailTolerance(float eyeX, float eyeY, float eyeZ, float fovYRadians, int viewportHeight, float pixels)
+{
+    TrailTolerance tolerance;
+    tolerance.eyeX = eyeX;
+    tolerance.eyeY = eyeY;
+    tolerance.eyeZ = eyeZ;
+    tolerance.worldPerPixel = 2.0f * std::tan(fovYRadians * 0.5f) / float(std::max(1, viewportHeight));
+    tolerance.pixels = pixels;
+    return tolerance;
+}
+
+// Squared distance from 'p' to the segment a-b
+inline float SegmentDistanceSquared(const TrailVertex &a, const TrailVertex &b, const TrailVertex &p)
+{
+    float abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+    float apx = p.x - a.x, apy = p.y - a.y, apz = p.z - a.z;
+    float length2 = abx * abx + aby * aby + abz * abz;
+    float s = length2 > 0.0f ? std::min(1.0f, std::max(0.0f, (apx * abx + apy * aby + apz * abz) / length2)) : 0.0f;
+    float dx = apx - s * abx, dy = apy - s * aby, dz = apz - s * abz;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Index of the sample in (first, last) furthest outside the bound of the segment first-last,
+// relative to its own bound; -1 if all of them are inside
+inline int WorstTrailSample(const TrailVertex *run, int first, int last, const TrailTolerance &tolerance)
+{
+    int worst = -1;
+    float worstRatio = 1.0f;
+    for (int i = first + 1; i < last; ++i)
+    {
+        float bound = tolerance.boundSquared(run[i]);
+        float distance = SegmentDistanceSquared(run[first], run[last], run[i]);
+        if (distance > bound * worstRatio)
+        {
+            worstRatio = bound > 0.0f ? distance / bound : 1e30f;
+            worst = i;
+        }
+    }
+    return worst;
+}
+
+// Douglas-Peucker over run[0 .. count). Writes the kept indices in increasing order to 'kept'
+// (always 0 and count - 1 among them) and returns how many there are.
+inline int SimplifyTrailRun(const TrailVertex *run, int count, const TrailTolerance &tolerance, int *kept)
+{
+    if (count <= 2)
+    {
+        for (int i = 0; i < count; ++i)
+            kept[i] = i;
+        return count;
+    }
+
+    bool keep[TRAIL_SIMPLIFY_WINDOW] = {};
+    int stack[2 * TRAIL_SIMPLIFY_WINDOW];
+    int top = 0;
+    keep[0] = keep[count - 1] = true;
+    stack[top++] = 0;
+    stack[top++] = count - 1;
+    while (top > 0)
+    {
+        int last = stack[--top];
+        int first = stack[--top];
+        int split = WorstTrailSample(run, first, last, tolerance);
+        if (split < 0)
+            continue;
+        keep[split] = true;
+        stack[top++] = first;
+        stack[top++] = split;
+        stack[top++] = split;
+        stack[top++] = last;
+    }
+
+    int n = 0;
+    for (int i = 0; i < count; ++i)
+        if (keep[i])
+            kept[n++] = i;
+    return n;
+}
+
+// Simplifier state of one trail. The pending samples live in the caller's storage, room for
+// TRAIL_SIMPLIFY_WINDOW of them.
+struct TrailRun
+{
+    int pending = 0;       // Samples in the run, the first one is the last final vertex
+    bool openEnd = false;  // The trail's newest vertex is the run's provisional end
+};
+
+// Adds sample 'p' to a trail. The trail changes through append(sample), which adds a vertex
+// at the new end, and replaceLast(sample), which moves the newest vertex.
+template <typename Append, typename ReplaceLast>
+void AddTrailSample(TrailRun &run, TrailVertex *pending, const TrailVertex &p, const TrailTolerance &tolerance,
+                    Append &&append, ReplaceLast &&replaceLast)
+{
+    auto setEnd = [&](const TrailVertex &s)
+    {
+        if (run.openEnd)
+            replaceLast(s);
+        else
+            append(s);
+    };
+
+    if (run.pending == 0 || tolerance.pixels <= 0.0f)
+    {
+        append(p);
+        pending[0] = p;
+        run.pending = 1;
+        run.openEnd = false;
+        return;
+    }
+
+    pending[run.pending++] = p;
+    const int count = run.pending;
+    if (WorstTrailSample(pending, 0, count - 1, tolerance) < 0)
+    {
+        if (count < TRAIL_SIMPLIFY_WINDOW)
+        {
+            // Still one straight segment, just move its end
+            setEnd(p);
+            run.openEnd = true;
+            return;
+        }
+        setEnd(p); // Full: the segment becomes final as it is
+    }
+    else
+    {
+        // The run broke, keep what Douglas-Peucker keeps of it
+        int kept[TRAIL_SIMPLIFY_WINDOW];
+        int n = SimplifyTrailRun(pending, count, tolerance, kept);
+        setEnd(pending[kept[1]]);
+        for (int k = 2; k < n; ++k)
+            append(pending[kept[k]]);
+    }
+
+    pending[0] = p;
+    run.pending = 1;
+    run.openEnd = false;
+}
@@ -0,0 +1,420 @@
+//
+//  Trail_Simplify_Check.cpp
+//  SpaceEngine
+//
+//  Renders the trails of a headless run twice, from the raw samples and from the output of
+//  the incremental simplifier (Trail_Simplify.h), and compares the images. Reports how many
+//  vertices the simplifier saves and how many pixels change.
+//
+//  Trails are sampled every few steps like in the demos and drawn the way the demos draw them:
+//  1 pixel line strips over the last --length samples, blended with alpha 0.4, from a few
+//  fixed cameras. Single pixels change wherever a line moves by a fraction of a pixel (and
+//  where a trail's loops now cross a pixel apart instead of on top of each other, blending
+//  differently), so those are only counted. A pixel is visibly changed if a line appeared,
+//  vanished or moved further: it is a trail pixel in one image with no trail pixel within
+//  one pixel of it in the other.
+//
+//  Passes if under 0.1% of the trail pixels are visibly changed in every view and all views
+//  together need at least 5x fewer vertices. The close "belt" view stays under that on its
+//  own (4.6x by default): asteroids scattered onto tight inner orbits get only ~40 samples
+//  per orbit, and a bound loose enough to thin those further visibly moves lines elsewhere.
+//
+//      ./Trail_Simplify_Check
+//      ./Trail_Simplify_Check --pixels 0.5 --asteroids 500 --scenario slow
+//      ./Trail_Simplify_Check --steps 4500 --every 3 --length 1000 --size 1280x720    (the defaults)
+//      ./Trail_Simplify_Check --every 1 --length 3000   Same trails sampled every step
+//
+//  How many vertices can go depends on how finely the trails are sampled compared to how
+//  tightly they curve on screen: a circle needs about pi * sqrt(r / 2e) vertices for error e,
+//  so the Fast demo's inner planet (128 samples per orbit) can't lose much more than 4/5 of them.
+//      ./Trail_Simplify_Check --ppm trails          Also writes trails_<view>_raw.ppm, _simplified.ppm, _diff.ppm
+//
+//  Build: clang++ -std=c++17 -O3 -fno-math-errno -fno-trapping-math -pthread -I"Engine Codes" "Engine Codes/Trail_Simplify_Check.cpp" -o trail_simplify_check
+//
+
+#include "Headless_Simulation.h"
+#include "Simulator.h"
+#include "Trail_Simplify.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+const float TRAIL_ALPHA = 0.4f;
+const float FOV_Y = 45.0f * float(M_PI) / 180.0f;
+const int CHANGE_THRESHOLD = 2;          // Channel difference (of 255) of a changed pixel
+const double MAX_VISIBLE_SHARE = 0.001; // Of the trail pixels, in every view
+const double MIN_REDUCTION = 5.0;       // Raw vertices per simplified one, over all views
+
+struct Camera
+{
+    std::string name;
+    float eye[3];
+    float target[3];
+};
+
+// RGB float image, cleared to the demos' background
+struct Image
+{
+    int width, height;
+    std::vector<float> rgb;
+
+    Image(int w, int h) : width(w), height(h), rgb(size_t(w) * h * 3)
+    {
+        for (size_t i = 0; i < rgb.size(); i += 3)
+        {
+            rgb[i] = 0.02f;
+            rgb[i + 1] = 0.02f;
+            rgb[i + 2] = 0.05f;
+        }
+    }
+
+    int channel(int x, int y, int c) const { return int(std::lround(std::min(1.0f, rgb[(size_t(y) * width + x) * 3 + c]) * 255.0f)); }
+
+    void blend(int x, int y, const float color[3])
+    {
+        if (x < 0 || y < 0 || x >= width || y >= height)
+            return;
+        float *p = &rgb[(size_t(y) * width + x) * 3];
+        for (int c = 0; c < 3; ++c)
+            p[c] = TRAIL_ALPHA * color[c] + (1.0f - TRAIL_ALPHA) * p[c];
+    }
+
+    bool writePpm(const std::string &path) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "P6\n"
+            << width << " " << height << "\n255\n";
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                for (int c = 0; c < 3; ++c)
+                    out.put(char(channel(x, y, c)));
+        return bool(out);
+    }
+};
+
+// Perspective projection like glm::lookAt + glm::perspective
+struct Projection
+{
+    float right[3], up[3], forward[3], eye[3];
+    float scaleX, scaleY;
+    int width, height;
+
+    Projection(const Camera &camera, int w, int h) : width(w), height(h)
+    {
+        auto normalize = [](float *v)
+        {
+            float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            for (int k = 0; k < 3; ++k)
+                v[k] /= length;
+        };
+        for (int k = 0; k < 3; ++k)
+        {
+            eye[k] = camera.eye[k];
+            forward[k] = camera.target[k] - camera.eye[k];
+        }
+        normalize(forward);
+        const float worldUp[3] = {0.0f, 1.0f, 0.0f};
+        right[0] = forward[1] * worldUp[2] - forward[2] * worldUp[1];
+        right[1] = forward[2] * worldUp[0] - forward[0] * worldUp[2];
+        right[2] = forward[0] * worldUp[1] - forward[1] * worldUp[0];
+        normalize(right);
+        up[0] = right[1] * forward[2] - right[2] * forward[1];
+        up[1] = right[2] * forward[0] - right[0] * forward[2];
+        up[2] = right[0] * forward[1] - right[1] * forward[0];
+        float tanHalf = std::tan(FOV_Y * 0.5f);
+        scaleY = 1.0f / tanHalf;
+        scaleX = scaleY * float(h) / float(w);
+    }
+
+    // Window coordinates of 'p'; false if it is behind the near plane
+    bool project(const TrailVertex &p, float &x, float &y) const
+    {
+        float d[3] = {p.x - eye[0], p.y - eye[1], p.z - eye[2]};
+        float depth = d[0] * forward[0] + d[1] * forward[1] + d[2] * forward[2];
+        if (depth < 0.1f)
+            return false;
+        float cx = (d[0] * right[0] + d[1] * right[1] + d[2] * right[2]) * scaleX / depth;
+        float cy = (d[0] * up[0] + d[1] * up[1] + d[2] * up[2]) * scaleY / depth;
+        x = (cx + 1.0f) * 0.5f * width;
+        y = (1.0f - cy) * 0.5f * height;
+        return true;
+    }
+};
+
+// GL_LINE_STRIP of 1 pixel lines: one fragment per pixel centre the line crosses along its
+// major axis, shared ends only once (close to GL's diamond exit rule, so runs of sub-pixel
+// segments don't blend the same pixel again and again). Nothing older than stamp 'cut' is
+// drawn, like the trail shader discards faded out fragments.
+void DrawStrip(Image &image, const Projection &projection, const TrailVertex *points, int count, const float color[3], float cut)
+{
+    for (int i = 0; i + 1 < count; ++i)
+    {
+        TrailVertex a = points[i];
+        const TrailVertex &b = points[i + 1];
+        if (b.t <= cut)
+            continue;
+        if (a.t < cut)
+        {
+            float f = (cut - a.t) / (b.t - a.t);
+            a = {a.x + f * (b.x - a.x), a.y + f * (b.y - a.y), a.z + f * (b.z - a.z), cut};
+        }
+        float x0, y0, x1, y1;
+        if (!projection.project(a, x0, y0) || !projection.project(b, x1, y1))
+            continue;
+        const bool xMajor = std::fabs(x1 - x0) >= std::fabs(y1 - y0);
+        const float a0 = xMajor ? x0 : y0, a1 = xMajor ? x1 : y1; // Along the major axis
+        const float b0 = xMajor ? y0 : x0, b1 = xMajor ? y1 : x1;
+        if (a0 == a1 || std::fabs(a1 - a0) > 4.0f * (image.width + image.height))
+            continue; // No pixel centre crossed, or way off screen
+        const float slope = (b1 - b0) / (a1 - a0);
+
+        // Centres c + 0.5 in [a0, a1) going up, (a1, a0] going down
+        int first, last, direction;
+        if (a1 > a0)
+            first = int(std::ceil(a0 - 0.5f)), last = int(std::ceil(a1 - 0.5f)) - 1, direction = 1;
+        else
+            first = int(std::floor(a0 - 0.5f)), last = int(std::floor(a1 - 0.5f)) + 1, direction = -1;
+        for (int c = first; (last - c) * direction >= 0; c += direction)
+        {
+            int minor = int(std::floor(b0 + (c + 0.5f - a0) * slope));
+            if (xMajor)
+                image.blend(c, minor, color);
+            else
+                image.blend(minor, c, color);
+        }
+    }
+}
+
+// A trail as the pool draws it: from the newest vertex no later than the first wanted sample on
+int DrawnStart(const std::vector<TrailVertex> &trail, float since)
+{
+    auto first = std::lower_bound(trail.begin(), trail.end(), since, [](const TrailVertex &s, float t)
+                                  { return s.t < t; });
+    return std::max(0, int(first - trail.begin()) - 1);
+}
+
+bool Lit(const Image &image, int x, int y)
+{
+    static const Image background(1, 1);
+    for (int c = 0; c < 3; ++c)
+        if (std::abs(image.channel(x, y, c) - background.channel(0, 0, c)) > CHANGE_THRESHOLD)
+            return true;
+    return false;
+}
+
+// Trail pixels of 'a' with no trail pixel within one pixel in 'b', marked in 'mask'
+long long VisiblyChanged(const Image &a, const Image &b, std::vector<bool> &mask)
+{
+    long long count = 0;
+    for (int y = 0; y < a.height; ++y)
+    {
+        for (int x = 0; x < a.width; ++x)
+        {
+            bool matched = !Lit(a, x, y);
+            for (int oy = -1; oy <= 1 && !matched; ++oy)
+            {
+                for (int ox = -1; ox <= 1 && !matched; ++ox)
+                {
+                    int bx = x + ox, by = y + oy;
+                    matched = bx >= 0 && by >= 0 && bx < b.width && by < b.height && Lit(b, bx, by);
+                }
+            }
+            if (!matched)
+            {
+                mask[size_t(y) * a.width + x] = true;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    std::string scenarioName = "fast";
+    uint64_t seed = 42;
+    long long steps = 4500;
+    int asteroids = 200;
+    int every = 3;
+    int length = 1000;
+    int width = 1280, height = 720;
+    float pixels = 1.5f; // TRAIL_PIXEL_ERROR of the Fast demo
+    std::string ppm;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--scenario" && hasValue)
+            scenarioName = argv[++i];
+        else if (arg == "--seed" && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--steps" && hasValue)
+            steps = std::atoll(argv[++i]);
+        else if (arg == "--asteroids" && hasValue)
+            asteroids = std::atoi(argv[++i]);
+        else if (arg == "--every" && hasValue)
+            every = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--length" && hasValue)
+            length = std::max(2, std::atoi(argv[++i]));
+        else if (arg == "--pixels" && hasValue)
+            pixels = std::atof(argv[++i]);
+        else if (arg == "--size" && hasValue && std::sscanf(argv[i + 1], "%dx%d", &width, &height) == 2)
+            ++i;
+        else if (arg == "--ppm" && hasValue)
+            ppm = argv[++i];
+        else
+        {
+            std::cerr << "Unknown argument '" << arg << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    Scenario scenario;
+    if (!ScenarioByName(scenarioName, scenario))
+    {
+        std::cerr << "Unknown scenario '" << scenarioName << "' (use fast or slow)" << std::endl;
+        return 1;
+    }
+    scenario.asteroidCount = asteroids;
+    Simulator sim(CreateWorld(scenario, seed), SimulationSettings());
+    const size_t bodies = sim.world.size();
+
+    // Raw samples by body ID (bodies never move slots without Morton ordering, but be safe)
+    std::vector<std::vector<TrailVertex>> raw(bodies);
+    std::vector<float> colors(bodies * 3);
+    std::vector<bool> moving(bodies);
+    for (size_t i = 0; i < bodies; ++i)
+    {
+        uint32_t id = sim.world.id[i];
+        colors[id * 3] = sim.world.cr[i];
+        colors[id * 3 + 1] = sim.world.cg[i];
+        colors[id * 3 + 2] = sim.world.cb[i];
+        moving[id] = !sim.world.fixed[i];
+    }
+    long long samples = 0;
+    for (long long step = 1; step <= steps; ++step)
+    {
+        sim.step(scenario.maxTimestep);
+        if (step % every != 0)
+            continue;
+        for (size_t i = 0; i < bodies; ++i)
+            raw[sim.world.id[i]].push_back({float(sim.world.px[i]), float(sim.world.py[i]), float(sim.world.pz[i]), float(samples)});
+        samples++;
+    }
+    const float since = float(samples - length);
+    const float cut = since - 1.0f; // Where the shader's fade reaches 0
+
+    std::cout << "=== Trail simplification ===" << std::endl;
+    std::cout << "Scenario " << scenario.name << ", " << bodies << " bodies, " << samples << " samples per trail, drawn over the last "
+              << length << ", error bound " << pixels << " px, " << width << "x" << height << std::endl;
+
+    const Camera cameras[] = {
+        {"overview", {0.0f, 22.0f, 30.0f}, {0.0f, 0.0f, 0.0f}},
+        {"belt", {14.0f, 2.0f, 9.0f}, {0.0f, 0.0f, 0.0f}},
+        {"edge-on", {0.0f, 1.0f, 34.0f}, {0.0f, 0.0f, 0.0f}},
+    };
+
+    bool pass = true;
+    long long totalRaw = 0, totalSimplified = 0;
+    for (const Camera &camera : cameras)
+    {
+        const Projection projection(camera, width, height);
+        const TrailTolerance tolerance = MakeTrailTolerance(camera.eye[0], camera.eye[1], camera.eye[2], FOV_Y, height, pixels);
+
+        Image rawImage(width, height), simplifiedImage(width, height);
+        long long rawVertices = 0, simplifiedVertices = 0;
+        std::vector<TrailVertex> simplified;
+        TrailVertex pending[TRAIL_SIMPLIFY_WINDOW];
+        for (size_t id = 0; id < bodies; ++id)
+        {
+            if (!moving[id])
+                continue;
+
+            // Feed the samples in order, as they would have arrived
+            simplified.clear();
+            TrailRun run;
+            for (const TrailVertex &s : raw[id])
+                AddTrailSample(run, pending, s, tolerance, [&](const TrailVertex &v)
+                               { simplified.push_back(v); }, [&](const TrailVertex &v)
+                               { simplified.back() = v; });
+
+            int rawStart = DrawnStart(raw[id], since);
+            int simplifiedStart = DrawnStart(simplified, since);
+            rawVertices += (long long)raw[id].size() - rawStart;
+            simplifiedVertices += (long long)simplified.size() - simplifiedStart;
+            DrawStrip(rawImage, projection, raw[id].data() + rawStart, int(raw[id].size()) - rawStart, &colors[id * 3], cut);
+            DrawStrip(simplifiedImage, projection, simplified.data() + simplifiedStart, int(simplified.size()) - simplifiedStart,
+                      &colors[id * 3], cut);
+        }
+
+        long long changed = 0, trailPixels = 0;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                int difference = 0;
+                for (int c = 0; c < 3; ++c)
+                    difference = std::max(difference, std::abs(rawImage.channel(x, y, c) - simplifiedImage.channel(x, y, c)));
+                changed += difference > CHANGE_THRESHOLD ? 1 : 0;
+                trailPixels += Lit(rawImage, x, y) ? 1 : 0;
+            }
+        }
+        std::vector<bool> visibleMask(size_t(width) * height);
+        long long visible = VisiblyChanged(rawImage, simplifiedImage, visibleMask) +
+                            VisiblyChanged(simplifiedImage, rawImage, visibleMask);
+
+        double reduction = simplifiedVertices ? double(rawVertices) / simplifiedVertices : 0.0;
+        double visibleShare = trailPixels ? double(visible) / trailPixels : 0.0;
+        bool ok = visibleShare < MAX_VISIBLE_SHARE;
+        pass = pass && ok;
+        totalRaw += rawVertices;
+        totalSimplified += simplifiedVertices;
+        std::cout << std::left << std::setw(9) << camera.name << std::right
+                  << "  vertices " << rawVertices << " -> " << simplifiedVertices << " (" << std::fixed
+                  << std::setprecision(1) << reduction << "x fewer, " << rawVertices * 12 / 1024 << " -> "
+                  << simplifiedVertices * 12 / 1024 << " KiB)  trail pixels " << trailPixels << ", changed "
+                  << changed << ", visibly " << visible << " (" << std::setprecision(3)
+                  << visibleShare * 100.0 << "%)  " << (ok ? "PASS" : "FAIL") << std::defaultfloat << std::endl;
+
+        if (!ppm.empty())
+        {
+            // Changed pixels grey, visibly changed ones red
+            Image diff(width, height);
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    float *p = &diff.rgb[(size_t(y) * width + x) * 3];
+                    int difference = 0;
+                    for (int c = 0; c < 3; ++c)
+                        difference = std::max(difference, std::abs(rawImage.channel(x, y, c) - simplifiedImage.channel(x, y, c)));
+                    p[0] = p[1] = p[2] = difference > CHANGE_THRESHOLD ? 0.35f : 0.0f;
+                    if (visibleMask[size_t(y) * width + x])
+                        p[0] = 1.0f, p[1] = p[2] = 0.0f;
+                }
+            }
+            std::string prefix = ppm + "_" + camera.name;
+            if (!rawImage.writePpm(prefix + "_raw.ppm") || !simplifiedImage.writePpm(prefix + "_simplified.ppm") ||
+                !diff.writePpm(prefix + "_diff.ppm"))
+                std::cerr << "Could not write " << prefix << "_*.ppm" << std::endl;
+        }
+    }
+
+    const double reduction = totalSimplified ? double(totalRaw) / totalSimplified : 0.0;
+    const bool reduced = reduction >= MIN_REDUCTION;
+    pass = pass && reduced;
+    std::cout << "All views: " << std::fixed << std::setprecision(1) << reduction << "x fewer vertices  "
+              << (reduced ? "PASS" : "FAIL") << std::defaultfloat << std::endl;
+    std::cout << (pass ? "PASS" : "FAIL") << ": under " << MAX_VISIBLE_SHARE * 100.0
+              << "% of the trail pixels visibly changed in every view, at least " << MIN_REDUCTION
+              << "x fewer vertices over all views" << std::endl;
+    return pass ? 0 : 1;
+}